@@ -3,6 +3,7 @@
 
 #include <any/rt_types.h>
 #include <any/stack.h>
+#include <any/mbox.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -12,16 +13,47 @@ extern "C" {
     assert(idx == 0 || \
         ((idx >= a->frame->bp - a->frame->nargs) && (idx < a->stack.sp)))
 
-/// Initialize as a new actor.
+/// Initialize as a new actor, `opts` may be NULL to use default sizes.
 ANY_API aerror_t
 aactor_init(
-    aactor_t* self, ascheduler_t* owner, aalloc_t alloc, void* alloc_ud);
+    aactor_t* self, ascheduler_t* owner, const aactor_opts_t* opts,
+    aalloc_t alloc, void* alloc_ud);
 
-/// Release all internal allocated memory.
+/** Release all internal allocated memory.
+\brief Buffers of the default sizes are kept in the pool of its owner.
+*/
 ANY_API void
 aactor_cleanup(
     aactor_t* self);
 
+/** Run stackless actor `a` on the calling native stack.
+\brief
+The entry point must be a byte code function. This returns when the actor
+exits, or blocks and is unwound by \ref aactor_suspend. All its state is in the
+VM frames, so the next call continues at `frame->ip` by entering the dispatcher
+again.
+*/
+ANY_API void
+aactor_resume(
+    aactor_t* a);
+
+/// Release all buffers kept by `self`.
+ANY_API void
+aactor_pool_cleanup(
+    aactor_pool_t* self, aalloc_t alloc, void* alloc_ud);
+
+/** Returns TRUE if stackless actor `a` can be suspended.
+\brief That is only when no native function is on the call stack.
+*/
+ANY_API int32_t
+aactor_suspendable(
+    aactor_t* a);
+
+/// Unwind stackless actor `a` back to \ref aactor_resume.
+ANY_API void
+aactor_suspend(
+    aactor_t* a);
+
 /// Throw an error, with description string pushed onto the stack.
 ANY_API void
 any_error(
@@ -37,6 +69,29 @@ ANY_API aerror_t
 aactor_heap_reserve(
     aactor_t* self, aint_t more, aint_t n);
 
+/** Override the number of reductions per slice of this actor.
+\brief `reductions` = 0 falls back to \ref ascheduler_set_reductions.
+*/
+static inline void
+aactor_set_reductions(
+    aactor_t* self, aint_t reductions)
+{
+    self->reductions = reductions;
+}
+
+/** Change the priority of this actor to one of \ref aprio_t.
+\brief
+That takes effect when it is queued next time, so only the actor itself or its
+spawner before starting it may call this.
+*/
+static inline void
+aactor_set_priority(
+    aactor_t* self, aint_t priority)
+{
+    assert(priority >= APRIO_LOW && priority <= APRIO_MAX);
+    self->priority = priority;
+}
+
 /// Push a value onto the stack, should be internal used.
 static inline void
 aactor_push(
@@ -96,6 +151,20 @@ ANY_API void
 any_mbox_send(
     aactor_t* a);
 
+/** Send a request and wait for the reply in `timeout`.
+\brief
+Pops the message on top and the pid below it like \ref any_mbox_send, then
+pushes the first message from that pid received after sending, which is
+removed from the message box, or nil if timed out. Messages queued before or
+sent by others and the receive in progress are left untouched. If the receiver
+is waiting for a message, this switches to it directly instead of going through
+the run queues, and its reply switches back the same way. Actors of
+\ref asmp_t are always queued.
+*/
+ANY_API aerror_t
+any_mbox_call(
+    aactor_t* a, aint_t timeout);
+
 /** Pickup next message.
 \brief Please refer \ref AOC_RCV.
 */
@@ -117,6 +186,13 @@ ANY_API void
 any_mbox_rewind(
     aactor_t* a);
 
+/** Set the receive marker.
+\brief Please refer \ref AOC_MRK.
+*/
+ANY_API void
+any_mbox_mark(
+    aactor_t* a);
+
 /// Suspends the execution flow.
 ANY_API void
 any_yield(
@@ -366,12 +442,20 @@ any_top(
 }
 
 /** Spawn a new actor.
-\brief This function follow the same protocol as \ref any_call.
+\brief
+This function follow the same protocol as \ref any_call, `cstack_sz` = 0
+spawns a stackless actor, see \ref ascheduler_new_actor.
 */
 ANY_API void
 any_spawn(
     aactor_t* a, aint_t cstack_sz, aint_t nargs, apid_t* pid);
 
+/// Spawn a new actor with initial sizes `opts`, see \ref any_spawn.
+ANY_API void
+any_spawn_opts(
+    aactor_t* a, aint_t cstack_sz, const aactor_opts_t* opts, aint_t nargs,
+    apid_t* pid);
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
@@ -0,0 +1,302 @@
+/* Copyright (c) 2017 Nguyen Viet Giang. All rights reserved. */
+#pragma once
+
+#include <any/rt_types.h>
+#include <any/actor.h>
+#include <any/scheduler.h>
+#include <any/std.h>
+#include <any/std_string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Receives chunks of the generated C source.
+typedef void(*aaot_writer_t)(const char* s, aint_t sz, void* ud);
+
+/** Translate a loaded chunk into C source of a native library.
+\brief
+`module` is the root prototype of a chunk added to a loader, so that all of
+its prototypes are verified. Every module function becomes a native function
+of an `alib_t` named after the module, registered by the generated
+`void aot_lib_add_<module>(aloader_t*)`, which makes \ref aloader_link
+resolve imports to it exactly like to the byte code. Tail calls of a function
+to itself become loops. Returns `AERR_MALFORMED` if any prototype is not
+verified or has any other tail call, which would grow the native stack.
+*/
+ANY_API aerror_t
+aaot_translate(
+    aprototype_t* module, aalloc_t alloc, void* alloc_ud,
+    aaot_writer_t writer, void* ud);
+
+/*
+Runtime support of generated code. Each helper mirrors the unchecked handler
+of its instruction in the dispatcher, operands were proven well formed by the
+verifier before translating.
+*/
+
+/// Push onto the stack reserved by \ref aaot_enter, returns the new slot.
+static inline avalue_t*
+aaot_push(
+    aactor_t* a)
+{
+    return a->stack.v + a->stack.sp++;
+}
+
+/// Returns value at `idx` relative to the top, 1 is the top.
+static inline avalue_t*
+aaot_top(
+    aactor_t* a, aint_t idx)
+{
+    return a->stack.v + a->stack.sp - idx;
+}
+
+/// Check arguments, reserve the stack and push nil locals.
+static inline void
+aaot_enter(
+    aactor_t* a, aint_t min_args, aint_t num_locals, aint_t max_stack)
+{
+    if (a->frame->nargs < min_args) {
+        any_error(a, AERR_RUNTIME, "bad index %lld", (long long int)-min_args);
+    }
+    if (astack_reserve(&a->stack, max_stack) != AERR_NONE) {
+        any_error(a, AERR_RUNTIME, "out of memory");
+    }
+    while (a->stack.sp < a->frame->bp + num_locals) {
+        av_nil(aaot_push(a));
+    }
+}
+
+/** Replace the arguments of the current call by `nargs` ones on top.
+\brief For a self tail call, the function then enters again without growing
+the native stack.
+*/
+static inline void
+aaot_tail(
+    aactor_t* a, aint_t nargs)
+{
+    aframe_t* frame = a->frame;
+    aint_t base = frame->bp - frame->nargs - 1;
+    memmove(a->stack.v + base, a->stack.v + a->stack.sp - nargs - 1,
+        (size_t)(nargs + 1) * sizeof(avalue_t));
+    frame->nargs = nargs;
+    a->stack.sp = base + nargs + 1;
+    frame->bp = a->stack.sp;
+}
+
+/// Count a reduction of a call or a backward jump.
+static inline void
+aaot_reduce(
+    aactor_t* a)
+{
+    if (--a->budget <= 0) ascheduler_preempt(a->owner, a);
+}
+
+static inline void
+aaot_pop(
+    aactor_t* a, aint_t n)
+{
+    a->stack.sp -= n;
+}
+
+static inline void
+aaot_nil(
+    aactor_t* a)
+{
+    av_nil(aaot_push(a));
+}
+
+static inline void
+aaot_bool(
+    aactor_t* a, int32_t val)
+{
+    av_boolean(aaot_push(a), val);
+}
+
+static inline void
+aaot_integer(
+    aactor_t* a, aint_t val)
+{
+    av_integer(aaot_push(a), val);
+}
+
+static inline void
+aaot_real(
+    aactor_t* a, areal_t val)
+{
+    av_real(aaot_push(a), val);
+}
+
+static inline void
+aaot_native(
+    aactor_t* a, anative_func_t f)
+{
+    av_native_func(aaot_push(a), f);
+}
+
+static inline void
+aaot_llv(
+    aactor_t* a, aint_t idx)
+{
+    *aaot_push(a) = a->stack.v[a->frame->bp + idx];
+}
+
+static inline void
+aaot_slv(
+    aactor_t* a, aint_t idx)
+{
+    --a->stack.sp;
+    a->stack.v[a->frame->bp + idx] = a->stack.v[a->stack.sp];
+}
+
+/// Pop the condition of `jin`.
+static inline int32_t
+aaot_test(
+    aactor_t* a)
+{
+    --a->stack.sp;
+    return any_to_bool(a, a->stack.sp);
+}
+
+/// Returns `AERR_TIMEOUT` if no message arrived in time.
+static inline aerror_t
+aaot_recv(
+    aactor_t* a)
+{
+    return any_mbox_recv(a, any_check_integer(a, a->stack.sp - 1));
+}
+
+// `rsetter` stores the result of reals, `isetter` of integers.
+#define AAOT_BINARY(name, isetter, rsetter, op) \
+    static inline void \
+    aaot_##name( \
+        aactor_t* a) \
+    { \
+        avalue_t* rhsv = aaot_top(a, 2); \
+        avalue_t* lhsv = rhsv + 1; \
+        if (lhsv->tag.type == AVT_INTEGER && \
+            rhsv->tag.type == AVT_INTEGER) { \
+            isetter(rhsv, lhsv->v.integer op rhsv->v.integer); \
+        } else { \
+            areal_t lhs = any_check_real(a, a->stack.sp - 1); \
+            areal_t rhs = any_check_real(a, a->stack.sp - 2); \
+            rsetter(rhsv, lhs op rhs); \
+        } \
+        a->stack.sp -= 1; \
+    }
+
+AAOT_BINARY(add, av_integer, av_real, +)
+AAOT_BINARY(sub, av_integer, av_real, -)
+AAOT_BINARY(mul, av_integer, av_real, *)
+AAOT_BINARY(lt, av_boolean, av_boolean, <)
+AAOT_BINARY(le, av_boolean, av_boolean, <=)
+AAOT_BINARY(gt, av_boolean, av_boolean, >)
+AAOT_BINARY(ge, av_boolean, av_boolean, >=)
+#undef AAOT_BINARY
+
+static inline void
+aaot_div(
+    aactor_t* a)
+{
+    avalue_t* rhsv = aaot_top(a, 2);
+    avalue_t* lhsv = rhsv + 1;
+    if (lhsv->tag.type == AVT_INTEGER && rhsv->tag.type == AVT_INTEGER) {
+        if (rhsv->v.integer == 0) {
+            any_error(a, AERR_RUNTIME, "divide by zero");
+        }
+        av_integer(rhsv, lhsv->v.integer / rhsv->v.integer);
+    } else {
+        areal_t lhs = any_check_real(a, a->stack.sp - 1);
+        areal_t rhs = any_check_real(a, a->stack.sp - 2);
+        if (afuzzy_equals(rhs, 0)) {
+            any_error(a, AERR_RUNTIME, "divide by zero");
+        }
+        av_real(rhsv, lhs / rhs);
+    }
+    a->stack.sp -= 1;
+}
+
+static inline void
+aaot_not(
+    aactor_t* a)
+{
+    int32_t cond = any_to_bool(a, a->stack.sp - 1);
+    av_boolean(aaot_top(a, 1), !cond);
+}
+
+static inline void
+aaot_eq(
+    aactor_t* a)
+{
+    int32_t eq = any_equals(a, a->stack.sp - 1, a->stack.sp - 2);
+    av_boolean(aaot_top(a, 2), eq);
+    a->stack.sp -= 1;
+}
+
+static inline void
+aaot_add_ll(
+    aactor_t* a, aint_t lhs, aint_t rhs)
+{
+    aint_t lhsi = a->frame->bp + lhs;
+    aint_t rhsi = a->frame->bp + rhs;
+    avalue_t* lhsv = a->stack.v + lhsi;
+    avalue_t* rhsv = a->stack.v + rhsi;
+    if (lhsv->tag.type == AVT_INTEGER && rhsv->tag.type == AVT_INTEGER) {
+        av_integer(aaot_push(a), lhsv->v.integer + rhsv->v.integer);
+    } else {
+        areal_t l = any_check_real(a, lhsi);
+        areal_t r = any_check_real(a, rhsi);
+        av_real(aaot_push(a), l + r);
+    }
+}
+
+/// Add `val` to the value at absolute index `idx` in place.
+static inline void
+aaot_add_at(
+    aactor_t* a, aint_t idx, aint_t val)
+{
+    avalue_t* v = a->stack.v + idx;
+    if (v->tag.type == AVT_INTEGER) {
+        av_integer(v, val + v->v.integer);
+    } else {
+        av_real(v, val + any_check_real(a, idx));
+    }
+}
+
+static inline void
+aaot_addi(
+    aactor_t* a, aint_t val)
+{
+    aaot_add_at(a, a->stack.sp - 1, val);
+}
+
+static inline void
+aaot_inc(
+    aactor_t* a, aint_t idx, aint_t val)
+{
+    aaot_add_at(a, a->frame->bp + idx, val);
+}
+
+/// Pop `x` of compare and branch, returns `val <op> x`.
+#define AAOT_BRANCH(name, op) \
+    static inline int32_t \
+    aaot_##name( \
+        aactor_t* a, aint_t val) \
+    { \
+        avalue_t* v = aaot_top(a, 1); \
+        int32_t cond = v->tag.type == AVT_INTEGER \
+            ? val op v->v.integer \
+            : val op any_check_real(a, a->stack.sp - 1); \
+        a->stack.sp -= 1; \
+        return cond; \
+    }
+
+AAOT_BRANCH(jlt, <)
+AAOT_BRANCH(jle, <=)
+AAOT_BRANCH(jgt, >)
+AAOT_BRANCH(jge, >=)
+#undef AAOT_BRANCH
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -27,6 +27,22 @@ ANY_API void
 aasm_save(
     aasm_t* self);
 
+/** Same as \ref aasm_save, after fusing common sequences with \ref aasm_fuse.
+\brief Instruction indices returned by \ref aasm_emit are not valid anymore.
+*/
+ANY_API void
+aasm_save_fused(
+    aasm_t* self);
+
+/** Rewrite common instruction sequences into fused instructions.
+\brief Applied to every prototype, jump displacements and source lines are
+kept consistent. Sequences containing a jump target are left as is.
+\return The number of fused sequences.
+*/
+ANY_API aint_t
+aasm_fuse(
+    aasm_t* self);
+
 /// Release all internal allocated memory, result as a *fresh* assembler.
 ANY_API void
 aasm_cleanup(
@@ -22,6 +22,16 @@ ADB_API void
 adb_cleanup(
     adb_t* self);
 
+/** Serve folded stacks of `sampler` at `/profile/samples`.
+\note `sampler` must outlive the debug service, NULL to detach.
+*/
+static inline void
+adb_attach_sampler(
+    adb_t* self, asampler_t* sampler)
+{
+    self->sampler = sampler;
+}
+
 /// Give the debug server a chance to run.
 ADB_API void
 adb_run_once(
@@ -7,7 +7,9 @@
 extern "C" {
 #endif
 
-/// Initialize as a new garbage collector.
+/** Initialize as a new garbage collector.
+\brief The heap is allocated by the first \ref agc_reserve.
+*/
 ANY_API aerror_t
 agc_init(
     agc_t* self, aint_t heap_cap, aalloc_t alloc, void* alloc_ud);
@@ -39,6 +41,26 @@ ANY_API aerror_t
 agc_reserve(
     agc_t* self, aint_t more, aint_t n);
 
+/// Use `heap` of `2 * heap_cap` bytes, instead of allocating the first one.
+static inline void
+agc_attach(
+    agc_t* self, uint8_t* heap, aint_t heap_cap)
+{
+    assert(self->cur_heap == NULL);
+    self->cur_heap = heap;
+    self->new_heap = heap + heap_cap;
+    self->heap_cap = heap_cap;
+    self->heap_sz = 0;
+    self->buffers = -1;
+}
+
+/** Take the heap out of this collector, which has none after.
+\brief Returns NULL if there is no heap, its size is `2 * heap_cap` before.
+*/
+ANY_API uint8_t*
+agc_detach(
+    agc_t* self);
+
 /** Reclaim unreferenced objects.
 \brief `root` must be NULL terminated.
 */
@@ -46,6 +68,115 @@ ANY_API void
 agc_collect(
     agc_t* self, avalue_t** roots, aint_t* num_roots);
 
+/** Copy objects reachable from `n` values of `v` into the free semi-space.
+\brief
+`v` is rewritten to refer the copies, objects shared by them are copied once.
+Returns the size of the copies, they are valid until the next collection.
+*/
+ANY_API aint_t
+agc_stage(
+    agc_t* self, avalue_t* v, aint_t n);
+
+/** Append `sz` bytes of objects staged by \ref agc_stage to the heap.
+\brief `v` is rewritten like \ref agc_stage, the space must be reserved.
+*/
+ANY_API void
+agc_copy_in(
+    agc_t* self, const uint8_t* objs, aint_t sz, avalue_t* v, aint_t n);
+
+/** Stage collectable `v` into a new fragment, see \ref afrag_t.
+\brief Returns NULL if out of memory.
+*/
+ANY_API afrag_t*
+agc_frag_new(
+    agc_t* self, const avalue_t* v);
+
+/** Make a fragment of a single string with contents `s`, off any heap.
+\brief Returns NULL if out of memory.
+*/
+ANY_API afrag_t*
+afrag_string_new(
+    aalloc_t alloc, void* alloc_ud, const char* s);
+
+/** Make the fragment which carries `post` to its queue, off any heap.
+\brief What `post` owns is moved or released. Returns NULL if out of memory.
+*/
+ANY_API afrag_t*
+afrag_post_new(
+    aalloc_t alloc, void* alloc_ud, apost_t* post);
+
+/** Copy objects of `frag` into this heap, which must be reserved.
+\brief The message is written to `out`, `frag` is not released.
+*/
+ANY_API void
+agc_frag_merge(
+    agc_t* self, const afrag_t* frag, avalue_t* out);
+
+/// Release a fragment which is not needed anymore.
+ANY_API void
+afrag_free(
+    afrag_t* self);
+
+/// Allocate a binary of `cap` bytes with one reference, NULL if out of memory.
+ANY_API abinary_t*
+abinary_new(
+    aalloc_t alloc, void* alloc_ud, aint_t cap);
+
+/// Bytes following the header.
+static inline uint8_t*
+abinary_bytes(
+    abinary_t* self)
+{
+    return (uint8_t*)(self + 1);
+}
+
+/// Add a reference.
+static inline void
+abinary_retain(
+    abinary_t* self)
+{
+#ifdef ANY_SMP
+    __atomic_add_fetch(&self->refs, 1, __ATOMIC_RELAXED);
+#else
+    ++self->refs;
+#endif
+}
+
+/// Returns TRUE if there is more than one reference.
+static inline int32_t
+abinary_shared(
+    abinary_t* self)
+{
+#ifdef ANY_SMP
+    return __atomic_load_n(&self->refs, __ATOMIC_ACQUIRE) > 1;
+#else
+    return self->refs > 1;
+#endif
+}
+
+/// Remove a reference, the last one frees it.
+ANY_API void
+abinary_release(
+    abinary_t* self);
+
+/// Add buffer at `heap_idx` to the ones checked for binaries by collection.
+static inline void
+agc_link_buffer(
+    agc_t* self, aint_t heap_idx)
+{
+    AGC_CAST(agc_buffer_t, self, heap_idx)->next = self->buffers;
+    self->buffers = heap_idx;
+}
+
+/// Bytes of buffer `o`, which may be shared, see \ref abinary_t.
+static inline uint8_t*
+agc_buffer_bytes(
+    agc_t* self, agc_buffer_t* o)
+{
+    if (o->bin) return abinary_bytes(o->bin);
+    return AGC_CAST(uint8_t, self, o->buff.v.heap_idx);
+}
+
 /// Get current heap size.
 static inline aint_t
 agc_heap_size(
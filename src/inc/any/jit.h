@@ -0,0 +1,69 @@
+/* Copyright (c) 2017 Nguyen Viet Giang. All rights reserved. */
+#pragma once
+
+#include <any/rt_types.h>
+
+#ifdef ANY_JIT
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef ANY_JIT_THRESHOLD
+/// Hotness of a prototype to be compiled.
+#define ANY_JIT_THRESHOLD 1000
+#endif
+
+/// Results of native code.
+enum {
+    /// Continue interpreting at `ip`.
+    AJIT_EXIT,
+    /// Reductions are used up, continue at `ip` after preempting.
+    AJIT_PREEMPT
+};
+
+/** Translate a verified prototype into x86-64 native code.
+\brief
+This is a baseline compiler, each instruction is expanded into a fixed
+template that works directly on the value stack of actor, with inline fast
+paths for integers and calls into C helpers for the remaining types. Calls,
+returns, constant strings and mailbox instructions are left to the
+interpreter, native code returns right before them, and is entered again
+after them. On success `pt->jit` is set, on failure the prototype simply
+stays interpreted.
+*/
+ANY_API aerror_t
+ajit_compile(
+    aprototype_t* pt, aalloc_t alloc, void* alloc_ud);
+
+/// Release native code of `pt` and its nested prototypes, if any.
+ANY_API void
+ajit_release(
+    aprototype_t* pt);
+
+/// Native code of `pt`, NULL if not compiled yet by any worker.
+static inline ajit_code_t*
+ajit_code(
+    aprototype_t* pt)
+{
+#ifdef ANY_SMP
+    return __atomic_load_n(&pt->jit, __ATOMIC_ACQUIRE);
+#else
+    return pt->jit;
+#endif
+}
+
+/// Run native code of current frame from `ip`, see \ref AJIT_EXIT.
+static inline int32_t
+ajit_run(
+    aactor_t* a, aprototype_t* pt, aint_t ip)
+{
+    ajit_code_t* jc = ajit_code(pt);
+    return jc->code(a, jc->entries[ip]);
+}
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // ANY_JIT
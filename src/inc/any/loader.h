@@ -35,6 +35,70 @@ aloader_on_linked(
     self->on_linked_ud = ud;
 }
 
+/** Opcode of loaded instruction `i`, which may be quickened meanwhile.
+\brief
+With `ANY_SMP`, workers share prototypes of the loader, the whole instruction is
+loaded atomically, see \ref ainstruction_quicken.
+*/
+static inline int32_t
+ainstruction_opcode(
+    const ainstruction_t* i)
+{
+#ifdef ANY_SMP
+    ainstruction_t w;
+    __atomic_load(i, &w, __ATOMIC_RELAXED);
+    return w.b.opcode;
+#else
+    return i->b.opcode;
+#endif
+}
+
+#ifndef ANY_QUICKEN_MISSES
+/// Type misses after which an instruction is not quickened anymore.
+#define ANY_QUICKEN_MISSES 4
+#endif
+
+/** Rewrite the opcode of generic instruction `i` into its quickened `op`.
+\brief
+Does nothing once `i` missed \ref ANY_QUICKEN_MISSES times, so that polymorphic
+sites stay generic instead of rewriting shared code on every flip.
+*/
+static inline void
+ainstruction_quicken(
+    ainstruction_t* i, int32_t op)
+{
+#ifdef ANY_SMP
+    ainstruction_t w;
+    __atomic_load(i, &w, __ATOMIC_RELAXED);
+    if (w.b._ >= ANY_QUICKEN_MISSES) return;
+    w.b.opcode = (uint32_t)op;
+    __atomic_store(i, &w, __ATOMIC_RELAXED);
+#else
+    if (i->b._ >= ANY_QUICKEN_MISSES) return;
+    i->b.opcode = (uint32_t)op;
+#endif
+}
+
+/** Restore generic `op` of quickened instruction `i` after a type miss.
+\brief Misses are counted in the operand, which generic arithmetic and
+comparison instructions leave unused.
+*/
+static inline void
+ainstruction_dequicken(
+    ainstruction_t* i, int32_t op)
+{
+#ifdef ANY_SMP
+    ainstruction_t w;
+    __atomic_load(i, &w, __ATOMIC_RELAXED);
+    w.b.opcode = (uint32_t)op;
+    ++w.b._;
+    __atomic_store(i, &w, __ATOMIC_RELAXED);
+#else
+    i->b.opcode = (uint32_t)op;
+    ++i->b._;
+#endif
+}
+
 /** Add new byte code chunk to `pendings` list.
 \note `chunk_alloc` is optional, used to free `chunk` if necessary.
 */
@@ -0,0 +1,153 @@
+/* Copyright (c) 2017 Nguyen Viet Giang. All rights reserved. */
+#pragma once
+
+#include <any/rt_types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Initialize as a new message box.
+\brief `cap` cells are allocated by the first \ref ambox_reserve.
+*/
+static inline aerror_t
+ambox_init(
+    ambox_t* self, aint_t cap, aalloc_t alloc, void* alloc_ud)
+{
+    self->alloc = alloc;
+    self->alloc_ud = alloc_ud;
+    self->v = NULL;
+    self->frags = NULL;
+    self->next = NULL;
+    self->from = NULL;
+    self->frags_sz = 0;
+    self->cap = 0;
+    self->init_cap = cap > 0 ? cap : 1;
+    self->num_cells = 0;
+    self->num_msgs = 0;
+    self->head = -1;
+    self->tail = -1;
+    self->free = -1;
+    self->peek = -1;
+    self->prev = -1;
+    self->cur = -1;
+    self->mark = -1;
+    return AERR_NONE;
+}
+
+/// Release all allocated memory and fragments.
+ANY_API void
+ambox_cleanup(
+    ambox_t* self);
+
+/// Ensures that there are `more` free cells.
+ANY_API aerror_t
+ambox_reserve(
+    ambox_t* self, aint_t more);
+
+/** Cell of the next message, must be reserved.
+\brief The message is queued by \ref ambox_push after the cell is filled.
+*/
+static inline avalue_t*
+ambox_slot(
+    ambox_t* self)
+{
+    return self->v + (self->free >= 0 ? self->free : self->num_cells);
+}
+
+/** Queue the message in \ref ambox_slot from `from` to the back.
+\brief If `frag` is not NULL, the slot must be nil and it owns `frag`.
+*/
+static inline void
+ambox_push_frag(
+    ambox_t* self, afrag_t* frag, aint_t from)
+{
+    aint_t c;
+    if (self->free >= 0) {
+        c = self->free;
+        self->free = self->next[c];
+    } else {
+        c = self->num_cells++;
+    }
+    self->frags[c] = frag;
+    if (frag) self->frags_sz += frag->sz;
+    self->from[c] = from;
+    self->next[c] = -1;
+    if (self->tail >= 0) self->next[self->tail] = c;
+    else self->head = c;
+    self->tail = c;
+    ++self->num_msgs;
+}
+
+/** Queue the message in \ref ambox_slot, which is on the heap, to the back.
+\brief `from` is the pid of the sender, -1 if not an actor.
+*/
+static inline void
+ambox_push(
+    ambox_t* self, aint_t from)
+{
+    ambox_push_frag(self, NULL, from);
+}
+
+/** Queue the message carried by posted `frag`, a cell must be reserved.
+\brief The box owns `frag` from now on, it is freed if without objects.
+*/
+ANY_API void
+ambox_push_post(
+    ambox_t* self, afrag_t* frag);
+
+/// Take the fragment of cell `c`, the caller merges it into `v[c]`.
+static inline afrag_t*
+ambox_take_frag(
+    ambox_t* self, aint_t c)
+{
+    afrag_t* frag = self->frags[c];
+    if (frag) {
+        self->frags[c] = NULL;
+        self->frags_sz -= frag->sz;
+    }
+    return frag;
+}
+
+/// Pick up the message after the peek pointer, NULL if there is none.
+static inline avalue_t*
+ambox_peek(
+    ambox_t* self)
+{
+    aint_t c = self->peek >= 0 ? self->next[self->peek] : self->head;
+    if (c < 0) return NULL;
+    self->prev = self->peek;
+    self->cur = c;
+    self->peek = c;
+    return self->v + c;
+}
+
+/** Remove the message last picked up, then rewind to the front.
+\brief The receive marker is cleared.
+\return FALSE if no message is picked up since the last rewind.
+*/
+ANY_API int32_t
+ambox_remove(
+    ambox_t* self);
+
+/// Rewind the peek pointer to the receive marker, or the front if none.
+static inline void
+ambox_rewind(
+    ambox_t* self)
+{
+    self->peek = self->mark;
+    self->cur = -1;
+}
+
+/// Set the receive marker after the last message and move the peek pointer.
+static inline void
+ambox_mark(
+    ambox_t* self)
+{
+    self->mark = self->tail;
+    ambox_rewind(self);
+}
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -0,0 +1,79 @@
+/* Copyright (c) 2017 Nguyen Viet Giang. All rights reserved. */
+#pragma once
+
+#include <any/rt_types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Initialize as a new table of up to `1 << idx_bits` processes.
+\brief No slot is allocated until the first \ref aprocess_table_alloc.
+*/
+ANY_API aerror_t
+aprocess_table_init(
+    aprocess_table_t* self, int8_t idx_bits, int8_t gen_bits,
+    aalloc_t alloc, void* alloc_ud);
+
+/// Release all chunks, processes must be cleaned up already.
+ANY_API void
+aprocess_table_cleanup(
+    aprocess_table_t* self);
+
+/** Take the least recently freed slot, grows by a chunk if there is none.
+\brief The generation of its pid is advanced, so stale pids miss it.
+\return NULL if the table is full or out of memory.
+*/
+ANY_API aprocess_t*
+aprocess_table_alloc(
+    aprocess_table_t* self);
+
+/// Returns this process to the table.
+ANY_API void
+aprocess_table_free(
+    aprocess_table_t* self, aprocess_t* p);
+
+/// Get slot by index, NULL if its chunk is not allocated yet.
+static inline aprocess_t*
+aprocess_table_at(
+    aprocess_table_t* self, apid_idx_t idx)
+{
+    aprocess_t* chunk;
+#ifdef ANY_SMP
+    // chunks are published by other threads.
+    chunk = __atomic_load_n(
+        self->chunks + (idx >> self->chunk_bits), __ATOMIC_ACQUIRE);
+#else
+    chunk = self->chunks[idx >> self->chunk_bits];
+#endif
+    if (chunk == NULL) return NULL;
+    return chunk + (idx & ((1 << self->chunk_bits) - 1));
+}
+
+/// Get slot of `pid`, NULL if that slot is not allocated yet.
+static inline aprocess_t*
+aprocess_table_slot(
+    aprocess_table_t* self, apid_t pid)
+{
+    return aprocess_table_at(self, apid_idx(self->idx_bits, pid));
+}
+
+/// Release the native stack of `p`, stackless processes have none.
+static inline void
+aprocess_delete_task(
+    aprocess_t* p)
+{
+    if ((p->actor.flags & APF_STACKLESS) == 0) atask_delete(&p->ptask.task);
+}
+
+/// Returns number of living processes.
+static inline aint_t
+aprocess_table_size(
+    aprocess_table_t* self)
+{
+    return self->num_procs;
+}
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
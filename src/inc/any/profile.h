@@ -0,0 +1,37 @@
+/* Copyright (c) 2017 Nguyen Viet Giang. All rights reserved. */
+#pragma once
+
+#include <any/rt_types.h>
+
+#ifdef ANY_PROFILE
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Visited prototype, `module` is the symbol of its chunk.
+typedef void(*aprofile_visitor_t)(
+    const char* module, aprototype_t* pt, void* ud);
+
+/// Mnemonic of `opcode`, NULL if not an opcode.
+ANY_API const char*
+aprofile_opcode_name(
+    int32_t opcode);
+
+/** Visit all prototypes of running and garbage chunks.
+\brief Prototypes are visited in depth first order, module prototypes included.
+*/
+ANY_API void
+aprofile_visit(
+    ascheduler_t* self, aprofile_visitor_t visitor, void* ud);
+
+/// Clear opcode and prototype counters.
+ANY_API void
+aprofile_reset(
+    ascheduler_t* self);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif // ANY_PROFILE
@@ -7,6 +7,10 @@
 #include <any/task.h>
 #include <any/timer.h>
 
+#ifdef ANY_SMP
+#include <pthread.h>
+#endif
+
 // Specify the operation to be performed by the instructions.
 typedef enum aopcode_e {
     AOC_NOP = 0,
@@ -27,11 +31,13 @@ typedef enum aopcode_e {
 
     AOC_IVK = 40,
     AOC_RET = 41,
+    AOC_TVK = 42,
 
     AOC_SND = 50,
     AOC_RCV = 51,
     AOC_RMV = 52,
     AOC_RWD = 53,
+    AOC_MRK = 54,
 
     AOC_ADD = 60,
     AOC_SUB = 61,
@@ -43,7 +49,35 @@ typedef enum aopcode_e {
     AOC_LT  = 72,
     AOC_LE  = 73,
     AOC_GT  = 74,
-    AOC_GE  = 75
+    AOC_GE  = 75,
+
+    AOC_ADD_LL = 80,
+    AOC_ADDI   = 81,
+    AOC_INC    = 82,
+    AOC_JLT    = 83,
+    AOC_JLE    = 84,
+    AOC_JGT    = 85,
+    AOC_JGE    = 86,
+
+    // Quickened forms, only rewritten at runtime into the instruction copy
+    // owned by \ref achunk_t, never emitted into a chunk.
+    AOC_ADD_II = 90,
+    AOC_SUB_II = 91,
+    AOC_MUL_II = 92,
+    AOC_DIV_II = 93,
+    AOC_LT_II  = 94,
+    AOC_LE_II  = 95,
+    AOC_GT_II  = 96,
+    AOC_GE_II  = 97,
+
+    AOC_ADD_RR = 100,
+    AOC_SUB_RR = 101,
+    AOC_MUL_RR = 102,
+    AOC_DIV_RR = 103,
+    AOC_LT_RR  = 104,
+    AOC_LE_RR  = 105,
+    AOC_GT_RR  = 106,
+    AOC_GE_RR  = 107
 } aopcode_t;
 
 /** Base type.
@@ -270,6 +304,22 @@ typedef struct ai_ret_s {
     uint32_t _;
 } ai_ret_t;
 
+/** Tail call, the current frame is reused for the callee.
+\brief Same as \ref ai_ivk_t followed by \ref ai_ret_t, without growing the
+frame stack.
+\rst
+=======  =======
+8 bits   24 bits
+=======  =======
+AOC_TVK  nargs
+=======  =======
+\endrst
+*/
+typedef struct ai_tvk_s {
+    uint32_t _ : 8;
+    int32_t nargs : 24;
+} ai_tvk_t;
+
 /** Pop message and next a target pid from the stack and send it.
 \rst
 =======  =======
@@ -325,11 +375,12 @@ typedef struct ai_rmv_s {
 } ai_rmv_t;
 
 /** Rewind the peek pointer to the front.
+\brief Or to the receive marker, see \ref AOC_MRK.
 \rst
 =======  =======
 8 bits   24 bits
 =======  =======
-AOC_RMV  _
+AOC_RWD  _
 =======  =======
 \endrst
 */
@@ -337,6 +388,23 @@ typedef struct ai_rwd_s {
     uint32_t _;
 } ai_rwd_t;
 
+/** Set the receive marker after the last message in the queue.
+\brief
+The peek pointer is moved to the marker, \ref AOC_RWD rewinds to it instead of
+the front so messages queued before it are not scanned again. The marker is
+cleared by \ref AOC_RMV.
+\rst
+=======  =======
+8 bits   24 bits
+=======  =======
+AOC_MRK  _
+=======  =======
+\endrst
+*/
+typedef struct ai_mrk_s {
+    uint32_t _;
+} ai_mrk_t;
+
 /** Add two numbers.
 \rst
 =======  ============
@@ -467,6 +535,116 @@ typedef struct ai_ge_s {
     uint32_t _;
 } ai_ge_t;
 
+/** Add two stack values, fused `llv rhs; llv lhs; add`.
+\brief Push the sum of values at `lhs` and `rhs` onto the stack.
+\rst
+==========  =======  =======
+8 bits      12 bits  12 bits
+==========  =======  =======
+AOC_ADD_LL  lhs      rhs
+==========  =======  =======
+\endrst
+*/
+typedef struct ai_add_ll_s {
+    uint32_t _ : 8;
+    int32_t lhs : 12;
+    int32_t rhs : 12;
+} ai_add_ll_t;
+
+/** Add a small integer `val` to top of the stack, fused `lsi val; add`.
+\rst
+========  =======
+8 bits    24 bits
+========  =======
+AOC_ADDI  val
+========  =======
+\endrst
+*/
+typedef struct ai_addi_s {
+    uint32_t _ : 8;
+    int32_t val : 24;
+} ai_addi_t;
+
+/** Add a small integer `val` to stack value at `idx` in place.
+\brief Fused `llv idx; lsi val; add; slv idx`, the stack is left untouched.
+\rst
+=======  =======  =======
+8 bits   12 bits  12 bits
+=======  =======  =======
+AOC_INC  idx      val
+=======  =======  =======
+\endrst
+*/
+typedef struct ai_inc_s {
+    uint32_t _ : 8;
+    int32_t idx : 12;
+    int32_t val : 12;
+} ai_inc_t;
+
+/** Compare and branch, fused `lsi val; lt; jin displacement`.
+\brief Pop a number and jump if `val` is not less than it.
+\rst
+=======  =======  ============
+8 bits   12 bits  12 bits
+=======  =======  ============
+AOC_JLT  val      displacement
+=======  =======  ============
+\endrst
+*/
+typedef struct ai_jlt_s {
+    uint32_t _ : 8;
+    int32_t val : 12;
+    int32_t displacement : 12;
+} ai_jlt_t;
+
+/** Compare and branch, fused `lsi val; le; jin displacement`.
+\brief Pop a number and jump if `val` is not less than or equals to it.
+\rst
+=======  =======  ============
+8 bits   12 bits  12 bits
+=======  =======  ============
+AOC_JLE  val      displacement
+=======  =======  ============
+\endrst
+*/
+typedef struct ai_jle_s {
+    uint32_t _ : 8;
+    int32_t val : 12;
+    int32_t displacement : 12;
+} ai_jle_t;
+
+/** Compare and branch, fused `lsi val; gt; jin displacement`.
+\brief Pop a number and jump if `val` is not greater than it.
+\rst
+=======  =======  ============
+8 bits   12 bits  12 bits
+=======  =======  ============
+AOC_JGT  val      displacement
+=======  =======  ============
+\endrst
+*/
+typedef struct ai_jgt_s {
+    uint32_t _ : 8;
+    int32_t val : 12;
+    int32_t displacement : 12;
+} ai_jgt_t;
+
+/** Compare and branch, fused `lsi val; ge; jin displacement`.
+\brief Pop a number and jump if `val` is not greater than or equals to it.
+\rst
+=======  =======  ============
+8 bits   12 bits  12 bits
+=======  =======  ============
+AOC_JGE  val      displacement
+=======  =======  ============
+\endrst
+*/
+typedef struct ai_jge_s {
+    uint32_t _ : 8;
+    int32_t val : 12;
+    int32_t displacement : 12;
+} ai_jge_t;
+
 /// Variant of instruction types, instruction size is fixed 4 bytes.
 typedef union {
     ai_base_t b;
@@ -481,7 +659,15 @@ typedef union {
     ai_jmp_t jmp;
     ai_jin_t jin;
     ai_ivk_t ivk;
+    ai_tvk_t tvk;
     ai_rcv_t rcv;
+    ai_add_ll_t add_ll;
+    ai_addi_t addi;
+    ai_inc_t inc;
+    ai_jlt_t jlt;
+    ai_jle_t jle;
+    ai_jgt_t jgt;
+    ai_jge_t jge;
 } ainstruction_t;
 
 ASTATIC_ASSERT(sizeof(ainstruction_t) == 4);
@@ -629,6 +815,16 @@ ai_ret()
     return i;
 }
 
+static inline ainstruction_t
+ai_tvk(
+    aint_t nargs)
+{
+    ainstruction_t i;
+    i.b.opcode = AOC_TVK;
+    i.tvk.nargs = (int32_t)nargs;
+    return i;
+}
+
 static inline ainstruction_t
 ai_snd()
 {
@@ -663,6 +859,14 @@ ai_rwd()
     return i;
 }
 
+static inline ainstruction_t
+ai_mrk()
+{
+    ainstruction_t i;
+    i.b.opcode = AOC_MRK;
+    return i;
+}
+
 static inline ainstruction_t
 ai_add()
 {
@@ -743,6 +947,82 @@ ai_ge()
     return i;
 }
 
+static inline ainstruction_t
+ai_add_ll(
+    aint_t lhs, aint_t rhs)
+{
+    ainstruction_t i;
+    i.b.opcode = AOC_ADD_LL;
+    i.add_ll.lhs = (int32_t)lhs;
+    i.add_ll.rhs = (int32_t)rhs;
+    return i;
+}
+
+static inline ainstruction_t
+ai_addi(
+    aint_t val)
+{
+    ainstruction_t i;
+    i.b.opcode = AOC_ADDI;
+    i.addi.val = (int32_t)val;
+    return i;
+}
+
+static inline ainstruction_t
+ai_inc(
+    aint_t idx, aint_t val)
+{
+    ainstruction_t i;
+    i.b.opcode = AOC_INC;
+    i.inc.idx = (int32_t)idx;
+    i.inc.val = (int32_t)val;
+    return i;
+}
+
+static inline ainstruction_t
+ai_jlt(
+    aint_t val, aint_t displacement)
+{
+    ainstruction_t i;
+    i.b.opcode = AOC_JLT;
+    i.jlt.val = (int32_t)val;
+    i.jlt.displacement = (int32_t)displacement;
+    return i;
+}
+
+static inline ainstruction_t
+ai_jle(
+    aint_t val, aint_t displacement)
+{
+    ainstruction_t i;
+    i.b.opcode = AOC_JLE;
+    i.jle.val = (int32_t)val;
+    i.jle.displacement = (int32_t)displacement;
+    return i;
+}
+
+static inline ainstruction_t
+ai_jgt(
+    aint_t val, aint_t displacement)
+{
+    ainstruction_t i;
+    i.b.opcode = AOC_JGT;
+    i.jgt.val = (int32_t)val;
+    i.jgt.displacement = (int32_t)displacement;
+    return i;
+}
+
+static inline ainstruction_t
+ai_jge(
+    aint_t val, aint_t displacement)
+{
+    ainstruction_t i;
+    i.b.opcode = AOC_JGE;
+    i.jge.val = (int32_t)val;
+    i.jge.displacement = (int32_t)displacement;
+    return i;
+}
+
 /** Allocator interface.
 \brief
 `old` = 0 to malloc,
@@ -980,6 +1260,10 @@ typedef struct agc_s {
     aint_t heap_cap;
     aint_t heap_sz;
     aint_t scan;
+    /// Capacity of the first allocation, see \ref agc_init.
+    aint_t init_cap;
+    /// Last allocated \ref agc_buffer_t, -1 if none.
+    aint_t buffers;
 } agc_t;
 
 /// Collectable value header.
@@ -992,13 +1276,54 @@ typedef struct agc_header_s {
 #define AGC_CAST(T, gc, idx) \
     ((T*)((gc)->cur_heap + idx + sizeof(agc_header_t)))
 
+/// Buffers of at least this capacity are kept off heap in \ref abinary_t.
+#define ABINARY_MIN_SZ 256
+
+/** Reference counted bytes of a large \ref agc_buffer_t.
+\brief
+Shared by buffers of many actors after sending, it is copied before writing if
+there is more than one reference. Bytes follow this header.
+*/
+typedef struct abinary_s {
+    aalloc_t alloc;
+    void* alloc_ud;
+    aint_t refs;
+} abinary_t;
+
 /// Collectable buffer.
 typedef struct agc_buffer_s {
     aint_t cap;
     aint_t sz;
+    /// Bytes on heap, nil if they are in `bin`.
     avalue_t buff;
+    abinary_t* bin;
+    /// Buffer allocated before this one in the same heap, -1 if none.
+    aint_t next;
 } agc_buffer_t;
 
+/** Objects of a message staged outside of any heap, see \ref agc_frag_new.
+\brief
+They are copied into the heap of the receiver when it picks up the message or
+collects, so a sender never allocates on that heap. Objects follow this header,
+`v` refers them by offset from the first one.
+*/
+typedef struct afrag_s {
+    aalloc_t alloc;
+    void* alloc_ud;
+    aint_t sz;
+    avalue_t v;
+    /// Next post in the same queue, see \ref ascheduler_post.
+    struct afrag_s* next;
+    /// Receiver while queued as a post.
+    apid_t pid;
+    /// Sender while queued as a post, -1 if not an actor.
+    aint_t from;
+#ifdef ANY_SMP
+    /// Worker which recycles this fragment without objects, NULL if none.
+    struct ascheduler_s* home;
+#endif
+} afrag_t;
+
 /// Combination of hash and length.
 typedef struct ahash_and_length_s {
     uint32_t hash;
@@ -1158,6 +1483,37 @@ typedef struct alib_s {
     alist_node_t node;
 } alib_t;
 
+#ifdef ANY_PROFILE
+/** Execution counters of a prototype.
+\brief Only available when built with `USE_PROFILE`, see \ref aprofile_visit.
+*/
+typedef struct aprofile_s {
+    /// Number of executed instructions.
+    aint_t instructions;
+    /// Number of calls, tail calls included.
+    aint_t calls;
+    /// Microseconds spent in returned calls, including callees and the time
+    /// the actor was suspended.
+    aint_t usecs;
+} aprofile_t;
+#endif
+
+#ifdef ANY_JIT
+struct aactor_s;
+
+/** Native code of a prototype, see \ref ajit_compile.
+\brief Lives at the start of its own executable mapping of `mem_sz` bytes.
+*/
+typedef struct ajit_code_s {
+    aint_t mem_sz;
+    /// Native address of each instruction.
+    const uint8_t** entries;
+    /// Enters at `entry`, returns on reaching an instruction left to the
+    /// interpreter, with `ip` and `sp` written back.
+    int32_t(*code)(struct aactor_s* a, const uint8_t* entry);
+} ajit_code_t;
+#endif
+
 /// Runtime prototype.
 typedef struct aprototype_s {
     struct achunk_s* chunk;
@@ -1169,6 +1525,20 @@ typedef struct aprototype_s {
     avalue_t* import_values;
     aint_t* source_lines;
     struct aprototype_s* nesteds;
+    /// Instructions are proven well formed, see \ref averify_prototype.
+    int32_t verified;
+    /// Deepest value stack usage including local variables.
+    aint_t max_stack;
+    /// Number of arguments accessed by negative indices.
+    aint_t min_args;
+#ifdef ANY_PROFILE
+    aprofile_t profile;
+#endif
+#ifdef ANY_JIT
+    /// Number of calls and backward jumps, compiled at `ANY_JIT_THRESHOLD`.
+    aint_t hotness;
+    ajit_code_t* jit;
+#endif
 } aprototype_t;
 
 /// Runtime byte code chunk.
@@ -1179,6 +1549,8 @@ typedef struct achunk_s {
     void* alloc_ud;
     avalue_t* imports;
     aprototype_t* prototypes;
+    /// Writable copy of all instructions, `header` is never written to.
+    ainstruction_t* instructions;
     alist_node_t node;
     int32_t retain;
 } achunk_t;
@@ -1224,20 +1596,88 @@ typedef struct astack_s {
     avalue_t* v;
     aint_t sp;
     aint_t cap;
+    /// Capacity of the first allocation, see \ref astack_init.
+    aint_t init_cap;
 } astack_t;
 
+/** Message box, a queue of cells linked by index.
+\brief
+Messages are never moved, so removing one in the middle is O(1). Cells which
+are not in use are nil, the garbage collector scans `v[0 .. num_cells)`. A cell
+with a fragment is also nil until its objects are merged into the heap.
+*/
+typedef struct ambox_s {
+    aalloc_t alloc;
+    void* alloc_ud;
+    avalue_t* v;
+    /// Fragment of each cell, NULL if the message is on the heap already.
+    afrag_t** frags;
+    /// Next cell of each cell, -1 terminated.
+    aint_t* next;
+    /// Pid of the sender of each cell, -1 if not an actor.
+    aint_t* from;
+    /// Bytes of all fragments.
+    aint_t frags_sz;
+    aint_t cap;
+    /// Capacity of the first allocation, see \ref ambox_init.
+    aint_t init_cap;
+    /// Cells ever taken, the rest are not initialized.
+    aint_t num_cells;
+    aint_t num_msgs;
+    aint_t head;
+    aint_t tail;
+    aint_t free;
+    /// Last picked up cell, -1 if the next one is the head.
+    aint_t peek;
+    /// Cell before the one to be removed, -1 if it is the head.
+    aint_t prev;
+    /// Cell to be removed, -1 if none is picked up since the last rewind.
+    aint_t cur;
+    /// Tail when the receive marker was set, -1 if none.
+    aint_t mark;
+} ambox_t;
+
 /// Process flags.
 typedef enum apflags_e {
-    APF_EXIT = 1 << 0
+    APF_EXIT = 1 << 0,
+    /// Runs on the native stack of its scheduler, see \ref aactor_resume.
+    APF_STACKLESS = 1 << 1,
+    /// Resumed after waiting, the interrupted receive does not wait again.
+    APF_WOKEN = 1 << 2,
+    /// Waiting for the reply in \ref any_mbox_call.
+    APF_CALLING = 1 << 3
 } apflags_t;
 
-/// Process stack frame.
+/** Scheduling priority of an actor.
+\brief
+Each level has its own run queue, see \ref ascheduler_next_queue. Higher levels
+run first, so they are not queued behind lower ones which are always runnable.
+*/
+typedef enum aprio_e {
+    APRIO_LOW = -1,
+    APRIO_NORMAL = 0,
+    APRIO_HIGH = 1,
+    APRIO_MAX = 2
+} aprio_t;
+
+/// Number of priority levels, run queues are indexed by `APRIO_MAX - prio`.
+enum { APRIO_NUM = APRIO_MAX - APRIO_LOW + 1 };
+
+/// Times a non-empty run queue is passed over before it runs once anyway.
+enum { APRIO_MAX_SKIPS = 8 };
+
+/** Process stack frame.
+\brief Frames are contiguous in \ref aactor_t, caller frame is `frame - 1`.
+*/
 typedef struct aframe_s {
-    struct aframe_s* prev;
     aprototype_t* pt;
     aint_t ip;
     aint_t bp;
     aint_t nargs;
+#ifdef ANY_PROFILE
+    /// Time of entering `pt`, in microseconds.
+    aint_t enter_usecs;
+#endif
 } aframe_t;
 
 /// Error catching points.
@@ -1247,6 +1687,22 @@ typedef struct acatch_s {
     jmp_buf jbuff;
 } acatch_t;
 
+/** Initial sizes of a new actor, 0 picks the default.
+\brief
+Nothing is allocated until it is used, small sizes only save the memory of
+actors which do use that part a little.
+*/
+typedef struct aactor_opts_s {
+    /// Slots of the value stack.
+    aint_t stack_sz;
+    /// Slots of the message box.
+    aint_t msbox_sz;
+    /// Bytes of each heap semi-space.
+    aint_t heap_sz;
+    /// One of \ref aprio_t.
+    aint_t priority;
+} aactor_opts_t;
+
 /** The actor.
 \brief
 AVM concurrency is rely on `actor model`, which is inspired by Erlang. In this
@@ -1292,28 +1748,121 @@ typedef struct aactor_s {
     struct ascheduler_s* owner;
     acatch_t* error_jmp;
     aframe_t* frame;
+    aframe_t* frames;
+    aint_t max_frames;
+    /// Reductions per slice, 0 to use \ref ascheduler_t::reductions.
+    aint_t reductions;
+    /// Reductions left in the current slice.
+    aint_t budget;
+    /// One of \ref aprio_t, picks the run queue when queued next time.
+    aint_t priority;
     astack_t stack;
-    astack_t msbox;
-    aint_t msg_pp;
+    ambox_t msbox;
     agc_t gc;
 } aactor_t;
 
+/** Buffers of reaped actors, reused by new actors of the default sizes.
+\brief Each list is linked through the first word of its buffers.
+*/
+typedef struct aactor_pool_s {
+    void* stacks;
+    aint_t num_stacks;
+    void* frames;
+    aint_t num_frames;
+    void* heaps;
+    aint_t num_heaps;
+} aactor_pool_t;
+
 /// Process task.
 typedef struct aprocess_task_s {
     alist_node_t node;
     atask_t task;
 } aprocess_task_t;
 
+/// Message sent from another thread, see \ref ascheduler_post.
+typedef struct apost_s {
+    avalue_t v;
+    /// Contents of \ref AVT_STRING, owned by the post, made into `frag` when
+    /// posted.
+    char* s;
+    /// Message with objects if not NULL, then `v` is ignored, owned by post.
+    afrag_t* frag;
+} apost_t;
+
+#ifdef ANY_SMP
+/// Inbox of a dead process, posts to it are dropped, see \ref asmp_post.
+#define ASMP_CLOSED ((afrag_t*)1)
+
+/// States of a process in a worker, see \ref asmp_t.
+typedef enum asmp_state_e {
+    /// Created but not started yet.
+    ASMP_PENDING,
+    /// Queued in `runnings` of its worker.
+    ASMP_RUNNABLE,
+    /// Switched to by its worker, not in any list.
+    ASMP_RUNNING,
+    /// Queued in `waitings` of its worker.
+    ASMP_WAITING
+} asmp_state_t;
+#endif
+
+/// Entry of the timer heap, see \ref ascheduler_t.
+typedef struct atimer_entry_s {
+    aint_t deadline;
+    struct aprocess_s* p;
+} atimer_entry_t;
+
 /// Light-weight process.
 typedef struct aprocess_s {
     int32_t dead;
     apid_t pid;
+    /// Next dead slot in the free list of \ref aprocess_table_t.
+    struct aprocess_s* next_free;
     aactor_t actor;
     aprocess_task_t ptask;
-    aint_t wait_for;
+    /// Absolute \ref atimer_usecs when waiting times out, negative if never.
+    aint_t deadline;
+    /// Index in `timers` of the owner, -1 if not there.
+    aint_t timer_idx;
     int32_t wake_on_msg;
+#ifdef ANY_SMP
+    /// One of \ref asmp_state_t, guarded by the lock of `actor.owner`.
+    int32_t state;
+    /// Set by the actor itself, parked by its worker after switching out.
+    int32_t parking;
+    /** Lock-free stack of posts, newest first, \ref ASMP_CLOSED if dead.
+    \brief Any thread pushes, only the process itself takes them all at once.
+    */
+    afrag_t* inbox;
+#endif
 } aprocess_t;
 
+/// Number of slots per chunk of \ref aprocess_table_t in bits.
+enum { APROCESS_CHUNK_BITS = 8 };
+
+/** Process table indexed by pid.
+\brief
+Slots are added in chunks of `1 << chunk_bits` and never move, the directory of
+chunks is sized for `1 << idx_bits` slots up front so lookups never see it
+moving either. Dead slots are reused in the order they died, that keeps a
+slot unused as long as possible before its generation wraps around.
+*/
+typedef struct aprocess_table_s {
+    aalloc_t alloc;
+    void* alloc_ud;
+    int8_t idx_bits;
+    int8_t gen_bits;
+    int8_t chunk_bits;
+    /// Chunks of slots, NULL if not allocated yet.
+    aprocess_t** chunks;
+    aint_t num_chunks;
+    aint_t max_chunks;
+    /// FIFO of dead slots.
+    aprocess_t* free_head;
+    aprocess_t* free_tail;
+    aint_t num_procs;
+} aprocess_table_t;
+
 /// Fatal error handler.
 typedef void(*aon_panic_t)(
     struct aactor_s*, void* ud);
@@ -1347,18 +1896,46 @@ context of a actor and comeback later, in native side.
 typedef struct ascheduler_s {
     aalloc_t alloc;
     void* alloc_ud;
-    aprocess_t* procs;
-    aint_t num_procs;
+    /// Owned by this or shared by workers of \ref asmp_t.
+    aprocess_table_t* procs;
     aloader_t loader;
-    int8_t idx_bits;
-    int8_t gen_bits;
-    apid_idx_t next_idx;
     aprocess_task_t root;
     alist_t pendings;
-    alist_t runnings;
+    /// Run queues of started processes by priority, see \ref aprio_t.
+    alist_t runnings[APRIO_NUM];
+    aint_t num_runnables;
+    /// Times each run queue was passed over while not empty.
+    aint_t skips[APRIO_NUM];
+    /// Slices left in the current \ref ascheduler_run_once.
+    aint_t slices;
+    /// Woken by a call or its reply, runs next instead of the queue heads.
+    aprocess_t* handoff;
+    /// Handoffs in a row since the run queues were picked from.
+    aint_t num_handoffs;
     alist_t waitings;
+    /// Exited processes, reaped by the next \ref ascheduler_run_once.
+    alist_t exits;
+    aactor_pool_t pool;
+    /// 4-ary min heap of timed waits by deadline.
+    atimer_entry_t* timers;
+    aint_t num_timers;
+    aint_t max_timers;
+    /// Time of the last \ref ascheduler_run_once.
     aint_t timer;
-    int32_t first_run;
+    /// Posts from other threads, newest first.
+    afrag_t* posts;
+    /// Read and write ends of the wakeup pipe, -1 if not created.
+    int32_t wakeup_fds[2];
+    /// TRUE if the wakeup pipe has been written since last drained.
+    int32_t signaled;
+    /// Actor currently running, NULL while the scheduler itself runs.
+    aactor_t* running;
+    /// Default reductions per slice, 0 disables preemption.
+    aint_t reductions;
+#ifdef ANY_PROFILE
+    /// Number of executed instructions per opcode.
+    aint_t opcodes[256];
+#endif
     aon_panic_t on_panic;
     void* on_panic_ud;
     aon_throw_t on_throw;
@@ -1369,4 +1946,42 @@ typedef struct ascheduler_s {
     void* on_exit_ud;
     aon_step_t on_step;
     void* on_step_ud;
+#ifdef ANY_SMP
+    /// Group this scheduler works for, NULL if it runs alone.
+    struct asmp_s* smp;
+    /// Guards `runnings`, `waitings` and states of their processes.
+    pthread_mutex_t lock;
+    pthread_t thread;
+    /// Free fragments for \ref asmp_worker_post, touched by this worker only.
+    afrag_t* spare;
+    /// Fragments released by other threads, pushed back lock-free.
+    afrag_t* returns;
+#endif
 } ascheduler_t;
+
+#ifdef ANY_SMP
+/** Scheduler running actors on many threads.
+\brief
+Each worker is an \ref ascheduler_t driven by its own thread. Actors always
+switch back to the worker which then picks the next one from its `runnings`,
+or steals from the tail of another worker when its queues are empty. Workers
+share `procs` and `loader`, so pids and imports are valid on every worker.
+Actors migrate between threads only while switched out, an actor is never run
+by two workers at once.
+*/
+typedef struct asmp_s {
+    aalloc_t alloc;
+    void* alloc_ud;
+    aloader_t loader;
+    ascheduler_t* workers;
+    int32_t num_workers;
+    aprocess_table_t procs;
+    /// Guards slot allocation and parking of idle workers.
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    int32_t num_idles;
+    int32_t stopped;
+    /// Round robin of \ref asmp_new_actor.
+    int32_t next_worker;
+} asmp_t;
+#endif
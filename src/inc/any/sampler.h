@@ -0,0 +1,63 @@
+/* Copyright (c) 2017 Nguyen Viet Giang. All rights reserved. */
+#pragma once
+
+#include <any/tool_types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// Receives chunks of the folded stacks output.
+typedef void(*asampler_writer_t)(const char* s, aint_t sz, void* ud);
+
+/// Initialize as a new sampler, with room for `max_samples` raw samples.
+ANY_API aerror_t
+asampler_init(
+    asampler_t* self, aalloc_t alloc, void* alloc_ud, ascheduler_t* target,
+    aint_t max_samples);
+
+/// Stop sampling and release all allocated memory.
+ANY_API void
+asampler_cleanup(
+    asampler_t* self);
+
+/** Start sampling every `usecs` of CPU time consumed by the calling thread.
+\brief Driven by `SIGPROF`, only one sampler can be started at a time.
+\note Must be called on the thread which runs the target scheduler, the
+signal is never delivered to other threads.
+*/
+ANY_API aerror_t
+asampler_start(
+    asampler_t* self, aint_t usecs);
+
+/// Stop sampling, already recorded samples are kept.
+ANY_API void
+asampler_stop(
+    asampler_t* self);
+
+/// Record the running actor of target now, this is what the timer calls.
+ANY_API void
+asampler_sample(
+    asampler_t* self);
+
+/// Aggregate recorded samples into folded stacks.
+ANY_API aerror_t
+asampler_collect(
+    asampler_t* self);
+
+/** Write aggregated stacks in folded format.
+\brief Each line is `frame;frame;... count`, outermost frame first, which is
+the input of `flamegraph.pl` and compatible tools.
+*/
+ANY_API void
+asampler_write(
+    asampler_t* self, asampler_writer_t writer, void* ud);
+
+/// Forget aggregated stacks.
+ANY_API void
+asampler_clear(
+    asampler_t* self);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -2,6 +2,7 @@
 #pragma once
 
 #include <any/rt_types.h>
+#include <any/process.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -13,7 +14,8 @@ The `apid_t` consists of two parts are `index` and `generation`, its lengths can
 be configured by `idx_bits` and `gen_bits`. The index will be used to directly
 lookup for a process from array. In additional, the generation part also be used
 to distinguish processes created at the same index slot. That caused by limited
-size of process array so eventually the index will be reused.
+size of process array so eventually the index will be reused. The array grows on
+demand up to `1 << idx_bits` processes, see \ref aprocess_table_t.
 \note This will shadow current thread.
 */
 ANY_API aerror_t
@@ -66,6 +68,28 @@ ascheduler_on_step(
     self->on_step_ud = ud;
 }
 
+/** Set default number of reductions an actor can run before being preempted.
+\brief Calls and backward jumps are counted as reductions, `reductions` = 0
+disables preemption, which is the default.
+*/
+static inline void
+ascheduler_set_reductions(
+    ascheduler_t* self, aint_t reductions)
+{
+    self->reductions = reductions;
+}
+
+/// Loader which resolves imports of actors on this scheduler.
+static inline aloader_t*
+ascheduler_loader(
+    ascheduler_t* self)
+{
+#ifdef ANY_SMP
+    if (self->smp) return &self->smp->loader;
+#endif
+    return &self->loader;
+}
+
 /// Release all processes.
 ANY_API void
 ascheduler_cleanup(
@@ -73,15 +97,15 @@ ascheduler_cleanup(
 
 /** Get alive actor by pid.
 \return NULL if that is not found or died.
+\note Workers of \ref asmp_t share the process table, the actor of another
+worker may die at any time, only \ref any_mbox_send is safe to it.
 */
 static inline aactor_t*
 ascheduler_actor(
     ascheduler_t* self, apid_t pid)
 {
-    apid_idx_t idx = apid_idx(self->idx_bits, pid);
-    aprocess_t* p = self->procs + idx;
-    if (idx >= (apid_idx_t)(1 << self->idx_bits)) return NULL;
-    if (p->pid == pid && !p->dead) return &p->actor;
+    aprocess_t* p = aprocess_table_slot(self->procs, pid);
+    if (p && p->pid == pid && !p->dead) return &p->actor;
     else return NULL;
 }
 
@@ -93,20 +117,16 @@ ascheduler_alloc(
     ascheduler_t* self);
 
 /// Returns this process to the pool.
-static inline void
+ANY_API void
 ascheduler_free(
-    ascheduler_t* self, aprocess_t* p)
-{
-    p->dead = TRUE;
-    --self->num_procs;
-}
+    ascheduler_t* self, aprocess_t* p);
 
 /// Returns number of living processes.
 static inline aint_t
 ascheduler_num_processes(
     ascheduler_t* self)
 {
-    return self->num_procs;
+    return aprocess_table_size(self->procs);
 }
 
 /// Get pid of this actor.
@@ -123,6 +143,45 @@ ANY_API void
 ascheduler_run_once(
     ascheduler_t* self);
 
+/** Run until no actor is runnable.
+\brief Actors which keep yielding keep this running as well.
+*/
+ANY_API void
+ascheduler_run_until_idle(
+    ascheduler_t* self);
+
+/// Returns TRUE if no actor is runnable or exited, and nothing was posted.
+ANY_API int32_t
+ascheduler_is_idle(
+    ascheduler_t* self);
+
+/** Returns how long the host may block before the next run in `usecs`.
+\brief 0 if not idle, -1 if there is no timer, so it depends on posts only.
+*/
+ANY_API aint_t
+ascheduler_timeout(
+    ascheduler_t* self);
+
+/** Returns a file descriptor to poll for readable, -1 if not supported.
+\brief
+It becomes readable after \ref ascheduler_post and is drained by the next
+run, create it before blocking on it the first time.
+*/
+ANY_API int32_t
+ascheduler_wakeup_fd(
+    ascheduler_t* self);
+
+/** Post a message to `pid`, thread safe.
+\brief
+The post is delivered at the beginning of the next run, `post->s` is released
+by the scheduler allocator which must be thread safe, `post->frag` by its own.
+Returns `AERR_FULL` if out of memory, `AERR_RUNTIME` if not supported by this
+platform.
+*/
+ANY_API aerror_t
+ascheduler_post(
+    ascheduler_t* self, apid_t pid, apost_t* post);
+
 /** Suspends this actor, and switch to next.
 \warning Suspends NOT running actor is undefined.
 */
@@ -130,6 +189,22 @@ ANY_API void
 ascheduler_yield(
     ascheduler_t* self, aactor_t* a);
 
+/** Move exited actor `a` to the exit queue, and switch to next.
+\brief
+Only that queue is reaped by the next \ref ascheduler_run_once, a stackful actor
+is never switched back to.
+*/
+ANY_API void
+ascheduler_exit(
+    ascheduler_t* self, aactor_t* a);
+
+/** Called when running actor `a` used up its reductions.
+\brief Yield if preemption is enabled, then start a new slice.
+*/
+ANY_API void
+ascheduler_preempt(
+    ascheduler_t* self, aactor_t* a);
+
 /** Suspends this actor for `usecs`.
 \warning Suspends NOT running actor is undefined.
 */
@@ -144,18 +219,88 @@ ANY_API void
 ascheduler_wait(
     ascheduler_t* self, aactor_t* a, aint_t usecs);
 
+/// Ensures that `timers` can hold `n` timed waits.
+ANY_API aerror_t
+ascheduler_reserve_timers(
+    ascheduler_t* self, aint_t n);
+
+/** Add waiting process `p` to `timers` by its `deadline`.
+\note Space must be reserved by \ref ascheduler_reserve_timers.
+*/
+ANY_API void
+ascheduler_add_timer(
+    ascheduler_t* self, aprocess_t* p);
+
+/// Remove `p` from `timers`, it must be there.
+ANY_API void
+ascheduler_remove_timer(
+    ascheduler_t* self, aprocess_t* p);
+
+/** Take the process of the earliest timer if it expired at `now`.
+\return NULL if there is none.
+*/
+ANY_API aprocess_t*
+ascheduler_pop_timer(
+    ascheduler_t* self, aint_t now);
+
+/// Returns the earliest deadline of sleeping or waiting actors, -1 if none.
+static inline aint_t
+ascheduler_next_deadline(
+    ascheduler_t* self)
+{
+    return self->num_timers > 0 ? self->timers[0].deadline : -1;
+}
+
+/// Queue process `p` to the back of the run queue of its priority.
+static inline void
+ascheduler_push_runnable(
+    ascheduler_t* self, aprocess_t* p)
+{
+    alist_push_back(
+        self->runnings + (APRIO_MAX - p->actor.priority), &p->ptask.node);
+    ++self->num_runnables;
+}
+
+/** Returns the run queue to take the next process from, -1 if all are empty.
+\brief
+That is the highest non-empty one, unless a lower one has been passed over
+\ref APRIO_MAX_SKIPS times, which then takes a slice so it does not starve.
+*/
+ANY_API aint_t
+ascheduler_next_queue(
+    ascheduler_t* self);
+
+/// Take the head of non-empty run queue `q`, see \ref ascheduler_next_queue.
+ANY_API aprocess_t*
+ascheduler_take(
+    ascheduler_t* self, aint_t q);
+
 /// Wake-up this actor if its waiting for incoming message.
 ANY_API void
 ascheduler_got_new_message(
     ascheduler_t* self, aactor_t* a);
 
 /** Create a new actor, and store its pointer to `a`.
+\brief
+`cstack_sz` = 0 creates a stackless actor, which has no native stack and is run
+on the stack of its scheduler, see \ref aactor_resume. It must enter byte code,
+and can not yield, sleep or wait inside a native function.
 \note Must be started manually.
 */
 ANY_API aerror_t
 ascheduler_new_actor(
     ascheduler_t* self, aint_t cstack_sz, aactor_t** a);
 
+/** Create a new actor with initial sizes `opts`, see \ref ascheduler_new_actor.
+\brief
+`opts` may be NULL, which is the same as \ref ascheduler_new_actor. Returns
+`AERR_RUNTIME` if its priority is not one of \ref aprio_t.
+*/
+ANY_API aerror_t
+ascheduler_new_actor_opts(
+    ascheduler_t* self, aint_t cstack_sz, const aactor_opts_t* opts,
+    aactor_t** a);
+
 /// Start actor and invoke the entry point.
 ANY_API void
 ascheduler_start(
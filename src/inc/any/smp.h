@@ -0,0 +1,181 @@
+/* Copyright (c) 2017 Nguyen Viet Giang. All rights reserved. */
+#pragma once
+
+#include <any/rt_types.h>
+#include <any/scheduler.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef ANY_SMP
+
+/** Initialize as a new group of `num_workers` schedulers.
+\brief
+`idx_bits` and `gen_bits` are the same as \ref ascheduler_init, all workers
+allocate pids from one table. `alloc` must be thread safe.
+*/
+ANY_API aerror_t
+asmp_init(
+    asmp_t* self, int32_t num_workers, int8_t idx_bits, int8_t gen_bits,
+    aalloc_t alloc, void* alloc_ud);
+
+/// Release all processes and workers, must not be running.
+ANY_API void
+asmp_cleanup(
+    asmp_t* self);
+
+/// Register fatal error handler of all workers.
+static inline void
+asmp_on_panic(
+    asmp_t* self, aon_panic_t handler, void* ud)
+{
+    int32_t i;
+    for (i = 0; i < self->num_workers; ++i) {
+        ascheduler_on_panic(self->workers + i, handler, ud);
+    }
+}
+
+/// Register exception error handler of all workers.
+static inline void
+asmp_on_throw(
+    asmp_t* self, aon_throw_t handler, void* ud)
+{
+    int32_t i;
+    for (i = 0; i < self->num_workers; ++i) {
+        ascheduler_on_throw(self->workers + i, handler, ud);
+    }
+}
+
+/// Register spawning handler of all workers.
+static inline void
+asmp_on_spawn(
+    asmp_t* self, aon_spawn_t handler, void* ud)
+{
+    int32_t i;
+    for (i = 0; i < self->num_workers; ++i) {
+        ascheduler_on_spawn(self->workers + i, handler, ud);
+    }
+}
+
+/// Register exit handler of all workers.
+static inline void
+asmp_on_exit(
+    asmp_t* self, aon_exit_t handler, void* ud)
+{
+    int32_t i;
+    for (i = 0; i < self->num_workers; ++i) {
+        ascheduler_on_exit(self->workers + i, handler, ud);
+    }
+}
+
+/// See \ref ascheduler_set_reductions.
+static inline void
+asmp_set_reductions(
+    asmp_t* self, aint_t reductions)
+{
+    int32_t i;
+    for (i = 0; i < self->num_workers; ++i) {
+        ascheduler_set_reductions(self->workers + i, reductions);
+    }
+}
+
+/// See \ref ascheduler_actor.
+static inline aactor_t*
+asmp_actor(
+    asmp_t* self, apid_t pid)
+{
+    return ascheduler_actor(self->workers, pid);
+}
+
+/// Returns number of living processes.
+static inline aint_t
+asmp_num_processes(
+    asmp_t* self)
+{
+    return __atomic_load_n(&self->procs.num_procs, __ATOMIC_ACQUIRE);
+}
+
+/** Create a new actor on the next worker in turn.
+\brief See \ref ascheduler_new_actor.
+\note Must be started manually by \ref asmp_start.
+*/
+ANY_API aerror_t
+asmp_new_actor(
+    asmp_t* self, aint_t cstack_sz, aactor_t** a);
+
+/// See \ref asmp_new_actor and \ref ascheduler_new_actor_opts.
+ANY_API aerror_t
+asmp_new_actor_opts(
+    asmp_t* self, aint_t cstack_sz, const aactor_opts_t* opts, aactor_t** a);
+
+/// Start actor and invoke the entry point.
+static inline void
+asmp_start(
+    asmp_t* self, aactor_t* a, aint_t nargs)
+{
+    AUNUSED(self);
+    ascheduler_start(a->owner, a, nargs);
+}
+
+/** Run all workers until there is no living process or \ref asmp_stop.
+\brief The first worker runs on the calling thread, which is shadowed.
+*/
+ANY_API aerror_t
+asmp_run(
+    asmp_t* self);
+
+/// Make \ref asmp_run return after running slices, thread safe.
+ANY_API void
+asmp_stop(
+    asmp_t* self);
+
+/** Post a message to `pid` from any thread, without locking the receiver.
+\brief
+The post is moved to the inbox of that process or released if it died, the
+receiver drains its inbox by \ref asmp_drain. Only the post which finds the
+inbox empty wakes the receiver up. Returns `AERR_FULL` if out of memory.
+*/
+ANY_API aerror_t
+asmp_post(
+    asmp_t* self, apid_t pid, apost_t* post);
+
+/** Same as \ref asmp_post from actor `a`, which is the sender.
+\brief Reuses the fragments freed by the worker running `a`.
+*/
+ANY_API aerror_t
+asmp_worker_post(
+    aactor_t* a, apid_t pid, apost_t* post);
+
+/// Move all posts of running actor `a` to its message box at once.
+ANY_API void
+asmp_drain(
+    aactor_t* a);
+
+/// Take an unused slot from the shared pool, see \ref ascheduler_alloc.
+ANY_API aprocess_t*
+asmp_alloc(
+    asmp_t* self);
+
+/// Return a dead process to the shared pool, see \ref ascheduler_free.
+ANY_API void
+asmp_free(
+    asmp_t* self, aprocess_t* p);
+
+/// Queue a started process to worker `w`.
+ANY_API void
+asmp_ready(
+    ascheduler_t* w, aprocess_t* p);
+
+/** Switch running actor `a` back to its worker `w`.
+\brief `a->owner` may be another worker when this returns.
+*/
+ANY_API void
+asmp_switch(
+    ascheduler_t* w, aactor_t* a);
+
+#endif // ANY_SMP
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
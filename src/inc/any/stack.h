@@ -7,17 +7,20 @@
 extern "C" {
 #endif
 
-/// Initialize as a new stack.
+/** Initialize as a new stack.
+\brief `cap` slots are allocated by the first \ref astack_reserve.
+*/
 static inline aerror_t
 astack_init(
     astack_t* self, aint_t cap, aalloc_t alloc, void* alloc_ud)
 {
     self->alloc = alloc;
     self->alloc_ud = alloc_ud;
-    self->v = (avalue_t*)alloc(alloc_ud, NULL, sizeof(avalue_t)*cap);
+    self->v = NULL;
     self->sp = 0;
-    self->cap = cap;
-    return self->v != NULL ? AERR_NONE : AERR_FULL;
+    self->cap = 0;
+    self->init_cap = cap > 0 ? cap : 1;
+    return AERR_NONE;
 }
 
 /// Release all allocated memory.
@@ -25,8 +28,9 @@ static inline void
 astack_cleanup(
     astack_t* self)
 {
-    self->alloc(self->alloc_ud, self->v, 0);
+    if (self->v) self->alloc(self->alloc_ud, self->v, 0);
     self->v = NULL;
+    self->cap = 0;
 }
 
 /// Ensures that there are `more` bytes in the stack.
@@ -3,6 +3,7 @@
 
 #include <any/rt_types.h>
 #include <any/actor.h>
+#include <any/gc.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -18,6 +19,13 @@ ANY_API aint_t
 agc_buffer_new(
     aactor_t* a, aint_t cap, avalue_t* v);
 
+/** Copy bytes of the buffer if they are shared with other actors.
+\brief Called before writing, see \ref abinary_t.
+*/
+ANY_API void
+any_buffer_unshare(
+    aactor_t* a, aint_t idx);
+
 /// Push new buffer onto the stack.
 static inline void
 any_push_buffer(
@@ -29,7 +37,7 @@ any_push_buffer(
     aactor_push(a, &v);
 }
 
-/// Get buffer pointer.
+/// Get buffer pointer for writing.
 static inline uint8_t*
 any_to_buffer(
     aactor_t* a, aint_t idx)
@@ -37,13 +45,29 @@ any_to_buffer(
     agc_buffer_t* b;
     avalue_t* v = aactor_at(a, idx);
     b = AGC_CAST(agc_buffer_t, &a->gc, v->v.heap_idx);
-    return AGC_CAST(uint8_t, &a->gc, b->buff.v.heap_idx);
+    if (b->bin && abinary_shared(b->bin)) {
+        any_buffer_unshare(a, idx);
+        v = aactor_at(a, idx);
+        b = AGC_CAST(agc_buffer_t, &a->gc, v->v.heap_idx);
+    }
+    return agc_buffer_bytes(&a->gc, b);
 }
 
 /// Check if that is buffer.
 static inline uint8_t*
 any_check_buffer(
     aactor_t* a, aint_t idx)
+{
+    if (any_type(a, idx).type != AVT_BUFFER) {
+        any_error(a, AERR_RUNTIME, "not buffer");
+    }
+    return any_to_buffer(a, idx);
+}
+
+/// Check if that is buffer, bytes may be shared so must not be written.
+static inline const uint8_t*
+any_check_buffer_view(
+    aactor_t* a, aint_t idx)
 {
     agc_buffer_t* b;
     avalue_t* v = aactor_at(a, idx);
@@ -51,7 +75,7 @@ any_check_buffer(
         any_error(a, AERR_RUNTIME, "not buffer");
     }
     b = AGC_CAST(agc_buffer_t, &a->gc, v->v.heap_idx);
-    return AGC_CAST(uint8_t, &a->gc, b->buff.v.heap_idx);
+    return agc_buffer_bytes(&a->gc, b);
 }
 
 /// Returns size of buffer in bytes.
@@ -40,7 +40,9 @@ void* sp;
 
 typedef struct atask_s {
     atask_ctx_t ctx;
+    /// Lowest address of the stack, the guard page if mmap'd.
     void* stack;
+    aint_t stack_sz;
 #ifdef ANY_USE_VALGRIND
     unsigned int vgid;
 #endif
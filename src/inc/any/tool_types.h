@@ -142,6 +142,54 @@ enum {
     (sizeof(((aasm_t*)0)->_context) / sizeof(((aasm_t*)0)->_context[0])) - 1
 };
 
+// Deepest frames recorded by a sample, outer frames are truncated.
+enum { ANY_SAMPLER_MAX_DEPTH = 32 };
+
+/// Sampled frame, `pt` is NULL for native functions.
+typedef struct asample_frame_s {
+    aprototype_t* pt;
+    aint_t ip;
+} asample_frame_t;
+
+/// Raw sample, innermost frame first, `depth` is 0 outside of actors.
+typedef struct asample_s {
+    aint_t depth;
+    asample_frame_t frames[ANY_SAMPLER_MAX_DEPTH];
+} asample_t;
+
+/// Aggregated folded stack.
+typedef struct asampler_stack_s {
+    char* stack;
+    aint_t count;
+    uint32_t hash;
+} asampler_stack_t;
+
+/** Statistical profiler.
+\brief
+A timer signal interrupts whatever is running and records the frames of the
+running actor into a fixed ring of raw samples, which never allocates. Later,
+\ref asampler_collect resolves raw samples into `module:function:line` frames
+and aggregates them by stack, in the folded format that flame graph tools
+consume. The ring must be collected often enough, samples are dropped when it
+is full, and before unloading chunks with \ref aloader_sweep.
+*/
+typedef struct asampler_s {
+    aalloc_t alloc;
+    void* alloc_ud;
+    ascheduler_t* target;
+    asample_t* samples;
+    aint_t max_samples;
+    // written by the signal handler only.
+    volatile aint_t head;
+    // written by asampler_collect only.
+    volatile aint_t tail;
+    volatile aint_t num_dropped;
+    asampler_stack_t* stacks;
+    aint_t num_stacks;
+    aint_t max_stacks;
+    aint_t num_samples;
+} asampler_t;
+
 /** Debug service.
 AVM debug service is the back-end that exposes debugging capabilities over wire.
 Which can be used to debug AVM byte code function that is currently running by
@@ -159,4 +207,5 @@ typedef struct adb_s {
     aint_t res_buf_sz;
     void* req_buf;
     aint_t req_buf_sz;
+    asampler_t* sampler;
 } adb_t;
\ No newline at end of file
@@ -0,0 +1,24 @@
+/* Copyright (c) 2017 Nguyen Viet Giang. All rights reserved. */
+#pragma once
+
+#include <any/rt_types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Verify the instructions of a prototype.
+\brief Abstract interpretation over all reachable instructions, which proves
+that stack depths are consistent, pops never underflow, local, constant,
+import and nested indices are in range, jump targets are valid and execution
+never falls off the end. On success, `pt->verified` is set and `max_stack` and
+`min_args` are recorded, so the dispatcher can skip those checks at run time.
+\note Nested prototypes are not visited.
+*/
+ANY_API aerror_t
+averify_prototype(
+    aprototype_t* pt, aalloc_t alloc, void* alloc_ud);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
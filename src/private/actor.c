@@ -3,17 +3,29 @@
 
 #include <any/loader.h>
 #include <any/scheduler.h>
+#include <any/smp.h>
 #include <any/gc.h>
 #include <any/std_string.h>
 
 #define INIT_STACK_SZ 64
 #define INIT_MSBOX_SZ 32
 #define INIT_HEAP_SZ 512
+#define INIT_FRAME_SZ 16
+
+// `longjmp` value unwinding a stackless actor, errors use 1.
+#define SUSPENDED 2
+
+// Buffers kept in each list of \ref aactor_pool_t.
+#define POOL_MAX 64
 
 void
 actor_dispatch(
     aactor_t* a);
 
+void
+actor_dispatch_resume(
+    aactor_t* a);
+
 static inline void*
 aalloc(
     aactor_t* self, void* old, const aint_t sz)
@@ -22,6 +34,66 @@ aalloc(
     return self->alloc(self->alloc_ud, old, sz);
 }
 
+// Returns NULL if buffers can not be shared with the owner.
+static inline aactor_pool_t*
+pool_of(
+    aactor_t* self)
+{
+#ifdef ANY_SMP
+    // actors are spawned and reaped across workers.
+    if (self->owner->smp) return NULL;
+#endif
+    return &self->owner->pool;
+}
+
+static inline void*
+pool_take(
+    void** head, aint_t* num)
+{
+    void* b = *head;
+    if (!b) return NULL;
+    *head = *(void**)b;
+    --*num;
+    return b;
+}
+
+static inline void
+pool_put(
+    void** head, aint_t* num, void* b)
+{
+    *(void**)b = *head;
+    *head = b;
+    ++*num;
+}
+
+static void
+pool_drain(
+    void** head, aint_t* num, aalloc_t alloc, void* alloc_ud)
+{
+    void* b;
+    while ((b = pool_take(head, num)) != NULL) alloc(alloc_ud, b, 0);
+}
+
+// Move default sized buffers of `self` to `pool`.
+static void
+recycle(
+    aactor_t* self, aactor_pool_t* pool)
+{
+    if (self->stack.v && self->stack.cap == INIT_STACK_SZ &&
+        pool->num_stacks < POOL_MAX) {
+        pool_put(&pool->stacks, &pool->num_stacks, self->stack.v);
+        self->stack.v = NULL;
+    }
+    if (self->frames && self->max_frames == INIT_FRAME_SZ &&
+        pool->num_frames < POOL_MAX) {
+        pool_put(&pool->frames, &pool->num_frames, self->frames);
+        self->frames = NULL;
+    }
+    if (self->gc.heap_cap == INIT_HEAP_SZ && pool->num_heaps < POOL_MAX) {
+        pool_put(&pool->heaps, &pool->num_heaps, agc_detach(&self->gc));
+    }
+}
+
 static void
 call(
     aactor_t* self, void* ud)
@@ -29,18 +101,36 @@ call(
     any_call(self, *(aint_t*)ud);
 }
 
-static inline void
-save_ctx(
-    aactor_t* a, aframe_t* frame, aint_t nargs)
+aframe_t*
+actor_push_frame(
+    aactor_t* a, aint_t nargs)
 {
-    frame->prev = a->frame;
-    a->frame = frame;
+    aint_t depth = a->frame - a->frames;
+    aframe_t* frame;
+    if (depth + 1 == a->max_frames) {
+        aint_t max_frames = a->max_frames * 2;
+        aframe_t* old = a->frames;
+        aframe_t* frames = (aframe_t*)aalloc(
+            a, NULL, max_frames * sizeof(aframe_t));
+        if (!frames) any_error(a, AERR_RUNTIME, "out of memory");
+        memcpy(frames, old, (size_t)(depth + 1) * sizeof(aframe_t));
+        // the sampler keeps walking the old frames until all is published.
+        *(aframe_t* volatile*)&a->frames = frames;
+        *(volatile aint_t*)&a->max_frames = max_frames;
+        *(aframe_t* volatile*)&a->frame = frames + depth;
+        aalloc(a, old, 0);
+    }
+    // the new frame is initialized before being published.
+    frame = a->frames + depth + 1;
+    memset(frame, 0, sizeof(aframe_t));
     frame->bp = a->stack.sp;
     frame->nargs = nargs;
+    *(aframe_t* volatile*)&a->frame = frame;
+    return frame;
 }
 
-static inline void
-load_ctx(
+void
+actor_pop_frame(
     aactor_t* a)
 {
     aint_t nsp = a->frame->bp - a->frame->nargs;
@@ -49,47 +139,79 @@ load_ctx(
     }
     a->stack.v[nsp - 1] = a->stack.v[a->stack.sp - 1];
     a->stack.sp = nsp;
-    a->frame = a->frame->prev;
+    --a->frame;
 }
 
 void ASTDCALL
 actor_entry(
     void* ud)
 {
-	aframe_t frame;
     aactor_t* a = (aactor_t*)ud;
     aint_t nargs = a->stack.v[--a->stack.sp].v.integer;
-	memset(&frame, 0, sizeof(aframe_t));
-	a->frame = &frame;
-	any_protected_call(a, nargs);
+    a->owner->running = a;
+    a->frame = a->frames;
+    memset(a->frame, 0, sizeof(aframe_t));
+    any_protected_call(a, nargs);
     a->flags |= APF_EXIT;
     if (a->owner->on_exit) {
         a->owner->on_exit(a, a->owner->on_exit_ud);
     }
+    // never resumed, the reaper deletes this task.
     for (;;) {
-        ascheduler_yield(a->owner, a);
+        ascheduler_exit(a->owner, a);
     }
 }
 
 aerror_t
 aactor_init(
-    aactor_t* self, ascheduler_t* owner, aalloc_t alloc, void* alloc_ud)
+    aactor_t* self, ascheduler_t* owner, const aactor_opts_t* opts,
+    aalloc_t alloc, void* alloc_ud)
 {
     aerror_t ec;
+    aint_t stack_sz = opts && opts->stack_sz > 0 ?
+        opts->stack_sz : INIT_STACK_SZ;
+    aint_t msbox_sz = opts && opts->msbox_sz > 0 ?
+        opts->msbox_sz : INIT_MSBOX_SZ;
+    aint_t heap_sz = opts && opts->heap_sz > 0 ?
+        opts->heap_sz : INIT_HEAP_SZ;
+    aint_t priority = opts ? opts->priority : APRIO_NORMAL;
+    aactor_pool_t* pool;
+    if (priority < APRIO_LOW || priority > APRIO_MAX) return AERR_RUNTIME;
     memset(self, 0, sizeof(aactor_t));
     self->owner = owner;
     self->alloc = alloc;
     self->alloc_ud = alloc_ud;
-    ec = astack_init(&self->stack, INIT_STACK_SZ, alloc, alloc_ud);
+    self->priority = priority;
+    // stacks and heap are allocated on first use.
+    ec = astack_init(&self->stack, stack_sz, alloc, alloc_ud);
     if (ec != AERR_NONE) goto failed;
-    ec = astack_init(&self->msbox, INIT_MSBOX_SZ, alloc, alloc_ud);
+    ec = ambox_init(&self->msbox, msbox_sz, alloc, alloc_ud);
     if (ec != AERR_NONE) goto failed;
-    ec = agc_init(&self->gc, INIT_HEAP_SZ, alloc, alloc_ud);
+    ec = agc_init(&self->gc, heap_sz, alloc, alloc_ud);
     if (ec != AERR_NONE) goto failed;
+    pool = pool_of(self);
+    if (pool) {
+        if (stack_sz == INIT_STACK_SZ) {
+            self->stack.v = (avalue_t*)pool_take(
+                &pool->stacks, &pool->num_stacks);
+            if (self->stack.v) self->stack.cap = INIT_STACK_SZ;
+        }
+        self->frames = (aframe_t*)pool_take(&pool->frames, &pool->num_frames);
+    }
+    if (!self->frames) self->frames = (aframe_t*)aalloc(
+        self, NULL, INIT_FRAME_SZ * sizeof(aframe_t));
+    if (!self->frames) {
+        agc_cleanup(&self->gc);
+        ec = AERR_FULL;
+        goto failed;
+    }
+    self->max_frames = INIT_FRAME_SZ;
+    self->frame = self->frames;
+    memset(self->frame, 0, sizeof(aframe_t));
     return ec;
 failed:
     astack_cleanup(&self->stack);
-    astack_cleanup(&self->msbox);
+    ambox_cleanup(&self->msbox);
     return ec;
 }
 
@@ -97,9 +219,100 @@ void
 aactor_cleanup(
     aactor_t* self)
 {
+    aactor_pool_t* pool = pool_of(self);
+    if (pool) recycle(self, pool);
     astack_cleanup(&self->stack);
-    astack_cleanup(&self->msbox);
+    ambox_cleanup(&self->msbox);
     agc_cleanup(&self->gc);
+    if (self->frames) aalloc(self, self->frames, 0);
+    self->frames = NULL;
+    self->frame = NULL;
+    self->max_frames = 0;
+}
+
+// Call the byte code entry point of a stackless actor.
+static void
+enter_stackless(
+    aactor_t* a, aint_t nargs)
+{
+    aint_t fp = a->stack.sp - nargs - 1;
+    if (fp < 0 || a->stack.v[fp].tag.type != AVT_BYTE_CODE_FUNC) {
+        any_error(a, AERR_RUNTIME, "stackless actor must enter byte code");
+    }
+    actor_push_frame(a, nargs)->pt = a->stack.v[fp].v.avm_func;
+    actor_dispatch(a);
+}
+
+void
+aactor_resume(
+    aactor_t* a)
+{
+    acatch_t c;
+    avalue_t ev;
+    const int32_t first = a->frame == a->frames;
+    aint_t nargs = 0;
+    if (first) {
+        nargs = a->stack.v[--a->stack.sp].v.integer;
+        memset(a->frame, 0, sizeof(aframe_t));
+    }
+    c.prev = NULL;
+    c.status = AERR_NONE;
+    a->error_jmp = &c;
+    switch (setjmp(c.jbuff)) {
+    case 0:
+        if (first) enter_stackless(a, nargs);
+        else actor_dispatch_resume(a);
+        actor_pop_frame(a);
+        // same as left by any_protected_call.
+        av_nil(&ev);
+        aactor_push(a, &ev);
+        break;
+    case SUSPENDED:
+        a->error_jmp = NULL;
+        return;
+    default:
+        // stack is reset as by a panic in any_protected_call.
+        ev = a->stack.v[a->stack.sp - 1];
+        a->frame = a->frames;
+        a->stack.v[0] = ev;
+        a->stack.sp = 1;
+        break;
+    }
+    a->error_jmp = NULL;
+    a->flags |= APF_EXIT;
+    if (a->owner->on_exit) {
+        a->owner->on_exit(a, a->owner->on_exit_ud);
+    }
+    ascheduler_exit(a->owner, a);
+}
+
+void
+aactor_pool_cleanup(
+    aactor_pool_t* self, aalloc_t alloc, void* alloc_ud)
+{
+    pool_drain(&self->stacks, &self->num_stacks, alloc, alloc_ud);
+    pool_drain(&self->frames, &self->num_frames, alloc, alloc_ud);
+    pool_drain(&self->heaps, &self->num_heaps, alloc, alloc_ud);
+}
+
+int32_t
+aactor_suspendable(
+    aactor_t* a)
+{
+    aframe_t* f;
+    if (a->frame == a->frames) return FALSE;
+    for (f = a->frames + 1; f <= a->frame; ++f) {
+        if (f->pt == NULL) return FALSE;
+    }
+    return TRUE;
+}
+
+void
+aactor_suspend(
+    aactor_t* a)
+{
+    assert(aactor_suspendable(a));
+    longjmp(a->error_jmp->jbuff, SUSPENDED);
 }
 
 void
@@ -107,7 +320,7 @@ any_import(
     aactor_t* a, const char* module, const char* name)
 {
     avalue_t v;
-    aerror_t ec = aloader_find(&a->owner->loader, module, name, &v);
+    aerror_t ec = aloader_find(ascheduler_loader(a->owner), module, name, &v);
     if (ec != AERR_NONE) any_push_nil(a);
     else aactor_push(a, &v);
 }
@@ -116,32 +329,31 @@ void
 any_call(
     aactor_t* a, aint_t nargs)
 {
-    aframe_t frame;
     aint_t fp = a->stack.sp - nargs - 1;
-    avalue_t* f = a->stack.v + fp;
+    avalue_t f;
 
     if (fp < a->frame->bp) {
         any_error(a, AERR_RUNTIME, "no function to call");
     }
 
-    if (f->tag.type != AVT_NATIVE_FUNC && f->tag.type != AVT_BYTE_CODE_FUNC) {
+    f = a->stack.v[fp];
+    if (f.tag.type != AVT_NATIVE_FUNC && f.tag.type != AVT_BYTE_CODE_FUNC) {
         any_error(a, AERR_RUNTIME, "attempt to call a non-function");
     }
 
-    memset(&frame, 0, sizeof(aframe_t));
-    save_ctx(a, &frame, nargs);
+    actor_push_frame(a, nargs);
 
-    switch (f->tag.type) {
+    switch (f.tag.type) {
     case AVT_NATIVE_FUNC:
-        f->v.func(a);
+        f.v.func(a);
         break;
     case AVT_BYTE_CODE_FUNC:
-        frame.pt = f->v.avm_func;
+        a->frame->pt = f.v.avm_func;
         actor_dispatch(a);
         break;
     }
 
-    load_ctx(a);
+    actor_pop_frame(a);
 }
 
 void
@@ -161,6 +373,50 @@ any_protected_call(
     aactor_push(a, &ev);
 }
 
+/** Copy `n` values of `v` and objects they refer into the heap of `ta`.
+\brief
+The copies are written to `out`. All objects are staged in the free semi-space
+of `a` first, so the heap of `ta` is reserved once. `v` must be reachable by
+the collector of `a`, which may run if `ta` is `a`.
+*/
+static aerror_t
+copy_values(
+    aactor_t* a, aactor_t* ta, const avalue_t* v, avalue_t* out, aint_t n)
+{
+    aint_t sz;
+    memcpy(out, v, sizeof(avalue_t) * (size_t)n);
+    sz = agc_stage(&a->gc, out, n);
+    if (sz == 0) return AERR_NONE;
+    if (aactor_heap_reserve(ta, sz, 0) != AERR_NONE) return AERR_FULL;
+    if (ta == a) {
+        // staged copies are gone if it was collected.
+        memcpy(out, v, sizeof(avalue_t) * (size_t)n);
+        agc_stage(&a->gc, out, n);
+    }
+    agc_copy_in(&ta->gc, a->gc.new_heap, sz, out, n);
+    return AERR_NONE;
+}
+
+#ifdef ANY_SMP
+// Target may run on another worker, leave its heap to itself.
+static void
+post(
+    aactor_t* a, apid_t pid, avalue_t* msg)
+{
+    apost_t p;
+    p.v = *msg;
+    p.s = NULL;
+    p.frag = NULL;
+    if (msg->tag.collectable) {
+        p.frag = agc_frag_new(&a->gc, msg);
+        if (!p.frag) any_error(a, AERR_RUNTIME, "out of memory");
+    }
+    if (asmp_worker_post(a, pid, &p) != AERR_NONE) {
+        any_error(a, AERR_RUNTIME, "out of memory");
+    }
+}
+#endif
+
 void
 any_mbox_send(
     aactor_t* a)
@@ -174,51 +430,81 @@ any_mbox_send(
     if (pid->tag.type != AVT_PID) {
         any_error(a, AERR_RUNTIME, "target must be a pid");
     }
+#ifdef ANY_SMP
+    if (a->owner->smp) {
+        post(a, pid->v.pid, msg);
+        return;
+    }
+#endif
     ta = ascheduler_actor(a->owner, pid->v.pid);
     if (!ta) return;
-    if (astack_reserve(&ta->msbox, 1) != AERR_NONE) {
+    if (ambox_reserve(&ta->msbox, 1) != AERR_NONE) {
         any_error(a, AERR_RUNTIME, "out of memory");
     }
-    switch (msg->tag.type) {
-    case AVT_NIL:
-    case AVT_PID:
-    case AVT_BOOLEAN:
-    case AVT_INTEGER:
-    case AVT_REAL:
-        ta->msbox.v[ta->msbox.sp] = *msg;
-        break;
-    case AVT_STRING:
-        if (AERR_NONE != agc_string_new(
-            ta,
-            agc_string_to_cstr(a, msg),
-            ta->msbox.v + ta->msbox.sp)) {
-            return; // TODO: review it
-        }
-        break;
-    case AVT_NATIVE_FUNC:
-    case AVT_BYTE_CODE_FUNC:
-    case AVT_FIXED_BUFFER:
-    case AVT_BUFFER:
-    case AVT_TUPLE:
-    case AVT_ARRAY:
-    case AVT_TABLE:
-        any_error(a, AERR_RUNTIME, "not supported type");
-        break;
+    // the heap of `ta` is left to itself, see \ref afrag_t.
+    if (msg->tag.collectable) {
+        afrag_t* frag = agc_frag_new(&a->gc, msg);
+        if (!frag) any_error(a, AERR_RUNTIME, "out of memory");
+        av_nil(ambox_slot(&ta->msbox));
+        ambox_push_frag(&ta->msbox, frag, ascheduler_pid(a->owner, a));
+    } else {
+        *ambox_slot(&ta->msbox) = *msg;
+        ambox_push(&ta->msbox, ascheduler_pid(a->owner, a));
     }
-    ++ta->msbox.sp;
     ascheduler_got_new_message(a->owner, ta);
 }
 
+// Copy objects of the message in cell `c` into the heap, if not there yet.
+static void
+merge(
+    aactor_t* a, aint_t c)
+{
+    afrag_t* frag = a->msbox.frags[c];
+    if (!frag) return;
+    if (aactor_heap_reserve(a, frag->sz, 0) != AERR_NONE) {
+        any_error(a, AERR_RUNTIME, "out of memory");
+    }
+    // may be merged already by collecting.
+    frag = ambox_take_frag(&a->msbox, c);
+    if (!frag) return;
+    agc_frag_merge(&a->gc, frag, a->msbox.v + c);
+    afrag_free(frag);
+}
+
+static void
+merge_all(
+    aactor_t* a)
+{
+    aint_t c;
+    for (c = 0; c < a->msbox.num_cells; ++c) {
+        afrag_t* frag = ambox_take_frag(&a->msbox, c);
+        if (!frag) continue;
+        agc_frag_merge(&a->gc, frag, a->msbox.v + c);
+        afrag_free(frag);
+    }
+}
+
 aerror_t
 any_mbox_recv(
     aactor_t* a, aint_t timeout)
 {
+    if (a->flags & APF_WOKEN) {
+        // the receive is run again after waiting.
+        a->flags &= ~APF_WOKEN;
+        timeout = ADONT_WAIT;
+    }
     for (;;) {
-        if (a->msg_pp < a->msbox.sp) {
+        avalue_t* msg;
+#ifdef ANY_SMP
+        if (a->owner->smp) asmp_drain(a);
+#endif
+        msg = ambox_peek(&a->msbox);
+        if (msg) {
             if (a->stack.sp <= a->frame->bp) {
                 any_error(a, AERR_RUNTIME, "receive to empty stack");
             }
-            a->stack.v[a->stack.sp - 1] = a->msbox.v[a->msg_pp++];
+            merge(a, a->msbox.cur);
+            a->stack.v[a->stack.sp - 1] = a->msbox.v[a->msbox.cur];
             return AERR_NONE;
         } else {
             if (timeout == ADONT_WAIT) {
@@ -231,22 +517,49 @@ any_mbox_recv(
     }
 }
 
+aerror_t
+any_mbox_call(
+    aactor_t* a, aint_t timeout)
+{
+    ambox_t* const mb = &a->msbox;
+    aint_t const mark = mb->mark;
+    aint_t const peek = mb->peek;
+    aint_t const prev = mb->prev;
+    aint_t const cur = mb->cur;
+    aint_t const deadline = timeout > 0 ? atimer_usecs() + timeout : timeout;
+    aint_t callee;
+    aerror_t ec;
+    // the reply is after messages queued so far, which are left as they are.
+    any_mbox_mark(a);
+    a->flags |= APF_CALLING;
+    any_mbox_send(a);
+    // popped by sending, still there and checked to be a pid.
+    callee = a->stack.v[a->stack.sp].v.pid;
+    any_push_nil(a);
+    // messages from others meanwhile are left after the marker.
+    while ((ec = any_mbox_recv(a, timeout)) == AERR_NONE &&
+        mb->from[mb->cur] != callee) {
+        if (deadline <= 0) continue;
+        timeout = deadline - atimer_usecs();
+        if (timeout <= 0) timeout = ADONT_WAIT;
+    }
+    a->flags &= ~APF_CALLING;
+    if (ec == AERR_NONE) any_mbox_remove(a);
+    else av_nil(a->stack.v + a->stack.sp - 1);
+    // resume the receive in progress, if any.
+    mb->mark = mark;
+    mb->peek = peek;
+    mb->prev = prev;
+    mb->cur = cur;
+    return ec;
+}
+
 void
 any_mbox_remove(
     aactor_t* a)
 {
-    if (a->msg_pp <= 0) {
+    if (!ambox_remove(&a->msbox)) {
         any_error(a, AERR_RUNTIME, "no message to remove");
-    } else {
-        aint_t num_tails = a->msbox.sp - a->msg_pp;
-        if (num_tails != 0) {
-            memmove(
-                a->msbox.v + a->msg_pp - 1,
-                a->msbox.v + a->msg_pp,
-                sizeof(avalue_t) * (size_t)num_tails);
-        }
-        a->msg_pp = 0;
-        --a->msbox.sp;
     }
 }
 
@@ -254,7 +567,18 @@ void
 any_mbox_rewind(
     aactor_t* a)
 {
-    a->msg_pp = 0;
+    ambox_rewind(&a->msbox);
+}
+
+void
+any_mbox_mark(
+    aactor_t* a)
+{
+#ifdef ANY_SMP
+    // posts already sent are before the marker.
+    if (a->owner->smp) asmp_drain(a);
+#endif
+    ambox_mark(&a->msbox);
 }
 
 void
@@ -276,7 +600,7 @@ any_try(
     aactor_t* a, void(*f)(aactor_t*, void*), void* ud)
 {
     aint_t sp = a->stack.sp;
-    aframe_t* frame = a->frame;
+    aint_t depth = a->frame - a->frames;
     avalue_t ev;
     acatch_t c;
     c.status = AERR_NONE;
@@ -286,7 +610,7 @@ any_try(
     if (c.status != AERR_NONE) {
         ev = a->stack.v[a->stack.sp - 1];
         a->stack.sp = sp;
-        a->frame = frame;
+        a->frame = a->frames + depth;
     } else {
         ev.tag.type = AVT_NIL;
     }
@@ -330,15 +654,19 @@ void
 aactor_gc(
     aactor_t* a)
 {
-    avalue_t* roots[] = {
-        a->stack.v,
-        a->msbox.v,
-        NULL
-    };
-    aint_t num_roots[] = {
-        a->stack.sp,
-        a->msbox.sp
-    };
+    avalue_t* roots[3];
+    aint_t num_roots[2];
+    aint_t n = 0;
+    // roots are NULL terminated, skip stacks which are not allocated yet.
+    if (a->stack.v) {
+        roots[n] = a->stack.v;
+        num_roots[n++] = a->stack.sp;
+    }
+    if (a->msbox.v) {
+        roots[n] = a->msbox.v;
+        num_roots[n++] = a->msbox.num_cells;
+    }
+    roots[n] = NULL;
     agc_collect(&a->gc, roots, num_roots);
 }
 
@@ -346,8 +674,23 @@ aerror_t
 aactor_heap_reserve(
     aactor_t* self, aint_t more, aint_t n)
 {
+    if (self->gc.heap_cap == 0 && self->gc.init_cap == INIT_HEAP_SZ) {
+        aactor_pool_t* pool = pool_of(self);
+        uint8_t* heap = pool ?
+            (uint8_t*)pool_take(&pool->heaps, &pool->num_heaps) : NULL;
+        if (heap) agc_attach(&self->gc, heap, INIT_HEAP_SZ);
+    }
     if (agc_check(&self->gc, more, n) == FALSE) {
+        // nothing to collect before the first allocation.
+        if (self->gc.heap_cap == 0) return agc_reserve(&self->gc, more, n);
         aactor_gc(self);
+        // take in fragments while the heap is compact anyway.
+        if (self->msbox.frags_sz > 0 && (
+            agc_check(&self->gc, more + self->msbox.frags_sz, n) ||
+            agc_reserve(
+                &self->gc, more + self->msbox.frags_sz, n) == AERR_NONE)) {
+            merge_all(self);
+        }
         if (agc_check(&self->gc, more, n) == FALSE) {
             return agc_reserve(&self->gc, more, n);
         }
@@ -358,30 +701,27 @@ aactor_heap_reserve(
 void
 any_spawn(
     aactor_t* a, aint_t cstack_sz, aint_t nargs, apid_t* pid)
+{
+    any_spawn_opts(a, cstack_sz, NULL, nargs, pid);
+}
+
+void
+any_spawn_opts(
+    aactor_t* a, aint_t cstack_sz, const aactor_opts_t* opts, aint_t nargs,
+    apid_t* pid)
 {
     aactor_t* na;
-    aint_t i;
-    aerror_t ec = ascheduler_new_actor(a->owner, cstack_sz, &na);
+    aerror_t ec = ascheduler_new_actor_opts(a->owner, cstack_sz, opts, &na);
     if (ec != AERR_NONE) {
         any_error(a, ec, "failed to create actor");
     }
-    for (i = 0; i < nargs + 1; ++i) {
-        avalue_t* v = a->stack.v + a->stack.sp - nargs - 1 + i;
-        switch (v->tag.type) {
-        case AVT_NIL:
-        case AVT_PID:
-        case AVT_BOOLEAN:
-        case AVT_INTEGER:
-        case AVT_REAL:
-        case AVT_NATIVE_FUNC:
-        case AVT_BYTE_CODE_FUNC:
-            aactor_push(na, v);
-            break;
-        default:
-            any_error(a, AERR_RUNTIME, "not supported type");
-            break;
-        }
+    if (astack_reserve(&na->stack, nargs + 1) != AERR_NONE ||
+        copy_values(
+            a, na, a->stack.v + a->stack.sp - nargs - 1,
+            na->stack.v + na->stack.sp, nargs + 1) != AERR_NONE) {
+        any_error(a, AERR_RUNTIME, "out of memory");
     }
+    na->stack.sp += nargs + 1;
     any_pop(a, nargs + 1);
     ascheduler_start(a->owner, na, nargs);
     *pid = ascheduler_pid(na->owner, na);
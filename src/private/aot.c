@@ -0,0 +1,522 @@
+/* Copyright (c) 2017 Nguyen Viet Giang. All rights reserved. */
+#include <any/aot.h>
+
+#include <ctype.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+
+typedef struct aaot_s {
+    aprototype_t* module;
+    aalloc_t alloc;
+    void* alloc_ud;
+    aaot_writer_t writer;
+    void* ud;
+} aaot_t;
+
+static void
+out(
+    aaot_t* self, const char* fmt, ...)
+{
+    char buf[256];
+    int n;
+    va_list args;
+    va_start(args, fmt);
+    n = vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    if (n < 0) return;
+    if (n >= (int)sizeof(buf)) n = (int)sizeof(buf) - 1;
+    self->writer(buf, (aint_t)n, self->ud);
+}
+
+static void
+out_raw(
+    aaot_t* self, const char* s)
+{
+    self->writer(s, (aint_t)strlen(s), self->ud);
+}
+
+// Write `s` as a C identifier, invalid characters become `_`.
+static void
+out_ident(
+    aaot_t* self, const char* s)
+{
+    for (; *s; ++s) {
+        char c = isalnum((unsigned char)*s) ? *s : '_';
+        self->writer(&c, 1, self->ud);
+    }
+}
+
+// Write `s` as a C string literal.
+static void
+out_string(
+    aaot_t* self, const char* s)
+{
+    self->writer("\"", 1, self->ud);
+    for (; *s; ++s) {
+        unsigned char c = (unsigned char)*s;
+        switch (c) {
+        case '\\': self->writer("\\\\", 2, self->ud); break;
+        case '"':  self->writer("\\\"", 2, self->ud); break;
+        case '\n': self->writer("\\n", 2, self->ud); break;
+        case '\r': self->writer("\\r", 2, self->ud); break;
+        case '\t': self->writer("\\t", 2, self->ud); break;
+        default:
+            // octal escapes never swallow the following characters.
+            if (c < 0x20 || c >= 0x7F) {
+                out(self, "\\%03o", c);
+            } else {
+                self->writer((const char*)&c, 1, self->ud);
+            }
+            break;
+        }
+    }
+    self->writer("\"", 1, self->ud);
+}
+
+// Generated functions are named after the index of their prototype in chunk.
+static aint_t
+func_id(
+    aaot_t* self, aprototype_t* pt)
+{
+    return (aint_t)(pt - self->module);
+}
+
+static int32_t
+all_verified(
+    aprototype_t* pt)
+{
+    aint_t i;
+    for (i = 0; i < pt->header->num_nesteds; ++i) {
+        aprototype_t* nested = pt->nesteds + i;
+        if (!nested->verified || !all_verified(nested)) return FALSE;
+    }
+    return TRUE;
+}
+
+static void
+declare(
+    aaot_t* self, aprototype_t* pt)
+{
+    aint_t i;
+    for (i = 0; i < pt->header->num_nesteds; ++i) {
+        out(self, "static void aot_%lld(aactor_t* a);\n",
+            (long long int)func_id(self, pt->nesteds + i));
+        declare(self, pt->nesteds + i);
+    }
+}
+
+// Returns the module function imported by `imp`, or NULL if it is foreign.
+static aprototype_t*
+find_local(
+    aaot_t* self, aprototype_t* pt, const aimport_t* imp)
+{
+    aprototype_t* m = self->module;
+    aint_t i;
+    if (strcmp(pt->strings + imp->module, m->strings + m->header->symbol)) {
+        return NULL;
+    }
+    for (i = 0; i < m->header->num_nesteds; ++i) {
+        aprototype_t* f = m->nesteds + i;
+        if (strcmp(pt->strings + imp->name, f->strings + f->header->symbol)) {
+            continue;
+        }
+        return f;
+    }
+    return NULL;
+}
+
+static void
+out_constant(
+    aaot_t* self, aprototype_t* pt, const aconstant_t* c)
+{
+    switch (c->type) {
+    case ACT_INTEGER: {
+        aint_t val = c->integer;
+        if (val == INT64_MIN) {
+            out(self, "    aaot_integer(a, INT64_MIN);\n");
+        } else {
+            out(self, "    aaot_integer(a, %lldLL);\n", (long long int)val);
+        }
+        break;
+    }
+    case ACT_REAL: {
+        double val = c->real;
+        if (isnan(val)) {
+            out(self, "    aaot_real(a, NAN);\n");
+        } else if (isinf(val)) {
+            out(self, "    aaot_real(a, %sHUGE_VAL);\n", val < 0 ? "-" : "");
+        } else {
+            // hexadecimal floating point is exact.
+            out(self, "    aaot_real(a, %a);\n", val);
+        }
+        break;
+    }
+    default:
+        out(self, "    any_push_string(a, ");
+        out_string(self, pt->strings + c->string);
+        out(self, ");\n");
+        break;
+    }
+}
+
+// Jump to `target` if `cond`, or always if NULL, backward jumps count a
+// reduction.
+static void
+out_branch(
+    aaot_t* self, const char* cond, aint_t ip, aint_t target)
+{
+    if (cond == NULL) {
+        if (target <= ip) out(self, "    aaot_reduce(a);\n");
+        out(self, "    goto l%lld;\n", (long long int)target);
+    } else if (target <= ip) {
+        out(self, "    if (%s) {\n", cond);
+        out(self, "        aaot_reduce(a);\n");
+        out(self, "        goto l%lld;\n", (long long int)target);
+        out(self, "    }\n");
+    } else {
+        out(self, "    if (%s) goto l%lld;\n", cond, (long long int)target);
+    }
+}
+
+static aint_t
+jump_target(
+    const ainstruction_t* i, aint_t ip)
+{
+    switch (i->b.opcode) {
+    case AOC_JMP: return ip + i->jmp.displacement + 1;
+    case AOC_JIN: return ip + i->jin.displacement + 1;
+    case AOC_RCV: return ip + i->rcv.displacement + 1;
+    case AOC_JLT:
+    case AOC_JLE:
+    case AOC_JGT:
+    case AOC_JGE:
+        return ip + i->jlt.displacement + 1;
+    default:
+        return -1;
+    }
+}
+
+/*
+TRUE if the function called by `tvk` at `ip` is `pt` itself. The instruction
+which pushed it is found by walking back within the same block, until a jump
+target where stacks of other paths join.
+*/
+static int32_t
+self_tail(
+    aaot_t* self, aprototype_t* pt, const uint8_t* targets, aint_t ip)
+{
+    aint_t depth = pt->instructions[ip].tvk.nargs;
+    aint_t k;
+    if (depth < 0) return FALSE;
+    for (k = ip - 1; k >= 0 && !targets[k + 1]; --k) {
+        const ainstruction_t* i = pt->instructions + k;
+        aint_t pops = 0;
+        aint_t pushes = 0;
+        switch (i->b.opcode) {
+        case AOC_NOP:
+        case AOC_BRK:
+        case AOC_RMV:
+        case AOC_RWD:
+        case AOC_MRK:
+        case AOC_INC:
+            break;
+        case AOC_POP:
+            pops = i->pop.n;
+            break;
+        case AOC_LDK:
+        case AOC_NIL:
+        case AOC_LDB:
+        case AOC_LSI:
+        case AOC_LLV:
+        case AOC_IMP:
+        case AOC_CLS:
+        case AOC_ADD_LL:
+            pushes = 1;
+            break;
+        case AOC_SLV:
+        case AOC_JIN:
+        case AOC_JLT:
+        case AOC_JLE:
+        case AOC_JGT:
+        case AOC_JGE:
+            pops = 1;
+            break;
+        case AOC_IVK:
+            if (i->ivk.nargs < 0) return FALSE;
+            pops = i->ivk.nargs + 1;
+            pushes = 1;
+            break;
+        case AOC_SND:
+            pops = 2;
+            break;
+        case AOC_RCV:
+        case AOC_NOT:
+        case AOC_ADDI:
+            pops = 1;
+            pushes = 1;
+            break;
+        case AOC_ADD:
+        case AOC_SUB:
+        case AOC_MUL:
+        case AOC_DIV:
+        case AOC_EQ:
+        case AOC_LT:
+        case AOC_LE:
+        case AOC_GT:
+        case AOC_GE:
+            pops = 2;
+            pushes = 1;
+            break;
+        default:
+            return FALSE;
+        }
+        if (depth < pushes) {
+            return i->b.opcode == AOC_IMP &&
+                find_local(self, pt, pt->imports + i->imp.idx) == pt;
+        }
+        depth += pops - pushes;
+    }
+    return FALSE;
+}
+
+static aerror_t
+translate_instruction(
+    aaot_t* self, aprototype_t* pt, aint_t ip)
+{
+    static const char* const BINARIES[] = {
+        [AOC_ADD] = "add", [AOC_SUB] = "sub", [AOC_MUL] = "mul",
+        [AOC_DIV] = "div", [AOC_EQ] = "eq",
+        [AOC_LT] = "lt", [AOC_LE] = "le", [AOC_GT] = "gt", [AOC_GE] = "ge"
+    };
+    const ainstruction_t* i = pt->instructions + ip;
+    const aint_t target = jump_target(i, ip);
+    char cond[64];
+
+    switch (i->b.opcode) {
+    case AOC_NOP:
+    case AOC_BRK:
+        out(self, "    ;\n");
+        break;
+    case AOC_POP:
+        out(self, "    aaot_pop(a, %d);\n", i->pop.n);
+        break;
+    case AOC_LDK:
+        out_constant(self, pt, pt->constants + i->ldk.idx);
+        break;
+    case AOC_NIL:
+        out(self, "    aaot_nil(a);\n");
+        break;
+    case AOC_LDB:
+        out(self, "    aaot_bool(a, %s);\n", i->ldb.val ? "TRUE" : "FALSE");
+        break;
+    case AOC_LSI:
+        out(self, "    aaot_integer(a, %d);\n", i->lsi.val);
+        break;
+    case AOC_LLV:
+        out(self, "    aaot_llv(a, %d);\n", i->llv.idx);
+        break;
+    case AOC_SLV:
+        out(self, "    aaot_slv(a, %d);\n", i->slv.idx);
+        break;
+    case AOC_IMP: {
+        const aimport_t* imp = pt->imports + i->imp.idx;
+        aprototype_t* f = find_local(self, pt, imp);
+        if (f) {
+            // calls inside the module skip the lookup.
+            out(self, "    aaot_native(a, &aot_%lld);\n",
+                (long long int)func_id(self, f));
+        } else {
+            out(self, "    any_import(a, ");
+            out_string(self, pt->strings + imp->module);
+            out(self, ", ");
+            out_string(self, pt->strings + imp->name);
+            out(self, ");\n");
+        }
+        break;
+    }
+    case AOC_CLS:
+        out(self, "    aaot_native(a, &aot_%lld);\n",
+            (long long int)func_id(self, pt->nesteds + i->cls.idx));
+        break;
+    case AOC_JMP:
+        out_branch(self, NULL, ip, target);
+        break;
+    case AOC_JIN:
+        out_branch(self, "!aaot_test(a)", ip, target);
+        break;
+    case AOC_IVK:
+        out(self, "    aaot_reduce(a);\n");
+        out(self, "    any_call(a, %d);\n", i->ivk.nargs);
+        break;
+    case AOC_RET:
+        out(self, "    return;\n");
+        break;
+    case AOC_TVK:
+        // only to itself, see \ref self_tail.
+        out(self, "    aaot_reduce(a);\n");
+        out(self, "    aaot_tail(a, %d);\n", i->tvk.nargs);
+        out(self, "    goto enter;\n");
+        break;
+    case AOC_SND:
+        out(self, "    any_mbox_send(a);\n");
+        break;
+    case AOC_RCV:
+        out_branch(self, "aaot_recv(a) == AERR_TIMEOUT", ip, target);
+        break;
+    case AOC_RMV:
+        out(self, "    any_mbox_remove(a);\n");
+        break;
+    case AOC_RWD:
+        out(self, "    any_mbox_rewind(a);\n");
+        break;
+    case AOC_MRK:
+        out(self, "    any_mbox_mark(a);\n");
+        break;
+    case AOC_ADD:
+    case AOC_SUB:
+    case AOC_MUL:
+    case AOC_DIV:
+    case AOC_EQ:
+    case AOC_LT:
+    case AOC_LE:
+    case AOC_GT:
+    case AOC_GE:
+        out(self, "    aaot_%s(a);\n", BINARIES[i->b.opcode]);
+        break;
+    case AOC_NOT:
+        out(self, "    aaot_not(a);\n");
+        break;
+    case AOC_ADD_LL:
+        out(self, "    aaot_add_ll(a, %d, %d);\n",
+            i->add_ll.lhs, i->add_ll.rhs);
+        break;
+    case AOC_ADDI:
+        out(self, "    aaot_addi(a, %d);\n", i->addi.val);
+        break;
+    case AOC_INC:
+        out(self, "    aaot_inc(a, %d, %d);\n", i->inc.idx, i->inc.val);
+        break;
+    case AOC_JLT:
+    case AOC_JLE:
+    case AOC_JGT:
+    case AOC_JGE: {
+        const char* name =
+            i->b.opcode == AOC_JLT ? "jlt" :
+            i->b.opcode == AOC_JLE ? "jle" :
+            i->b.opcode == AOC_JGT ? "jgt" : "jge";
+        snprintf(cond, sizeof(cond), "!aaot_%s(a, %d)", name, i->jlt.val);
+        out_branch(self, cond, ip, target);
+        break;
+    }
+    default:
+        return AERR_MALFORMED;
+    }
+    return AERR_NONE;
+}
+
+static aerror_t
+translate_prototype(
+    aaot_t* self, aprototype_t* pt)
+{
+    const aint_t n = pt->header->num_instructions;
+    aerror_t ec = AERR_NONE;
+    int32_t tails = FALSE;
+    uint8_t* targets;
+    aint_t ip;
+
+    targets = (uint8_t*)self->alloc(self->alloc_ud, NULL, n);
+    if (!targets) return AERR_FULL;
+    memset(targets, 0, (size_t)n);
+    for (ip = 0; ip < n; ++ip) {
+        aint_t target = jump_target(pt->instructions + ip, ip);
+        if (target >= 0) targets[target] = TRUE;
+    }
+    // other tail calls would grow the native stack on each one.
+    for (ip = 0; ip < n && ec == AERR_NONE; ++ip) {
+        if (pt->instructions[ip].b.opcode != AOC_TVK) continue;
+        if (self_tail(self, pt, targets, ip)) tails = TRUE;
+        else ec = AERR_MALFORMED;
+    }
+    if (ec != AERR_NONE) {
+        self->alloc(self->alloc_ud, targets, 0);
+        return ec;
+    }
+
+    out(self, "// ");
+    out_raw(self, self->module->strings + self->module->header->symbol);
+    out(self, ":");
+    out_raw(self, pt->strings + pt->header->symbol);
+    out(self, "\nstatic void\naot_%lld(\n    aactor_t* a)\n{\n",
+        (long long int)func_id(self, pt));
+    if (tails) out(self, "enter:\n");
+    out(self, "    aaot_enter(a, %lld, %lld, %lld);\n",
+        (long long int)pt->min_args,
+        (long long int)pt->header->num_local_vars,
+        (long long int)pt->max_stack);
+    for (ip = 0; ip < n && ec == AERR_NONE; ++ip) {
+        if (targets[ip]) out(self, "l%lld:\n", (long long int)ip);
+        ec = translate_instruction(self, pt, ip);
+    }
+    out(self, "}\n\n");
+
+    self->alloc(self->alloc_ud, targets, 0);
+    return ec;
+}
+
+static aerror_t
+define(
+    aaot_t* self, aprototype_t* pt)
+{
+    aint_t i;
+    for (i = 0; i < pt->header->num_nesteds; ++i) {
+        aerror_t ec = translate_prototype(self, pt->nesteds + i);
+        if (ec == AERR_NONE) ec = define(self, pt->nesteds + i);
+        if (ec != AERR_NONE) return ec;
+    }
+    return AERR_NONE;
+}
+
+aerror_t
+aaot_translate(
+    aprototype_t* module, aalloc_t alloc, void* alloc_ud,
+    aaot_writer_t writer, void* ud)
+{
+    const char* name = module->strings + module->header->symbol;
+    aerror_t ec;
+    aint_t i;
+    aaot_t self;
+
+    if (!all_verified(module)) return AERR_MALFORMED;
+
+    self.module = module;
+    self.alloc = alloc;
+    self.alloc_ud = alloc_ud;
+    self.writer = writer;
+    self.ud = ud;
+
+    out(&self, "/* Generated by amlc --aot, do not edit. */\n");
+    out(&self, "#include <any/aot.h>\n#include <any/loader.h>\n\n");
+    out(&self, "#include <math.h>\n\n");
+    declare(&self, module);
+    out(&self, "\n");
+
+    ec = define(&self, module);
+    if (ec != AERR_NONE) return ec;
+
+    out(&self, "static alib_func_t funcs[] = {\n");
+    for (i = 0; i < module->header->num_nesteds; ++i) {
+        aprototype_t* f = module->nesteds + i;
+        out(&self, "    { ");
+        out_string(&self, f->strings + f->header->symbol);
+        out(&self, ", &aot_%lld },\n", (long long int)func_id(&self, f));
+    }
+    out(&self, "    { NULL, NULL }\n};\n\n");
+    out(&self, "static alib_t lib = { ");
+    out_string(&self, name);
+    out(&self, ", funcs };\n\n");
+    out(&self, "void\naot_lib_add_");
+    out_ident(&self, name);
+    out(&self, "(\n    aloader_t* l)\n{\n    aloader_add_lib(l, &lib);\n}\n");
+    return AERR_NONE;
+}
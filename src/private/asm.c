@@ -492,6 +492,180 @@ load_chunk(
     return ec;
 }
 
+// Signed range of 12 bits operands in fused instructions.
+static inline int32_t
+fits_12(
+    aint_t v)
+{
+    return v >= -2048 && v <= 2047;
+}
+
+// Returns TRUE if `i` may jump, with its displacement in `disp`.
+static int32_t
+jump_of(
+    ainstruction_t i, aint_t* disp)
+{
+    switch (i.b.opcode) {
+    case AOC_JMP:
+    case AOC_JIN:
+    case AOC_RCV:
+        *disp = i.jmp.displacement;
+        return TRUE;
+    case AOC_JLT:
+    case AOC_JLE:
+    case AOC_JGT:
+    case AOC_JGE:
+        *disp = i.jlt.displacement;
+        return TRUE;
+    default:
+        return FALSE;
+    }
+}
+
+static inline void
+set_jump(
+    ainstruction_t* i, aint_t disp)
+{
+    if (i->b.opcode >= AOC_JLT && i->b.opcode <= AOC_JGE) {
+        i->jlt.displacement = (int32_t)disp;
+    } else {
+        i->jmp.displacement = (int32_t)disp;
+    }
+}
+
+// Try to fuse a sequence starting at `ip`, returns the number of consumed
+// instructions, or 1 if there is nothing to fuse.
+static aint_t
+fuse_at(
+    const ainstruction_t* in,
+    aint_t n,
+    aint_t ip,
+    const uint8_t* targets,
+    ainstruction_t* out)
+{
+    const ainstruction_t* i = in + ip;
+    aint_t left = n - ip;
+    *out = *i;
+
+    // `llv x; lsi k; add; slv x`
+    if (left >= 4 && !targets[ip + 1] && !targets[ip + 2] &&
+        !targets[ip + 3] &&
+        i[0].b.opcode == AOC_LLV && i[1].b.opcode == AOC_LSI &&
+        i[2].b.opcode == AOC_ADD && i[3].b.opcode == AOC_SLV &&
+        i[0].llv.idx == i[3].slv.idx &&
+        fits_12(i[0].llv.idx) && fits_12(i[1].lsi.val)) {
+        *out = ai_inc(i[0].llv.idx, i[1].lsi.val);
+        return 4;
+    }
+
+    // `lsi k; <cmp>; jin d`
+    if (left >= 3 && !targets[ip + 1] && !targets[ip + 2] &&
+        i[0].b.opcode == AOC_LSI && i[2].b.opcode == AOC_JIN &&
+        fits_12(i[0].lsi.val) && fits_12(i[2].jin.displacement)) {
+        aint_t k = i[0].lsi.val;
+        aint_t d = i[2].jin.displacement;
+        switch (i[1].b.opcode) {
+        case AOC_LT: *out = ai_jlt(k, d); return 3;
+        case AOC_LE: *out = ai_jle(k, d); return 3;
+        case AOC_GT: *out = ai_jgt(k, d); return 3;
+        case AOC_GE: *out = ai_jge(k, d); return 3;
+        default: break;
+        }
+    }
+
+    // `llv r; llv l; add`
+    if (left >= 3 && !targets[ip + 1] && !targets[ip + 2] &&
+        i[0].b.opcode == AOC_LLV && i[1].b.opcode == AOC_LLV &&
+        i[2].b.opcode == AOC_ADD &&
+        fits_12(i[0].llv.idx) && fits_12(i[1].llv.idx)) {
+        *out = ai_add_ll(i[1].llv.idx, i[0].llv.idx);
+        return 3;
+    }
+
+    // `ivk n; ret`
+    if (left >= 2 && !targets[ip + 1] &&
+        i[0].b.opcode == AOC_IVK && i[1].b.opcode == AOC_RET) {
+        *out = ai_tvk(i[0].ivk.nargs);
+        return 2;
+    }
+
+    // `lsi k; add`
+    if (left >= 2 && !targets[ip + 1] &&
+        i[0].b.opcode == AOC_LSI && i[1].b.opcode == AOC_ADD) {
+        *out = ai_addi(i[0].lsi.val);
+        return 2;
+    }
+
+    return 1;
+}
+
+static aint_t
+fuse_prototype(
+    aasm_t* self, aasm_prototype_t* p)
+{
+    const aint_t n = p->num_instructions;
+    ainstruction_t* const instructions = instructions_of(p);
+    aint_t* const source_lines = source_lines_of(p);
+    ainstruction_t* out;
+    aint_t* lines;
+    aint_t* map;
+    aint_t* from;
+    uint8_t* targets;
+    aint_t ip, nn = 0, num_fused = 0;
+
+    if (n == 0) return 0;
+
+    targets = (uint8_t*)aalloc(self, NULL, n);
+    memset(targets, 0, (size_t)n);
+    for (ip = 0; ip < n; ++ip) {
+        aint_t disp;
+        aint_t target;
+        if (!jump_of(instructions[ip], &disp)) continue;
+        target = ip + disp + 1;
+        if (target < 0 || target >= n) {
+            // leave malformed jumps as is, the verifier will reject them.
+            aalloc(self, targets, 0);
+            return 0;
+        }
+        targets[target] = TRUE;
+    }
+
+    out = (ainstruction_t*)aalloc(self, NULL, n * sizeof(ainstruction_t));
+    lines = (aint_t*)aalloc(self, NULL, n * sizeof(aint_t));
+    map = (aint_t*)aalloc(self, NULL, n * sizeof(aint_t));
+    from = (aint_t*)aalloc(self, NULL, n * sizeof(aint_t));
+
+    for (ip = 0; ip < n;) {
+        aint_t j;
+        aint_t len = fuse_at(instructions, n, ip, targets, out + nn);
+        // old jump source, last instruction of a fused compare and branch.
+        from[nn] = ip + len - 1;
+        lines[nn] = source_lines[ip];
+        for (j = 0; j < len; ++j) map[ip + j] = nn;
+        if (len > 1) ++num_fused;
+        ip += len;
+        ++nn;
+    }
+
+    for (ip = 0; ip < nn; ++ip) {
+        aint_t disp;
+        if (!jump_of(out[ip], &disp)) continue;
+        // displacements never grow while compacting.
+        set_jump(out + ip, map[from[ip] + disp + 1] - ip - 1);
+    }
+
+    memcpy(instructions, out, (size_t)nn * sizeof(ainstruction_t));
+    memcpy(source_lines, lines, (size_t)nn * sizeof(aint_t));
+    p->num_instructions = nn;
+
+    aalloc(self, from, 0);
+    aalloc(self, map, 0);
+    aalloc(self, lines, 0);
+    aalloc(self, out, 0);
+    aalloc(self, targets, 0);
+    return num_fused;
+}
+
 static aint_t
 push_unsafe(
     aasm_t* self)
@@ -572,6 +746,15 @@ aasm_save(
     assert(self->chunk_size == sz);
 }
 
+void
+aasm_save_fused(
+    aasm_t* self)
+{
+    if (self->_num_slots == 0) return;
+    aasm_fuse(self);
+    aasm_save(self);
+}
+
 void
 aasm_cleanup(
     aasm_t* self)
@@ -620,6 +803,18 @@ aasm_emit(
     return p->num_instructions++;
 }
 
+aint_t
+aasm_fuse(
+    aasm_t* self)
+{
+    aint_t i;
+    aint_t num_fused = 0;
+    for (i = 0; i < self->_num_slots; ++i) {
+        num_fused += fuse_prototype(self, aasm_prototype_at(self, i));
+    }
+    return num_fused;
+}
+
 aint_t
 aasm_add_constant(
     aasm_t* self, aconstant_t constant)
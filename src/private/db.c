@@ -4,6 +4,8 @@
 #include <any/scheduler.h>
 #include <any/loader.h>
 #include <any/actor.h>
+#include <any/profile.h>
+#include <any/sampler.h>
 
 #define REQUEST_BUFF_SZ 2048
 #define IO_BUFF_SZ 8192
@@ -47,6 +49,27 @@ static const struct wby_header JSON_HEADERS[] = {
     }
 };
 
+static const struct wby_header TEXT_HEADERS[] = {
+    { "Content-Type",
+      "text/plain"
+    },
+    { "Cache-Control",
+      "no-cache"
+    },
+    { "Access-Control-Allow-Origin",
+      "*"
+    },
+    { "Access-Control-Allow-Methods",
+      "GET, POST, PUT, PATCH, DELETE, OPTIONS"
+    },
+    { "Access-Control-Allow-Headers",
+      "Connection, Content-Type"
+    },
+    { "Access-Control-Max-Age",
+      "600"
+    }
+};
+
 static const struct wby_header BINARY_HEADERS[] = {
     { "Content-Type",
       "application/octet-stream"
@@ -109,6 +132,31 @@ wby_write_fmt(
     va_end(args);
 }
 
+// Write `s` as the content of a JSON string.
+static void
+wby_write_json(
+    struct wby_con* con, const char* s)
+{
+    static const char hex[] = "0123456789abcdef";
+    const char* run = s;
+    for (; *s; ++s) {
+        char esc[6] = { '\\', 'u', '0', '0', 0, 0 };
+        unsigned char c = (unsigned char)*s;
+        if (c >= 0x20 && c != '"' && c != '\\') continue;
+        if (s > run) wby_write(con, run, (wby_size)(s - run));
+        if (c == '"' || c == '\\') {
+            esc[1] = (char)c;
+            wby_write(con, esc, 2);
+        } else {
+            esc[4] = hex[c >> 4];
+            esc[5] = hex[c & 0xF];
+            wby_write(con, esc, sizeof(esc));
+        }
+        run = s + 1;
+    }
+    if (s > run) wby_write(con, run, (wby_size)(s - run));
+}
+
 static void
 json_response_begin(
     struct wby_con* con, int status, int content_length)
@@ -127,6 +175,15 @@ binary_response_begin(
         BINARY_HEADERS, ASTATIC_ARRAY_COUNT(BINARY_HEADERS));
 }
 
+static void
+text_response_begin(
+    struct wby_con* con, int status, int content_length)
+{
+    wby_response_begin(
+        con, status, content_length,
+        TEXT_HEADERS, ASTATIC_ARRAY_COUNT(TEXT_HEADERS));
+}
+
 static int
 simple_response(
     struct wby_con* con, int status)
@@ -149,8 +206,9 @@ list_modules(
         if (*first == FALSE) wby_write(con, ",", 1);
         wby_write_fmt(con, "{\"id\":%zd,", (size_t)chunk);
         wby_write_fmt(con, "\"type\":\"%s\",", type);
-        wby_write_fmt(con, "\"module\":\"%s\"}",
-            m->strings + m->header->symbol);
+        WBY_WRITE_STATIC(con, "\"module\":\"");
+        wby_write_json(con, m->strings + m->header->symbol);
+        WBY_WRITE_STATIC(con, "\"}");
         *first = FALSE;
         i = i->next;
     }
@@ -291,7 +349,106 @@ handle_actors(
             con->request.query_params, "module", module, sizeof(module));
         wby_find_query_var(
             con->request.query_params, "name", name, sizeof(name));
-        return post_actor(db, con, module, name, 4096000/*TODO: hard code?*/);
+        return post_actor(db, con, module, name, 262144/*TODO: hard code?*/);
+    }
+    return simple_response(con, 405);
+}
+
+#ifdef ANY_PROFILE
+typedef struct profile_writer_s {
+    struct wby_con* con;
+    int32_t first;
+} profile_writer_t;
+
+static void
+write_prototype_profile(
+    const char* module, aprototype_t* pt, void* ud)
+{
+    profile_writer_t* w = (profile_writer_t*)ud;
+    const aprofile_t* p = &pt->profile;
+    if (p->instructions == 0 && p->calls == 0) return;
+    if (w->first == FALSE) WBY_WRITE_STATIC(w->con, ",");
+    WBY_WRITE_STATIC(w->con, "{\"module\":\"");
+    wby_write_json(w->con, module);
+    WBY_WRITE_STATIC(w->con, "\",\"name\":\"");
+    wby_write_json(w->con, pt->strings + pt->header->symbol);
+    wby_write_fmt(w->con, "\",\"instructions\":%lld,",
+        (long long)p->instructions);
+    wby_write_fmt(w->con, "\"calls\":%lld,", (long long)p->calls);
+    wby_write_fmt(w->con, "\"usecs\":%lld}", (long long)p->usecs);
+    w->first = FALSE;
+}
+
+static int
+handle_profile(
+    adb_t* db, struct wby_con* con)
+{
+    if (strcmp(con->request.method, "GET") == 0) {
+        int32_t op;
+        profile_writer_t w;
+        w.con = con;
+        w.first = TRUE;
+        json_response_begin(con, 200, -1);
+        WBY_WRITE_STATIC(con, "{\"opcodes\":{");
+        for (op = 0; op < 256; ++op) {
+            aint_t n = db->target->opcodes[op];
+            if (n == 0 || aprofile_opcode_name(op) == NULL) continue;
+            if (w.first == FALSE) WBY_WRITE_STATIC(con, ",");
+            wby_write_fmt(con, "\"%s\":%lld",
+                aprofile_opcode_name(op), (long long)n);
+            w.first = FALSE;
+        }
+        WBY_WRITE_STATIC(con, "},\"prototypes\":[");
+        w.first = TRUE;
+        aprofile_visit(db->target, &write_prototype_profile, &w);
+        WBY_WRITE_STATIC(con, "]}");
+        wby_response_end(con);
+        return 0;
+    }
+    if (strcmp(con->request.method, "DELETE") == 0) {
+        aprofile_reset(db->target);
+        return simple_response(con, 204);
+    }
+    return simple_response(con, 405);
+}
+#else
+static int
+handle_profile(
+    adb_t* db, struct wby_con* con)
+{
+    AUNUSED(db);
+    // built without USE_PROFILE.
+    return simple_response(con, 501);
+}
+#endif
+
+static void
+write_folded(
+    const char* s, aint_t sz, void* ud)
+{
+    wby_write((struct wby_con*)ud, s, (wby_size)sz);
+}
+
+static int
+handle_samples(
+    adb_t* db, struct wby_con* con)
+{
+    if (db->sampler == NULL) {
+        return simple_response(con, 404);
+    }
+    if (strcmp(con->request.method, "GET") == 0) {
+        if (asampler_collect(db->sampler) != AERR_NONE) {
+            return simple_response(con, 503);
+        }
+        text_response_begin(con, 200, -1);
+        asampler_write(db->sampler, &write_folded, con);
+        wby_response_end(con);
+        return 0;
+    }
+    if (strcmp(con->request.method, "DELETE") == 0) {
+        asampler_collect(db->sampler);
+        asampler_clear(db->sampler);
+        return simple_response(con, 204);
     }
     return simple_response(con, 405);
 }
@@ -314,6 +471,12 @@ dispatch(
         if (strcmp(uri, "/actors") == 0) {
             return handle_actors(db, con);
         }
+        if (strcmp(uri, "/profile") == 0) {
+            return handle_profile(db, con);
+        }
+        if (strcmp(uri, "/profile/samples") == 0) {
+            return handle_samples(db, con);
+        }
         return 1;
     }
 }
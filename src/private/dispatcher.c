@@ -1,9 +1,21 @@
 /* Copyright (c) 2017 Nguyen Viet Giang. All rights reserved. */
 #include <any/actor.h>
 
+#include <any/scheduler.h>
+#include <any/loader.h>
+#include <any/jit.h>
+
 #include <any/std_string.h>
 #include <any/std.h>
 
+aframe_t*
+actor_push_frame(
+    aactor_t* a, aint_t nargs);
+
+void
+actor_pop_frame(
+    aactor_t* a);
+
 static void
 fill_nil(
     aactor_t* a, aint_t num)
@@ -14,113 +26,522 @@ fill_nil(
     }
 }
 
-#define LOGICAL_OP(op) \
-    aint_t cnt = any_count(a); \
-    if (cnt < 2) { \
-        any_error(a, AERR_RUNTIME, "pop underflow"); \
-    } else { \
-        aint_t a_lhs = any_check_index(a, cnt - 1); \
-        aint_t a_rhs = any_check_index(a, cnt - 2); \
-        avalue_t* lhsv = aactor_at(a, a_lhs); \
-        avalue_t* rhsv = aactor_at(a, a_rhs); \
-        if (lhsv->tag.type == AVT_INTEGER && \
-            rhsv->tag.type == AVT_INTEGER) { \
-            av_boolean(rhsv, lhsv->v.integer op rhsv->v.integer); \
-        } else { \
-            areal_t lhs = any_check_real(a, a_lhs); \
-            areal_t rhs = any_check_real(a, a_rhs); \
-            av_boolean(rhsv, lhs op rhs); \
+#if (defined(AGNUC) || defined(ACLANG)) && !defined(ANY_SWITCH_DISPATCH)
+// direct threaded dispatch via computed goto (labels as values).
+#define ATHREADED_DISPATCH
+#endif
+
+/*
+Each opcode may have two entry points, `VM_CHECKED` validates the operands then
+falls through into `VM_UNCHECKED`, which trusts them. Unchecked entries are only
+used for prototypes proven well formed by the verifier, see `averify_prototype`.
+The switch based fallback always goes through the checked entries.
+*/
+#ifdef ATHREADED_DISPATCH
+#define VM_CHECKED_LABEL(op) [op] = &&c_##op
+#define VM_UNCHECKED_LABEL(op) [op] = &&u_##op
+#define VM_CASE(op) c_##op: u_##op:
+#define VM_CHECKED(op) c_##op:
+#define VM_UNCHECKED(op) u_##op:
+#define VM_DEFAULT c_bad:
+#define VM_DISPATCH() \
+    do { \
+        if (frame->ip >= pth->num_instructions) goto return_missing; \
+        i = pt->instructions + frame->ip; \
+        VM_PROFILE_OP(); \
+        goto *table[ainstruction_opcode(i)]; \
+    } while (0)
+#else
+#define VM_CASE(op) case op:
+#define VM_CHECKED(op) case op:
+#define VM_UNCHECKED(op)
+#define VM_DEFAULT default:
+#define VM_DISPATCH() goto dispatch
+#endif
+
+// Load the current frame, called whenever the frame is switched.
+#ifdef ATHREADED_DISPATCH
+#define VM_SELECT() \
+    do { \
+        frame = a->frame; \
+        pt = frame->pt; \
+        pth = pt->header; \
+        verified = pt->verified && frame->nargs >= pt->min_args; \
+        table = a->owner->on_step \
+            ? step_table \
+            : (verified ? unchecked_table : checked_table); \
+        VM_JIT_SELECT(); \
+    } while (0)
+#else
+#define VM_SELECT() \
+    do { \
+        frame = a->frame; \
+        pt = frame->pt; \
+        pth = pt->header; \
+        verified = pt->verified && frame->nargs >= pt->min_args; \
+        stepping = a->owner->on_step != NULL; \
+        VM_JIT_SELECT(); \
+    } while (0)
+#endif
+
+/*
+A debugger may attach while an actor loops in a single frame, or while it is
+suspended in a call or a receive, backward jumps and instructions left by
+native code select the frame again once `on_step` is set.
+*/
+#ifdef ATHREADED_DISPATCH
+#define VM_STEP_SELECT() \
+    do { \
+        if (a->owner->on_step && table != step_table) VM_SELECT(); \
+    } while (0)
+#else
+#define VM_STEP_SELECT() \
+    do { \
+        if (a->owner->on_step && !stepping) VM_SELECT(); \
+    } while (0)
+#endif
+
+// Counters of prototypes, which workers of `ANY_SMP` share.
+#ifdef ANY_SMP
+#define VM_ADD(counter, n) __atomic_add_fetch(&(counter), (n), __ATOMIC_RELAXED)
+#else
+#define VM_ADD(counter, n) ((counter) += (n))
+#endif
+
+/*
+With `ANY_PROFILE`, every dispatched instruction is counted per opcode and per
+prototype, calls are counted on entering and timed until returning.
+*/
+#ifdef ANY_PROFILE
+#define VM_PROFILE_OP() \
+    do { \
+        ++a->owner->opcodes[ainstruction_opcode(i)]; \
+        VM_ADD(pt->profile.instructions, 1); \
+    } while (0)
+#define VM_PROFILE_ENTER() \
+    do { \
+        VM_ADD(pt->profile.calls, 1); \
+        frame->enter_usecs = atimer_usecs(); \
+    } while (0)
+#define VM_PROFILE_LEAVE() \
+    VM_ADD(pt->profile.usecs, atimer_usecs() - frame->enter_usecs)
+#else
+#define VM_PROFILE_OP() ((void)0)
+#define VM_PROFILE_ENTER() ((void)0)
+#define VM_PROFILE_LEAVE() ((void)0)
+#endif
+
+/*
+Count a reduction, calls and backward jumps bound the slice of an actor. Stackless
+actors may be unwound in here, so `frame->ip` must be where they continue.
+*/
+#define VM_REDUCE() \
+    do { \
+        if (--a->budget <= 0) { \
+            ascheduler_preempt(a->owner, a); \
+            VM_SELECT(); \
+        } \
+    } while (0)
+
+/*
+With `ANY_JIT`, verified prototypes are compiled to native code once they are
+hot, counted on calls and backward jumps. Native code returns before the
+instructions it leaves to the interpreter, which enters it again after them.
+Stepping a debugger always interprets.
+*/
+#ifdef ANY_JIT
+#define VM_JIT_SELECT() jitting = verified && a->owner->on_step == NULL
+#define VM_JIT_HOT() \
+    do { \
+        if (jitting && ajit_code(pt) == NULL && \
+            VM_ADD(pt->hotness, 1) == ANY_JIT_THRESHOLD) { \
+            ajit_compile(pt, a->alloc, a->alloc_ud); \
         } \
+    } while (0)
+#define VM_JIT() \
+    do { \
+        if (jitting && ajit_code(pt)) goto jit_run; \
+    } while (0)
+#else
+#define VM_JIT_SELECT() ((void)0)
+#define VM_JIT_HOT() ((void)0)
+#define VM_JIT() ((void)0)
+#endif
+
+#define VM_NEXT() \
+    do { \
+        ++frame->ip; \
+        VM_DISPATCH(); \
+    } while (0)
+
+// Continue after an instruction native code returned on.
+#define VM_NEXT_JIT() \
+    do { \
+        ++frame->ip; \
+        VM_STEP_SELECT(); \
+        VM_JIT(); \
+        VM_DISPATCH(); \
+    } while (0)
+
+#define VM_CHECK_COUNT(n) \
+    if (any_count(a) < n) any_error(a, AERR_RUNTIME, "pop underflow")
+
+#define VM_RESERVE(n) \
+    if (astack_reserve(&a->stack, n) != AERR_NONE) \
+        any_error(a, AERR_RUNTIME, "out of memory")
+
+// Push onto the already reserved stack, returns the new slot.
+#define VM_PUSH() (a->stack.v + a->stack.sp++)
+
+/*
+Generic arithmetic and comparison handlers quicken the instruction into the
+int-int or real-real form matching the observed operands. Quickened handlers
+only guard the operand types, and restore the generic opcode on a miss, which
+stays generic after \ref ANY_QUICKEN_MISSES of them. Opcodes are rewritten by
+\ref ainstruction_quicken since `ANY_SMP` workers share them.
+*/
+#ifdef ATHREADED_DISPATCH
+#define VM_DEQUICKEN(op) \
+    do { \
+        ainstruction_dequicken(i, op); \
+        goto *checked_table[op]; \
+    } while (0)
+#else
+#define VM_DEQUICKEN(op) \
+    do { \
+        ainstruction_dequicken(i, op); \
+        goto dispatch_op; \
+    } while (0)
+#endif
+
+#define ARITH_OP(op, ii, rr) \
+    avalue_t* rhsv = a->stack.v + a->stack.sp - 2; \
+    avalue_t* lhsv = rhsv + 1; \
+    if (lhsv->tag.type == AVT_INTEGER && \
+        rhsv->tag.type == AVT_INTEGER) { \
+        av_integer(rhsv, lhsv->v.integer op rhsv->v.integer); \
+        ainstruction_quicken(i, ii); \
+    } else { \
+        int32_t reals = lhsv->tag.type == AVT_REAL && \
+            rhsv->tag.type == AVT_REAL; \
+        areal_t lhs = any_check_real(a, a->stack.sp - 1); \
+        areal_t rhs = any_check_real(a, a->stack.sp - 2); \
+        av_real(rhsv, lhs op rhs); \
+        if (reals) ainstruction_quicken(i, rr); \
+    } \
+    a->stack.sp -= 1;
+
+#define LOGICAL_OP(op, ii, rr) \
+    avalue_t* rhsv = a->stack.v + a->stack.sp - 2; \
+    avalue_t* lhsv = rhsv + 1; \
+    if (lhsv->tag.type == AVT_INTEGER && \
+        rhsv->tag.type == AVT_INTEGER) { \
+        av_boolean(rhsv, lhsv->v.integer op rhsv->v.integer); \
+        ainstruction_quicken(i, ii); \
+    } else { \
+        int32_t reals = lhsv->tag.type == AVT_REAL && \
+            rhsv->tag.type == AVT_REAL; \
+        areal_t lhs = any_check_real(a, a->stack.sp - 1); \
+        areal_t rhs = any_check_real(a, a->stack.sp - 2); \
+        av_boolean(rhsv, lhs op rhs); \
+        if (reals) ainstruction_quicken(i, rr); \
+    } \
+    a->stack.sp -= 1;
+
+// Quickened form, `t` is the expected type of both operands.
+#define QUICK_OP(t, f, setter, op, generic) \
+    avalue_t* rhsv = a->stack.v + a->stack.sp - 2; \
+    avalue_t* lhsv = rhsv + 1; \
+    if (lhsv->tag.type == t && rhsv->tag.type == t) { \
+        setter(rhsv, lhsv->v.f op rhsv->v.f); \
         a->stack.sp -= 1; \
+        VM_NEXT(); \
+    } \
+    VM_DEQUICKEN(generic);
+
+// Add small integer `val` to the value at absolute index `idx` in place.
+#define ADDI_OP(idx, val) \
+    avalue_t* v = a->stack.v + (idx); \
+    if (v->tag.type == AVT_INTEGER) { \
+        av_integer(v, (val) + v->v.integer); \
+    } else { \
+        av_real(v, (val) + any_check_real(a, (idx))); \
     }
 
-void
-actor_dispatch(
-    aactor_t* a)
+// Fused `lsi val; <op>; jin`, all compare and branch share the same layout.
+#define BRANCH_OP(f, op, taken) \
+    avalue_t* v = a->stack.v + a->stack.sp - 1; \
+    int32_t cond = v->tag.type == AVT_INTEGER \
+        ? i->f.val op v->v.integer \
+        : i->f.val op any_check_real(a, a->stack.sp - 1); \
+    a->stack.sp -= 1; \
+    if (cond == FALSE) goto taken; \
+    VM_NEXT();
+
+/*
+Byte code calls stay in this loop, until returning from the `entry` frame, which
+is remembered by depth since frames may be moved while growing. With `resume`,
+the current frame continues at its `ip` instead of being entered.
+*/
+static void
+dispatch(
+    aactor_t* a, const aint_t entry, const int32_t resume)
 {
-    aframe_t* frame = a->frame;
-    aprototype_t* pt = frame->pt;
-    aprototype_header_t* pth = pt->header;
-    fill_nil(a, pth->num_local_vars);
-    for (; frame->ip < pth->num_instructions; ++frame->ip) {
-        ainstruction_t* i = pt->instructions + frame->ip;
-        if (a->owner->on_step) {
-            while (a->owner->on_step(a, a->owner->on_step_ud) == FALSE) {
-                any_yield(a);
-            }
+    aframe_t* frame;
+    aprototype_t* pt;
+    aprototype_header_t* pth;
+    ainstruction_t* i;
+    int32_t verified;
+#ifdef ANY_JIT
+    int32_t jitting;
+#endif
+#ifdef ATHREADED_DISPATCH
+#if defined(ACLANG)
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Winitializer-overrides"
+#elif defined(AGNUC)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Woverride-init"
+#endif
+    static const void* const checked_table[256] = {
+        [0 ... 255] = &&c_bad,
+        VM_CHECKED_LABEL(AOC_NOP), VM_CHECKED_LABEL(AOC_BRK),
+        VM_CHECKED_LABEL(AOC_POP),
+        VM_CHECKED_LABEL(AOC_LDK), VM_CHECKED_LABEL(AOC_NIL),
+        VM_CHECKED_LABEL(AOC_LDB), VM_CHECKED_LABEL(AOC_LSI),
+        VM_CHECKED_LABEL(AOC_LLV), VM_CHECKED_LABEL(AOC_SLV),
+        VM_CHECKED_LABEL(AOC_IMP), VM_CHECKED_LABEL(AOC_CLS),
+        VM_CHECKED_LABEL(AOC_JMP), VM_CHECKED_LABEL(AOC_JIN),
+        VM_CHECKED_LABEL(AOC_IVK), VM_CHECKED_LABEL(AOC_RET),
+        VM_CHECKED_LABEL(AOC_TVK),
+        VM_CHECKED_LABEL(AOC_SND), VM_CHECKED_LABEL(AOC_RCV),
+        VM_CHECKED_LABEL(AOC_RMV), VM_CHECKED_LABEL(AOC_RWD),
+        VM_CHECKED_LABEL(AOC_MRK),
+        VM_CHECKED_LABEL(AOC_ADD), VM_CHECKED_LABEL(AOC_SUB),
+        VM_CHECKED_LABEL(AOC_MUL), VM_CHECKED_LABEL(AOC_DIV),
+        VM_CHECKED_LABEL(AOC_NOT), VM_CHECKED_LABEL(AOC_EQ),
+        VM_CHECKED_LABEL(AOC_LT), VM_CHECKED_LABEL(AOC_LE),
+        VM_CHECKED_LABEL(AOC_GT), VM_CHECKED_LABEL(AOC_GE),
+        VM_CHECKED_LABEL(AOC_ADD_LL), VM_CHECKED_LABEL(AOC_ADDI),
+        VM_CHECKED_LABEL(AOC_INC),
+        VM_CHECKED_LABEL(AOC_JLT), VM_CHECKED_LABEL(AOC_JLE),
+        VM_CHECKED_LABEL(AOC_JGT), VM_CHECKED_LABEL(AOC_JGE),
+        VM_CHECKED_LABEL(AOC_ADD_II), VM_CHECKED_LABEL(AOC_SUB_II),
+        VM_CHECKED_LABEL(AOC_MUL_II), VM_CHECKED_LABEL(AOC_DIV_II),
+        VM_CHECKED_LABEL(AOC_LT_II), VM_CHECKED_LABEL(AOC_LE_II),
+        VM_CHECKED_LABEL(AOC_GT_II), VM_CHECKED_LABEL(AOC_GE_II),
+        VM_CHECKED_LABEL(AOC_ADD_RR), VM_CHECKED_LABEL(AOC_SUB_RR),
+        VM_CHECKED_LABEL(AOC_MUL_RR), VM_CHECKED_LABEL(AOC_DIV_RR),
+        VM_CHECKED_LABEL(AOC_LT_RR), VM_CHECKED_LABEL(AOC_LE_RR),
+        VM_CHECKED_LABEL(AOC_GT_RR), VM_CHECKED_LABEL(AOC_GE_RR)
+    };
+    static const void* const unchecked_table[256] = {
+        [0 ... 255] = &&c_bad,
+        VM_UNCHECKED_LABEL(AOC_NOP), VM_UNCHECKED_LABEL(AOC_BRK),
+        VM_UNCHECKED_LABEL(AOC_POP),
+        VM_UNCHECKED_LABEL(AOC_LDK), VM_UNCHECKED_LABEL(AOC_NIL),
+        VM_UNCHECKED_LABEL(AOC_LDB), VM_UNCHECKED_LABEL(AOC_LSI),
+        VM_UNCHECKED_LABEL(AOC_LLV), VM_UNCHECKED_LABEL(AOC_SLV),
+        VM_UNCHECKED_LABEL(AOC_IMP), VM_UNCHECKED_LABEL(AOC_CLS),
+        VM_UNCHECKED_LABEL(AOC_JMP), VM_UNCHECKED_LABEL(AOC_JIN),
+        VM_UNCHECKED_LABEL(AOC_IVK), VM_UNCHECKED_LABEL(AOC_RET),
+        VM_UNCHECKED_LABEL(AOC_TVK),
+        VM_UNCHECKED_LABEL(AOC_SND), VM_UNCHECKED_LABEL(AOC_RCV),
+        VM_UNCHECKED_LABEL(AOC_RMV), VM_UNCHECKED_LABEL(AOC_RWD),
+        VM_UNCHECKED_LABEL(AOC_MRK),
+        VM_UNCHECKED_LABEL(AOC_ADD), VM_UNCHECKED_LABEL(AOC_SUB),
+        VM_UNCHECKED_LABEL(AOC_MUL), VM_UNCHECKED_LABEL(AOC_DIV),
+        VM_UNCHECKED_LABEL(AOC_NOT), VM_UNCHECKED_LABEL(AOC_EQ),
+        VM_UNCHECKED_LABEL(AOC_LT), VM_UNCHECKED_LABEL(AOC_LE),
+        VM_UNCHECKED_LABEL(AOC_GT), VM_UNCHECKED_LABEL(AOC_GE),
+        VM_UNCHECKED_LABEL(AOC_ADD_LL), VM_UNCHECKED_LABEL(AOC_ADDI),
+        VM_UNCHECKED_LABEL(AOC_INC),
+        VM_UNCHECKED_LABEL(AOC_JLT), VM_UNCHECKED_LABEL(AOC_JLE),
+        VM_UNCHECKED_LABEL(AOC_JGT), VM_UNCHECKED_LABEL(AOC_JGE),
+        VM_UNCHECKED_LABEL(AOC_ADD_II), VM_UNCHECKED_LABEL(AOC_SUB_II),
+        VM_UNCHECKED_LABEL(AOC_MUL_II), VM_UNCHECKED_LABEL(AOC_DIV_II),
+        VM_UNCHECKED_LABEL(AOC_LT_II), VM_UNCHECKED_LABEL(AOC_LE_II),
+        VM_UNCHECKED_LABEL(AOC_GT_II), VM_UNCHECKED_LABEL(AOC_GE_II),
+        VM_UNCHECKED_LABEL(AOC_ADD_RR), VM_UNCHECKED_LABEL(AOC_SUB_RR),
+        VM_UNCHECKED_LABEL(AOC_MUL_RR), VM_UNCHECKED_LABEL(AOC_DIV_RR),
+        VM_UNCHECKED_LABEL(AOC_LT_RR), VM_UNCHECKED_LABEL(AOC_LE_RR),
+        VM_UNCHECKED_LABEL(AOC_GT_RR), VM_UNCHECKED_LABEL(AOC_GE_RR)
+    };
+    // every opcode goes through the step hook first, then the checked handler.
+    static const void* const step_table[256] = {
+        [0 ... 255] = &&l_step
+    };
+#if defined(ACLANG)
+#pragma clang diagnostic pop
+#elif defined(AGNUC)
+#pragma GCC diagnostic pop
+#endif
+    const void* const* table;
+#else
+    int32_t stepping;
+#endif
+
+    if (resume) goto resume_ip;
+
+enter:
+    VM_SELECT();
+    VM_PROFILE_ENTER();
+    if (verified) {
+        // single reservation for the whole call, locals included.
+        VM_RESERVE(pt->max_stack);
+        while (a->stack.sp < frame->bp + pth->num_local_vars) {
+            av_nil(VM_PUSH());
+        }
+    } else {
+        fill_nil(a, pth->num_local_vars);
+    }
+    VM_JIT_HOT();
+    VM_JIT();
+    VM_DISPATCH();
+
+resume:
+    VM_SELECT();
+    VM_NEXT_JIT();
+
+resume_ip:
+    VM_SELECT();
+    VM_JIT();
+    VM_DISPATCH();
+
+#ifdef ANY_JIT
+jit_run:
+    if (ajit_run(a, pt, frame->ip) == AJIT_PREEMPT) {
+        ascheduler_preempt(a->owner, a);
+        VM_SELECT();
+        VM_JIT();
+    }
+    VM_DISPATCH();
+#endif
+
+#ifdef ATHREADED_DISPATCH
+l_step:
+    while (a->owner->on_step &&
+        a->owner->on_step(a, a->owner->on_step_ud) == FALSE) {
+        any_yield(a);
+    }
+    // debugger was detached while we were stopped.
+    if (a->owner->on_step == NULL) table = checked_table;
+    goto *checked_table[ainstruction_opcode(i)];
+#else
+dispatch:
+    if (frame->ip >= pth->num_instructions) goto return_missing;
+    i = pt->instructions + frame->ip;
+    VM_PROFILE_OP();
+    if (stepping) {
+        while (a->owner->on_step &&
+            a->owner->on_step(a, a->owner->on_step_ud) == FALSE) {
+            any_yield(a);
         }
-        switch (i->b.opcode) {
-        case AOC_NOP:
-        case AOC_BRK:
+        stepping = a->owner->on_step != NULL;
+    }
+dispatch_op:
+    switch (ainstruction_opcode(i)) {
+#endif
+        VM_CASE(AOC_NOP)
+        VM_CASE(AOC_BRK)
             // nop
-            break;
-        case AOC_POP:
+            VM_NEXT();
+        VM_CHECKED(AOC_POP)
             any_pop(a, i->pop.n);
-            break;
-        case AOC_LDK: {
-            aconstant_t* c = pt->constants + i->ldk.idx;
+            VM_NEXT();
+        VM_UNCHECKED(AOC_POP)
+            a->stack.sp -= i->pop.n;
+            VM_NEXT();
+        VM_CHECKED(AOC_LDK)
             if (i->ldk.idx < 0 || i->ldk.idx >= pth->num_constants) {
                 any_error(a, AERR_RUNTIME,
                     "bad constant index %d", i->ldk.idx);
             }
-            switch (pt->constants[i->ldk.idx].type) {
+            VM_RESERVE(1);
+        VM_UNCHECKED(AOC_LDK) {
+            aconstant_t* c = pt->constants + i->ldk.idx;
+            switch (c->type) {
             case ACT_INTEGER:
-                any_push_integer(a, c->integer);
+                av_integer(VM_PUSH(), c->integer);
                 break;
             case ACT_STRING:
                 any_push_string(a, pt->strings + c->string);
                 break;
             case ACT_REAL:
-                any_push_real(a, c->real);
+                av_real(VM_PUSH(), c->real);
                 break;
             default:
                 any_error(a, AERR_RUNTIME, "bad constant type");
                 break;
             }
-            break;
-        }
-        case AOC_NIL:
-            any_push_nil(a);
-            break;
-        case AOC_LDB:
-            any_push_bool(a, i->ldb.val ? TRUE : FALSE);
-            break;
-        case AOC_LSI:
-            any_push_integer(a, i->lsi.val);
-            break;
-        case AOC_LLV:
-            any_push_index(a, any_check_index(a, i->llv.idx));
-            break;
-        case AOC_SLV:
-            any_insert(a, any_check_index(a, i->slv.idx));
-            break;
-        case AOC_IMP:
+            VM_NEXT_JIT();
+        }
+        VM_CHECKED(AOC_NIL)
+            VM_RESERVE(1);
+        VM_UNCHECKED(AOC_NIL)
+            av_nil(VM_PUSH());
+            VM_NEXT();
+        VM_CHECKED(AOC_LDB)
+            VM_RESERVE(1);
+        VM_UNCHECKED(AOC_LDB)
+            av_boolean(VM_PUSH(), i->ldb.val ? TRUE : FALSE);
+            VM_NEXT();
+        VM_CHECKED(AOC_LSI)
+            VM_RESERVE(1);
+        VM_UNCHECKED(AOC_LSI)
+            av_integer(VM_PUSH(), i->lsi.val);
+            VM_NEXT();
+        VM_CHECKED(AOC_LLV)
+            any_check_index(a, i->llv.idx);
+            VM_RESERVE(1);
+        VM_UNCHECKED(AOC_LLV)
+            a->stack.v[a->stack.sp] = a->stack.v[frame->bp + i->llv.idx];
+            ++a->stack.sp;
+            VM_NEXT();
+        VM_CHECKED(AOC_SLV)
+            any_check_index(a, i->slv.idx);
+            any_pop(a, 1);
+            a->stack.v[frame->bp + i->slv.idx] = a->stack.v[a->stack.sp];
+            VM_NEXT();
+        VM_UNCHECKED(AOC_SLV)
+            --a->stack.sp;
+            a->stack.v[frame->bp + i->slv.idx] = a->stack.v[a->stack.sp];
+            VM_NEXT();
+        VM_CHECKED(AOC_IMP)
             if (i->imp.idx < 0 || i->imp.idx >= pth->num_imports) {
                 any_error(a, AERR_RUNTIME, "bad import index %d", i->imp.idx);
-            } else {
-                aactor_push(a, pt->import_values + i->imp.idx);
             }
-            break;
-        case AOC_CLS:
+            VM_RESERVE(1);
+        VM_UNCHECKED(AOC_IMP)
+            *VM_PUSH() = pt->import_values[i->imp.idx];
+            VM_NEXT();
+        VM_CHECKED(AOC_CLS)
             if (i->cls.idx < 0 || i->cls.idx >= pth->num_nesteds) {
                 any_error(a, AERR_RUNTIME, "bad nested index %d", i->cls.idx);
-            } else {
-                avalue_t v;
-                av_byte_code_func(&v, pt->nesteds + i->cls.idx);
-                aactor_push(a, &v);
             }
-            break;
-jmp:
-        case AOC_JMP: {
+            VM_RESERVE(1);
+        VM_UNCHECKED(AOC_CLS)
+            av_byte_code_func(VM_PUSH(), pt->nesteds + i->cls.idx);
+            VM_NEXT();
+        VM_CHECKED(AOC_JMP)
+        jmp: {
             aint_t nip = frame->ip + i->jmp.displacement + 1;
             if (nip < 0 || nip >= pth->num_instructions) {
                 any_error(a, AERR_RUNTIME, "bad jump");
-            } else {
-                frame->ip = nip - 1;
             }
-            break;
         }
-        case AOC_JIN: {
+        VM_UNCHECKED(AOC_JMP)
+        jmp_unchecked:
+            // taken first, so a stackless actor resumes at the target.
+            frame->ip += i->jmp.displacement + 1;
+            if (i->jmp.displacement < 0) {
+                VM_REDUCE();
+                VM_STEP_SELECT();
+                VM_JIT_HOT();
+            }
+            VM_JIT();
+            VM_DISPATCH();
+        VM_CHECKED(AOC_JIN) {
             aint_t cnt = any_count(a);
             if (cnt < 1) {
                 any_error(a, AERR_RUNTIME, "pop underflow");
@@ -132,17 +553,62 @@ jmp:
                     goto jmp;
                 }
             }
-            break;
+            VM_NEXT();
         }
-        case AOC_IVK:
+        VM_UNCHECKED(AOC_JIN)
+            --a->stack.sp;
+            if (any_to_bool(a, a->stack.sp) == FALSE) goto jmp_unchecked;
+            VM_NEXT();
+        VM_CASE(AOC_IVK) {
+            aint_t fp;
+            avalue_t* f;
+            VM_REDUCE();
+            fp = a->stack.sp - i->ivk.nargs - 1;
+            f = a->stack.v + fp;
+            if (i->ivk.nargs >= 0 && fp >= frame->bp &&
+                f->tag.type == AVT_BYTE_CODE_FUNC) {
+                actor_push_frame(a, i->ivk.nargs)->pt = f->v.avm_func;
+                goto enter;
+            }
             any_call(a, i->ivk.nargs);
-            break;
-        case AOC_RET:
-            return;
-        case AOC_SND:
+            frame = a->frame;
+            VM_NEXT_JIT();
+        }
+        VM_CASE(AOC_RET)
+        ret:
+            VM_PROFILE_LEAVE();
+            if (frame == a->frames + entry) return;
+            actor_pop_frame(a);
+            goto resume;
+        VM_CASE(AOC_TVK) {
+            aint_t fp;
+            avalue_t* f;
+            VM_REDUCE();
+            fp = a->stack.sp - i->tvk.nargs - 1;
+            f = a->stack.v + fp;
+            if (i->tvk.nargs >= 0 && fp >= frame->bp &&
+                f->tag.type == AVT_BYTE_CODE_FUNC) {
+                // callee and its arguments replace the current ones.
+                aint_t base = frame->bp - frame->nargs - 1;
+                aprototype_t* callee = f->v.avm_func;
+                VM_PROFILE_LEAVE();
+                frame->nargs = i->tvk.nargs;
+                memmove(a->stack.v + base, f,
+                    (size_t)(frame->nargs + 1) * sizeof(avalue_t));
+                a->stack.sp = base + frame->nargs + 1;
+                frame->pt = callee;
+                frame->ip = 0;
+                frame->bp = a->stack.sp;
+                goto enter;
+            }
+            any_call(a, i->tvk.nargs);
+            frame = a->frame;
+            goto ret;
+        }
+        VM_CASE(AOC_SND)
             any_mbox_send(a);
-            break;
-        case AOC_RCV: {
+            VM_NEXT_JIT();
+        VM_CHECKED(AOC_RCV) {
             aint_t cnt = any_count(a);
             if (cnt < 1) {
                 any_error(a, AERR_RUNTIME, "pop underflow");
@@ -153,148 +619,303 @@ jmp:
                     goto jmp;
                 }
             }
-            break;
+            VM_NEXT();
+        }
+        VM_UNCHECKED(AOC_RCV) {
+            aint_t timeout = any_check_integer(a, a->stack.sp - 1);
+            if (any_mbox_recv(a, timeout) == AERR_TIMEOUT) {
+                goto jmp_unchecked;
+            }
+            VM_NEXT_JIT();
         }
-        case AOC_RMV:
+        VM_CASE(AOC_RMV)
             any_mbox_remove(a);
-            break;
-        case AOC_RWD:
+            VM_NEXT_JIT();
+        VM_CASE(AOC_RWD)
             any_mbox_rewind(a);
-            break;
-        case AOC_ADD: {
-            aint_t cnt = any_count(a);
-            if (cnt < 2) {
-                any_error(a, AERR_RUNTIME, "pop underflow");
-            } else {
-                aint_t a_lhs = any_check_index(a, cnt - 1);
-                aint_t a_rhs = any_check_index(a, cnt - 2);
-                avalue_t* lhsv = aactor_at(a, a_lhs);
-                avalue_t* rhsv = aactor_at(a, a_rhs);
-                if (lhsv->tag.type == AVT_INTEGER &&
-                    rhsv->tag.type == AVT_INTEGER) {
-                    av_integer(rhsv, lhsv->v.integer + rhsv->v.integer);
-                } else {
-                    areal_t lhs = any_check_real(a, a_lhs);
-                    areal_t rhs = any_check_real(a, a_rhs);
-                    av_real(rhsv, lhs + rhs);
-                }
-                a->stack.sp -= 1;
-            }
-            break;
+            VM_NEXT_JIT();
+        VM_CASE(AOC_MRK)
+            any_mbox_mark(a);
+            VM_NEXT_JIT();
+        VM_CHECKED(AOC_ADD)
+            VM_CHECK_COUNT(2);
+        VM_UNCHECKED(AOC_ADD) {
+            ARITH_OP(+, AOC_ADD_II, AOC_ADD_RR)
+            VM_NEXT();
         }
-        case AOC_SUB: {
-            aint_t cnt = any_count(a);
-            if (cnt < 2) {
-                any_error(a, AERR_RUNTIME, "pop underflow");
+        VM_CHECKED(AOC_SUB)
+            VM_CHECK_COUNT(2);
+        VM_UNCHECKED(AOC_SUB) {
+            ARITH_OP(-, AOC_SUB_II, AOC_SUB_RR)
+            VM_NEXT();
+        }
+        VM_CHECKED(AOC_MUL)
+            VM_CHECK_COUNT(2);
+        VM_UNCHECKED(AOC_MUL) {
+            ARITH_OP(*, AOC_MUL_II, AOC_MUL_RR)
+            VM_NEXT();
+        }
+        VM_CHECKED(AOC_DIV)
+            VM_CHECK_COUNT(2);
+        VM_UNCHECKED(AOC_DIV) {
+            avalue_t* rhsv = a->stack.v + a->stack.sp - 2;
+            avalue_t* lhsv = rhsv + 1;
+            if (lhsv->tag.type == AVT_INTEGER &&
+                rhsv->tag.type == AVT_INTEGER) {
+                if (rhsv->v.integer == 0) {
+                    any_error(a, AERR_RUNTIME, "divide by zero");
+                }
+                av_integer(rhsv, lhsv->v.integer / rhsv->v.integer);
+                ainstruction_quicken(i, AOC_DIV_II);
             } else {
-                aint_t a_lhs = any_check_index(a, cnt - 1);
-                aint_t a_rhs = any_check_index(a, cnt - 2);
-                avalue_t* lhsv = aactor_at(a, a_lhs);
-                avalue_t* rhsv = aactor_at(a, a_rhs);
-                if (lhsv->tag.type == AVT_INTEGER &&
-                    rhsv->tag.type == AVT_INTEGER) {
-                    av_integer(rhsv, lhsv->v.integer - rhsv->v.integer);
-                } else {
-                    areal_t lhs = any_check_real(a, a_lhs);
-                    areal_t rhs = any_check_real(a, a_rhs);
-                    av_real(rhsv, lhs - rhs);
+                int32_t reals = lhsv->tag.type == AVT_REAL &&
+                    rhsv->tag.type == AVT_REAL;
+                areal_t lhs = any_check_real(a, a->stack.sp - 1);
+                areal_t rhs = any_check_real(a, a->stack.sp - 2);
+                if (afuzzy_equals(rhs, 0)) {
+                    any_error(a, AERR_RUNTIME, "divide by zero");
                 }
-                a->stack.sp -= 1;
+                av_real(rhsv, lhs / rhs);
+                if (reals) ainstruction_quicken(i, AOC_DIV_RR);
             }
-            break;
+            a->stack.sp -= 1;
+            VM_NEXT();
         }
-        case AOC_MUL: {
-            aint_t cnt = any_count(a);
-            if (cnt < 2) {
-                any_error(a, AERR_RUNTIME, "pop underflow");
+        VM_CHECKED(AOC_NOT)
+            VM_CHECK_COUNT(1);
+        VM_UNCHECKED(AOC_NOT) {
+            int32_t cond = any_to_bool(a, a->stack.sp - 1);
+            av_boolean(a->stack.v + a->stack.sp - 1, !cond);
+            VM_NEXT();
+        }
+        VM_CHECKED(AOC_EQ)
+            VM_CHECK_COUNT(2);
+        VM_UNCHECKED(AOC_EQ) {
+            int32_t eq = any_equals(a, a->stack.sp - 1, a->stack.sp - 2);
+            av_boolean(a->stack.v + a->stack.sp - 2, eq);
+            a->stack.sp -= 1;
+            VM_NEXT();
+        }
+        VM_CHECKED(AOC_LT)
+            VM_CHECK_COUNT(2);
+        VM_UNCHECKED(AOC_LT) {
+            LOGICAL_OP(<, AOC_LT_II, AOC_LT_RR)
+            VM_NEXT();
+        }
+        VM_CHECKED(AOC_LE)
+            VM_CHECK_COUNT(2);
+        VM_UNCHECKED(AOC_LE) {
+            LOGICAL_OP(<=, AOC_LE_II, AOC_LE_RR)
+            VM_NEXT();
+        }
+        VM_CHECKED(AOC_GT)
+            VM_CHECK_COUNT(2);
+        VM_UNCHECKED(AOC_GT) {
+            LOGICAL_OP(>, AOC_GT_II, AOC_GT_RR)
+            VM_NEXT();
+        }
+        VM_CHECKED(AOC_GE)
+            VM_CHECK_COUNT(2);
+        VM_UNCHECKED(AOC_GE) {
+            LOGICAL_OP(>=, AOC_GE_II, AOC_GE_RR)
+            VM_NEXT();
+        }
+        VM_CHECKED(AOC_ADD_LL)
+            any_check_index(a, i->add_ll.lhs);
+            any_check_index(a, i->add_ll.rhs);
+            VM_RESERVE(1);
+        VM_UNCHECKED(AOC_ADD_LL) {
+            aint_t lhsi = frame->bp + i->add_ll.lhs;
+            aint_t rhsi = frame->bp + i->add_ll.rhs;
+            avalue_t* lhsv = a->stack.v + lhsi;
+            avalue_t* rhsv = a->stack.v + rhsi;
+            if (lhsv->tag.type == AVT_INTEGER &&
+                rhsv->tag.type == AVT_INTEGER) {
+                av_integer(a->stack.v + a->stack.sp,
+                    lhsv->v.integer + rhsv->v.integer);
             } else {
-                aint_t a_lhs = any_check_index(a, cnt - 1);
-                aint_t a_rhs = any_check_index(a, cnt - 2);
-                avalue_t* lhsv = aactor_at(a, a_lhs);
-                avalue_t* rhsv = aactor_at(a, a_rhs);
-                if (lhsv->tag.type == AVT_INTEGER &&
-                    rhsv->tag.type == AVT_INTEGER) {
-                    av_integer(rhsv, lhsv->v.integer * rhsv->v.integer);
-                } else {
-                    areal_t lhs = any_check_real(a, a_lhs);
-                    areal_t rhs = any_check_real(a, a_rhs);
-                    av_real(rhsv, lhs * rhs);
-                }
-                a->stack.sp -= 1;
+                areal_t lhs = any_check_real(a, lhsi);
+                areal_t rhs = any_check_real(a, rhsi);
+                av_real(a->stack.v + a->stack.sp, lhs + rhs);
             }
-            break;
+            ++a->stack.sp;
+            VM_NEXT();
         }
-        case AOC_DIV: {
-            aint_t cnt = any_count(a);
-            if (cnt < 2) {
-                any_error(a, AERR_RUNTIME, "pop underflow");
-            } else {
-                aint_t a_lhs = any_check_index(a, cnt - 1);
-                aint_t a_rhs = any_check_index(a, cnt - 2);
-                avalue_t* lhsv = aactor_at(a, a_lhs);
-                avalue_t* rhsv = aactor_at(a, a_rhs);
-                if (lhsv->tag.type == AVT_INTEGER &&
-                    rhsv->tag.type == AVT_INTEGER) {
-                    if (rhsv->v.integer == 0) {
-                        any_error(a, AERR_RUNTIME, "divide by zero");
-                    }
-                    av_integer(rhsv, lhsv->v.integer / rhsv->v.integer);
-                } else {
-                    areal_t lhs = any_check_real(a, a_lhs);
-                    areal_t rhs = any_check_real(a, a_rhs);
-                    if (afuzzy_equals(rhs, 0)) {
-                        any_error(a, AERR_RUNTIME, "divide by zero");
-                    }
-                    av_real(rhsv, lhs / rhs);
-                }
-                a->stack.sp -= 1;
+        VM_CHECKED(AOC_ADDI)
+            VM_CHECK_COUNT(1);
+        VM_UNCHECKED(AOC_ADDI) {
+            ADDI_OP(a->stack.sp - 1, i->addi.val)
+            VM_NEXT();
+        }
+        VM_CHECKED(AOC_INC)
+            any_check_index(a, i->inc.idx);
+        VM_UNCHECKED(AOC_INC) {
+            ADDI_OP(frame->bp + i->inc.idx, i->inc.val)
+            VM_NEXT();
+        }
+        VM_CHECKED(AOC_JLT) {
+            VM_CHECK_COUNT(1);
+            BRANCH_OP(jlt, <, branch)
+        }
+        VM_UNCHECKED(AOC_JLT) {
+            BRANCH_OP(jlt, <, branch_unchecked)
+        }
+        VM_CHECKED(AOC_JLE) {
+            VM_CHECK_COUNT(1);
+            BRANCH_OP(jle, <=, branch)
+        }
+        VM_UNCHECKED(AOC_JLE) {
+            BRANCH_OP(jle, <=, branch_unchecked)
+        }
+        VM_CHECKED(AOC_JGT) {
+            VM_CHECK_COUNT(1);
+            BRANCH_OP(jgt, >, branch)
+        }
+        VM_UNCHECKED(AOC_JGT) {
+            BRANCH_OP(jgt, >, branch_unchecked)
+        }
+        VM_CHECKED(AOC_JGE) {
+            VM_CHECK_COUNT(1);
+            BRANCH_OP(jge, >=, branch)
+        }
+        VM_UNCHECKED(AOC_JGE) {
+            BRANCH_OP(jge, >=, branch_unchecked)
+        }
+        branch: {
+            aint_t nip = frame->ip + i->jlt.displacement + 1;
+            if (nip < 0 || nip >= pth->num_instructions) {
+                any_error(a, AERR_RUNTIME, "bad jump");
             }
-            break;
         }
-        case AOC_NOT: {
-            aint_t cnt = any_count(a);
-            if (cnt < 1) {
-                any_error(a, AERR_RUNTIME, "pop underflow");
-            } else {
-                aint_t a_cond = any_check_index(a, cnt - 1);
-                avalue_t* cond = aactor_at(a, a_cond);
-                av_boolean(cond, !any_to_bool(a, a_cond));
+        branch_unchecked:
+            frame->ip += i->jlt.displacement + 1;
+            if (i->jlt.displacement < 0) {
+                VM_REDUCE();
+                VM_STEP_SELECT();
+                VM_JIT_HOT();
             }
-            break;
+            VM_JIT();
+            VM_DISPATCH();
+        VM_CHECKED(AOC_ADD_II)
+            VM_CHECK_COUNT(2);
+        VM_UNCHECKED(AOC_ADD_II) {
+            QUICK_OP(AVT_INTEGER, integer, av_integer, +, AOC_ADD)
         }
-        case AOC_EQ: {
-            aint_t cnt = any_count(a);
-            if (cnt < 2) {
-                any_error(a, AERR_RUNTIME, "pop underflow");
-            } else {
-                aint_t a_lhs = any_check_index(a, cnt - 1);
-                aint_t a_rhs = any_check_index(a, cnt - 2);
-                avalue_t* rhs = aactor_at(a, a_rhs);
-                av_boolean(rhs, any_equals(a, a_lhs, a_rhs));
+        VM_CHECKED(AOC_SUB_II)
+            VM_CHECK_COUNT(2);
+        VM_UNCHECKED(AOC_SUB_II) {
+            QUICK_OP(AVT_INTEGER, integer, av_integer, -, AOC_SUB)
+        }
+        VM_CHECKED(AOC_MUL_II)
+            VM_CHECK_COUNT(2);
+        VM_UNCHECKED(AOC_MUL_II) {
+            QUICK_OP(AVT_INTEGER, integer, av_integer, *, AOC_MUL)
+        }
+        VM_CHECKED(AOC_DIV_II)
+            VM_CHECK_COUNT(2);
+        VM_UNCHECKED(AOC_DIV_II) {
+            avalue_t* rhsv = a->stack.v + a->stack.sp - 2;
+            avalue_t* lhsv = rhsv + 1;
+            // divide by zero is reported by the generic handler.
+            if (lhsv->tag.type == AVT_INTEGER && rhsv->tag.type == AVT_INTEGER &&
+                rhsv->v.integer != 0) {
+                av_integer(rhsv, lhsv->v.integer / rhsv->v.integer);
                 a->stack.sp -= 1;
+                VM_NEXT();
             }
-            break;
+            VM_DEQUICKEN(AOC_DIV);
+        }
+        VM_CHECKED(AOC_LT_II)
+            VM_CHECK_COUNT(2);
+        VM_UNCHECKED(AOC_LT_II) {
+            QUICK_OP(AVT_INTEGER, integer, av_boolean, <, AOC_LT)
+        }
+        VM_CHECKED(AOC_LE_II)
+            VM_CHECK_COUNT(2);
+        VM_UNCHECKED(AOC_LE_II) {
+            QUICK_OP(AVT_INTEGER, integer, av_boolean, <=, AOC_LE)
         }
-        case AOC_LT: {
-            LOGICAL_OP(<)
-            break;
+        VM_CHECKED(AOC_GT_II)
+            VM_CHECK_COUNT(2);
+        VM_UNCHECKED(AOC_GT_II) {
+            QUICK_OP(AVT_INTEGER, integer, av_boolean, >, AOC_GT)
         }
-        case AOC_LE: {
-            LOGICAL_OP(<=)
-            break;
+        VM_CHECKED(AOC_GE_II)
+            VM_CHECK_COUNT(2);
+        VM_UNCHECKED(AOC_GE_II) {
+            QUICK_OP(AVT_INTEGER, integer, av_boolean, >=, AOC_GE)
         }
-        case AOC_GT: {
-            LOGICAL_OP(>)
-            break;
+        VM_CHECKED(AOC_ADD_RR)
+            VM_CHECK_COUNT(2);
+        VM_UNCHECKED(AOC_ADD_RR) {
+            QUICK_OP(AVT_REAL, real, av_real, +, AOC_ADD)
         }
-        case AOC_GE: {
-            LOGICAL_OP(>=)
-            break;
+        VM_CHECKED(AOC_SUB_RR)
+            VM_CHECK_COUNT(2);
+        VM_UNCHECKED(AOC_SUB_RR) {
+            QUICK_OP(AVT_REAL, real, av_real, -, AOC_SUB)
+        }
+        VM_CHECKED(AOC_MUL_RR)
+            VM_CHECK_COUNT(2);
+        VM_UNCHECKED(AOC_MUL_RR) {
+            QUICK_OP(AVT_REAL, real, av_real, *, AOC_MUL)
+        }
+        VM_CHECKED(AOC_DIV_RR)
+            VM_CHECK_COUNT(2);
+        VM_UNCHECKED(AOC_DIV_RR) {
+            avalue_t* rhsv = a->stack.v + a->stack.sp - 2;
+            avalue_t* lhsv = rhsv + 1;
+            // divide by zero is reported by the generic handler.
+            if (lhsv->tag.type == AVT_REAL && rhsv->tag.type == AVT_REAL &&
+                !afuzzy_equals(rhsv->v.real, 0)) {
+                av_real(rhsv, lhsv->v.real / rhsv->v.real);
+                a->stack.sp -= 1;
+                VM_NEXT();
+            }
+            VM_DEQUICKEN(AOC_DIV);
         }
-        default:
-            any_error(a, AERR_RUNTIME, "bad instruction %u", i->b.opcode);
-            break;
+        VM_CHECKED(AOC_LT_RR)
+            VM_CHECK_COUNT(2);
+        VM_UNCHECKED(AOC_LT_RR) {
+            QUICK_OP(AVT_REAL, real, av_boolean, <, AOC_LT)
         }
+        VM_CHECKED(AOC_LE_RR)
+            VM_CHECK_COUNT(2);
+        VM_UNCHECKED(AOC_LE_RR) {
+            QUICK_OP(AVT_REAL, real, av_boolean, <=, AOC_LE)
+        }
+        VM_CHECKED(AOC_GT_RR)
+            VM_CHECK_COUNT(2);
+        VM_UNCHECKED(AOC_GT_RR) {
+            QUICK_OP(AVT_REAL, real, av_boolean, >, AOC_GT)
+        }
+        VM_CHECKED(AOC_GE_RR)
+            VM_CHECK_COUNT(2);
+        VM_UNCHECKED(AOC_GE_RR) {
+            QUICK_OP(AVT_REAL, real, av_boolean, >=, AOC_GE)
+        }
+        VM_DEFAULT
+            any_error(a, AERR_RUNTIME,
+                "bad instruction %d", ainstruction_opcode(i));
+            VM_NEXT();
+#ifndef ATHREADED_DISPATCH
     }
+#endif
+return_missing:
     any_error(a, AERR_RUNTIME, "return missing");
-}
\ No newline at end of file
+}
+
+void
+actor_dispatch(
+    aactor_t* a)
+{
+    dispatch(a, a->frame - a->frames, FALSE);
+}
+
+void
+actor_dispatch_resume(
+    aactor_t* a)
+{
+    // stackless actors enter byte code right above the root frame.
+    dispatch(a, 1, TRUE);
+}
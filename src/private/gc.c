@@ -1,9 +1,14 @@
 /* Copyright (c) 2017 Nguyen Viet Giang. All rights reserved. */
 #include <any/gc.h>
 
+#include <any/std_string.h>
+
 #define GROW_FACTOR 2
 #define NOT_FORWARED -1
 
+#define NEW_CAST(T, gc, idx) \
+    ((T*)((gc)->new_heap + idx + sizeof(agc_header_t)))
+
 static inline void*
 aalloc(
     agc_t* self, void* old, const aint_t sz)
@@ -38,6 +43,8 @@ copy(
     ngch = (agc_header_t*)(self->new_heap + self->heap_sz);
     if (ogch->forwared == NOT_FORWARED) {
         memcpy(ngch, ogch, (size_t)ogch->sz);
+        // remember the original, see \ref agc_stage.
+        ngch->forwared = v->v.heap_idx;
         ogch->forwared = self->heap_sz;
         self->heap_sz += ogch->sz;
     }
@@ -55,12 +62,13 @@ copy_tuple(
     }
 }
 
+// Elements are updated in the copied buffer, originals are left as is.
 static inline void
 copy_array(
     agc_t* self, agc_array_t* o)
 {
     aint_t i;
-    avalue_t* elements = AGC_CAST(avalue_t, self, o->buff.v.heap_idx);
+    avalue_t* elements = NEW_CAST(avalue_t, self, o->buff.v.heap_idx);
     for (i = 0; i < o->sz; ++i) {
         copy(self, elements + i);
     }
@@ -71,7 +79,7 @@ copy_table(
     agc_t* self, agc_table_t* o)
 {
     aint_t i;
-    avalue_t* elements = AGC_CAST(avalue_t, self, o->buff.v.heap_idx);
+    avalue_t* elements = NEW_CAST(avalue_t, self, o->buff.v.heap_idx);
     for (i = 0; i < o->sz; ++i) {
         copy(self, elements + i * 2);
         copy(self, elements + i * 2 + 1);
@@ -106,31 +114,139 @@ scan(
     }
     case AVT_ARRAY: {
         agc_array_t* o = (agc_array_t*)(gch + 1);
-        copy_array(self, o);
         copy(self, &o->buff);
+        copy_array(self, o);
         break;
     }
     case AVT_TABLE: {
         agc_table_t* o = (agc_table_t*)(gch + 1);
-        copy_table(self, o);
         copy(self, &o->buff);
+        copy_table(self, o);
         break;
     }
     default: assert(!"bad value type");
     }
 }
 
+static inline void
+move(
+    avalue_t* v, aint_t base)
+{
+    if (v->tag.collectable) v->v.heap_idx += base;
+}
+
+// Relocate references of `gch` which is copied `base` bytes further.
+static void
+rebase(
+    agc_t* self, agc_header_t* gch, aint_t base)
+{
+    aint_t i;
+    switch (gch->type) {
+    case AVT_BUFFER: {
+        agc_buffer_t* o = (agc_buffer_t*)(gch + 1);
+        move(&o->buff, base);
+        if (o->bin) abinary_retain(o->bin);
+        o->next = self->buffers;
+        self->buffers = (aint_t)((uint8_t*)gch - self->cur_heap);
+        break;
+    }
+    case AVT_TUPLE: {
+        agc_tuple_t* o = (agc_tuple_t*)(gch + 1);
+        avalue_t* elements = (avalue_t*)(o + 1);
+        for (i = 0; i < o->sz; ++i) {
+            move(elements + i, base);
+        }
+        break;
+    }
+    case AVT_ARRAY: {
+        agc_array_t* o = (agc_array_t*)(gch + 1);
+        avalue_t* elements =
+            AGC_CAST(avalue_t, self, o->buff.v.heap_idx + base);
+        for (i = 0; i < o->sz; ++i) {
+            move(elements + i, base);
+        }
+        move(&o->buff, base);
+        break;
+    }
+    case AVT_TABLE: {
+        agc_table_t* o = (agc_table_t*)(gch + 1);
+        avalue_t* elements =
+            AGC_CAST(avalue_t, self, o->buff.v.heap_idx + base);
+        for (i = 0; i < o->sz * 2; ++i) {
+            move(elements + i, base);
+        }
+        move(&o->buff, base);
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+// Relink buffers which are alive, release binaries of the others.
+static void
+sweep_buffers(
+    agc_t* self)
+{
+    aint_t idx = self->buffers;
+    self->buffers = -1;
+    while (idx >= 0) {
+        agc_header_t* gch = (agc_header_t*)(self->cur_heap + idx);
+        agc_buffer_t* o = (agc_buffer_t*)(gch + 1);
+        if (gch->forwared != NOT_FORWARED) {
+            NEW_CAST(agc_buffer_t, self, gch->forwared)->next = self->buffers;
+            self->buffers = gch->forwared;
+        } else if (o->bin) {
+            abinary_release(o->bin);
+        }
+        idx = o->next;
+    }
+}
+
+static void
+release_buffers(
+    agc_t* self)
+{
+    aint_t idx;
+    for (idx = self->buffers; idx >= 0;) {
+        agc_buffer_t* o = AGC_CAST(agc_buffer_t, self, idx);
+        if (o->bin) abinary_release(o->bin);
+        idx = o->next;
+    }
+    self->buffers = -1;
+}
+
+static void
+staged_refs(
+    const uint8_t* objs, aint_t sz, int32_t retain)
+{
+    aint_t pos;
+    for (pos = 0; pos != sz;) {
+        const agc_header_t* gch = (const agc_header_t*)(objs + pos);
+        if (gch->type == AVT_BUFFER) {
+            abinary_t* bin = ((const agc_buffer_t*)(gch + 1))->bin;
+            if (bin && retain) abinary_retain(bin);
+            else if (bin) abinary_release(bin);
+        }
+        pos += gch->sz;
+    }
+}
+
 aerror_t
 agc_init(
     agc_t* self, aint_t heap_cap, aalloc_t alloc, void* alloc_ud)
 {
     self->alloc = alloc;
     self->alloc_ud = alloc_ud;
-    self->cur_heap = (uint8_t*)aalloc(self, NULL, heap_cap*2);
-    if (!self->cur_heap) return AERR_FULL;
-    self->new_heap = self->cur_heap + heap_cap;
-    self->heap_cap = heap_cap;
+    self->cur_heap = NULL;
+    self->new_heap = NULL;
+    self->heap_cap = 0;
     self->heap_sz = 0;
+    self->scan = 0;
+    self->buffers = -1;
+    if (heap_cap <= 0) heap_cap = 8;
+    // semi-spaces are next to each other, objects are 8 bytes aligned.
+    self->init_cap = AALIGN_FORWARD(heap_cap, 8);
     return AERR_NONE;
 }
 
@@ -138,11 +254,25 @@ void
 agc_cleanup(
     agc_t* self)
 {
-    aalloc(self, low_heap(self), 0);
+    release_buffers(self);
+    if (self->cur_heap) aalloc(self, low_heap(self), 0);
+    self->new_heap = NULL;
+    self->cur_heap = NULL;
+    self->heap_cap = 0;
+    self->heap_sz = 0;
+}
+
+uint8_t*
+agc_detach(
+    agc_t* self)
+{
+    uint8_t* heap = self->cur_heap ? low_heap(self) : NULL;
+    release_buffers(self);
     self->new_heap = NULL;
     self->cur_heap = NULL;
     self->heap_cap = 0;
     self->heap_sz = 0;
+    return heap;
 }
 
 aint_t
@@ -167,13 +297,15 @@ agc_reserve(
     agc_t* self, aint_t more, aint_t n)
 {
     uint8_t* nh;
-    aint_t new_cap = self->heap_cap;
+    aint_t new_cap = self->heap_cap > 0 ? self->heap_cap : self->init_cap;
     more += (n * sizeof(agc_header_t));
     while (new_cap < self->heap_sz + more) new_cap *= GROW_FACTOR;
     nh = (uint8_t*)aalloc(self, NULL, new_cap * 2);
     if (!nh) return AERR_FULL;
-    memcpy(nh, self->cur_heap, (size_t)self->heap_sz);
-    aalloc(self, low_heap(self), 0);
+    if (self->cur_heap) {
+        memcpy(nh, self->cur_heap, (size_t)self->heap_sz);
+        aalloc(self, low_heap(self), 0);
+    }
     self->cur_heap = nh;
     self->new_heap = nh + new_cap;
     self->heap_cap = new_cap;
@@ -195,7 +327,170 @@ agc_collect(
     while (self->scan != self->heap_sz) {
         agc_header_t* header = (agc_header_t*)(self->new_heap + self->scan);
         scan(self, header);
+        header->forwared = NOT_FORWARED;
         self->scan += header->sz;
     }
+    sweep_buffers(self);
     swap(self);
 }
+
+aint_t
+agc_stage(
+    agc_t* self, avalue_t* v, aint_t n)
+{
+    aint_t heap_sz = self->heap_sz;
+    aint_t sz;
+    aint_t i;
+    self->heap_sz = 0;
+    self->scan = 0;
+    for (i = 0; i < n; ++i) {
+        copy(self, v + i);
+    }
+    while (self->scan != self->heap_sz) {
+        agc_header_t* header = (agc_header_t*)(self->new_heap + self->scan);
+        scan(self, header);
+        self->scan += header->sz;
+    }
+    sz = self->heap_sz;
+    // originals stay, undo their forwarding.
+    for (self->scan = 0; self->scan != sz;) {
+        agc_header_t* header = (agc_header_t*)(self->new_heap + self->scan);
+        agc_header_t* origin =
+            (agc_header_t*)(self->cur_heap + header->forwared);
+        origin->forwared = NOT_FORWARED;
+        header->forwared = NOT_FORWARED;
+        self->scan += header->sz;
+    }
+    self->heap_sz = heap_sz;
+    self->scan = 0;
+    return sz;
+}
+
+void
+agc_copy_in(
+    agc_t* self, const uint8_t* objs, aint_t sz, avalue_t* v, aint_t n)
+{
+    aint_t base = self->heap_sz;
+    aint_t pos;
+    aint_t i;
+    assert(base + sz <= self->heap_cap);
+    if (sz == 0) return;
+    memcpy(self->cur_heap + base, objs, (size_t)sz);
+    for (pos = 0; pos != sz;) {
+        agc_header_t* header = (agc_header_t*)(self->cur_heap + base + pos);
+        rebase(self, header, base);
+        pos += header->sz;
+    }
+    for (i = 0; i < n; ++i) {
+        move(v + i, base);
+    }
+    self->heap_sz += sz;
+}
+
+afrag_t*
+agc_frag_new(
+    agc_t* self, const avalue_t* v)
+{
+    afrag_t* frag;
+    avalue_t staged = *v;
+    aint_t sz = agc_stage(self, &staged, 1);
+    frag = (afrag_t*)aalloc(self, NULL, (aint_t)sizeof(afrag_t) + sz);
+    if (!frag) return NULL;
+    frag->alloc = self->alloc;
+    frag->alloc_ud = self->alloc_ud;
+    frag->sz = sz;
+    frag->v = staged;
+    memcpy(frag + 1, self->new_heap, (size_t)sz);
+    staged_refs((uint8_t*)(frag + 1), sz, TRUE);
+    return frag;
+}
+
+afrag_t*
+afrag_string_new(
+    aalloc_t alloc, void* alloc_ud, const char* s)
+{
+    ahash_and_length_t hal = ahash_and_length(s);
+    aint_t sz = AALIGN_FORWARD(sizeof(agc_header_t) + sizeof(agc_string_t) +
+        hal.length + 1, 8);
+    afrag_t* frag;
+    agc_header_t* gch;
+    agc_string_t* o;
+    frag = (afrag_t*)alloc(alloc_ud, NULL, (aint_t)sizeof(afrag_t) + sz);
+    if (!frag) return NULL;
+    frag->alloc = alloc;
+    frag->alloc_ud = alloc_ud;
+    frag->sz = sz;
+    // laid out as if staged from a heap, the string is the only object.
+    gch = (agc_header_t*)(frag + 1);
+    gch->type = AVT_STRING;
+    gch->forwared = NOT_FORWARED;
+    gch->sz = sz;
+    o = (agc_string_t*)(gch + 1);
+    o->hal = hal;
+    memcpy(o + 1, s, (size_t)hal.length + 1);
+    av_collectable(&frag->v, AVT_STRING, 0);
+    return frag;
+}
+
+afrag_t*
+afrag_post_new(
+    aalloc_t alloc, void* alloc_ud, apost_t* post)
+{
+    afrag_t* frag = post->frag;
+    post->frag = NULL;
+    if (post->s) {
+        frag = afrag_string_new(alloc, alloc_ud, post->s);
+        alloc(alloc_ud, post->s, 0);
+        post->s = NULL;
+    } else if (!frag) {
+        // without objects, the fragment only carries `v`.
+        frag = (afrag_t*)alloc(alloc_ud, NULL, (aint_t)sizeof(afrag_t));
+        if (!frag) return NULL;
+        frag->alloc = alloc;
+        frag->alloc_ud = alloc_ud;
+        frag->sz = 0;
+        frag->v = post->v;
+    }
+    return frag;
+}
+
+void
+agc_frag_merge(
+    agc_t* self, const afrag_t* frag, avalue_t* out)
+{
+    *out = frag->v;
+    agc_copy_in(self, (const uint8_t*)(frag + 1), frag->sz, out, 1);
+}
+
+void
+afrag_free(
+    afrag_t* self)
+{
+    staged_refs((uint8_t*)(self + 1), self->sz, FALSE);
+    self->alloc(self->alloc_ud, self, 0);
+}
+
+abinary_t*
+abinary_new(
+    aalloc_t alloc, void* alloc_ud, aint_t cap)
+{
+    abinary_t* self = (abinary_t*)alloc(
+        alloc_ud, NULL, (aint_t)sizeof(abinary_t) + cap);
+    if (!self) return NULL;
+    self->alloc = alloc;
+    self->alloc_ud = alloc_ud;
+    self->refs = 1;
+    return self;
+}
+
+void
+abinary_release(
+    abinary_t* self)
+{
+#ifdef ANY_SMP
+    if (__atomic_sub_fetch(&self->refs, 1, __ATOMIC_ACQ_REL) != 0) return;
+#else
+    if (--self->refs != 0) return;
+#endif
+    self->alloc(self->alloc_ud, self, 0);
+}
@@ -0,0 +1,952 @@
+/* Copyright (c) 2017 Nguyen Viet Giang. All rights reserved. */
+#include <any/jit.h>
+
+#ifdef ANY_JIT
+
+#if !defined(AARCH_AMD64) || !(defined(ALINUX) || defined(AAPPLE))
+#error "JIT requires x86-64 and mmap"
+#endif
+
+#include <any/actor.h>
+#include <any/loader.h>
+#include <any/std.h>
+
+#include <stddef.h>
+#include <sys/mman.h>
+
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+/*
+Register assignment of native code, all callee saved so that C helpers keep
+them, caches are written back to the actor before leaving or calling out.
+
+    rbx  actor
+    r12  a->stack.v
+    r13  top of stack, a->stack.v + a->stack.sp
+    r14  frame base, a->stack.v + frame->bp
+    r15  a->frame
+*/
+enum {
+    RAX = 0, RCX = 1, RDX = 2, RBX = 3, RSI = 6, RDI = 7,
+    R12 = 12, R13 = 13, R14 = 14, R15 = 15
+};
+
+// Condition codes, low nibble of `jcc` and `setcc`.
+enum {
+    CC_E = 0x4, CC_NE = 0x5, CC_L = 0xC, CC_GE = 0xD, CC_LE = 0xE, CC_G = 0xF,
+    CC_ALWAYS = -1
+};
+
+// Fixup targets besides instructions.
+enum { TARGET_EPILOGUE = -1 };
+
+#define SLOT(n) ((int32_t)((n) * (aint_t)sizeof(avalue_t)))
+#define TAG ((int32_t)offsetof(avalue_t, tag))
+#define VAL ((int32_t)offsetof(avalue_t, v))
+#define OFF(t, f) ((int32_t)offsetof(t, f))
+
+typedef struct afixup_s {
+    aint_t pos;
+    aint_t target;
+} afixup_t;
+
+// Backward jump, counts a reduction before looping.
+typedef struct astub_s {
+    aint_t target;
+    aint_t pos;
+} astub_t;
+
+typedef struct ajit_s {
+    aalloc_t alloc;
+    void* alloc_ud;
+    uint8_t* code;
+    aint_t sz;
+    aint_t cap;
+    aint_t* labels;
+    afixup_t* fixups;
+    aint_t num_fixups;
+    aint_t max_fixups;
+    astub_t* stubs;
+    aint_t num_stubs;
+    aint_t max_stubs;
+    int32_t failed;
+} ajit_t;
+
+static void*
+grow(
+    ajit_t* j, void* old, aint_t* cap, aint_t elem_sz)
+{
+    aint_t ncap = *cap ? *cap * 2 : 64;
+    void* p = j->alloc(j->alloc_ud, old, (size_t)(ncap * elem_sz));
+    if (!p) {
+        j->failed = TRUE;
+        return NULL;
+    }
+    *cap = ncap;
+    return p;
+}
+
+static void
+emit(
+    ajit_t* j, const void* b, aint_t n)
+{
+    if (j->failed) return;
+    while (j->sz + n > j->cap) {
+        uint8_t* code = (uint8_t*)grow(j, j->code, &j->cap, 1);
+        if (!code) return;
+        j->code = code;
+    }
+    memcpy(j->code + j->sz, b, (size_t)n);
+    j->sz += n;
+}
+
+static void
+emit8(
+    ajit_t* j, uint8_t b)
+{
+    emit(j, &b, 1);
+}
+
+static void
+emit32(
+    ajit_t* j, int32_t v)
+{
+    emit(j, &v, 4);
+}
+
+static void
+emit64(
+    ajit_t* j, uint64_t v)
+{
+    emit(j, &v, 8);
+}
+
+// `op reg, [base + disp]`, base must not be `rsp` or `r12`.
+static void
+emit_rm(
+    ajit_t* j, int32_t w, const char* op, int32_t reg, int32_t base,
+    int32_t disp)
+{
+    uint8_t rex = (uint8_t)(0x40 | (w ? 8 : 0) |
+        ((reg & 8) ? 4 : 0) | ((base & 8) ? 1 : 0));
+    assert((base & 7) != 4);
+    if (rex != 0x40) emit8(j, rex);
+    emit(j, op, (aint_t)strlen(op));
+    emit8(j, (uint8_t)(0x80 | ((reg & 7) << 3) | (base & 7)));
+    emit32(j, disp);
+}
+
+// `op rm, reg` between registers.
+static void
+emit_rr(
+    ajit_t* j, int32_t w, const char* op, int32_t reg, int32_t rm)
+{
+    uint8_t rex = (uint8_t)(0x40 | (w ? 8 : 0) |
+        ((reg & 8) ? 4 : 0) | ((rm & 8) ? 1 : 0));
+    if (rex != 0x40) emit8(j, rex);
+    emit(j, op, (aint_t)strlen(op));
+    emit8(j, (uint8_t)(0xC0 | ((reg & 7) << 3) | (rm & 7)));
+}
+
+// Opcode strings, `\x` escapes keep the encodings readable next to mnemonics.
+#define OP_ADD_R_RM "\x03"
+#define OP_SUB_R_RM "\x2B"
+#define OP_IMUL_R_RM "\x0F\xAF"
+#define OP_MOV_RM_R "\x89"
+#define OP_MOV_R_RM "\x8B"
+#define OP_LEA "\x8D"
+#define OP_MOV_RM_IMM "\xC7"
+#define OP_GRP1_RM_IMM32 "\x81"
+#define OP_GRP1_RM_IMM8 "\x83"
+#define OP_CMP_RM8_IMM8 "\x80"
+#define OP_MOVUPS_LOAD "\x0F\x10"
+#define OP_MOVUPS_STORE "\x0F\x11"
+
+static void
+set_tag(
+    ajit_t* j, int32_t base, int32_t disp, int32_t type)
+{
+    emit_rm(j, FALSE, OP_MOV_RM_IMM, 0, base, disp + TAG);
+    emit32(j, type);
+}
+
+// `add r13, n * sizeof(avalue_t)`, flags are clobbered.
+static void
+move_top(
+    ajit_t* j, aint_t n)
+{
+    emit_rr(j, TRUE, OP_GRP1_RM_IMM32, 0, R13);
+    emit32(j, SLOT(n));
+}
+
+// `mov rax, imm64`, absolute addresses of helpers and prototype data.
+static void
+mov_rax_imm64(
+    ajit_t* j, uint64_t v)
+{
+    emit8(j, 0x48);
+    emit8(j, 0xB8);
+    emit64(j, v);
+}
+
+static aint_t
+jump_local(
+    ajit_t* j, int32_t cc)
+{
+    if (cc == CC_ALWAYS) {
+        emit8(j, 0xE9);
+    } else {
+        emit8(j, 0x0F);
+        emit8(j, (uint8_t)(0x80 | cc));
+    }
+    emit32(j, 0);
+    return j->sz - 4;
+}
+
+static void
+bind_local(
+    ajit_t* j, aint_t pos)
+{
+    int32_t rel = (int32_t)(j->sz - (pos + 4));
+    if (j->failed) return;
+    memcpy(j->code + pos, &rel, 4);
+}
+
+static void
+jump_to(
+    ajit_t* j, int32_t cc, aint_t target)
+{
+    aint_t pos = jump_local(j, cc);
+    if (j->failed) return;
+    if (j->num_fixups == j->max_fixups) {
+        afixup_t* fixups = (afixup_t*)grow(
+            j, j->fixups, &j->max_fixups, sizeof(afixup_t));
+        if (!fixups) return;
+        j->fixups = fixups;
+    }
+    j->fixups[j->num_fixups].pos = pos;
+    j->fixups[j->num_fixups].target = target;
+    ++j->num_fixups;
+}
+
+// Jump from instruction `ip` to `target`, backward jumps count a reduction.
+static void
+branch(
+    ajit_t* j, int32_t cc, aint_t ip, aint_t target)
+{
+    if (target > ip) {
+        jump_to(j, cc, target);
+        return;
+    }
+    if (j->num_stubs == j->max_stubs) {
+        astub_t* stubs = (astub_t*)grow(
+            j, j->stubs, &j->max_stubs, sizeof(astub_t));
+        if (!stubs) return;
+        j->stubs = stubs;
+    }
+    j->stubs[j->num_stubs].target = target;
+    // stubs are placed after instructions and the epilogue.
+    jump_to(j, cc, TARGET_EPILOGUE - 1 - j->num_stubs);
+    ++j->num_stubs;
+}
+
+static void
+write_back(
+    ajit_t* j)
+{
+    static const uint8_t sar_rax_4[] = { 0x48, 0xC1, 0xF8, 0x04 };
+    emit_rr(j, TRUE, OP_MOV_RM_R, R13, RAX);
+    emit_rr(j, TRUE, "\x29", R12, RAX);
+    emit(j, sar_rax_4, sizeof(sar_rax_4));
+    emit_rm(j, TRUE, OP_MOV_RM_R, RAX, RBX, OFF(aactor_t, stack.sp));
+}
+
+static void
+reload(
+    ajit_t* j)
+{
+    static const uint8_t shl_rax_4[] = { 0x48, 0xC1, 0xE0, 0x04 };
+    static const uint8_t lea_r13[] = { 0x4D, 0x8D, 0x2C, 0x04 };
+    static const uint8_t lea_r14[] = { 0x4D, 0x8D, 0x34, 0x04 };
+    emit_rm(j, TRUE, OP_MOV_R_RM, R12, RBX, OFF(aactor_t, stack.v));
+    emit_rm(j, TRUE, OP_MOV_R_RM, RAX, RBX, OFF(aactor_t, stack.sp));
+    emit(j, shl_rax_4, sizeof(shl_rax_4));
+    emit(j, lea_r13, sizeof(lea_r13));
+    emit_rm(j, TRUE, OP_MOV_R_RM, R15, RBX, OFF(aactor_t, frame));
+    emit_rm(j, TRUE, OP_MOV_R_RM, RAX, R15, OFF(aframe_t, bp));
+    emit(j, shl_rax_4, sizeof(shl_rax_4));
+    emit(j, lea_r14, sizeof(lea_r14));
+}
+
+static void
+store_ip(
+    ajit_t* j, aint_t ip)
+{
+    emit_rm(j, TRUE, OP_MOV_RM_IMM, 0, R15, OFF(aframe_t, ip));
+    emit32(j, (int32_t)ip);
+}
+
+// Return `code` to the dispatcher, which continues at `ip`.
+static void
+leave(
+    ajit_t* j, aint_t ip, int32_t code)
+{
+    store_ip(j, ip);
+    write_back(j);
+    emit8(j, 0xB8);
+    emit32(j, code);
+    jump_to(j, CC_ALWAYS, TARGET_EPILOGUE);
+}
+
+/*
+Helpers may raise errors, which unwind through native code by `longjmp`, the
+instruction pointer is therefore stored first. Arguments beside the actor are
+loaded into `rsi` and `rdx` by the caller between `call_begin` and `call_end`.
+*/
+static void
+call_begin(
+    ajit_t* j, aint_t ip)
+{
+    store_ip(j, ip);
+    write_back(j);
+    emit_rr(j, TRUE, OP_MOV_RM_R, RBX, RDI);
+}
+
+// The `int32_t` result, if any, is kept in `ecx` since reloading uses `rax`.
+static void
+call_end(
+    ajit_t* j, void* fn)
+{
+    static const uint8_t call_rax[] = { 0xFF, 0xD0 };
+    static const uint8_t mov_ecx_eax[] = { 0x89, 0xC1 };
+    mov_rax_imm64(j, (uint64_t)(uintptr_t)fn);
+    emit(j, call_rax, sizeof(call_rax));
+    emit(j, mov_ecx_eax, sizeof(mov_ecx_eax));
+    reload(j);
+}
+
+static void
+arg_imm(
+    ajit_t* j, int32_t reg, aint_t v)
+{
+    emit_rr(j, TRUE, OP_MOV_RM_IMM, 0, reg);
+    emit32(j, (int32_t)v);
+}
+
+static void
+arg_ptr(
+    ajit_t* j, int32_t reg, int32_t base, int32_t disp)
+{
+    emit_rm(j, TRUE, OP_LEA, reg, base, disp);
+}
+
+// Test the result of the last helper, kept by `call_end`.
+static void
+test_result(
+    ajit_t* j)
+{
+    static const uint8_t test_ecx_ecx[] = { 0x85, 0xC9 };
+    emit(j, test_ecx_ecx, sizeof(test_ecx_ecx));
+}
+
+// Jump to `slow` unless the value at `[base + disp]` is an integer.
+static aint_t
+guard_integer(
+    ajit_t* j, int32_t base, int32_t disp)
+{
+    emit_rm(j, FALSE, OP_CMP_RM8_IMM8, 7, base, disp + TAG);
+    emit8(j, AVT_INTEGER);
+    return jump_local(j, CC_NE);
+}
+
+static void
+helper_binary(
+    aactor_t* a, int32_t op)
+{
+    avalue_t* rhsv = a->stack.v + a->stack.sp - 2;
+    avalue_t* lhsv = rhsv + 1;
+    if (op == AOC_EQ) {
+        av_boolean(rhsv, any_equals(a, a->stack.sp - 1, a->stack.sp - 2));
+    } else if (lhsv->tag.type == AVT_INTEGER &&
+        rhsv->tag.type == AVT_INTEGER) {
+        aint_t lhs = lhsv->v.integer;
+        aint_t rhs = rhsv->v.integer;
+        switch (op) {
+        case AOC_ADD: av_integer(rhsv, lhs + rhs); break;
+        case AOC_SUB: av_integer(rhsv, lhs - rhs); break;
+        case AOC_MUL: av_integer(rhsv, lhs * rhs); break;
+        case AOC_DIV:
+            if (rhs == 0) any_error(a, AERR_RUNTIME, "divide by zero");
+            av_integer(rhsv, lhs / rhs);
+            break;
+        case AOC_LT: av_boolean(rhsv, lhs < rhs); break;
+        case AOC_LE: av_boolean(rhsv, lhs <= rhs); break;
+        case AOC_GT: av_boolean(rhsv, lhs > rhs); break;
+        case AOC_GE: av_boolean(rhsv, lhs >= rhs); break;
+        }
+    } else {
+        areal_t lhs = any_check_real(a, a->stack.sp - 1);
+        areal_t rhs = any_check_real(a, a->stack.sp - 2);
+        switch (op) {
+        case AOC_ADD: av_real(rhsv, lhs + rhs); break;
+        case AOC_SUB: av_real(rhsv, lhs - rhs); break;
+        case AOC_MUL: av_real(rhsv, lhs * rhs); break;
+        case AOC_DIV:
+            if (afuzzy_equals(rhs, 0)) {
+                any_error(a, AERR_RUNTIME, "divide by zero");
+            }
+            av_real(rhsv, lhs / rhs);
+            break;
+        case AOC_LT: av_boolean(rhsv, lhs < rhs); break;
+        case AOC_LE: av_boolean(rhsv, lhs <= rhs); break;
+        case AOC_GT: av_boolean(rhsv, lhs > rhs); break;
+        case AOC_GE: av_boolean(rhsv, lhs >= rhs); break;
+        }
+    }
+    a->stack.sp -= 1;
+}
+
+static void
+helper_not(
+    aactor_t* a)
+{
+    int32_t cond = any_to_bool(a, a->stack.sp - 1);
+    av_boolean(a->stack.v + a->stack.sp - 1, !cond);
+}
+
+// Pop the condition of `jin`.
+static int32_t
+helper_test(
+    aactor_t* a)
+{
+    int32_t cond = any_to_bool(a, a->stack.sp - 1);
+    a->stack.sp -= 1;
+    return cond;
+}
+
+// Pop the operand of compare and branch, returns the condition.
+static int32_t
+helper_branch(
+    aactor_t* a, int32_t op, aint_t val)
+{
+    areal_t x = any_check_real(a, a->stack.sp - 1);
+    a->stack.sp -= 1;
+    switch (op) {
+    case AOC_JLT: return val < x;
+    case AOC_JLE: return val <= x;
+    case AOC_JGT: return val > x;
+    default:      return val >= x;
+    }
+}
+
+static void
+helper_addi(
+    aactor_t* a, avalue_t* v, aint_t val)
+{
+    av_real(v, val + any_check_real(a, v - a->stack.v));
+}
+
+static void
+helper_add_ll(
+    aactor_t* a, avalue_t* lhsv, avalue_t* rhsv)
+{
+    areal_t lhs = any_check_real(a, lhsv - a->stack.v);
+    areal_t rhs = any_check_real(a, rhsv - a->stack.v);
+    av_real(a->stack.v + a->stack.sp, lhs + rhs);
+    ++a->stack.sp;
+}
+
+// Quickened opcodes are compiled as their generic form.
+static int32_t
+generic_opcode(
+    int32_t op)
+{
+    switch (op) {
+    case AOC_ADD_II: case AOC_ADD_RR: return AOC_ADD;
+    case AOC_SUB_II: case AOC_SUB_RR: return AOC_SUB;
+    case AOC_MUL_II: case AOC_MUL_RR: return AOC_MUL;
+    case AOC_DIV_II: case AOC_DIV_RR: return AOC_DIV;
+    case AOC_LT_II: case AOC_LT_RR: return AOC_LT;
+    case AOC_LE_II: case AOC_LE_RR: return AOC_LE;
+    case AOC_GT_II: case AOC_GT_RR: return AOC_GT;
+    case AOC_GE_II: case AOC_GE_RR: return AOC_GE;
+    default: return op;
+    }
+}
+
+static void
+push_bits(
+    ajit_t* j, uint64_t bits, int32_t type)
+{
+    mov_rax_imm64(j, bits);
+    emit_rm(j, TRUE, OP_MOV_RM_R, RAX, R13, VAL);
+    set_tag(j, R13, 0, type);
+    move_top(j, 1);
+}
+
+static void
+copy_value(
+    ajit_t* j, int32_t from, int32_t from_disp, int32_t to, int32_t to_disp)
+{
+    emit_rm(j, FALSE, OP_MOVUPS_LOAD, 0, from, from_disp);
+    emit_rm(j, FALSE, OP_MOVUPS_STORE, 0, to, to_disp);
+}
+
+static void
+arith(
+    ajit_t* j, aint_t ip, int32_t op)
+{
+    aint_t slow1, slow2, done;
+    slow1 = guard_integer(j, R13, SLOT(-1));
+    slow2 = guard_integer(j, R13, SLOT(-2));
+    emit_rm(j, TRUE, OP_MOV_R_RM, RAX, R13, SLOT(-1) + VAL);
+    switch (op) {
+    case AOC_ADD:
+        emit_rm(j, TRUE, OP_ADD_R_RM, RAX, R13, SLOT(-2) + VAL);
+        break;
+    case AOC_SUB:
+        emit_rm(j, TRUE, OP_SUB_R_RM, RAX, R13, SLOT(-2) + VAL);
+        break;
+    default:
+        emit_rm(j, TRUE, OP_IMUL_R_RM, RAX, R13, SLOT(-2) + VAL);
+        break;
+    }
+    emit_rm(j, TRUE, OP_MOV_RM_R, RAX, R13, SLOT(-2) + VAL);
+    move_top(j, -1);
+    done = jump_local(j, CC_ALWAYS);
+    bind_local(j, slow1);
+    bind_local(j, slow2);
+    call_begin(j, ip);
+    arg_imm(j, RSI, op);
+    call_end(j, (void*)&helper_binary);
+    bind_local(j, done);
+}
+
+static void
+compare(
+    ajit_t* j, aint_t ip, int32_t op)
+{
+    static const uint8_t movzx_eax_al[] = { 0x0F, 0xB6, 0xC0 };
+    aint_t slow1, slow2, done;
+    int32_t cc;
+    switch (op) {
+    case AOC_LT: cc = CC_L; break;
+    case AOC_LE: cc = CC_LE; break;
+    case AOC_GT: cc = CC_G; break;
+    default:     cc = CC_GE; break;
+    }
+    slow1 = guard_integer(j, R13, SLOT(-1));
+    slow2 = guard_integer(j, R13, SLOT(-2));
+    emit_rm(j, TRUE, OP_MOV_R_RM, RAX, R13, SLOT(-1) + VAL);
+    emit_rm(j, TRUE, "\x3B", RAX, R13, SLOT(-2) + VAL);
+    emit8(j, 0x0F);
+    emit8(j, (uint8_t)(0x90 | cc));
+    emit8(j, 0xC0);
+    emit(j, movzx_eax_al, sizeof(movzx_eax_al));
+    emit_rm(j, TRUE, OP_MOV_RM_R, RAX, R13, SLOT(-2) + VAL);
+    set_tag(j, R13, SLOT(-2), AVT_BOOLEAN);
+    move_top(j, -1);
+    done = jump_local(j, CC_ALWAYS);
+    bind_local(j, slow1);
+    bind_local(j, slow2);
+    call_begin(j, ip);
+    arg_imm(j, RSI, op);
+    call_end(j, (void*)&helper_binary);
+    bind_local(j, done);
+}
+
+// `add` small integer in place, `ADDI` and `INC`.
+static void
+add_imm(
+    ajit_t* j, aint_t ip, int32_t base, int32_t disp, aint_t val)
+{
+    aint_t slow, done;
+    slow = guard_integer(j, base, disp);
+    emit_rm(j, TRUE, OP_GRP1_RM_IMM32, 0, base, disp + VAL);
+    emit32(j, (int32_t)val);
+    done = jump_local(j, CC_ALWAYS);
+    bind_local(j, slow);
+    call_begin(j, ip);
+    arg_ptr(j, RSI, base, disp);
+    arg_imm(j, RDX, val);
+    call_end(j, (void*)&helper_addi);
+    bind_local(j, done);
+}
+
+static void
+add_ll(
+    ajit_t* j, aint_t ip, aint_t lhs, aint_t rhs)
+{
+    aint_t slow1, slow2, done;
+    slow1 = guard_integer(j, R14, SLOT(lhs));
+    slow2 = guard_integer(j, R14, SLOT(rhs));
+    emit_rm(j, TRUE, OP_MOV_R_RM, RAX, R14, SLOT(lhs) + VAL);
+    emit_rm(j, TRUE, OP_ADD_R_RM, RAX, R14, SLOT(rhs) + VAL);
+    emit_rm(j, TRUE, OP_MOV_RM_R, RAX, R13, VAL);
+    set_tag(j, R13, 0, AVT_INTEGER);
+    move_top(j, 1);
+    done = jump_local(j, CC_ALWAYS);
+    bind_local(j, slow1);
+    bind_local(j, slow2);
+    call_begin(j, ip);
+    arg_ptr(j, RSI, R14, SLOT(lhs));
+    arg_ptr(j, RDX, R14, SLOT(rhs));
+    call_end(j, (void*)&helper_add_ll);
+    bind_local(j, done);
+}
+
+// Fused compare and branch, jumps when `val <op> x` does not hold.
+static void
+compare_branch(
+    ajit_t* j, aint_t ip, int32_t op, aint_t val, aint_t target)
+{
+    aint_t slow, done;
+    int32_t cc;
+    // flags of `cmp x, val`, inverted condition.
+    switch (op) {
+    case AOC_JLT: cc = CC_LE; break;
+    case AOC_JLE: cc = CC_L; break;
+    case AOC_JGT: cc = CC_GE; break;
+    default:      cc = CC_G; break;
+    }
+    slow = guard_integer(j, R13, SLOT(-1));
+    emit_rm(j, TRUE, OP_GRP1_RM_IMM32, 7, R13, SLOT(-1) + VAL);
+    emit32(j, (int32_t)val);
+    // `lea` pops without touching flags.
+    emit_rm(j, TRUE, OP_LEA, R13, R13, SLOT(-1));
+    branch(j, cc, ip, target);
+    done = jump_local(j, CC_ALWAYS);
+    bind_local(j, slow);
+    call_begin(j, ip);
+    arg_imm(j, RSI, op);
+    arg_imm(j, RDX, val);
+    call_end(j, (void*)&helper_branch);
+    test_result(j);
+    branch(j, CC_E, ip, target);
+    bind_local(j, done);
+}
+
+static void
+jump_if_not(
+    ajit_t* j, aint_t ip, aint_t target)
+{
+    aint_t slow, done;
+    emit_rm(j, FALSE, OP_CMP_RM8_IMM8, 7, R13, SLOT(-1) + TAG);
+    emit8(j, AVT_BOOLEAN);
+    slow = jump_local(j, CC_NE);
+    move_top(j, -1);
+    emit_rm(j, FALSE, OP_GRP1_RM_IMM8, 7, R13, VAL);
+    emit8(j, 0);
+    branch(j, CC_E, ip, target);
+    done = jump_local(j, CC_ALWAYS);
+    bind_local(j, slow);
+    call_begin(j, ip);
+    call_end(j, (void*)&helper_test);
+    test_result(j);
+    branch(j, CC_E, ip, target);
+    bind_local(j, done);
+}
+
+#ifdef ANY_PROFILE
+// Count instruction `i` as the interpreter does, see `VM_PROFILE_OP`.
+static void
+profile_op(
+    ajit_t* j, aprototype_t* pt, const ainstruction_t* i)
+{
+    const int32_t op = ainstruction_opcode(i);
+    emit_rm(j, TRUE, OP_MOV_R_RM, RAX, RBX, OFF(aactor_t, owner));
+    emit_rm(j, TRUE, OP_GRP1_RM_IMM8, 0, RAX,
+        OFF(ascheduler_t, opcodes) + op * (int32_t)sizeof(aint_t));
+    emit8(j, 1);
+    mov_rax_imm64(j, (uint64_t)(uintptr_t)&pt->profile.instructions);
+#ifdef ANY_SMP
+    // `lock`, prototypes are shared between workers.
+    emit8(j, 0xF0);
+#endif
+    emit_rm(j, TRUE, OP_GRP1_RM_IMM8, 0, RAX, 0);
+    emit8(j, 1);
+}
+#endif
+
+// Returns FALSE without emitting anything if `ip` is left to the interpreter.
+static int32_t
+compile_native(
+    ajit_t* j, aprototype_t* pt, aint_t ip)
+{
+    const ainstruction_t* i = pt->instructions + ip;
+    int32_t op = generic_opcode(ainstruction_opcode(i));
+    switch (op) {
+    case AOC_NOP:
+    case AOC_BRK:
+        break;
+    case AOC_POP:
+        move_top(j, -i->pop.n);
+        break;
+    case AOC_LDK: {
+        const aconstant_t* c = pt->constants + i->ldk.idx;
+        uint64_t bits;
+        if (c->type == ACT_INTEGER) {
+            push_bits(j, (uint64_t)c->integer, AVT_INTEGER);
+        } else if (c->type == ACT_REAL) {
+            memcpy(&bits, &c->real, sizeof(bits));
+            push_bits(j, bits, AVT_REAL);
+        } else {
+            // strings are allocated by the interpreter.
+            return FALSE;
+        }
+        break;
+    }
+    case AOC_NIL:
+        set_tag(j, R13, 0, AVT_NIL);
+        move_top(j, 1);
+        break;
+    case AOC_LDB:
+        set_tag(j, R13, 0, AVT_BOOLEAN);
+        emit_rm(j, FALSE, OP_MOV_RM_IMM, 0, R13, VAL);
+        emit32(j, i->ldb.val ? TRUE : FALSE);
+        move_top(j, 1);
+        break;
+    case AOC_LSI:
+        set_tag(j, R13, 0, AVT_INTEGER);
+        emit_rm(j, TRUE, OP_MOV_RM_IMM, 0, R13, VAL);
+        emit32(j, i->lsi.val);
+        move_top(j, 1);
+        break;
+    case AOC_LLV:
+        copy_value(j, R14, SLOT(i->llv.idx), R13, 0);
+        move_top(j, 1);
+        break;
+    case AOC_SLV:
+        move_top(j, -1);
+        copy_value(j, R13, 0, R14, SLOT(i->slv.idx));
+        break;
+    case AOC_IMP:
+        mov_rax_imm64(j, (uint64_t)(uintptr_t)(pt->import_values + i->imp.idx));
+        copy_value(j, RAX, 0, R13, 0);
+        move_top(j, 1);
+        break;
+    case AOC_CLS:
+        mov_rax_imm64(j, (uint64_t)(uintptr_t)(pt->nesteds + i->cls.idx));
+        emit_rm(j, TRUE, OP_MOV_RM_R, RAX, R13, VAL);
+        set_tag(j, R13, 0, AVT_BYTE_CODE_FUNC);
+        move_top(j, 1);
+        break;
+    case AOC_JMP:
+        branch(j, CC_ALWAYS, ip, ip + i->jmp.displacement + 1);
+        break;
+    case AOC_JIN:
+        jump_if_not(j, ip, ip + i->jin.displacement + 1);
+        break;
+    case AOC_ADD:
+    case AOC_SUB:
+    case AOC_MUL:
+        arith(j, ip, op);
+        break;
+    case AOC_DIV:
+    case AOC_EQ:
+        call_begin(j, ip);
+        arg_imm(j, RSI, op);
+        call_end(j, (void*)&helper_binary);
+        break;
+    case AOC_NOT:
+        call_begin(j, ip);
+        call_end(j, (void*)&helper_not);
+        break;
+    case AOC_LT:
+    case AOC_LE:
+    case AOC_GT:
+    case AOC_GE:
+        compare(j, ip, op);
+        break;
+    case AOC_ADD_LL:
+        add_ll(j, ip, i->add_ll.lhs, i->add_ll.rhs);
+        break;
+    case AOC_ADDI:
+        add_imm(j, ip, R13, SLOT(-1), i->addi.val);
+        break;
+    case AOC_INC:
+        add_imm(j, ip, R14, SLOT(i->inc.idx), i->inc.val);
+        break;
+    case AOC_JLT:
+    case AOC_JLE:
+    case AOC_JGT:
+    case AOC_JGE:
+        compare_branch(
+            j, ip, op, i->jlt.val, ip + i->jlt.displacement + 1);
+        break;
+    default:
+        // calls, returns and mailbox are left to the interpreter.
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/*
+With `ANY_PROFILE`, native instructions are counted before their code, those
+left to the interpreter are counted when it dispatches them.
+*/
+static void
+compile_instruction(
+    ajit_t* j, aprototype_t* pt, aint_t ip)
+{
+#ifdef ANY_PROFILE
+    const aint_t start = j->sz;
+    profile_op(j, pt, pt->instructions + ip);
+    if (compile_native(j, pt, ip)) return;
+    j->sz = start;
+#else
+    if (compile_native(j, pt, ip)) return;
+#endif
+    leave(j, ip, AJIT_EXIT);
+}
+
+static void
+prologue(
+    ajit_t* j)
+{
+    static const uint8_t push[] = {
+        0x53, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57
+    };
+    static const uint8_t jmp_rsi[] = { 0xFF, 0xE6 };
+    // 5 pushes and the return address keep `rsp` aligned for helpers.
+    emit(j, push, sizeof(push));
+    emit_rr(j, TRUE, OP_MOV_RM_R, RDI, RBX);
+    reload(j);
+    emit(j, jmp_rsi, sizeof(jmp_rsi));
+}
+
+static void
+epilogue(
+    ajit_t* j)
+{
+    static const uint8_t pop[] = {
+        0x41, 0x5F, 0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C, 0x5B, 0xC3
+    };
+    emit(j, pop, sizeof(pop));
+}
+
+static void
+cleanup(
+    ajit_t* j)
+{
+    if (j->code) j->alloc(j->alloc_ud, j->code, 0);
+    if (j->labels) j->alloc(j->alloc_ud, j->labels, 0);
+    if (j->fixups) j->alloc(j->alloc_ud, j->fixups, 0);
+    if (j->stubs) j->alloc(j->alloc_ud, j->stubs, 0);
+}
+
+static aerror_t
+install(
+    ajit_t* j, aprototype_t* pt)
+{
+    const aint_t n = pt->header->num_instructions;
+    const aint_t code_off = (aint_t)((sizeof(ajit_code_t) + 15) & ~15);
+    const aint_t entries_off = (code_off + j->sz + 7) & ~7;
+    const aint_t mem_sz = entries_off + n * (aint_t)sizeof(uint8_t*);
+    uint8_t* mem;
+    ajit_code_t* jc;
+    aint_t ip;
+
+    mem = (uint8_t*)mmap(NULL, (size_t)mem_sz, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) return AERR_FULL;
+
+    jc = (ajit_code_t*)mem;
+    jc->mem_sz = mem_sz;
+    jc->entries = (const uint8_t**)(mem + entries_off);
+    *(void**)&jc->code = mem + code_off;
+    memcpy(mem + code_off, j->code, (size_t)j->sz);
+    for (ip = 0; ip < n; ++ip) {
+        jc->entries[ip] = mem + code_off + j->labels[ip];
+    }
+    if (mprotect(mem, (size_t)mem_sz, PROT_READ | PROT_EXEC) != 0) {
+        munmap(mem, (size_t)mem_sz);
+        return AERR_FULL;
+    }
+#ifdef ANY_SMP
+    {
+        // another worker may have compiled it meanwhile.
+        ajit_code_t* none = NULL;
+        if (!__atomic_compare_exchange_n(&pt->jit, &none, jc, FALSE,
+                __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+            munmap(mem, (size_t)mem_sz);
+        }
+    }
+#else
+    pt->jit = jc;
+#endif
+    return AERR_NONE;
+}
+
+aerror_t
+ajit_compile(
+    aprototype_t* pt, aalloc_t alloc, void* alloc_ud)
+{
+    const aint_t n = pt->header->num_instructions;
+    aerror_t ec;
+    aint_t ip, k, epilogue_pos;
+    ajit_t j;
+
+    if (ajit_code(pt)) return AERR_NONE;
+    // native code trusts operands as unchecked handlers do.
+    if (!pt->verified) return AERR_MALFORMED;
+
+    memset(&j, 0, sizeof(j));
+    j.alloc = alloc;
+    j.alloc_ud = alloc_ud;
+    j.labels = (aint_t*)alloc(alloc_ud, NULL, sizeof(aint_t) * (size_t)n);
+    if (!j.labels) return AERR_FULL;
+
+    prologue(&j);
+    for (ip = 0; ip < n; ++ip) {
+        j.labels[ip] = j.sz;
+        compile_instruction(&j, pt, ip);
+    }
+    // the verifier rejects falling off the end, no trailing exit needed.
+    epilogue_pos = j.sz;
+    epilogue(&j);
+    for (k = 0; k < j.num_stubs && !j.failed; ++k) {
+        // `sub qword [rbx + budget], 1; jg target`, else preempt at target.
+        j.stubs[k].pos = j.sz;
+        emit_rm(&j, TRUE, OP_GRP1_RM_IMM8, 5, RBX, OFF(aactor_t, budget));
+        emit8(&j, 1);
+        jump_to(&j, CC_G, j.stubs[k].target);
+        leave(&j, j.stubs[k].target, AJIT_PREEMPT);
+    }
+    for (k = 0; k < j.num_fixups && !j.failed; ++k) {
+        const afixup_t* f = j.fixups + k;
+        aint_t dest;
+        int32_t rel;
+        if (f->target >= 0) {
+            dest = j.labels[f->target];
+        } else if (f->target == TARGET_EPILOGUE) {
+            dest = epilogue_pos;
+        } else {
+            dest = j.stubs[TARGET_EPILOGUE - 1 - f->target].pos;
+        }
+        rel = (int32_t)(dest - (f->pos + 4));
+        memcpy(j.code + f->pos, &rel, 4);
+    }
+
+    ec = j.failed ? AERR_FULL : install(&j, pt);
+    cleanup(&j);
+    return ec;
+}
+
+void
+ajit_release(
+    aprototype_t* pt)
+{
+    aint_t i;
+    if (pt->jit) {
+        munmap(pt->jit, (size_t)pt->jit->mem_sz);
+        pt->jit = NULL;
+    }
+    for (i = 0; i < pt->header->num_nesteds; ++i) {
+        ajit_release(pt->nesteds + i);
+    }
+}
+
+#endif // ANY_JIT
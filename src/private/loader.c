@@ -3,6 +3,8 @@
 
 #include <any/version.h>
 #include <any/list.h>
+#include <any/verifier.h>
+#include <any/jit.h>
 
 const achunk_header_t CHUNK_HEADER = {
     { 0x41, 0x6E, 0x79, 0x00 },
@@ -17,12 +19,14 @@ const achunk_header_t CHUNK_HEADER = {
 
 static aint_t
 calc_sizes(
-    int8_t* b, aint_t sz, aint_t* off, aint_t* num_imps, aint_t* num_protos)
+    int8_t* b, aint_t sz, aint_t* off,
+    aint_t* num_imps, aint_t* num_protos, aint_t* num_ins)
 {
     aint_t i;
     aprototype_header_t* const p = (aprototype_header_t*)(b + *off);
 
     *num_imps += p->num_imports; *num_protos += p->num_nesteds;
+    *num_ins += p->num_instructions;
     *off += sizeof(aprototype_header_t) + p->strings_sz +
         sizeof(ainstruction_t) * p->num_instructions +
         sizeof(aconstant_t) * p->num_constants +
@@ -31,7 +35,8 @@ calc_sizes(
     if (*off > sz) return AERR_MALFORMED;
 
     for (i = 0; i < p->num_nesteds; ++i) {
-        aerror_t ec = calc_sizes(b, sz, off, num_imps, num_protos);
+        aerror_t ec = calc_sizes(
+            b, sz, off, num_imps, num_protos, num_ins);
         if (ec != AERR_NONE) return ec;
     }
 
@@ -48,6 +53,9 @@ free_chunk_list(
         i = i->next;
         if (check_for_retain && c->retain) continue;
         alist_node_erase(&c->node);
+#ifdef ANY_JIT
+        ajit_release(c->prototypes);
+#endif
         if (c->alloc) c->alloc(c->alloc_ud, c->header, 0);
         self->alloc(self->alloc_ud, c, 0);
     }
@@ -68,25 +76,44 @@ free_libs(
 static void
 create_proto(
     achunk_t* chunk, aint_t* off,
-    aprototype_t* pt, avalue_t** next_imp, aprototype_t** next_pt)
+    aprototype_t* pt, avalue_t** next_imp, aprototype_t** next_pt,
+    ainstruction_t** next_ins)
 {
     aint_t i;
     int8_t* const b = (int8_t*)chunk->header;
     aprototype_header_t* const p = (aprototype_header_t*)(b + *off);
+    const ainstruction_t* const ins = (const ainstruction_t*)(
+        ((uint8_t*)(p + 1)) + p->strings_sz);
 
     pt->chunk = chunk;
     pt->header = p;
     pt->strings = (const char*)(p + 1);
-    pt->instructions = (ainstruction_t*)(((uint8_t*)(p + 1)) + p->strings_sz);
-    pt->constants = (aconstant_t*)(pt->instructions + p->num_instructions);
+    // instructions are quickened in place, work on a copy.
+    pt->instructions = *next_ins; *next_ins += p->num_instructions;
+    memcpy(pt->instructions, ins,
+        (size_t)p->num_instructions * sizeof(ainstruction_t));
+    // unused operands of arithmetic count quickening misses from zero.
+    for (i = 0; i < p->num_instructions; ++i) {
+        ainstruction_t* in = pt->instructions + i;
+        if (in->b.opcode >= AOC_ADD && in->b.opcode <= AOC_GE) in->b._ = 0;
+    }
+    pt->constants = (aconstant_t*)(ins + p->num_instructions);
     pt->imports = (aimport_t*)(pt->constants + p->num_constants);
     pt->import_values = *next_imp; *next_imp += p->num_imports;
     pt->source_lines = (aint_t*)(pt->imports + p->num_imports);
     pt->nesteds = *next_pt; *next_pt += p->num_nesteds;
+#ifdef ANY_PROFILE
+    memset(&pt->profile, 0, sizeof(aprofile_t));
+#endif
+#ifdef ANY_JIT
+    pt->hotness = 0;
+    pt->jit = NULL;
+#endif
     *off += (uint8_t*)(pt->source_lines + p->num_instructions) - (uint8_t*)p;
 
     for (i = 0; i < p->num_nesteds; ++i) {
-        create_proto(chunk, off, pt->nesteds + i, next_imp, next_pt);
+        create_proto(
+            chunk, off, pt->nesteds + i, next_imp, next_pt, next_ins);
     }
 }
 
@@ -276,8 +303,9 @@ create_module(
     aint_t off = sizeof(achunk_header_t);
     avalue_t* next_imp = chunk->imports;
     aprototype_t* next_pt = chunk->prototypes;
+    ainstruction_t* next_ins = chunk->instructions;
     aprototype_t* pt = next_pt++;
-    create_proto(chunk, &off, pt, &next_imp, &next_pt);
+    create_proto(chunk, &off, pt, &next_imp, &next_pt, &next_ins);
 }
 
 aerror_t
@@ -286,7 +314,7 @@ aloader_add_chunk(
     aalloc_t chunk_alloc, void* chunk_alloc_ud)
 {
     achunk_t* c;
-    aint_t off, num_imps, num_protos;
+    aint_t off, num_imps, num_protos, num_ins;
     aerror_t ec;
 
     if (chunk_sz < sizeof(achunk_header_t) ||
@@ -294,14 +322,16 @@ aloader_add_chunk(
         return AERR_MALFORMED;
     off = sizeof(achunk_header_t);
 
-    num_imps = 0; num_protos = 1 /* include module proto */;
-    ec = calc_sizes((int8_t*)chunk, chunk_sz, &off, &num_imps, &num_protos);
+    num_imps = 0; num_protos = 1 /* include module proto */; num_ins = 0;
+    ec = calc_sizes(
+        (int8_t*)chunk, chunk_sz, &off, &num_imps, &num_protos, &num_ins);
     if (ec != AERR_NONE) return ec;
 
     c = (achunk_t*)self->alloc(self->alloc_ud, NULL,
         sizeof(achunk_t) +
         num_imps * sizeof(avalue_t) +
-        num_protos * sizeof(aprototype_t));
+        num_protos * sizeof(aprototype_t) +
+        num_ins * sizeof(ainstruction_t));
     c->header = chunk;
     c->chunk_sz = chunk_sz;
     c->alloc = chunk_alloc;
@@ -309,7 +339,12 @@ aloader_add_chunk(
     c->imports = (avalue_t*)(((uint8_t*)c) + sizeof(achunk_t));
     c->prototypes = (aprototype_t*)(
         ((uint8_t*)c->imports) + num_imps * sizeof(avalue_t));
+    c->instructions = (ainstruction_t*)(c->prototypes + num_protos);
     create_module(c);
+    // unverified prototypes still run, through the checked dispatch path.
+    for (off = 0; off < num_protos; ++off) {
+        averify_prototype(c->prototypes + off, self->alloc, self->alloc_ud);
+    }
     c->retain = FALSE;
     alist_push_back(&self->pendings, &c->node);
 
@@ -0,0 +1,103 @@
+/* Copyright (c) 2017 Nguyen Viet Giang. All rights reserved. */
+#include <any/mbox.h>
+
+#include <any/gc.h>
+
+#define GROW_FACTOR 2
+
+aerror_t
+ambox_reserve(
+    ambox_t* self, aint_t more)
+{
+    avalue_t* nv;
+    aint_t new_cap;
+    if (self->num_msgs + more <= self->cap) {
+        return AERR_NONE;
+    } else {
+        new_cap = self->cap > 0 ? self->cap : self->init_cap;
+        while (new_cap < self->num_msgs + more) new_cap *= GROW_FACTOR;
+        // fragments, links then senders are kept after the values in the same
+        // block, moved from the last one as they grow.
+        nv = (avalue_t*)self->alloc(
+            self->alloc_ud, self->v,
+            (sizeof(avalue_t) + sizeof(afrag_t*) + sizeof(aint_t) * 2) *
+            (size_t)new_cap);
+        if (nv == NULL) {
+            return AERR_FULL;
+        } else {
+            afrag_t** frags = (afrag_t**)(nv + new_cap);
+            aint_t* next = (aint_t*)(frags + new_cap);
+            aint_t* old_next =
+                (aint_t*)((afrag_t**)(nv + self->cap) + self->cap);
+            memmove(
+                next + new_cap, old_next + self->cap,
+                sizeof(aint_t)*(size_t)self->num_cells);
+            memmove(
+                next, old_next,
+                sizeof(aint_t)*(size_t)self->num_cells);
+            memmove(
+                frags, nv + self->cap,
+                sizeof(afrag_t*)*(size_t)self->num_cells);
+            self->v = nv;
+            self->frags = frags;
+            self->next = next;
+            self->from = next + new_cap;
+            self->cap = new_cap;
+            return AERR_NONE;
+        }
+    }
+}
+
+void
+ambox_cleanup(
+    ambox_t* self)
+{
+    aint_t c;
+    for (c = 0; c < self->num_cells; ++c) {
+        afrag_t* frag = ambox_take_frag(self, c);
+        if (frag) afrag_free(frag);
+    }
+    if (self->v) self->alloc(self->alloc_ud, self->v, 0);
+    self->v = NULL;
+    self->frags = NULL;
+    self->next = NULL;
+    self->from = NULL;
+    self->cap = 0;
+    self->num_cells = 0;
+}
+
+void
+ambox_push_post(
+    ambox_t* self, afrag_t* frag)
+{
+    if (frag->sz == 0) {
+        *ambox_slot(self) = frag->v;
+        ambox_push(self, frag->from);
+        afrag_free(frag);
+    } else {
+        av_nil(ambox_slot(self));
+        ambox_push_frag(self, frag, frag->from);
+    }
+}
+
+int32_t
+ambox_remove(
+    ambox_t* self)
+{
+    aint_t c = self->cur;
+    afrag_t* frag;
+    if (c < 0) return FALSE;
+    if (self->prev >= 0) self->next[self->prev] = self->next[c];
+    else self->head = self->next[c];
+    if (self->tail == c) self->tail = self->prev;
+    frag = ambox_take_frag(self, c);
+    if (frag) afrag_free(frag);
+    av_nil(self->v + c);
+    self->next[c] = self->free;
+    self->free = c;
+    --self->num_msgs;
+    self->peek = -1;
+    self->cur = -1;
+    self->mark = -1;
+    return TRUE;
+}
@@ -0,0 +1,124 @@
+/* Copyright (c) 2017 Nguyen Viet Giang. All rights reserved. */
+#include <any/process.h>
+
+static inline void*
+aalloc(
+    aprocess_table_t* self, void* old, const aint_t sz)
+{
+    return self->alloc(self->alloc_ud, old, sz);
+}
+
+static void
+push_free(
+    aprocess_table_t* self, aprocess_t* p)
+{
+    p->next_free = NULL;
+    if (self->free_tail) self->free_tail->next_free = p;
+    else self->free_head = p;
+    self->free_tail = p;
+}
+
+static aerror_t
+grow(
+    aprocess_table_t* self)
+{
+    aint_t sz = (aint_t)1 << self->chunk_bits;
+    apid_idx_t base = (apid_idx_t)(self->num_chunks << self->chunk_bits);
+    aprocess_t* chunk;
+    aint_t i;
+    if (self->num_chunks == self->max_chunks) return AERR_FULL;
+    chunk = (aprocess_t*)aalloc(
+        self, NULL, ((aint_t)sizeof(aprocess_t)) * sz);
+    if (!chunk) return AERR_FULL;
+    for (i = 0; i < sz; ++i) {
+        aprocess_t* p = chunk + i;
+        p->dead = TRUE;
+        p->pid = apid_from(
+            self->idx_bits, self->gen_bits, base + (apid_idx_t)i, 0);
+        p->timer_idx = -1;
+#ifdef ANY_SMP
+        p->inbox = ASMP_CLOSED;
+#endif
+        push_free(self, p);
+    }
+#ifdef ANY_SMP
+    __atomic_store_n(
+        self->chunks + self->num_chunks, chunk, __ATOMIC_RELEASE);
+#else
+    self->chunks[self->num_chunks] = chunk;
+#endif
+    ++self->num_chunks;
+    return AERR_NONE;
+}
+
+aerror_t
+aprocess_table_init(
+    aprocess_table_t* self, int8_t idx_bits, int8_t gen_bits,
+    aalloc_t alloc, void* alloc_ud)
+{
+    memset(self, 0, sizeof(aprocess_table_t));
+    self->alloc = alloc;
+    self->alloc_ud = alloc_ud;
+    self->idx_bits = idx_bits;
+    self->gen_bits = gen_bits;
+    self->chunk_bits =
+        idx_bits < APROCESS_CHUNK_BITS ? idx_bits : APROCESS_CHUNK_BITS;
+    self->max_chunks = (aint_t)1 << (idx_bits - self->chunk_bits);
+    self->chunks = (aprocess_t**)aalloc(
+        self, NULL, ((aint_t)sizeof(aprocess_t*)) * self->max_chunks);
+    if (!self->chunks) return AERR_FULL;
+    memset(self->chunks, 0, sizeof(aprocess_t*) * (size_t)self->max_chunks);
+    return AERR_NONE;
+}
+
+void
+aprocess_table_cleanup(
+    aprocess_table_t* self)
+{
+    aint_t i;
+    for (i = 0; i < self->num_chunks; ++i) {
+        aalloc(self, self->chunks[i], 0);
+    }
+    if (self->chunks) aalloc(self, self->chunks, 0);
+    self->chunks = NULL;
+    self->num_chunks = 0;
+    self->free_head = NULL;
+    self->free_tail = NULL;
+}
+
+aprocess_t*
+aprocess_table_alloc(
+    aprocess_table_t* self)
+{
+    aprocess_t* p;
+    apid_gen_t gen;
+    if (!self->free_head && grow(self) != AERR_NONE) return NULL;
+    p = self->free_head;
+    self->free_head = p->next_free;
+    if (!self->free_head) self->free_tail = NULL;
+    gen = apid_gen(self->idx_bits, self->gen_bits, p->pid);
+    gen = (gen + 1) & ((1 << self->gen_bits) - 1);
+#ifdef ANY_SMP
+    // loaded by \ref asmp_post from other threads.
+    __atomic_store_n(&p->pid, apid_from(self->idx_bits, self->gen_bits,
+        apid_idx(self->idx_bits, p->pid), gen), __ATOMIC_RELEASE);
+#else
+    p->pid = apid_from(self->idx_bits, self->gen_bits,
+        apid_idx(self->idx_bits, p->pid), gen);
+#endif
+    p->dead = FALSE;
+    p->deadline = -1;
+    p->timer_idx = -1;
+    p->wake_on_msg = FALSE;
+    ++self->num_procs;
+    return p;
+}
+
+void
+aprocess_table_free(
+    aprocess_table_t* self, aprocess_t* p)
+{
+    p->dead = TRUE;
+    push_free(self, p);
+    --self->num_procs;
+}
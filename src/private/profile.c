@@ -0,0 +1,94 @@
+/* Copyright (c) 2017 Nguyen Viet Giang. All rights reserved. */
+#include <any/profile.h>
+
+#ifdef ANY_PROFILE
+
+#include <any/list.h>
+#include <any/scheduler.h>
+
+static const char* const OPCODE_NAMES[256] = {
+    [AOC_NOP] = "nop", [AOC_BRK] = "brk", [AOC_POP] = "pop",
+    [AOC_LDK] = "ldk", [AOC_NIL] = "nil", [AOC_LDB] = "ldb",
+    [AOC_LSI] = "lsi", [AOC_LLV] = "llv", [AOC_SLV] = "slv",
+    [AOC_IMP] = "imp", [AOC_CLS] = "cls",
+    [AOC_JMP] = "jmp", [AOC_JIN] = "jin",
+    [AOC_IVK] = "ivk", [AOC_RET] = "ret", [AOC_TVK] = "tvk",
+    [AOC_SND] = "snd", [AOC_RCV] = "rcv",
+    [AOC_RMV] = "rmv", [AOC_RWD] = "rwd", [AOC_MRK] = "mrk",
+    [AOC_ADD] = "add", [AOC_SUB] = "sub",
+    [AOC_MUL] = "mul", [AOC_DIV] = "div",
+    [AOC_NOT] = "not", [AOC_EQ] = "eq",
+    [AOC_LT] = "lt", [AOC_LE] = "le", [AOC_GT] = "gt", [AOC_GE] = "ge",
+    [AOC_ADD_LL] = "add_ll", [AOC_ADDI] = "addi", [AOC_INC] = "inc",
+    [AOC_JLT] = "jlt", [AOC_JLE] = "jle",
+    [AOC_JGT] = "jgt", [AOC_JGE] = "jge",
+    [AOC_ADD_II] = "add_ii", [AOC_SUB_II] = "sub_ii",
+    [AOC_MUL_II] = "mul_ii", [AOC_DIV_II] = "div_ii",
+    [AOC_LT_II] = "lt_ii", [AOC_LE_II] = "le_ii",
+    [AOC_GT_II] = "gt_ii", [AOC_GE_II] = "ge_ii",
+    [AOC_ADD_RR] = "add_rr", [AOC_SUB_RR] = "sub_rr",
+    [AOC_MUL_RR] = "mul_rr", [AOC_DIV_RR] = "div_rr",
+    [AOC_LT_RR] = "lt_rr", [AOC_LE_RR] = "le_rr",
+    [AOC_GT_RR] = "gt_rr", [AOC_GE_RR] = "ge_rr"
+};
+
+static void
+visit_prototype(
+    const char* module, aprototype_t* pt,
+    aprofile_visitor_t visitor, void* ud)
+{
+    aint_t i;
+    visitor(module, pt, ud);
+    for (i = 0; i < pt->header->num_nesteds; ++i) {
+        visit_prototype(module, pt->nesteds + i, visitor, ud);
+    }
+}
+
+static void
+visit_chunks(
+    alist_t* chunks, aprofile_visitor_t visitor, void* ud)
+{
+    alist_node_t* i = alist_head(chunks);
+    while (!alist_is_end(chunks, i)) {
+        achunk_t* chunk = ALIST_NODE_CAST(achunk_t, i);
+        aprototype_t* m = chunk->prototypes;
+        visit_prototype(m->strings + m->header->symbol, m, visitor, ud);
+        i = i->next;
+    }
+}
+
+static void
+reset_prototype(
+    const char* module, aprototype_t* pt, void* ud)
+{
+    AUNUSED(module);
+    AUNUSED(ud);
+    memset(&pt->profile, 0, sizeof(aprofile_t));
+}
+
+const char*
+aprofile_opcode_name(
+    int32_t opcode)
+{
+    if (opcode < 0 || opcode > 255) return NULL;
+    return OPCODE_NAMES[opcode];
+}
+
+void
+aprofile_visit(
+    ascheduler_t* self, aprofile_visitor_t visitor, void* ud)
+{
+    aloader_t* loader = ascheduler_loader(self);
+    visit_chunks(&loader->runnings, visitor, ud);
+    visit_chunks(&loader->garbages, visitor, ud);
+}
+
+void
+aprofile_reset(
+    ascheduler_t* self)
+{
+    memset(self->opcodes, 0, sizeof(self->opcodes));
+    aprofile_visit(self, &reset_prototype, NULL);
+}
+
+#endif // ANY_PROFILE
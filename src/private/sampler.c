@@ -0,0 +1,367 @@
+/* Copyright (c) 2017 Nguyen Viet Giang. All rights reserved. */
+#include <any/sampler.h>
+
+#if defined(ALINUX)
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+#elif defined(AAPPLE)
+#include <pthread.h>
+#include <signal.h>
+#include <sys/time.h>
+#endif
+
+#define INIT_STACKS_SZ 64
+#define MAX_FOLDED_SZ 4096
+
+// sampler driven by the timer signal, if any.
+static asampler_t* volatile s_active;
+
+#if defined(ALINUX) || defined(AAPPLE)
+static struct sigaction s_old_action;
+
+#if defined(ALINUX)
+static timer_t s_timer;
+#else
+// the process wide timer signal may land on any thread.
+static pthread_t s_thread;
+#endif
+
+static void
+on_sigprof(
+    int sig)
+{
+    asampler_t* self = s_active;
+    AUNUSED(sig);
+#if defined(AAPPLE)
+    if (!pthread_equal(pthread_self(), s_thread)) return;
+#endif
+    if (self) asampler_sample(self);
+}
+
+// Deliver `SIGPROF` every `usecs` of CPU time consumed by the calling thread.
+static int32_t
+arm_timer(
+    aint_t usecs)
+{
+#if defined(ALINUX)
+    struct sigevent ev;
+    struct itimerspec it;
+    memset(&ev, 0, sizeof(ev));
+    ev.sigev_notify = SIGEV_THREAD_ID;
+    ev.sigev_signo = SIGPROF;
+    ev.sigev_notify_thread_id = (pid_t)syscall(SYS_gettid);
+    if (timer_create(CLOCK_THREAD_CPUTIME_ID, &ev, &s_timer) != 0) {
+        return FALSE;
+    }
+    it.it_interval.tv_sec = (time_t)(usecs / 1000000);
+    it.it_interval.tv_nsec = (long)(usecs % 1000000) * 1000;
+    it.it_value = it.it_interval;
+    if (timer_settime(s_timer, 0, &it, NULL) != 0) {
+        timer_delete(s_timer);
+        return FALSE;
+    }
+    return TRUE;
+#else
+    struct itimerval it;
+    s_thread = pthread_self();
+    it.it_interval.tv_sec = (time_t)(usecs / 1000000);
+    it.it_interval.tv_usec = (suseconds_t)(usecs % 1000000);
+    it.it_value = it.it_interval;
+    return setitimer(ITIMER_PROF, &it, NULL) == 0;
+#endif
+}
+
+static void
+disarm_timer()
+{
+#if defined(ALINUX)
+    timer_delete(s_timer);
+#else
+    struct itimerval it;
+    memset(&it, 0, sizeof(it));
+    setitimer(ITIMER_PROF, &it, NULL);
+#endif
+}
+#endif
+
+static inline void*
+aalloc(
+    asampler_t* self, void* old, const aint_t sz)
+{
+    return self->alloc(self->alloc_ud, old, sz);
+}
+
+static uint32_t
+hash_of(
+    const char* s, aint_t sz)
+{
+    // FNV-1a
+    uint32_t h = 2166136261u;
+    aint_t i;
+    for (i = 0; i < sz; ++i) {
+        h ^= (uint8_t)s[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// Append `s` to folded `buf` of `len`, truncated at `MAX_FOLDED_SZ`.
+static aint_t
+append(
+    char* buf, aint_t len, const char* s)
+{
+    aint_t n = (aint_t)strlen(s);
+    if (len + n >= MAX_FOLDED_SZ) n = MAX_FOLDED_SZ - 1 - len;
+    memcpy(buf + len, s, (size_t)n);
+    buf[len + n] = '\0';
+    return len + n;
+}
+
+static aint_t
+append_frame(
+    char* buf, aint_t len, const asample_frame_t* f)
+{
+    char line[32];
+    const aprototype_t* pt = f->pt;
+    const aprototype_t* m;
+    if (pt == NULL) return append(buf, len, "[native]");
+    m = pt->chunk->prototypes;
+    len = append(buf, len, m->strings + m->header->symbol);
+    len = append(buf, len, ":");
+    len = append(buf, len, pt->strings + pt->header->symbol);
+    // the frame may be sampled while switching to another prototype.
+    if (f->ip >= 0 && f->ip < pt->header->num_instructions) {
+        snprintf(line, sizeof(line), ":%lld",
+            (long long)pt->source_lines[f->ip]);
+        len = append(buf, len, line);
+    }
+    return len;
+}
+
+static aint_t
+fold(
+    const asample_t* s, char* buf)
+{
+    aint_t len = 0;
+    aint_t i;
+    buf[0] = '\0';
+    if (s->depth == 0) return append(buf, len, "[scheduler]");
+    for (i = s->depth - 1; i >= 0; --i) {
+        len = append_frame(buf, len, s->frames + i);
+        if (i > 0) len = append(buf, len, ";");
+    }
+    return len;
+}
+
+static aerror_t
+grow_stacks(
+    asampler_t* self)
+{
+    aint_t i;
+    aint_t max_stacks = self->max_stacks * 2;
+    asampler_stack_t* stacks = (asampler_stack_t*)aalloc(
+        self, NULL, max_stacks * sizeof(asampler_stack_t));
+    if (!stacks) return AERR_FULL;
+    memset(stacks, 0, (size_t)max_stacks * sizeof(asampler_stack_t));
+    for (i = 0; i < self->max_stacks; ++i) {
+        asampler_stack_t* o = self->stacks + i;
+        aint_t j;
+        if (o->stack == NULL) continue;
+        j = o->hash & (max_stacks - 1);
+        while (stacks[j].stack) j = (j + 1) & (max_stacks - 1);
+        stacks[j] = *o;
+    }
+    aalloc(self, self->stacks, 0);
+    self->stacks = stacks;
+    self->max_stacks = max_stacks;
+    return AERR_NONE;
+}
+
+static aerror_t
+add_stack(
+    asampler_t* self, const char* folded, aint_t len)
+{
+    uint32_t h = hash_of(folded, len);
+    aint_t i;
+    if ((self->num_stacks + 1) * 2 > self->max_stacks) {
+        aerror_t ec = grow_stacks(self);
+        if (ec != AERR_NONE) return ec;
+    }
+    i = h & (self->max_stacks - 1);
+    for (;;) {
+        asampler_stack_t* s = self->stacks + i;
+        if (s->stack == NULL) {
+            s->stack = (char*)aalloc(self, NULL, len + 1);
+            if (!s->stack) return AERR_FULL;
+            memcpy(s->stack, folded, (size_t)len + 1);
+            s->hash = h;
+            s->count = 1;
+            ++self->num_stacks;
+            return AERR_NONE;
+        }
+        if (s->hash == h && strcmp(s->stack, folded) == 0) {
+            ++s->count;
+            return AERR_NONE;
+        }
+        i = (i + 1) & (self->max_stacks - 1);
+    }
+}
+
+aerror_t
+asampler_init(
+    asampler_t* self, aalloc_t alloc, void* alloc_ud, ascheduler_t* target,
+    aint_t max_samples)
+{
+    memset(self, 0, sizeof(asampler_t));
+    self->alloc = alloc;
+    self->alloc_ud = alloc_ud;
+    self->target = target;
+    self->samples = (asample_t*)aalloc(
+        self, NULL, max_samples * sizeof(asample_t));
+    if (!self->samples) return AERR_FULL;
+    self->max_samples = max_samples;
+    self->stacks = (asampler_stack_t*)aalloc(
+        self, NULL, INIT_STACKS_SZ * sizeof(asampler_stack_t));
+    if (!self->stacks) {
+        aalloc(self, self->samples, 0);
+        self->samples = NULL;
+        return AERR_FULL;
+    }
+    memset(self->stacks, 0, INIT_STACKS_SZ * sizeof(asampler_stack_t));
+    self->max_stacks = INIT_STACKS_SZ;
+    return AERR_NONE;
+}
+
+void
+asampler_cleanup(
+    asampler_t* self)
+{
+    asampler_stop(self);
+    asampler_clear(self);
+    aalloc(self, self->stacks, 0);
+    aalloc(self, self->samples, 0);
+    self->stacks = NULL;
+    self->samples = NULL;
+}
+
+aerror_t
+asampler_start(
+    asampler_t* self, aint_t usecs)
+{
+#if defined(ALINUX) || defined(AAPPLE)
+    struct sigaction sa;
+    if (s_active != NULL || usecs <= 0) return AERR_RUNTIME;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = &on_sigprof;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    if (sigaction(SIGPROF, &sa, &s_old_action) != 0) return AERR_RUNTIME;
+    s_active = self;
+    if (!arm_timer(usecs)) {
+        s_active = NULL;
+        sigaction(SIGPROF, &s_old_action, NULL);
+        return AERR_RUNTIME;
+    }
+    return AERR_NONE;
+#else
+    AUNUSED(self);
+    AUNUSED(usecs);
+    return AERR_RUNTIME;
+#endif
+}
+
+void
+asampler_stop(
+    asampler_t* self)
+{
+#if defined(ALINUX) || defined(AAPPLE)
+    if (s_active != self) return;
+    disarm_timer();
+    sigaction(SIGPROF, &s_old_action, NULL);
+    s_active = NULL;
+#else
+    AUNUSED(self);
+#endif
+}
+
+void
+asampler_sample(
+    asampler_t* self)
+{
+    // must stay async signal safe, no allocation nor locking in here.
+    const aint_t head = self->head;
+    asample_t* s;
+    aactor_t* a;
+    if (head - self->tail >= self->max_samples) {
+        ++self->num_dropped;
+        return;
+    }
+    s = self->samples + (head % self->max_samples);
+    s->depth = 0;
+    a = *(aactor_t* volatile*)&self->target->running;
+    if (a) {
+        aframe_t* const frames = *(aframe_t* volatile*)&a->frames;
+        const aint_t max_frames = *(volatile aint_t*)&a->max_frames;
+        aframe_t* f = *(aframe_t* volatile*)&a->frame;
+        // interrupted while growing, `f` still points into the old frames.
+        if (f < frames || f >= frames + max_frames) f = NULL;
+        // the first frame is only the entry point of actor.
+        for (; f && f > frames && s->depth < ANY_SAMPLER_MAX_DEPTH; --f) {
+            asample_frame_t* sf = s->frames + s->depth++;
+            sf->pt = f->pt;
+            sf->ip = f->ip;
+        }
+    }
+    self->head = head + 1;
+}
+
+aerror_t
+asampler_collect(
+    asampler_t* self)
+{
+    char folded[MAX_FOLDED_SZ];
+    while (self->tail != self->head) {
+        const asample_t* s = self->samples + (self->tail % self->max_samples);
+        aerror_t ec = add_stack(self, folded, fold(s, folded));
+        if (ec != AERR_NONE) return ec;
+        ++self->num_samples;
+        self->tail = self->tail + 1;
+    }
+    return AERR_NONE;
+}
+
+void
+asampler_write(
+    asampler_t* self, asampler_writer_t writer, void* ud)
+{
+    char count[32];
+    aint_t i;
+    for (i = 0; i < self->max_stacks; ++i) {
+        const asampler_stack_t* s = self->stacks + i;
+        if (s->stack == NULL) continue;
+        writer(s->stack, (aint_t)strlen(s->stack), ud);
+        snprintf(count, sizeof(count), " %lld\n", (long long)s->count);
+        writer(count, (aint_t)strlen(count), ud);
+    }
+}
+
+void
+asampler_clear(
+    asampler_t* self)
+{
+    aint_t i;
+    for (i = 0; i < self->max_stacks; ++i) {
+        asampler_stack_t* s = self->stacks + i;
+        if (s->stack == NULL) continue;
+        aalloc(self, s->stack, 0);
+        s->stack = NULL;
+    }
+    self->num_stacks = 0;
+    self->num_samples = 0;
+    self->num_dropped = 0;
+}
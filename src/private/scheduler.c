@@ -3,6 +3,16 @@
 
 #include <any/loader.h>
 #include <any/actor.h>
+#include <any/gc.h>
+#include <any/smp.h>
+
+#if defined(ALINUX)
+#include <sys/eventfd.h>
+#include <unistd.h>
+#elif defined(AAPPLE)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 void ASTDCALL
 actor_entry(
@@ -15,54 +25,126 @@ aalloc(
     return self->alloc(self->alloc_ud, old, sz);
 }
 
-static void
-init_processes(
-    aprocess_t* procs, aint_t num)
+// Slice used when preemption is disabled, only to bound the counter.
+#define UNLIMITED_BUDGET (1 << 30)
+
+// Handoffs in a row before the run queues are picked from again, so actors
+// calling each other do not starve the others.
+#define MAX_HANDOFFS 8
+
+// Timer heap is 4-ary, children of `i` are `4 * i + 1` to `4 * i + 4`.
+#define TIMER_ARITY 4
+
+// Start a new slice for `a`.
+static inline void
+refill(
+    ascheduler_t* self, aactor_t* a)
 {
-    aint_t i;
-    for (i = 0; i < num; ++i) {
-        procs[i].dead = TRUE;
-        procs[i].pid = 0;
-    }
+    aint_t n = a->reductions > 0 ? a->reductions : self->reductions;
+    a->budget = n > 0 ? n : UNLIMITED_BUDGET;
 }
 
+// Release processes of `list` up to `end`.
 static void
-cleanup(
-    ascheduler_t* self, int32_t shutdown)
+free_all(
+    ascheduler_t* self, alist_t* list, alist_node_t* end)
 {
-    alist_node_t* i = alist_head(&self->runnings);
-    while (i != &self->root.node) {
-        alist_node_t* const next = i->next;
-        aprocess_task_t* const t = ALIST_NODE_CAST(aprocess_task_t, i);
-        aprocess_t* const p = ACAST_FROM_FIELD(aprocess_t, t, ptask);
-        if (shutdown || (p->actor.flags & APF_EXIT) != 0) {
-            aactor_cleanup(&p->actor);
-            alist_node_erase(&t->node);
-            ascheduler_free(p->actor.owner, p);
-        }
-        i = next;
-    }
-    if (shutdown == FALSE) return;
-    i = alist_head(&self->pendings);
-    while (!alist_is_end(&self->pendings, i)) {
+    alist_node_t* i = alist_head(list);
+    while (i != end) {
         alist_node_t* const next = i->next;
         aprocess_task_t* const t = ALIST_NODE_CAST(aprocess_task_t, i);
         aprocess_t* const p = ACAST_FROM_FIELD(aprocess_t, t, ptask);
         aactor_cleanup(&p->actor);
+        aprocess_delete_task(p);
         alist_node_erase(&t->node);
-        ascheduler_free(p->actor.owner, p);
+        ascheduler_free(self, p);
         i = next;
     }
-    i = alist_head(&self->waitings);
-    while (!alist_is_end(&self->waitings, i)) {
-        alist_node_t* const next = i->next;
-        aprocess_task_t* const t = ALIST_NODE_CAST(aprocess_task_t, i);
-        aprocess_t* const p = ACAST_FROM_FIELD(aprocess_t, t, ptask);
-        aactor_cleanup(&p->actor);
-        alist_node_erase(&t->node);
-        ascheduler_free(p->actor.owner, p);
-        i = next;
+}
+
+static void
+cleanup(
+    ascheduler_t* self, int32_t shutdown)
+{
+    aint_t q;
+    free_all(self, &self->exits, &self->exits.root);
+    if (shutdown == FALSE) return;
+    for (q = 0; q < APRIO_NUM; ++q) {
+        free_all(self, self->runnings + q, &self->runnings[q].root);
+    }
+    self->num_runnables = 0;
+    self->handoff = NULL;
+    free_all(self, &self->pendings, &self->pendings.root);
+    free_all(self, &self->waitings, &self->waitings.root);
+}
+
+static inline int32_t
+is_stackless(
+    alist_node_t* node)
+{
+    aprocess_task_t* t = ALIST_NODE_CAST(aprocess_task_t, node);
+    aprocess_t* p = ACAST_FROM_FIELD(aprocess_t, t, ptask);
+    return (p->actor.flags & APF_STACKLESS) != 0;
+}
+
+// Stackless `a` must be unwindable before it is moved out of `runnings`.
+static inline void
+check_suspendable(
+    aactor_t* a)
+{
+    if ((a->flags & APF_STACKLESS) && !aactor_suspendable(a)) {
+        any_error(a, AERR_RUNTIME,
+            "stackless actor can not block in native function");
+    }
+}
+
+// Unwind stackless `a`, its next slice starts when it is resumed.
+static void
+suspend(
+    ascheduler_t* self, aactor_t* a)
+{
+    refill(self, a);
+    aactor_suspend(a);
+}
+
+// Take `handoff` out of its run queue.
+static aprocess_t*
+take_handoff(
+    ascheduler_t* self)
+{
+    aprocess_t* p = self->handoff;
+    self->handoff = NULL;
+    ++self->num_handoffs;
+    alist_node_erase(&p->ptask.node);
+    --self->num_runnables;
+    if (self->slices > 0) --self->slices;
+    return p;
+}
+
+/*
+Switch from stackful `p`, which is queued already, to the next process of this
+run. Stackless processes have no task to switch to, `root` runs them on its own
+stack.
+*/
+static void
+switch_next(
+    ascheduler_t* self, aprocess_t* p)
+{
+    aprocess_task_t* t = &self->root;
+    aprocess_t* next = NULL;
+    if (self->handoff) {
+        if (!is_stackless(&self->handoff->ptask.node)) {
+            next = take_handoff(self);
+        }
+    } else {
+        aint_t q = self->slices > 0 ? ascheduler_next_queue(self) : -1;
+        if (q >= 0 && !is_stackless(alist_head(self->runnings + q))) {
+            next = ascheduler_take(self, q);
+        }
     }
+    if (next == p) return;
+    if (next) t = &next->ptask;
+    atask_yield(&p->ptask.task, &t->task);
 }
 
 static void
@@ -70,57 +152,211 @@ wait_for(
     ascheduler_t* self, aactor_t* a, aint_t usecs, int32_t wake_on_msg)
 {
     aprocess_t* p = ACAST_FROM_FIELD(aprocess_t, a, actor);
-    alist_node_t* next_node = p->ptask.node.next;
-    aprocess_task_t* next = ALIST_NODE_CAST(aprocess_task_t, next_node);
-    alist_node_t* wback = alist_back(&self->waitings);
-    assert(p->wait_for == 0);
-    alist_node_erase(&p->ptask.node);
-    alist_node_insert(&p->ptask.node, wback, wback->next);
-    p->wait_for = usecs;
+    assert(p->timer_idx < 0);
+    check_suspendable(a);
+    p->deadline = usecs >= 0 ? atimer_usecs() + usecs : -1;
+    // resumed at the receive, which does not wait again.
+    if (a->flags & APF_STACKLESS) a->flags |= APF_WOKEN;
+#ifdef ANY_SMP
+    if (self->smp) {
+        p->wake_on_msg = wake_on_msg;
+        p->parking = TRUE;
+        if (a->flags & APF_STACKLESS) suspend(self, a);
+        asmp_switch(self, a);
+        a->owner->running = a;
+        refill(a->owner, a);
+        return;
+    }
+#endif
+    alist_push_back(&self->waitings, &p->ptask.node);
+    if (p->deadline >= 0) ascheduler_add_timer(self, p);
     p->wake_on_msg = wake_on_msg;
-    atask_yield(&p->ptask.task, &next->task);
+    if (a->flags & APF_STACKLESS) suspend(self, a);
+    switch_next(self, p);
+    self->running = a;
+    refill(self, a);
 }
 
+// Queue pending or waiting `p`, which also runs in the current run.
 static inline void
 add_to_runnings(
     ascheduler_t* self, aprocess_t* p)
 {
-    alist_node_t* n = &p->ptask.node;
-    alist_node_t* r = &self->root.node;
-    alist_node_erase(n);
-    alist_node_insert(n, r->prev, r);
+    alist_node_erase(&p->ptask.node);
+    ascheduler_push_runnable(self, p);
+    ++self->slices;
 }
 
 static void
-check_waitings(
-    ascheduler_t* self, aint_t delta)
+check_timers(
+    ascheduler_t* self, aint_t now)
 {
-    alist_node_t* i = alist_head(&self->waitings);
-    while (!alist_is_end(&self->waitings, i)) {
-        alist_node_t* const next = i->next;
-        aprocess_task_t* const t = ALIST_NODE_CAST(aprocess_task_t, i);
-        aprocess_t* const p = ACAST_FROM_FIELD(aprocess_t, t, ptask);
-        if (p->wait_for >= 0) {
-            p->wait_for -= delta;
-            if (p->wait_for <= 0) {
-                p->wait_for = 0;
-                p->wake_on_msg = FALSE;
-                add_to_runnings(self, p);
+    aprocess_t* p;
+    while ((p = ascheduler_pop_timer(self, now)) != NULL) {
+        p->wake_on_msg = FALSE;
+        add_to_runnings(self, p);
+    }
+}
+
+static inline void
+set_timer(
+    ascheduler_t* self, aint_t idx, atimer_entry_t e)
+{
+    self->timers[idx] = e;
+    e.p->timer_idx = idx;
+}
+
+static void
+sift_up(
+    ascheduler_t* self, aint_t idx, atimer_entry_t e)
+{
+    while (idx > 0) {
+        aint_t parent = (idx - 1) / TIMER_ARITY;
+        if (self->timers[parent].deadline <= e.deadline) break;
+        set_timer(self, idx, self->timers[parent]);
+        idx = parent;
+    }
+    set_timer(self, idx, e);
+}
+
+static void
+sift_down(
+    ascheduler_t* self, aint_t idx, atimer_entry_t e)
+{
+    for (;;) {
+        aint_t first = idx * TIMER_ARITY + 1;
+        aint_t last = first + TIMER_ARITY;
+        aint_t min = idx;
+        aint_t min_deadline = e.deadline;
+        aint_t i;
+        if (last > self->num_timers) last = self->num_timers;
+        for (i = first; i < last; ++i) {
+            if (self->timers[i].deadline < min_deadline) {
+                min = i;
+                min_deadline = self->timers[i].deadline;
             }
         }
-        i = next;
+        if (min == idx) break;
+        set_timer(self, idx, self->timers[min]);
+        idx = min;
     }
+    set_timer(self, idx, e);
+}
+
+static void
+resume(
+    ascheduler_t* self, aprocess_t* p)
+{
+    self->running = &p->actor;
+    aactor_resume(&p->actor);
 }
 
+/*
+Run a slice for each process runnable at the beginning or woken meanwhile, so
+every process runs once if all have the same priority. A process woken by a
+call or its reply runs next, see \ref any_mbox_call. Stackful processes switch
+to the next one by themselves, and back to `root` before a stackless one or the
+end of this run.
+*/
 static inline void
 run_once(
     ascheduler_t* self)
 {
-    alist_node_t* head = alist_head(&self->runnings);
-    if (head != &self->root.node) {
-        aprocess_task_t* next = ALIST_NODE_CAST(aprocess_task_t, head);
-        atask_yield(&self->root.task, &next->task);
+    aint_t q;
+    self->slices = self->num_runnables;
+    for (;;) {
+        aprocess_t* p;
+        if (self->handoff) {
+            p = take_handoff(self);
+        } else if (self->slices > 0 &&
+            (q = ascheduler_next_queue(self)) >= 0) {
+            p = ascheduler_take(self, q);
+        } else {
+            break;
+        }
+        if (p->actor.flags & APF_STACKLESS) {
+            resume(self, p);
+        } else {
+            atask_yield(&self->root.task, &p->ptask.task);
+        }
+    }
+    self->running = NULL;
+}
+
+#if defined(ALINUX) || defined(AAPPLE)
+static void
+signal_wakeup(
+    ascheduler_t* self)
+{
+    int32_t fd = __atomic_load_n(&self->wakeup_fds[1], __ATOMIC_ACQUIRE);
+    if (fd < 0) return;
+    if (__atomic_exchange_n(&self->signaled, TRUE, __ATOMIC_ACQ_REL)) return;
+#if defined(ALINUX)
+    {
+        uint64_t one = 1;
+        if (write(fd, &one, sizeof(one)) < 0) return;
     }
+#else
+    if (write(fd, "", 1) < 0) return;
+#endif
+}
+
+static void
+clear_wakeup(
+    ascheduler_t* self)
+{
+    char buf[64];
+    if (self->wakeup_fds[0] < 0) return;
+    __atomic_store_n(&self->signaled, FALSE, __ATOMIC_RELEASE);
+    while (read(self->wakeup_fds[0], buf, sizeof(buf)) > 0) {}
+}
+#endif
+
+static void
+deliver(
+    ascheduler_t* self, afrag_t* frag)
+{
+    aactor_t* ta = ascheduler_actor(self, frag->pid);
+    if (!ta || ambox_reserve(&ta->msbox, 1) != AERR_NONE) {
+        afrag_free(frag);
+        return;
+    }
+    ambox_push_post(&ta->msbox, frag);
+    ascheduler_got_new_message(self, ta);
+}
+
+static void
+free_posts(
+    ascheduler_t* self, afrag_t* n, int32_t delivers)
+{
+    while (n) {
+        afrag_t* const next = n->next;
+        if (delivers) deliver(self, n);
+        else afrag_free(n);
+        n = next;
+    }
+}
+
+static void
+check_posts(
+    ascheduler_t* self)
+{
+#if defined(ALINUX) || defined(AAPPLE)
+    afrag_t* n;
+    afrag_t* fifo = NULL;
+    if (__atomic_load_n(&self->posts, __ATOMIC_ACQUIRE) == NULL) return;
+    clear_wakeup(self);
+    n = __atomic_exchange_n(&self->posts, NULL, __ATOMIC_ACQ_REL);
+    while (n) {
+        afrag_t* const next = n->next;
+        n->next = fifo;
+        fifo = n;
+        n = next;
+    }
+    free_posts(self, fifo, TRUE);
+#else
+    AUNUSED(self);
+#endif
 }
 
 aerror_t
@@ -129,26 +365,28 @@ ascheduler_init(
     aalloc_t alloc, void* alloc_ud)
 {
     aerror_t ec;
+    aint_t q;
     memset(self, 0, sizeof(ascheduler_t));
     self->alloc = alloc;
     self->alloc_ud = alloc_ud;
-    self->idx_bits = idx_bits;
-    self->gen_bits = gen_bits;
-    self->procs = aalloc(self, NULL,
-        ((aint_t)sizeof(aprocess_t)) * (aint_t)(1 << idx_bits));
-    self->next_idx = 0;
+    self->procs = (aprocess_table_t*)aalloc(
+        self, NULL, (aint_t)sizeof(aprocess_table_t));
+    if (!self->procs) return AERR_FULL;
+    ec = aprocess_table_init(self->procs, idx_bits, gen_bits, alloc, alloc_ud);
+    if (ec != AERR_NONE) goto failed;
+    self->wakeup_fds[0] = -1;
+    self->wakeup_fds[1] = -1;
     aloader_init(&self->loader, alloc, alloc_ud);
-    init_processes(self->procs, (aint_t)(1 << idx_bits));
     alist_init(&self->pendings);
-    alist_init(&self->runnings);
+    for (q = 0; q < APRIO_NUM; ++q) alist_init(self->runnings + q);
     alist_init(&self->waitings);
-    alist_push_back(&self->runnings, &self->root.node);
+    alist_init(&self->exits);
     ec = atask_shadow(&self->root.task);
     if (ec != AERR_NONE) goto failed;
-    self->first_run = TRUE;
     return ec;
 failed:
-    if (self->procs) aalloc(self, self->procs, 0);
+    aprocess_table_cleanup(self->procs);
+    aalloc(self, self->procs, 0);
     return ec;
 }
 
@@ -157,26 +395,148 @@ ascheduler_run_once(
     ascheduler_t* self)
 {
     cleanup(self, FALSE);
-    if (self->first_run) {
-        self->first_run = FALSE;
-        self->timer = atimer_usecs();
-    } else {
-        aint_t now = atimer_usecs();
-        aint_t delta = now - self->timer;
-        self->timer = now;
-        check_waitings(self, delta);
-    }
+    check_posts(self);
+    self->timer = atimer_usecs();
+    check_timers(self, self->timer);
     run_once(self);
 }
 
+void
+ascheduler_run_until_idle(
+    ascheduler_t* self)
+{
+    do {
+        ascheduler_run_once(self);
+    } while (ascheduler_is_idle(self) == FALSE);
+}
+
+int32_t
+ascheduler_is_idle(
+    ascheduler_t* self)
+{
+    if (self->num_runnables > 0) return FALSE;
+    if (!alist_is_end(&self->exits, alist_head(&self->exits))) return FALSE;
+#if defined(ALINUX) || defined(AAPPLE)
+    if (__atomic_load_n(&self->posts, __ATOMIC_ACQUIRE) != NULL) return FALSE;
+#endif
+    return TRUE;
+}
+
+aint_t
+ascheduler_timeout(
+    ascheduler_t* self)
+{
+    aint_t deadline;
+    if (ascheduler_is_idle(self) == FALSE) return 0;
+    deadline = ascheduler_next_deadline(self);
+    if (deadline < 0) return -1;
+    deadline -= atimer_usecs();
+    return deadline > 0 ? deadline : 0;
+}
+
+int32_t
+ascheduler_wakeup_fd(
+    ascheduler_t* self)
+{
+#if defined(ALINUX)
+    if (self->wakeup_fds[0] < 0) {
+        int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (fd < 0) return -1;
+        self->wakeup_fds[0] = fd;
+        __atomic_store_n(&self->wakeup_fds[1], fd, __ATOMIC_RELEASE);
+    }
+    return self->wakeup_fds[0];
+#elif defined(AAPPLE)
+    if (self->wakeup_fds[0] < 0) {
+        int fds[2];
+        if (pipe(fds) != 0) return -1;
+        fcntl(fds[0], F_SETFL, O_NONBLOCK);
+        fcntl(fds[1], F_SETFL, O_NONBLOCK);
+        fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+        fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+        self->wakeup_fds[0] = fds[0];
+        __atomic_store_n(&self->wakeup_fds[1], fds[1], __ATOMIC_RELEASE);
+    }
+    return self->wakeup_fds[0];
+#else
+    AUNUSED(self);
+    return -1;
+#endif
+}
+
+aerror_t
+ascheduler_post(
+    ascheduler_t* self, apid_t pid, apost_t* post)
+{
+#if defined(ALINUX) || defined(AAPPLE)
+    // delivery only links fragments, queued through their own links.
+    afrag_t* n = afrag_post_new(self->alloc, self->alloc_ud, post);
+    if (!n) return AERR_FULL;
+    n->pid = pid;
+    n->from = -1;
+    n->next = __atomic_load_n(&self->posts, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&self->posts, &n->next, n, TRUE,
+        __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {}
+    signal_wakeup(self);
+    return AERR_NONE;
+#else
+    AUNUSED(pid);
+    if (post->s) aalloc(self, post->s, 0);
+    if (post->frag) afrag_free(post->frag);
+    return AERR_RUNTIME;
+#endif
+}
+
 void
 ascheduler_yield(
     ascheduler_t* self, aactor_t* a)
 {
     aprocess_t* p = ACAST_FROM_FIELD(aprocess_t, a, actor);
-    alist_node_t* next_node = p->ptask.node.next;
-    aprocess_task_t* next = ALIST_NODE_CAST(aprocess_task_t, next_node);
-    atask_yield(&p->ptask.task, &next->task);
+    if (a->flags & APF_STACKLESS) check_suspendable(a);
+#ifdef ANY_SMP
+    if (self->smp) {
+        if (a->flags & APF_STACKLESS) suspend(self, a);
+        asmp_switch(self, a);
+        self = a->owner;
+        self->running = a;
+        refill(self, a);
+        return;
+    }
+#endif
+    ascheduler_push_runnable(self, p);
+    if (a->flags & APF_STACKLESS) suspend(self, a);
+    switch_next(self, p);
+    self->running = a;
+    refill(self, a);
+}
+
+void
+ascheduler_exit(
+    ascheduler_t* self, aactor_t* a)
+{
+    aprocess_t* p = ACAST_FROM_FIELD(aprocess_t, a, actor);
+#ifdef ANY_SMP
+    if (self->smp) {
+        // workers reap exited processes after their slices.
+        if ((a->flags & APF_STACKLESS) == 0) asmp_switch(self, a);
+        return;
+    }
+#endif
+    alist_push_back(&self->exits, &p->ptask.node);
+    if ((a->flags & APF_STACKLESS) == 0) switch_next(self, p);
+}
+
+void
+ascheduler_preempt(
+    ascheduler_t* self, aactor_t* a)
+{
+    // stackless actors run native functions to the end.
+    if ((a->reductions > 0 || self->reductions > 0) &&
+        ((a->flags & APF_STACKLESS) == 0 || aactor_suspendable(a))) {
+        ascheduler_yield(self, a);
+    } else {
+        refill(self, a);
+    }
 }
 
 void
@@ -193,15 +553,58 @@ ascheduler_wait(
     wait_for(self, a, usecs, TRUE);
 }
 
+aint_t
+ascheduler_next_queue(
+    ascheduler_t* self)
+{
+    aint_t top = -1;
+    aint_t q;
+    for (q = 0; q < APRIO_NUM; ++q) {
+        if (alist_is_end(self->runnings + q, alist_head(self->runnings + q))) {
+            continue;
+        }
+        if (top < 0) top = q;
+        else if (self->skips[q] >= APRIO_MAX_SKIPS) return q;
+    }
+    return top;
+}
+
+aprocess_t*
+ascheduler_take(
+    ascheduler_t* self, aint_t q)
+{
+    alist_node_t* n = alist_head(self->runnings + q);
+    aint_t i;
+    assert(!alist_is_end(self->runnings + q, n));
+    // lower queues waiting behind this one.
+    for (i = q + 1; i < APRIO_NUM; ++i) {
+        if (!alist_is_end(self->runnings + i, alist_head(self->runnings + i))) {
+            ++self->skips[i];
+        }
+    }
+    self->skips[q] = 0;
+    self->num_handoffs = 0;
+    alist_node_erase(n);
+    --self->num_runnables;
+    --self->slices;
+    return ACAST_FROM_FIELD(
+        aprocess_t, ALIST_NODE_CAST(aprocess_task_t, n), ptask);
+}
+
 void
 ascheduler_got_new_message(
     ascheduler_t* self, aactor_t* a)
 {
     aprocess_t* p = ACAST_FROM_FIELD(aprocess_t, a, actor);
     if (p->wake_on_msg) {
-        p->wait_for = 0;
+        if (p->timer_idx >= 0) ascheduler_remove_timer(self, p);
         p->wake_on_msg = FALSE;
         add_to_runnings(self, p);
+        // a call or its reply runs the receiver next.
+        if (self->running && self->num_handoffs < MAX_HANDOFFS &&
+            ((self->running->flags | a->flags) & APF_CALLING)) {
+            self->handoff = p;
+        }
     }
 }
 
@@ -210,6 +613,14 @@ ascheduler_cleanup(
     ascheduler_t* self)
 {
     cleanup(self, TRUE);
+    aactor_pool_cleanup(&self->pool, self->alloc, self->alloc_ud);
+    free_posts(self, self->posts, FALSE);
+#if defined(ALINUX) || defined(AAPPLE)
+    if (self->wakeup_fds[0] >= 0) close(self->wakeup_fds[0]);
+    if (self->wakeup_fds[1] != self->wakeup_fds[0]) close(self->wakeup_fds[1]);
+#endif
+    if (self->timers) aalloc(self, self->timers, 0);
+    aprocess_table_cleanup(self->procs);
     aalloc(self, self->procs, 0);
     aloader_cleanup(&self->loader);
 }
@@ -218,40 +629,71 @@ aprocess_t*
 ascheduler_alloc(
     ascheduler_t* self)
 {
-    aint_t loop = (aint_t)(1 << self->idx_bits);
-    do {
-        aprocess_t* p = self->procs + self->next_idx;
-        self->next_idx = (self->next_idx + 1) & ((1 << self->idx_bits) - 1);
-        if (p->dead) {
-            apid_idx_t idx = (apid_idx_t)(p - self->procs);
-            apid_gen_t gen = apid_gen(self->idx_bits, self->gen_bits, p->pid);
-            gen = (gen + 1) & ((1 << self->gen_bits) - 1);
-            p->pid = apid_from(self->idx_bits, self->gen_bits, idx, gen);
-            p->dead = FALSE;
-            p->wait_for = 0;
-            p->wake_on_msg = FALSE;
-            ++self->num_procs;
-            return p;
-        }
-    } while (--loop);
-    return NULL;
+    aprocess_t* p;
+#ifdef ANY_SMP
+    if (self->smp) return asmp_alloc(self->smp);
+#endif
+    p = aprocess_table_alloc(self->procs);
+    if (p == NULL) return NULL;
+    // every process may wait at once, so adding a timer never fails.
+    if (ascheduler_reserve_timers(
+            self, aprocess_table_size(self->procs)) != AERR_NONE) {
+        aprocess_table_free(self->procs, p);
+        return NULL;
+    }
+    return p;
+}
+
+void
+ascheduler_free(
+    ascheduler_t* self, aprocess_t* p)
+{
+#ifdef ANY_SMP
+    if (self->smp) {
+        asmp_free(self->smp, p);
+        return;
+    }
+#endif
+    aprocess_table_free(self->procs, p);
 }
 
 aerror_t
 ascheduler_new_actor(
     ascheduler_t* self, aint_t cstack_sz, aactor_t** a)
+{
+    return ascheduler_new_actor_opts(self, cstack_sz, NULL, a);
+}
+
+aerror_t
+ascheduler_new_actor_opts(
+    ascheduler_t* self, aint_t cstack_sz, const aactor_opts_t* opts,
+    aactor_t** a)
 {
     aerror_t ec;
     aprocess_t* p = ascheduler_alloc(self);
     if (p == NULL) return AERR_FULL;
     *a = &p->actor;
-    ec = atask_create(&p->ptask.task, &actor_entry, *a, cstack_sz);
-    if (ec != AERR_NONE) return ec;
-    ec = aactor_init(*a, self, self->alloc, self->alloc_ud);
-    if (ec != AERR_NONE) atask_delete(&p->ptask.task);
+    if (cstack_sz > 0) {
+        ec = atask_create(&p->ptask.task, &actor_entry, *a, cstack_sz);
+        if (ec != AERR_NONE) {
+            ascheduler_free(self, p);
+            return ec;
+        }
+    }
+    ec = aactor_init(*a, self, opts, self->alloc, self->alloc_ud);
+    if (ec != AERR_NONE) {
+        if (cstack_sz > 0) atask_delete(&p->ptask.task);
+        ascheduler_free(self, p);
+        return ec;
+    }
+    if (cstack_sz == 0) (*a)->flags |= APF_STACKLESS;
     if (self->on_spawn) {
         self->on_spawn(*a, self->on_spawn_ud);
     }
+#ifdef ANY_SMP
+    // not queued until started, cleaned up from the process table.
+    if (self->smp) return ec;
+#endif
     alist_push_back(&self->pendings, &p->ptask.node);
     return ec;
 }
@@ -262,5 +704,69 @@ ascheduler_start(
 {
     aprocess_t* p = ACAST_FROM_FIELD(aprocess_t, a, actor);
     any_push_integer(a, nargs);
+    refill(self, a);
+#ifdef ANY_SMP
+    if (self->smp) {
+        asmp_ready(self, p);
+        return;
+    }
+#endif
     add_to_runnings(self, p);
 }
+
+aerror_t
+ascheduler_reserve_timers(
+    ascheduler_t* self, aint_t n)
+{
+    aint_t cap = self->max_timers ? self->max_timers : 16;
+    atimer_entry_t* timers;
+    if (n <= self->max_timers) return AERR_NONE;
+    while (cap < n) cap *= 2;
+    timers = (atimer_entry_t*)aalloc(
+        self, self->timers, cap * (aint_t)sizeof(atimer_entry_t));
+    if (!timers) return AERR_FULL;
+    self->timers = timers;
+    self->max_timers = cap;
+    return AERR_NONE;
+}
+
+void
+ascheduler_add_timer(
+    ascheduler_t* self, aprocess_t* p)
+{
+    atimer_entry_t e;
+    assert(self->num_timers < self->max_timers);
+    e.deadline = p->deadline;
+    e.p = p;
+    sift_up(self, self->num_timers++, e);
+}
+
+void
+ascheduler_remove_timer(
+    ascheduler_t* self, aprocess_t* p)
+{
+    aint_t idx = p->timer_idx;
+    atimer_entry_t last;
+    assert(idx >= 0 && idx < self->num_timers);
+    assert(self->timers[idx].p == p);
+    p->timer_idx = -1;
+    last = self->timers[--self->num_timers];
+    if (idx == self->num_timers) return;
+    if (idx > 0 &&
+        self->timers[(idx - 1) / TIMER_ARITY].deadline > last.deadline) {
+        sift_up(self, idx, last);
+    } else {
+        sift_down(self, idx, last);
+    }
+}
+
+aprocess_t*
+ascheduler_pop_timer(
+    ascheduler_t* self, aint_t now)
+{
+    aprocess_t* p;
+    if (self->num_timers == 0 || self->timers[0].deadline > now) return NULL;
+    p = self->timers[0].p;
+    ascheduler_remove_timer(self, p);
+    return p;
+}
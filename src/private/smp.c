@@ -0,0 +1,608 @@
+/* Copyright (c) 2017 Nguyen Viet Giang. All rights reserved. */
+#include <any/smp.h>
+
+#ifdef ANY_SMP
+
+#include <any/loader.h>
+#include <any/actor.h>
+#include <any/gc.h>
+
+#include <time.h>
+
+static inline void*
+aalloc(
+    asmp_t* self, void* old, const aint_t sz)
+{
+    return self->alloc(self->alloc_ud, old, sz);
+}
+
+static void
+drop_post(
+    asmp_t* self, apost_t* post)
+{
+    if (post->s) aalloc(self, post->s, 0);
+    if (post->frag) afrag_free(post->frag);
+    post->s = NULL;
+    post->frag = NULL;
+}
+
+// Fragment `n` goes back to the worker which allocated it, `cur` is the
+// worker calling this or NULL if unknown.
+static void
+release_frag(
+    ascheduler_t* cur, afrag_t* n)
+{
+    ascheduler_t* const home = n->home;
+    if (home == NULL) {
+        afrag_free(n);
+    } else if (home == cur) {
+        n->next = home->spare;
+        home->spare = n;
+    } else {
+        n->next = __atomic_load_n(&home->returns, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&home->returns, &n->next, n,
+            TRUE, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {}
+    }
+}
+
+// Fragment without objects which carries `v`, from the spares of `w`.
+static afrag_t*
+alloc_frag(
+    asmp_t* self, ascheduler_t* w, const avalue_t* v)
+{
+    afrag_t* n;
+    if (w->spare == NULL && __atomic_load_n(&w->returns, __ATOMIC_RELAXED)) {
+        w->spare = __atomic_exchange_n(&w->returns, NULL, __ATOMIC_ACQUIRE);
+    }
+    n = w->spare;
+    if (n) {
+        w->spare = n->next;
+    } else {
+        n = (afrag_t*)aalloc(self, NULL, (aint_t)sizeof(afrag_t));
+        if (!n) return NULL;
+        n->alloc = self->alloc;
+        n->alloc_ud = self->alloc_ud;
+        n->sz = 0;
+        n->home = w;
+    }
+    n->v = *v;
+    return n;
+}
+
+static void
+free_frags(
+    afrag_t* n)
+{
+    while (n) {
+        afrag_t* const next = n->next;
+        afrag_free(n);
+        n = next;
+    }
+}
+
+static void
+drop_posts(
+    ascheduler_t* cur, afrag_t* n)
+{
+    while (n) {
+        afrag_t* const next = n->next;
+        release_frag(cur, n);
+        n = next;
+    }
+}
+
+// Posts to `p` are dropped from now on.
+static void
+close_inbox(
+    aprocess_t* p)
+{
+    afrag_t* n = __atomic_exchange_n(&p->inbox, ASMP_CLOSED, __ATOMIC_ACQUIRE);
+    if (n != ASMP_CLOSED) drop_posts(NULL, n);
+}
+
+// Wake up parked workers, if any, to steal newly queued processes.
+static void
+notify(
+    asmp_t* self)
+{
+    if (__atomic_load_n(&self->num_idles, __ATOMIC_ACQUIRE) == 0) return;
+    pthread_mutex_lock(&self->lock);
+    pthread_cond_broadcast(&self->wakeup);
+    pthread_mutex_unlock(&self->lock);
+}
+
+// Following helpers require the lock of `w`.
+
+static inline void
+push_runnable(
+    ascheduler_t* w, aprocess_t* p)
+{
+    p->state = ASMP_RUNNABLE;
+    ascheduler_push_runnable(w, p);
+}
+
+static aprocess_t*
+pop_runnable(
+    ascheduler_t* w)
+{
+    aint_t q = ascheduler_next_queue(w);
+    aprocess_t* p;
+    if (q < 0) return NULL;
+    p = ascheduler_take(w, q);
+    p->state = ASMP_RUNNING;
+    return p;
+}
+
+// Take the tail of the highest non-empty queue, NULL if there is none.
+static aprocess_t*
+pop_tail(
+    ascheduler_t* w)
+{
+    aint_t q;
+    for (q = 0; q < APRIO_NUM; ++q) {
+        alist_node_t* n = alist_back(w->runnings + q);
+        aprocess_t* p;
+        if (alist_is_end(w->runnings + q, n)) continue;
+        p = ACAST_FROM_FIELD(
+            aprocess_t, ALIST_NODE_CAST(aprocess_task_t, n), ptask);
+        alist_node_erase(n);
+        --w->num_runnables;
+        p->state = ASMP_RUNNING;
+        return p;
+    }
+    return NULL;
+}
+
+// Queue processes timed out at `now`, returns the next deadline.
+static aint_t
+check_timers(
+    ascheduler_t* w, aint_t now)
+{
+    aprocess_t* p;
+    while ((p = ascheduler_pop_timer(w, now)) != NULL) {
+        p->wake_on_msg = FALSE;
+        alist_node_erase(&p->ptask.node);
+        push_runnable(w, p);
+    }
+    return ascheduler_next_deadline(w);
+}
+
+static aprocess_t*
+steal(
+    ascheduler_t* w)
+{
+    asmp_t* smp = w->smp;
+    int32_t idx = (int32_t)(w - smp->workers);
+    int32_t i;
+    for (i = 1; i < smp->num_workers; ++i) {
+        ascheduler_t* v = smp->workers + (idx + i) % smp->num_workers;
+        aprocess_t* p;
+        pthread_mutex_lock(&v->lock);
+        p = pop_tail(v);
+        if (p) __atomic_store_n(&p->actor.owner, w, __ATOMIC_RELEASE);
+        pthread_mutex_unlock(&v->lock);
+        if (p) return p;
+    }
+    return NULL;
+}
+
+static void
+exit_process(
+    ascheduler_t* w, aprocess_t* p)
+{
+    asmp_t* smp = w->smp;
+    aactor_cleanup(&p->actor);
+    aprocess_delete_task(p);
+    asmp_free(smp, p);
+}
+
+static void
+run_process(
+    ascheduler_t* w, aprocess_t* p)
+{
+    if (p->actor.flags & APF_STACKLESS) {
+        w->running = &p->actor;
+        aactor_resume(&p->actor);
+    } else {
+        atask_yield(&w->root.task, &p->ptask.task);
+    }
+    w->running = NULL;
+    if (p->actor.flags & APF_EXIT) {
+        exit_process(w, p);
+        return;
+    }
+    pthread_mutex_lock(&w->lock);
+    if (p->parking) {
+        p->parking = FALSE;
+        // a post came after the actor checked its inbox, see \ref asmp_post.
+        if (p->wake_on_msg &&
+            __atomic_load_n(&p->inbox, __ATOMIC_ACQUIRE) != NULL) {
+            p->wake_on_msg = FALSE;
+            push_runnable(w, p);
+        } else {
+            p->state = ASMP_WAITING;
+            alist_push_back(&w->waitings, &p->ptask.node);
+            if (p->deadline >= 0) ascheduler_add_timer(w, p);
+        }
+    } else {
+        push_runnable(w, p);
+    }
+    pthread_mutex_unlock(&w->lock);
+}
+
+// Returns TRUE if any worker has queued processes.
+static int32_t
+has_runnables(
+    asmp_t* self)
+{
+    int32_t i;
+    for (i = 0; i < self->num_workers; ++i) {
+        ascheduler_t* v = self->workers + i;
+        int32_t found;
+        pthread_mutex_lock(&v->lock);
+        found = v->num_runnables > 0;
+        pthread_mutex_unlock(&v->lock);
+        if (found) return TRUE;
+    }
+    return FALSE;
+}
+
+// Sleep until new processes are queued or `usecs` passed, -1 for no timeout.
+static void
+park(
+    ascheduler_t* w, aint_t usecs)
+{
+    asmp_t* smp = w->smp;
+    pthread_mutex_lock(&smp->lock);
+    ++smp->num_idles;
+    // rechecked after counted as idle, so no notification is lost.
+    if (smp->procs.num_procs > 0 && !smp->stopped && !has_runnables(smp)) {
+        if (usecs < 0) {
+            pthread_cond_wait(&smp->wakeup, &smp->lock);
+        } else {
+            struct timespec ts;
+            clock_gettime(CLOCK_REALTIME, &ts);
+            ts.tv_sec += (time_t)(usecs / 1000000);
+            ts.tv_nsec += (long)(usecs % 1000000) * 1000;
+            if (ts.tv_nsec >= 1000000000) {
+                ts.tv_sec += 1;
+                ts.tv_nsec -= 1000000000;
+            }
+            pthread_cond_timedwait(&smp->wakeup, &smp->lock, &ts);
+        }
+    }
+    --smp->num_idles;
+    pthread_mutex_unlock(&smp->lock);
+}
+
+static void*
+worker_main(
+    void* ud)
+{
+    ascheduler_t* w = (ascheduler_t*)ud;
+    asmp_t* smp = w->smp;
+    atask_shadow(&w->root.task);
+    while (!__atomic_load_n(&smp->stopped, __ATOMIC_ACQUIRE) &&
+        asmp_num_processes(smp) > 0) {
+        aint_t next;
+        aprocess_t* p;
+        int32_t more;
+        pthread_mutex_lock(&w->lock);
+        w->timer = atimer_usecs();
+        next = check_timers(w, w->timer);
+        p = pop_runnable(w);
+        more = w->num_runnables > 0;
+        pthread_mutex_unlock(&w->lock);
+        // timed out and yielded processes are queued here without waking up
+        // parked workers, which steal the ones left behind.
+        if (more) notify(smp);
+        if (p == NULL) p = steal(w);
+        if (p) run_process(w, p);
+        else if (next < 0) park(w, -1);
+        else park(w, next > w->timer ? next - w->timer : 0);
+    }
+    return NULL;
+}
+
+static void
+init_worker(
+    asmp_t* self, ascheduler_t* w)
+{
+    aint_t q;
+    memset(w, 0, sizeof(ascheduler_t));
+    w->alloc = self->alloc;
+    w->alloc_ud = self->alloc_ud;
+    w->procs = &self->procs;
+    w->smp = self;
+    w->wakeup_fds[0] = -1;
+    w->wakeup_fds[1] = -1;
+    alist_init(&w->pendings);
+    for (q = 0; q < APRIO_NUM; ++q) alist_init(w->runnings + q);
+    alist_init(&w->waitings);
+    alist_init(&w->exits);
+    pthread_mutex_init(&w->lock, NULL);
+}
+
+aerror_t
+asmp_init(
+    asmp_t* self, int32_t num_workers, int8_t idx_bits, int8_t gen_bits,
+    aalloc_t alloc, void* alloc_ud)
+{
+    aint_t i;
+    memset(self, 0, sizeof(asmp_t));
+    if (num_workers <= 0) return AERR_RUNTIME;
+    self->alloc = alloc;
+    self->alloc_ud = alloc_ud;
+    if (aprocess_table_init(
+            &self->procs, idx_bits, gen_bits, alloc, alloc_ud) != AERR_NONE) {
+        return AERR_FULL;
+    }
+    self->workers = (ascheduler_t*)aalloc(
+        self, NULL, ((aint_t)sizeof(ascheduler_t)) * num_workers);
+    if (!self->workers) {
+        aprocess_table_cleanup(&self->procs);
+        return AERR_FULL;
+    }
+    self->num_workers = num_workers;
+    for (i = 0; i < num_workers; ++i) {
+        init_worker(self, self->workers + i);
+    }
+    aloader_init(&self->loader, alloc, alloc_ud);
+    pthread_mutex_init(&self->lock, NULL);
+    pthread_cond_init(&self->wakeup, NULL);
+    return AERR_NONE;
+}
+
+void
+asmp_cleanup(
+    asmp_t* self)
+{
+    aint_t num_slots = self->procs.num_chunks << self->procs.chunk_bits;
+    aint_t i;
+    for (i = 0; i < num_slots; ++i) {
+        aprocess_t* p = aprocess_table_at(&self->procs, (apid_idx_t)i);
+        if (!p->dead) {
+            aactor_cleanup(&p->actor);
+            aprocess_delete_task(p);
+            p->dead = TRUE;
+        }
+        close_inbox(p);
+    }
+    for (i = 0; i < self->num_workers; ++i) {
+        ascheduler_t* w = self->workers + i;
+        if (w->timers) aalloc(self, w->timers, 0);
+        free_frags(w->spare);
+        free_frags(w->returns);
+        pthread_mutex_destroy(&w->lock);
+    }
+    pthread_cond_destroy(&self->wakeup);
+    pthread_mutex_destroy(&self->lock);
+    aalloc(self, self->workers, 0);
+    aprocess_table_cleanup(&self->procs);
+    aloader_cleanup(&self->loader);
+}
+
+aerror_t
+asmp_new_actor(
+    asmp_t* self, aint_t cstack_sz, aactor_t** a)
+{
+    return asmp_new_actor_opts(self, cstack_sz, NULL, a);
+}
+
+aerror_t
+asmp_new_actor_opts(
+    asmp_t* self, aint_t cstack_sz, const aactor_opts_t* opts, aactor_t** a)
+{
+    int32_t i = __atomic_fetch_add(&self->next_worker, 1, __ATOMIC_RELAXED);
+    i = (int32_t)((uint32_t)i % (uint32_t)self->num_workers);
+    return ascheduler_new_actor_opts(self->workers + i, cstack_sz, opts, a);
+}
+
+aerror_t
+asmp_run(
+    asmp_t* self)
+{
+    aerror_t ec = AERR_NONE;
+    int32_t num_threads;
+    int32_t i;
+    __atomic_store_n(&self->stopped, FALSE, __ATOMIC_RELEASE);
+    for (num_threads = 1; num_threads < self->num_workers; ++num_threads) {
+        ascheduler_t* w = self->workers + num_threads;
+        if (pthread_create(&w->thread, NULL, &worker_main, w) != 0) {
+            // the others still drain all queues by stealing.
+            ec = AERR_FULL;
+            break;
+        }
+    }
+    worker_main(self->workers);
+    for (i = 1; i < num_threads; ++i) {
+        pthread_join(self->workers[i].thread, NULL);
+    }
+    return ec;
+}
+
+void
+asmp_stop(
+    asmp_t* self)
+{
+    pthread_mutex_lock(&self->lock);
+    __atomic_store_n(&self->stopped, TRUE, __ATOMIC_RELEASE);
+    pthread_cond_broadcast(&self->wakeup);
+    pthread_mutex_unlock(&self->lock);
+}
+
+static aerror_t
+post_from(
+    asmp_t* self, aactor_t* from, apid_t pid, apost_t* post)
+{
+    aprocess_t* p = aprocess_table_slot(&self->procs, pid);
+    ascheduler_t* const cur = from ? from->owner : NULL;
+    afrag_t* n;
+    afrag_t* head;
+    ascheduler_t* w;
+    int32_t woke = FALSE;
+    if (p == NULL || __atomic_load_n(&p->pid, __ATOMIC_ACQUIRE) != pid) {
+        drop_post(self, post);
+        return AERR_NONE;
+    }
+    // queued through links of the fragment, no node is allocated.
+    if (from && !post->s && !post->frag) {
+        n = alloc_frag(self, cur, &post->v);
+    } else {
+        n = afrag_post_new(self->alloc, self->alloc_ud, post);
+        if (n) n->home = NULL;
+    }
+    if (!n) return AERR_FULL;
+    n->pid = pid;
+    n->from = from ? ascheduler_pid(cur, from) : -1;
+    head = __atomic_load_n(&p->inbox, __ATOMIC_RELAXED);
+    do {
+        if (head == ASMP_CLOSED) {
+            release_frag(cur, n);
+            return AERR_NONE;
+        }
+        n->next = head;
+    } while (!__atomic_compare_exchange_n(&p->inbox, &head, n, TRUE,
+        __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    // the post which made the inbox not empty wakes the process up, it checks
+    // the inbox again under the lock of its owner before waiting.
+    if (head != NULL) return AERR_NONE;
+    // owner only changes by stealing, under the lock of the old owner.
+    for (;;) {
+        w = __atomic_load_n(&p->actor.owner, __ATOMIC_ACQUIRE);
+        pthread_mutex_lock(&w->lock);
+        if (p->actor.owner == w) break;
+        pthread_mutex_unlock(&w->lock);
+    }
+    if (p->state == ASMP_WAITING && p->wake_on_msg) {
+        if (p->timer_idx >= 0) ascheduler_remove_timer(w, p);
+        p->wake_on_msg = FALSE;
+        alist_node_erase(&p->ptask.node);
+        push_runnable(w, p);
+        woke = TRUE;
+    }
+    pthread_mutex_unlock(&w->lock);
+    if (woke) notify(self);
+    return AERR_NONE;
+}
+
+aerror_t
+asmp_post(
+    asmp_t* self, apid_t pid, apost_t* post)
+{
+    return post_from(self, NULL, pid, post);
+}
+
+aerror_t
+asmp_worker_post(
+    aactor_t* a, apid_t pid, apost_t* post)
+{
+    return post_from(a->owner->smp, a, pid, post);
+}
+
+void
+asmp_drain(
+    aactor_t* a)
+{
+    aprocess_t* p = ACAST_FROM_FIELD(aprocess_t, a, actor);
+    afrag_t* posts = NULL;
+    afrag_t* n;
+    aint_t num_posts = 0;
+    if (__atomic_load_n(&p->inbox, __ATOMIC_RELAXED) == NULL) return;
+    n = __atomic_exchange_n(&p->inbox, NULL, __ATOMIC_ACQUIRE);
+    // newest first, reverse them to the order they were sent.
+    while (n) {
+        afrag_t* const next = n->next;
+        n->next = posts;
+        posts = n;
+        n = next;
+        ++num_posts;
+    }
+    if (ambox_reserve(&a->msbox, num_posts) != AERR_NONE) {
+        drop_posts(a->owner, posts);
+        any_error(a, AERR_RUNTIME, "out of memory");
+    }
+    for (n = posts; n; n = posts) {
+        posts = n->next;
+        if (n->pid != p->pid) {
+            // sent to the previous process of this slot.
+        } else if (n->sz == 0) {
+            *ambox_slot(&a->msbox) = n->v;
+            ambox_push(&a->msbox, n->from);
+        } else {
+            av_nil(ambox_slot(&a->msbox));
+            ambox_push_frag(&a->msbox, n, n->from);
+            continue;
+        }
+        release_frag(a->owner, n);
+    }
+}
+
+// Requires the lock of `self`.
+static aerror_t
+reserve_timers(
+    asmp_t* self)
+{
+    aerror_t ec = AERR_NONE;
+    int32_t i;
+    for (i = 0; i < self->num_workers && ec == AERR_NONE; ++i) {
+        ascheduler_t* w = self->workers + i;
+        pthread_mutex_lock(&w->lock);
+        ec = ascheduler_reserve_timers(w, self->procs.num_procs);
+        pthread_mutex_unlock(&w->lock);
+    }
+    return ec;
+}
+
+aprocess_t*
+asmp_alloc(
+    asmp_t* self)
+{
+    aprocess_t* p;
+    pthread_mutex_lock(&self->lock);
+    p = aprocess_table_alloc(&self->procs);
+    if (p) {
+        p->state = ASMP_PENDING;
+        p->parking = FALSE;
+        __atomic_store_n(&p->inbox, NULL, __ATOMIC_RELEASE);
+    }
+    // processes migrate, so any worker may time all of them.
+    if (p && reserve_timers(self) != AERR_NONE) {
+        aprocess_table_free(&self->procs, p);
+        close_inbox(p);
+        p = NULL;
+    }
+    pthread_mutex_unlock(&self->lock);
+    return p;
+}
+
+void
+asmp_free(
+    asmp_t* self, aprocess_t* p)
+{
+    pthread_mutex_lock(&self->lock);
+    aprocess_table_free(&self->procs, p);
+    close_inbox(p);
+    if (self->procs.num_procs == 0) pthread_cond_broadcast(&self->wakeup);
+    pthread_mutex_unlock(&self->lock);
+}
+
+void
+asmp_ready(
+    ascheduler_t* w, aprocess_t* p)
+{
+    pthread_mutex_lock(&w->lock);
+    push_runnable(w, p);
+    pthread_mutex_unlock(&w->lock);
+    notify(w->smp);
+}
+
+void
+asmp_switch(
+    ascheduler_t* w, aactor_t* a)
+{
+    aprocess_t* p = ACAST_FROM_FIELD(aprocess_t, a, actor);
+    atask_yield(&p->ptask.task, &w->root.task);
+}
+
+#endif // ANY_SMP
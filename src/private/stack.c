@@ -12,7 +12,7 @@ astack_reserve(
     if (self->sp + more <= self->cap) {
         return AERR_NONE;
     } else {
-        new_cap = self->cap;
+        new_cap = self->cap > 0 ? self->cap : self->init_cap;
         while (new_cap < self->sp + more) new_cap *= GROW_FACTOR;
         nv = (avalue_t*)self->alloc(
             self->alloc_ud, self->v, sizeof(avalue_t)*new_cap);
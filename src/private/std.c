@@ -60,6 +60,60 @@ lspawn(
     any_push_pid(a, pid);
 }
 
+static void
+lcall(
+    aactor_t* a)
+{
+    aint_t a_pid = any_check_index(a, -1);
+    aint_t a_msg = any_check_index(a, -2);
+    any_push_index(a, a_pid);
+    any_push_index(a, a_msg);
+    any_mbox_call(a, AINFINITE);
+}
+
+static aint_t
+check_priority(
+    aactor_t* a, aint_t idx)
+{
+    aint_t prio = any_check_integer(a, idx);
+    if (prio < APRIO_LOW || prio > APRIO_MAX) {
+        any_error(a, AERR_RUNTIME, "bad priority %lld", (long long int)prio);
+    }
+    return prio;
+}
+
+static void
+lspawn_prio(
+    aactor_t* a)
+{
+    apid_t pid;
+    aactor_opts_t opts;
+    aint_t a_entry = any_check_index(a, -1);
+    aint_t a_prio = any_check_index(a, -2);
+    memset(&opts, 0, sizeof(opts));
+    opts.priority = check_priority(a, a_prio);
+    any_push_index(a, a_entry);
+    any_spawn_opts(a, 1024*32, &opts, 0, &pid);
+    any_push_pid(a, pid);
+}
+
+static void
+lpriority(
+    aactor_t* a)
+{
+    any_push_integer(a, a->priority);
+}
+
+static void
+lset_priority(
+    aactor_t* a)
+{
+    aint_t a_prio = any_check_index(a, -1);
+    aint_t old = a->priority;
+    aactor_set_priority(a, check_priority(a, a_prio));
+    any_push_integer(a, old);
+}
+
 static inline void
 is_type(
     aactor_t* a, atype_t type)
@@ -156,6 +210,10 @@ static alib_func_t funcs[] = {
     { "usleep/1",       &lusleep },
     { "usecs/0",        &lusecs },
     { "spawn/1",        &lspawn },
+    { "spawn/2",        &lspawn_prio },
+    { "priority/0",     &lpriority },
+    { "set_priority/1", &lset_priority },
+    { "call/2",         &lcall },
     { "is_integer/1",   &lis_integer },
     { "is_real/1",      &lis_real },
     { "is_boolean/1",   &lis_boolean },
@@ -13,19 +13,35 @@ set_capacity(
 {
     avalue_t* v;
     agc_buffer_t* o;
-    aint_t bi;
-    aerror_t ec = aactor_heap_reserve(a, cap, 1);
-    if (ec < 0) any_error(a, AERR_RUNTIME, "out of memory");
-    bi = agc_alloc(&a->gc, AVT_FIXED_BUFFER, cap);
-    v = aactor_at(a, idx);
-    o = AGC_CAST(agc_buffer_t, &a->gc, v->v.heap_idx);
-    assert(cap >= o->sz);
-    memcpy(
-        AGC_CAST(void, &a->gc, bi),
-        AGC_CAST(void, &a->gc, o->buff.v.heap_idx),
-        (size_t)o->sz);
+    abinary_t* old;
+    if (cap >= ABINARY_MIN_SZ) {
+        abinary_t* bin = abinary_new(a->gc.alloc, a->gc.alloc_ud, cap);
+        if (!bin) any_error(a, AERR_RUNTIME, "out of memory");
+        v = aactor_at(a, idx);
+        o = AGC_CAST(agc_buffer_t, &a->gc, v->v.heap_idx);
+        assert(cap >= o->sz);
+        memcpy(abinary_bytes(bin), agc_buffer_bytes(&a->gc, o), (size_t)o->sz);
+        old = o->bin;
+        o->bin = bin;
+        av_nil(&o->buff);
+    } else {
+        aint_t bi;
+        aerror_t ec = aactor_heap_reserve(a, cap, 1);
+        if (ec < 0) any_error(a, AERR_RUNTIME, "out of memory");
+        bi = agc_alloc(&a->gc, AVT_FIXED_BUFFER, cap);
+        v = aactor_at(a, idx);
+        o = AGC_CAST(agc_buffer_t, &a->gc, v->v.heap_idx);
+        assert(cap >= o->sz);
+        memcpy(
+            AGC_CAST(void, &a->gc, bi),
+            agc_buffer_bytes(&a->gc, o),
+            (size_t)o->sz);
+        old = o->bin;
+        o->bin = NULL;
+        av_collectable(&o->buff, AVT_FIXED_BUFFER, bi);
+    }
     o->cap = cap;
-    av_collectable(&o->buff, AVT_FIXED_BUFFER, bi);
+    if (old) abinary_release(old);
 }
 
 static inline void
@@ -57,7 +73,7 @@ lreserve(
     aint_t a_self = any_check_index(a, -1);
     aint_t a_cap = any_check_index(a, -2);
     aint_t cap = any_check_integer(a, a_cap);
-    any_check_buffer(a, a_self);
+    any_check_buffer_view(a, a_self);
     any_buffer_reserve(a, a_self, cap);
     any_push_nil(a);
 }
@@ -67,7 +83,7 @@ lshrink_to_fit(
     aactor_t* a)
 {
     aint_t a_self = any_check_index(a, -1);
-    any_check_buffer(a, a_self);
+    any_check_buffer_view(a, a_self);
     any_buffer_shrink_to_fit(a, a_self);
     any_push_nil(a);
 }
@@ -82,7 +98,7 @@ lresize(
     if (sz < 0) {
         any_error(a, AERR_RUNTIME, "bad size %lld", (long long int)sz);
     }
-    any_check_buffer(a, a_self);
+    any_check_buffer_view(a, a_self);
     any_buffer_resize(a, a_self, sz);
     any_push_nil(a);
 }
@@ -93,7 +109,7 @@ lget(
 {
     aint_t a_self = any_check_index(a, -1);
     aint_t a_idx = any_check_index(a, -2);
-    uint8_t* b = any_check_buffer(a, a_self);
+    const uint8_t* b = any_check_buffer_view(a, a_self);
     aint_t idx = any_check_integer(a, a_idx);
     aint_t sz = any_buffer_size(a, a_self);
     check_index(a, idx, sz);
@@ -121,7 +137,7 @@ lsize(
     aactor_t* a)
 {
     aint_t a_self = any_check_index(a, -1);
-    any_check_buffer(a, a_self);
+    any_check_buffer_view(a, a_self);
     any_push_integer(a, any_buffer_size(a, a_self));
 }
 
@@ -130,7 +146,7 @@ lcapacity(
     aactor_t* a)
 {
     aint_t a_self = any_check_index(a, -1);
-    any_check_buffer(a, a_self);
+    any_check_buffer_view(a, a_self);
     any_push_integer(a, any_buffer_capacity(a, a_self));
 }
 
@@ -160,20 +176,43 @@ agc_buffer_new(
     aactor_t* a, aint_t cap, avalue_t* v)
 {
     aerror_t ec;
+    aint_t oi;
+    agc_buffer_t* o;
     assert(cap >= 0);
-    ec = aactor_heap_reserve(a, sizeof(agc_buffer_t) + cap, 2);
-    if (ec < 0) {
-        return ec;
+    if (cap >= ABINARY_MIN_SZ) {
+        abinary_t* bin;
+        ec = aactor_heap_reserve(a, sizeof(agc_buffer_t), 1);
+        if (ec < 0) return ec;
+        bin = abinary_new(a->gc.alloc, a->gc.alloc_ud, cap);
+        if (!bin) return AERR_FULL;
+        oi = agc_alloc(&a->gc, AVT_BUFFER, sizeof(agc_buffer_t));
+        o = AGC_CAST(agc_buffer_t, &a->gc, oi);
+        o->bin = bin;
+        av_nil(&o->buff);
     } else {
-        aint_t oi = agc_alloc(&a->gc, AVT_BUFFER, sizeof(agc_buffer_t));
-        aint_t bi = agc_alloc(&a->gc, AVT_FIXED_BUFFER, cap);
-        agc_buffer_t* o = AGC_CAST(agc_buffer_t, &a->gc, oi);
-        o->cap = cap;
-        o->sz = 0;
+        aint_t bi;
+        ec = aactor_heap_reserve(a, sizeof(agc_buffer_t) + cap, 2);
+        if (ec < 0) return ec;
+        oi = agc_alloc(&a->gc, AVT_BUFFER, sizeof(agc_buffer_t));
+        bi = agc_alloc(&a->gc, AVT_FIXED_BUFFER, cap);
+        o = AGC_CAST(agc_buffer_t, &a->gc, oi);
+        o->bin = NULL;
         av_collectable(&o->buff, AVT_FIXED_BUFFER, bi);
-        av_collectable(v, AVT_BUFFER, oi);
-        return AERR_NONE;
     }
+    o->cap = cap;
+    o->sz = 0;
+    agc_link_buffer(&a->gc, oi);
+    av_collectable(v, AVT_BUFFER, oi);
+    return AERR_NONE;
+}
+
+void
+any_buffer_unshare(
+    aactor_t* a, aint_t idx)
+{
+    avalue_t* v = aactor_at(a, idx);
+    agc_buffer_t* o = AGC_CAST(agc_buffer_t, &a->gc, v->v.heap_idx);
+    if (o->bin && abinary_shared(o->bin)) set_capacity(a, idx, o->cap);
 }
 
 void
@@ -25,9 +25,10 @@ lprint(
             break;
         case AVT_PID: {
             apid_t pid = any_to_pid(a, arg_idx);
+            aprocess_table_t* t = a->owner->procs;
             snprintf(buf, sizeof(buf), "<%d.%d>",
-                apid_idx(a->owner->idx_bits, pid),
-                apid_gen(a->owner->idx_bits, a->owner->gen_bits, pid));
+                apid_idx(t->idx_bits, pid),
+                apid_gen(t->idx_bits, t->gen_bits, pid));
             out(out_ud, buf);
             break;
         }
@@ -3,6 +3,12 @@
 
 #ifdef ANY_TASK_GCCASM
 
+#if defined(ALINUX) || defined(AAPPLE)
+#include <sys/mman.h>
+#include <unistd.h>
+#define STACK_MMAP
+#endif
+
 #ifdef ANY_USE_VALGRIND
 #include <valgrind.h>
 #define STACK_REG(t, p, sz) (t)->vgid = VALGRIND_STACK_REGISTER(p, p+sz)
@@ -24,21 +30,138 @@ atask_ctx_switch(
 void
 atask_ctx_entryp();
 
+#ifdef STACK_MMAP
+
+// Number of distinct stack sizes kept by the pool.
+#define NUM_POOLS 8
+
+// Maximum number of free stacks kept per size.
+#define MAX_POOLED 64
+
+/* Stacks are mapped with a PROT_NONE guard page at the bottom, pages are only
+committed when touched. Stacks of deleted tasks are kept by size for the next
+task, with their pages given back to the system but the mapping kept. The link
+to the next free stack is stored in the top page, which is never given back.
+*/
+typedef struct stack_pool_s {
+    aint_t sz;
+    uint8_t* head;
+    aint_t num;
+} stack_pool_t;
+
+static stack_pool_t pools[NUM_POOLS];
+
+#ifdef ANY_SMP
+static volatile int32_t pools_lock;
+#define POOLS_LOCK() \
+    while (__atomic_exchange_n(&pools_lock, 1, __ATOMIC_ACQUIRE))
+#define POOLS_UNLOCK() __atomic_store_n(&pools_lock, 0, __ATOMIC_RELEASE)
+#else
+#define POOLS_LOCK()
+#define POOLS_UNLOCK()
+#endif
+
+static inline aint_t
+page_size()
+{
+    static aint_t sz;
+    if (sz == 0) sz = (aint_t)sysconf(_SC_PAGESIZE);
+    return sz;
+}
+
+static inline uint8_t**
+next_free(
+    uint8_t* stack, aint_t sz)
+{
+    return (uint8_t**)(stack + sz) - 1;
+}
+
+static uint8_t*
+stack_alloc(
+    aint_t sz)
+{
+    uint8_t* stack = NULL;
+    int32_t i;
+    POOLS_LOCK();
+    for (i = 0; i < NUM_POOLS; ++i) {
+        stack_pool_t* pool = pools + i;
+        if (pool->sz != sz || pool->head == NULL) continue;
+        stack = pool->head;
+        pool->head = *next_free(stack, sz);
+        --pool->num;
+        break;
+    }
+    POOLS_UNLOCK();
+    if (stack) return stack;
+    stack = (uint8_t*)mmap(NULL, (size_t)sz, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANON, -1, 0);
+    if (stack == MAP_FAILED) return NULL;
+    if (mprotect(stack, (size_t)page_size(), PROT_NONE) != 0) {
+        munmap(stack, (size_t)sz);
+        return NULL;
+    }
+    return stack;
+}
+
+static void
+stack_free(
+    uint8_t* stack, aint_t sz)
+{
+    stack_pool_t* pool = NULL;
+    aint_t page = page_size();
+    int32_t i;
+    // keep the guard and the top page.
+    if (sz > 2 * page) {
+        madvise(stack + page, (size_t)(sz - 2 * page), MADV_DONTNEED);
+    }
+    POOLS_LOCK();
+    for (i = 0; i < NUM_POOLS; ++i) {
+        if (pools[i].sz == sz) {
+            pool = pools + i;
+            break;
+        }
+        if (pool == NULL && pools[i].num == 0) pool = pools + i;
+    }
+    if (pool && pool->num < MAX_POOLED) {
+        pool->sz = sz;
+        *next_free(stack, sz) = pool->head;
+        pool->head = stack;
+        ++pool->num;
+        stack = NULL;
+    }
+    POOLS_UNLOCK();
+    if (stack) munmap(stack, (size_t)sz);
+}
+
+#endif // STACK_MMAP
+
 aerror_t
 atask_shadow(
-    struct atask_t* self)
+    struct atask_s* self)
 {
     self->stack = NULL;
+    self->stack_sz = 0;
     return AERR_NONE;
 }
 
 aerror_t
 atask_create(
-    struct atask_t* self, atask_entry_t entry, void* ud, aint_t stack_sz)
+    struct atask_s* self, atask_entry_t entry, void* ud, aint_t stack_sz)
 {
+#ifdef STACK_MMAP
+    aint_t page = page_size();
+    aint_t sz = ((stack_sz + page - 1) & -page) + page;
+    self->stack = stack_alloc(sz);
+    if (!self->stack) return AERR_FULL;
+    self->stack_sz = sz;
+    STACK_REG(self, (uint8_t*)self->stack + page, sz - page);
+    stack_sz = sz;
+#else
     self->stack = (uint8_t*)malloc(stack_sz);
     if (!self->stack) return AERR_FULL;
-    STACK_REG(self, self->stack, stack_sz);
+    self->stack_sz = stack_sz;
+    STACK_REG(self, (uint8_t*)self->stack, stack_sz);
+#endif
 #if defined(AARCH_I386)
 #error "TODO"
 #elif defined(AARCH_AMD64)
@@ -63,15 +186,19 @@ atask_create(
 
 void
 atask_delete(
-    struct atask_t* self)
+    struct atask_s* self)
 {
     STACK_DEREG(self);
+#ifdef STACK_MMAP
+    stack_free((uint8_t*)self->stack, self->stack_sz);
+#else
     free(self->stack);
+#endif
 }
 
 void
 atask_yield(
-    struct atask_t* self, struct atask_t* next)
+    struct atask_s* self, struct atask_s* next)
 {
     assert(self != next);
     atask_ctx_switch(&self->ctx, &next->ctx);
@@ -0,0 +1,218 @@
+/* Copyright (c) 2017 Nguyen Viet Giang. All rights reserved. */
+#include <any/verifier.h>
+
+enum { UNVISITED = -1 };
+
+typedef struct averifier_s {
+    aint_t* depths;
+    aint_t* works;
+    aint_t num_works;
+} averifier_t;
+
+// Flow `depth` into `ip`, returns FALSE on mismatch with an earlier visit.
+static int32_t
+flow(
+    averifier_t* self, aint_t ip, aint_t depth)
+{
+    if (self->depths[ip] == UNVISITED) {
+        self->depths[ip] = depth;
+        self->works[self->num_works++] = ip;
+        return TRUE;
+    }
+    return self->depths[ip] == depth;
+}
+
+static int32_t
+check_constant(
+    aprototype_t* pt, aint_t idx)
+{
+    const aconstant_t* c;
+    if (idx < 0 || idx >= pt->header->num_constants) return FALSE;
+    c = pt->constants + idx;
+    switch (c->type) {
+    case ACT_INTEGER:
+    case ACT_REAL:
+        return TRUE;
+    case ACT_STRING:
+        return c->string >= 0 && c->string < pt->header->strings_sz;
+    default:
+        return FALSE;
+    }
+}
+
+aerror_t
+averify_prototype(
+    aprototype_t* pt, aalloc_t alloc, void* alloc_ud)
+{
+    const aprototype_header_t* const h = pt->header;
+    const aint_t nlocals = h->num_local_vars;
+    const aint_t n = h->num_instructions;
+    aint_t max_stack = nlocals;
+    aint_t min_args = 0;
+    aint_t ip;
+    int32_t ok = TRUE;
+    averifier_t v;
+
+    pt->verified = FALSE;
+    pt->max_stack = 0;
+    pt->min_args = 0;
+    if (n <= 0 || nlocals < 0) return AERR_MALFORMED;
+
+    v.depths = (aint_t*)alloc(alloc_ud, NULL, sizeof(aint_t) * n * 2);
+    if (!v.depths) return AERR_FULL;
+    v.works = v.depths + n;
+    v.num_works = 0;
+    for (ip = 0; ip < n; ++ip) v.depths[ip] = UNVISITED;
+    flow(&v, 0, nlocals);
+
+    while (ok && v.num_works > 0) {
+        const ainstruction_t* i;
+        aint_t depth, pops = 0, pushes = 0, low = 0, target = 0;
+        int32_t jumps = FALSE, falls = TRUE;
+
+        ip = v.works[--v.num_works];
+        depth = v.depths[ip];
+        i = pt->instructions + ip;
+
+        switch (i->b.opcode) {
+        case AOC_NOP:
+        case AOC_BRK:
+        case AOC_RMV:
+        case AOC_RWD:
+        case AOC_MRK:
+            break;
+        case AOC_POP:
+            ok = i->pop.n >= 0;
+            pops = i->pop.n;
+            low = nlocals;
+            break;
+        case AOC_LDK:
+            ok = check_constant(pt, i->ldk.idx);
+            pushes = 1;
+            break;
+        case AOC_NIL:
+        case AOC_LDB:
+        case AOC_LSI:
+            pushes = 1;
+            break;
+        case AOC_LLV:
+            ok = i->llv.idx < depth;
+            if (-i->llv.idx > min_args) min_args = -i->llv.idx;
+            pushes = 1;
+            break;
+        case AOC_SLV:
+            ok = i->slv.idx < depth;
+            if (-i->slv.idx > min_args) min_args = -i->slv.idx;
+            pops = 1;
+            low = nlocals;
+            break;
+        case AOC_IMP:
+            ok = i->imp.idx >= 0 && i->imp.idx < h->num_imports;
+            pushes = 1;
+            break;
+        case AOC_CLS:
+            ok = i->cls.idx >= 0 && i->cls.idx < h->num_nesteds;
+            pushes = 1;
+            break;
+        case AOC_JMP:
+            target = ip + i->jmp.displacement + 1;
+            jumps = TRUE;
+            falls = FALSE;
+            break;
+        case AOC_JIN:
+            target = ip + i->jin.displacement + 1;
+            jumps = TRUE;
+            pops = 1;
+            break;
+        case AOC_IVK:
+            ok = i->ivk.nargs >= 0;
+            pops = i->ivk.nargs + 1;
+            pushes = 1;
+            break;
+        case AOC_RET:
+            pops = 1;
+            falls = FALSE;
+            break;
+        case AOC_TVK:
+            ok = i->tvk.nargs >= 0;
+            pops = i->tvk.nargs + 1;
+            falls = FALSE;
+            break;
+        case AOC_SND:
+            pops = 2;
+            low = nlocals;
+            break;
+        case AOC_RCV:
+            // timeout is replaced by the message, or kept when jumping.
+            target = ip + i->rcv.displacement + 1;
+            jumps = TRUE;
+            pops = 1;
+            pushes = 1;
+            break;
+        case AOC_NOT:
+            pops = 1;
+            pushes = 1;
+            break;
+        case AOC_ADD:
+        case AOC_SUB:
+        case AOC_MUL:
+        case AOC_DIV:
+        case AOC_EQ:
+        case AOC_LT:
+        case AOC_LE:
+        case AOC_GT:
+        case AOC_GE:
+            pops = 2;
+            pushes = 1;
+            break;
+        case AOC_ADD_LL:
+            ok = i->add_ll.lhs < depth && i->add_ll.rhs < depth;
+            if (-i->add_ll.lhs > min_args) min_args = -i->add_ll.lhs;
+            if (-i->add_ll.rhs > min_args) min_args = -i->add_ll.rhs;
+            pushes = 1;
+            break;
+        case AOC_ADDI:
+            pops = 1;
+            pushes = 1;
+            break;
+        case AOC_INC:
+            ok = i->inc.idx < depth;
+            if (-i->inc.idx > min_args) min_args = -i->inc.idx;
+            break;
+        case AOC_JLT:
+        case AOC_JLE:
+        case AOC_JGT:
+        case AOC_JGE:
+            // compare and branch opcodes share the same layout.
+            target = ip + i->jlt.displacement + 1;
+            jumps = TRUE;
+            pops = 1;
+            break;
+        default:
+            ok = FALSE;
+            break;
+        }
+        if (!ok || depth - pops < low) {
+            ok = FALSE;
+            break;
+        }
+        if (depth - pops + pushes > max_stack) {
+            max_stack = depth - pops + pushes;
+        }
+        if (jumps) {
+            aint_t tdepth = i->b.opcode == AOC_RCV ? depth : depth - pops;
+            ok = target >= 0 && target < n && flow(&v, target, tdepth);
+        }
+        if (ok && falls) {
+            ok = ip + 1 < n && flow(&v, ip + 1, depth - pops + pushes);
+        }
+    }
+
+    alloc(alloc_ud, v.depths, 0);
+    if (!ok) return AERR_MALFORMED;
+
+    pt->verified = TRUE;
+    pt->max_stack = max_stack;
+    pt->min_args = min_args;
+    return AERR_NONE;
+}
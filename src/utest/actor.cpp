@@ -240,4 +240,57 @@ TEST_CASE("process_spawn")
     REQUIRE(num_spawn_tests == 10);
 
     ascheduler_cleanup(&s);
-}
\ No newline at end of file
+}
+
+static void send_one(aactor_t* a)
+{
+    any_push_index(a, any_check_index(a, -1));
+    any_push_integer(a, 1);
+    any_mbox_send(a);
+    any_push_nil(a);
+}
+
+TEST_CASE("process_lazy_alloc")
+{
+    enum { NUM_IDX_BITS = 4 };
+    enum { NUM_GEN_BITS = 4 };
+
+    ascheduler_t s;
+    REQUIRE(AERR_NONE ==
+        ascheduler_init(&s, NUM_IDX_BITS, NUM_GEN_BITS, &myalloc, NULL));
+    ascheduler_on_panic(&s, &on_panic, NULL);
+
+    aactor_opts_t opts;
+    memset(&opts, 0, sizeof(opts));
+    opts.stack_sz = 4;
+    opts.msbox_sz = 2;
+    opts.heap_sz = 64;
+
+    aactor_t* a;
+    REQUIRE(AERR_NONE == ascheduler_new_actor_opts(&s, CSTACK_SZ, &opts, &a));
+    aactor_t* b;
+    REQUIRE(AERR_NONE == ascheduler_new_actor_opts(&s, CSTACK_SZ, &opts, &b));
+
+    CHECK(a->stack.v == NULL);
+    CHECK(a->msbox.v == NULL);
+    CHECK(a->gc.cur_heap == NULL);
+
+    any_push_native_func(a, &send_one);
+    CHECK(a->stack.cap == 4);
+    CHECK(a->gc.cur_heap == NULL);
+    any_push_string(a, "grows");
+    CHECK(a->gc.heap_cap == 64);
+    any_pop(a, 1);
+    any_push_pid(a, ascheduler_pid(&s, b));
+    ascheduler_start(&s, a, 1);
+
+    ascheduler_run_once(&s);
+
+    CHECK(a->msbox.v == NULL);
+    REQUIRE(b->msbox.num_msgs == 1);
+    CHECK(b->msbox.cap == 2);
+    CHECK(b->stack.v == NULL);
+    CHECK(b->gc.cur_heap == NULL);
+
+    ascheduler_cleanup(&s);
+}
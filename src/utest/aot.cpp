@@ -0,0 +1,246 @@
+/* Copyright (c) 2017 Nguyen Viet Giang. All rights reserved. */
+#include "prereq.h"
+
+#include <any/asm.h>
+#include <any/loader.h>
+#include <any/list.h>
+#include <any/aot.h>
+
+#include "aot_mod.h"
+
+#include <string>
+
+// Generated from aot_mod.h by aot_gen.
+extern "C" void aot_lib_add_aot_mod(aloader_t* l);
+
+static void write_string(const char* s, aint_t sz, void* ud)
+{
+    ((std::string*)ud)->append(s, (size_t)sz);
+}
+
+TEST_CASE("aot_translate")
+{
+    aasm_t as;
+    aasm_init(&as, &myalloc, NULL);
+    REQUIRE(aasm_load(&as, NULL) == AERR_NONE);
+    add_module(&as, "mod_test");
+
+    aloader_t l;
+    aloader_init(&l, &myalloc, NULL);
+
+    aasm_module_push(&as, "test_f");
+    aasm_prototype(&as)->num_local_vars = 1;
+    aint_t g = aasm_add_import(&as, "mod_test", "test_g");
+    aint_t p = aasm_add_import(&as, "std", "print/1");
+    aint_t s = aasm_add_constant(
+        &as, ac_string(aasm_string_to_ref(&as, "hi\n")));
+    aasm_emit(&as, ai_imp(p), 1);
+    aasm_emit(&as, ai_ldk(s), 1);
+    aasm_emit(&as, ai_ivk(1), 1);
+    aasm_emit(&as, ai_lsi(3), 2);
+    aasm_emit(&as, ai_slv(0), 2);
+    aasm_emit(&as, ai_inc(0, -1), 3);
+    aasm_emit(&as, ai_llv(0), 3);
+    aasm_emit(&as, ai_jgt(0, -3), 3);
+    aasm_emit(&as, ai_imp(g), 4);
+    aasm_emit(&as, ai_ivk(0), 4);
+    aasm_emit(&as, ai_pop(1), 4);
+    aasm_emit(&as, ai_llv(0), 5);
+    aasm_emit(&as, ai_ret(), 5);
+
+    SECTION("ok")
+    {
+        aasm_pop(&as);
+        aasm_module_push(&as, "test_g");
+        aasm_emit(&as, ai_lsi(1), 1);
+        aasm_emit(&as, ai_ret(), 1);
+        aasm_pop(&as);
+        aasm_save(&as);
+        REQUIRE(AERR_NONE ==
+            aloader_add_chunk(&l, as.chunk, as.chunk_size, NULL, NULL));
+        achunk_t* c = ALIST_NODE_CAST(achunk_t, alist_head(&l.pendings));
+
+        std::string src;
+        REQUIRE(AERR_NONE == aaot_translate(
+            c->prototypes, &myalloc, NULL, &write_string, &src));
+        CHECK(src.find("any_import(a, \"std\", \"print/1\");") != std::string::npos);
+        CHECK(src.find("any_push_string(a, \"hi\\n\");") != std::string::npos);
+        CHECK(src.find("if (!aaot_jgt(a, 0)) {") != std::string::npos);
+        CHECK(src.find("goto l5;") != std::string::npos);
+        // local imports are bound directly.
+        CHECK(src.find("aaot_native(a, &aot_2);") != std::string::npos);
+        CHECK(src.find("{ \"test_f\", &aot_1 },") != std::string::npos);
+        CHECK(src.find("{ \"test_g\", &aot_2 },") != std::string::npos);
+        CHECK(src.find("aot_lib_add_mod_test(") != std::string::npos);
+    }
+
+    SECTION("self_tail")
+    {
+        aasm_pop(&as);
+        aasm_module_push(&as, "test_g");
+        aint_t self = aasm_add_import(&as, "mod_test", "test_g");
+        aasm_emit(&as, ai_imp(self), 1);
+        aasm_emit(&as, ai_tvk(0), 1);
+        aasm_pop(&as);
+        aasm_save(&as);
+        REQUIRE(AERR_NONE ==
+            aloader_add_chunk(&l, as.chunk, as.chunk_size, NULL, NULL));
+        achunk_t* c = ALIST_NODE_CAST(achunk_t, alist_head(&l.pendings));
+
+        std::string src;
+        REQUIRE(AERR_NONE == aaot_translate(
+            c->prototypes, &myalloc, NULL, &write_string, &src));
+        // loops instead of calling.
+        CHECK(src.find("enter:\n    aaot_enter(a, 0, 0, ") !=
+            std::string::npos);
+        CHECK(src.find("aaot_tail(a, 0);\n    goto enter;") !=
+            std::string::npos);
+    }
+
+    SECTION("other_tail")
+    {
+        aasm_pop(&as);
+        aasm_module_push(&as, "test_g");
+        aint_t f = aasm_add_import(&as, "mod_test", "test_f");
+        aasm_emit(&as, ai_imp(f), 1);
+        aasm_emit(&as, ai_tvk(0), 1);
+        aasm_pop(&as);
+        aasm_save(&as);
+        REQUIRE(AERR_NONE ==
+            aloader_add_chunk(&l, as.chunk, as.chunk_size, NULL, NULL));
+        achunk_t* c = ALIST_NODE_CAST(achunk_t, alist_head(&l.pendings));
+
+        std::string src;
+        CHECK(AERR_MALFORMED == aaot_translate(
+            c->prototypes, &myalloc, NULL, &write_string, &src));
+    }
+
+    SECTION("not_verified")
+    {
+        aasm_pop(&as);
+        // falls off the end.
+        aasm_module_push(&as, "test_g");
+        aasm_emit(&as, ai_lsi(1), 1);
+        aasm_pop(&as);
+        aasm_save(&as);
+        REQUIRE(AERR_NONE ==
+            aloader_add_chunk(&l, as.chunk, as.chunk_size, NULL, NULL));
+        achunk_t* c = ALIST_NODE_CAST(achunk_t, alist_head(&l.pendings));
+
+        std::string src;
+        CHECK(AERR_MALFORMED == aaot_translate(
+            c->prototypes, &myalloc, NULL, &write_string, &src));
+    }
+
+    aloader_cleanup(&l);
+    aasm_cleanup(&as);
+}
+
+static void keep_result(aactor_t* a, void* ud)
+{
+    *(avalue_t*)ud = *aactor_at(a, any_check_index(a, 0));
+}
+
+// Run `aot_mod.f` with `args` from byte code or the generated C code.
+static avalue_t run_aot_mod(
+    aasm_t* as, bool native, const char* f, avalue_t* args, aint_t nargs)
+{
+    enum { NUM_IDX_BITS = 4 };
+    enum { NUM_GEN_BITS = 4 };
+
+    ascheduler_t s;
+    REQUIRE(AERR_NONE ==
+        ascheduler_init(&s, NUM_IDX_BITS, NUM_GEN_BITS, &myalloc, NULL));
+    ascheduler_on_panic(&s, &on_panic, NULL);
+    avalue_t ret;
+    av_nil(&ret);
+    ascheduler_on_exit(&s, &keep_result, &ret);
+    if (native) {
+        aot_lib_add_aot_mod(&s.loader);
+    } else {
+        REQUIRE(AERR_NONE == aloader_add_chunk(
+            &s.loader, as->chunk, as->chunk_size, NULL, NULL));
+    }
+    REQUIRE(AERR_NONE == aloader_link(&s.loader, TRUE));
+
+    aactor_t* a;
+    REQUIRE(AERR_NONE == ascheduler_new_actor(&s, CSTACK_SZ, &a));
+    any_import(a, "aot_mod", f);
+    for (aint_t i = 0; i < nargs; ++i) aactor_push(a, args + i);
+    ascheduler_start(&s, a, nargs);
+    ascheduler_run_until_idle(&s);
+    CHECK(ascheduler_num_processes(&s) == 0);
+    ascheduler_cleanup(&s);
+    return ret;
+}
+
+TEST_CASE("aot_run")
+{
+    aasm_t as;
+    aasm_init(&as, &myalloc, NULL);
+    REQUIRE(aasm_load(&as, NULL) == AERR_NONE);
+    aot_mod_build(&as);
+    aasm_save(&as);
+
+    avalue_t args[2];
+
+    SECTION("fused")
+    {
+        av_integer(args, 10);
+        avalue_t b = run_aot_mod(&as, false, "sum", args, 1);
+        avalue_t n = run_aot_mod(&as, true, "sum", args, 1);
+        REQUIRE(b.tag.type == AVT_INTEGER);
+        REQUIRE(n.tag.type == AVT_INTEGER);
+        CHECK(b.v.integer == 155);
+        CHECK(n.v.integer == b.v.integer);
+
+        // same loop over a real counter.
+        av_real(args, 4.5);
+        b = run_aot_mod(&as, false, "sum", args, 1);
+        n = run_aot_mod(&as, true, "sum", args, 1);
+        REQUIRE(b.tag.type == AVT_REAL);
+        REQUIRE(n.tag.type == AVT_REAL);
+        CHECK(n.v.real == b.v.real);
+    }
+
+    SECTION("real")
+    {
+        av_real(args, 7.25);
+        av_real(args + 1, -2.5);
+        avalue_t b = run_aot_mod(&as, false, "mix", args, 2);
+        avalue_t n = run_aot_mod(&as, true, "mix", args, 2);
+        REQUIRE(b.tag.type == AVT_REAL);
+        REQUIRE(n.tag.type == AVT_REAL);
+        CHECK(n.v.real == b.v.real);
+
+        av_integer(args, 9);
+        b = run_aot_mod(&as, false, "mix", args, 2);
+        n = run_aot_mod(&as, true, "mix", args, 2);
+        REQUIRE(n.tag.type == b.tag.type);
+        CHECK(n.v.real == b.v.real);
+    }
+
+    SECTION("call")
+    {
+        av_integer(args, 6);
+        avalue_t b = run_aot_mod(&as, false, "twice", args, 1);
+        avalue_t n = run_aot_mod(&as, true, "twice", args, 1);
+        REQUIRE(b.tag.type == AVT_INTEGER);
+        REQUIRE(n.tag.type == AVT_INTEGER);
+        CHECK(n.v.integer == b.v.integer);
+    }
+
+    SECTION("tail")
+    {
+        av_integer(args, 1000000);
+        av_integer(args + 1, 7);
+        avalue_t b = run_aot_mod(&as, false, "count", args, 2);
+        avalue_t n = run_aot_mod(&as, true, "count", args, 2);
+        REQUIRE(b.tag.type == AVT_INTEGER);
+        REQUIRE(n.tag.type == AVT_INTEGER);
+        CHECK(b.v.integer == 1000007);
+        CHECK(n.v.integer == b.v.integer);
+    }
+
+    aasm_cleanup(&as);
+}
@@ -0,0 +1,71 @@
+/* Copyright (c) 2017 Nguyen Viet Giang. All rights reserved. */
+#include "aot_mod.h"
+
+#include <any/loader.h>
+#include <any/list.h>
+#include <any/aot.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+static void*
+gen_alloc(
+    void* ud, void* old, aint_t sz)
+{
+    AUNUSED(ud);
+    if (sz == 0) {
+        free(old);
+        return NULL;
+    }
+    return realloc(old, (size_t)sz);
+}
+
+static void
+write_file(
+    const char* s, aint_t sz, void* ud)
+{
+    fwrite(s, 1, (size_t)sz, (FILE*)ud);
+}
+
+// Translate `aot_mod.h` into the C file in args, built into utest.
+int
+main(
+    int argc, char** argv)
+{
+    aasm_t as;
+    aloader_t l;
+    achunk_t* c;
+    FILE* f;
+    aerror_t ec;
+
+    if (argc != 2) {
+        fprintf(stderr, "usage: aot_gen <output.c>\n");
+        return 1;
+    }
+    aasm_init(&as, &gen_alloc, NULL);
+    if (aasm_load(&as, NULL) != AERR_NONE) return 1;
+    aot_mod_build(&as);
+    aasm_save(&as);
+
+    aloader_init(&l, &gen_alloc, NULL);
+    ec = aloader_add_chunk(&l, as.chunk, as.chunk_size, NULL, NULL);
+    if (ec == AERR_NONE) {
+        f = fopen(argv[1], "w");
+        if (f) {
+            c = ALIST_NODE_CAST(achunk_t, alist_head(&l.pendings));
+            ec = aaot_translate(
+                c->prototypes, &gen_alloc, NULL, &write_file, f);
+            fclose(f);
+            if (ec != AERR_NONE) remove(argv[1]);
+        } else {
+            ec = AERR_RUNTIME;
+        }
+    }
+    aloader_cleanup(&l);
+    aasm_cleanup(&as);
+    if (ec != AERR_NONE) {
+        fprintf(stderr, "aot_gen: failed to translate aot_mod\n");
+        return 1;
+    }
+    return 0;
+}
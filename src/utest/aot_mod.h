@@ -0,0 +1,74 @@
+/* Copyright (c) 2017 Nguyen Viet Giang. All rights reserved. */
+#pragma once
+
+#include <any/asm.h>
+
+/*
+Module `aot_mod`, translated to C by `aot_gen` at build time, and run by
+aot.cpp both as byte code and as that C code to compare the results.
+*/
+static void
+aot_mod_build(
+    aasm_t* as)
+{
+    aint_t half, sum, count;
+    aasm_prototype(as)->symbol = aasm_string_to_ref(as, "aot_mod");
+
+    // sum(n): 100 + n + (n - 1) + ... + 0, by fused instructions.
+    aasm_module_push(as, "sum");
+    aasm_prototype(as)->num_local_vars = 2;
+    aasm_emit(as, ai_lsi(0), 1);
+    aasm_emit(as, ai_slv(0), 1);
+    aasm_emit(as, ai_llv(-1), 2);
+    aasm_emit(as, ai_slv(1), 2);
+    aasm_emit(as, ai_add_ll(0, 1), 3);
+    aasm_emit(as, ai_slv(0), 3);
+    aasm_emit(as, ai_inc(1, -1), 4);
+    aasm_emit(as, ai_llv(1), 4);
+    aasm_emit(as, ai_jgt(0, -5), 4);
+    aasm_emit(as, ai_llv(0), 5);
+    aasm_emit(as, ai_addi(100), 5);
+    aasm_emit(as, ai_ret(), 5);
+    aasm_pop(as);
+
+    // mix(x, y): (x + y) * 0.5 - x / y.
+    aasm_module_push(as, "mix");
+    half = aasm_add_constant(as, ac_real(0.5));
+    aasm_emit(as, ai_llv(-1), 1);
+    aasm_emit(as, ai_llv(-2), 1);
+    aasm_emit(as, ai_add(), 1);
+    aasm_emit(as, ai_ldk(half), 1);
+    aasm_emit(as, ai_mul(), 1);
+    aasm_emit(as, ai_llv(-2), 2);
+    aasm_emit(as, ai_llv(-1), 2);
+    aasm_emit(as, ai_div(), 2);
+    aasm_emit(as, ai_sub(), 2);
+    aasm_emit(as, ai_ret(), 2);
+    aasm_pop(as);
+
+    // twice(n): sum(n) * 2, calls inside the module.
+    aasm_module_push(as, "twice");
+    sum = aasm_add_import(as, "aot_mod", "sum");
+    aasm_emit(as, ai_imp(sum), 1);
+    aasm_emit(as, ai_llv(-1), 1);
+    aasm_emit(as, ai_ivk(1), 1);
+    aasm_emit(as, ai_lsi(2), 1);
+    aasm_emit(as, ai_mul(), 1);
+    aasm_emit(as, ai_ret(), 1);
+    aasm_pop(as);
+
+    // count(n, acc): acc + n, by a self tail call per step.
+    aasm_module_push(as, "count");
+    count = aasm_add_import(as, "aot_mod", "count");
+    aasm_emit(as, ai_llv(-2), 1);
+    aasm_emit(as, ai_jlt(0, 6), 1);
+    aasm_emit(as, ai_imp(count), 2);
+    aasm_emit(as, ai_llv(-2), 2);
+    aasm_emit(as, ai_addi(-1), 2);
+    aasm_emit(as, ai_llv(-1), 2);
+    aasm_emit(as, ai_addi(1), 2);
+    aasm_emit(as, ai_tvk(2), 2);
+    aasm_emit(as, ai_llv(-1), 3);
+    aasm_emit(as, ai_ret(), 3);
+    aasm_pop(as);
+}
@@ -359,3 +359,77 @@ TEST_CASE("asm_save_load")
     aasm_cleanup(&a1);
     aasm_cleanup(&a2);
 }
+
+TEST_CASE("asm_fuse")
+{
+    aasm_t a;
+    aasm_init(&a, &myalloc, NULL);
+    REQUIRE(aasm_load(&a, NULL) == AERR_NONE);
+
+    aasm_push(&a);
+    aasm_emit(&a, ai_llv(0), 1);
+    aasm_emit(&a, ai_lsi(10), 2);
+    aasm_emit(&a, ai_gt(), 2);
+    aasm_emit(&a, ai_jin(9), 2);
+    aasm_emit(&a, ai_llv(1), 3);
+    aasm_emit(&a, ai_llv(0), 3);
+    aasm_emit(&a, ai_add(), 3);
+    aasm_emit(&a, ai_slv(1), 3);
+    aasm_emit(&a, ai_llv(0), 4);
+    aasm_emit(&a, ai_lsi(1), 4);
+    aasm_emit(&a, ai_add(), 4);
+    aasm_emit(&a, ai_slv(0), 4);
+    aasm_emit(&a, ai_jmp(-13), 5);
+    aasm_emit(&a, ai_llv(1), 6);
+    aasm_emit(&a, ai_lsi(100), 6);
+    aasm_emit(&a, ai_add(), 6);
+    aasm_emit(&a, ai_ret(), 7);
+
+    SECTION("fused")
+    {
+        REQUIRE(aasm_fuse(&a) == 4);
+
+        aasm_prototype_t* p = aasm_prototype(&a);
+        aasm_current_t c = aasm_resolve(&a);
+        REQUIRE(p->num_instructions == 9);
+        CHECK(c.instructions[0].b.opcode == AOC_LLV);
+        CHECK(c.instructions[1].b.opcode == AOC_JGT);
+        CHECK(c.instructions[1].jgt.val == 10);
+        CHECK(c.instructions[1].jgt.displacement == 4);
+        CHECK(c.instructions[2].b.opcode == AOC_ADD_LL);
+        CHECK(c.instructions[2].add_ll.lhs == 0);
+        CHECK(c.instructions[2].add_ll.rhs == 1);
+        CHECK(c.instructions[3].b.opcode == AOC_SLV);
+        CHECK(c.instructions[4].b.opcode == AOC_INC);
+        CHECK(c.instructions[4].inc.idx == 0);
+        CHECK(c.instructions[4].inc.val == 1);
+        CHECK(c.instructions[5].b.opcode == AOC_JMP);
+        CHECK(c.instructions[5].jmp.displacement == -6);
+        CHECK(c.instructions[6].b.opcode == AOC_LLV);
+        CHECK(c.instructions[7].b.opcode == AOC_ADDI);
+        CHECK(c.instructions[7].addi.val == 100);
+        CHECK(c.instructions[8].b.opcode == AOC_RET);
+
+        const aint_t lines[] = { 1, 2, 3, 3, 4, 5, 6, 6, 7 };
+        for (aint_t i = 0; i < 9; ++i) {
+            CHECK(c.source_lines[i] == lines[i]);
+        }
+
+        // nothing left to fuse
+        REQUIRE(aasm_fuse(&a) == 0);
+    }
+
+    SECTION("jump_target_inside")
+    {
+        // jump onto the `add` of `llv 1; llv 0; add`
+        aasm_emit(&a, ai_jmp(-12), 8);
+        REQUIRE(aasm_fuse(&a) == 3);
+        aasm_current_t c = aasm_resolve(&a);
+        CHECK(c.instructions[2].b.opcode == AOC_LLV);
+        CHECK(c.instructions[3].b.opcode == AOC_LLV);
+        CHECK(c.instructions[4].b.opcode == AOC_ADD);
+    }
+
+    aasm_pop(&a);
+    aasm_cleanup(&a);
+}
@@ -48,9 +48,11 @@ static void wby_response_end(struct wby_con*)
     // TODO
 }
 
-static int wby_write(struct wby_con*, const void*, wby_size)
+static std::string written;
+
+static int wby_write(struct wby_con*, const void* buf, wby_size sz)
 {
-    // TODO
+    written.append((const char*)buf, sz);
     return 0;
 }
 
@@ -134,3 +136,14 @@ TEST_CASE("db")
     ascheduler_cleanup(&s);
     aasm_cleanup(&as);
 }
+
+TEST_CASE("db_json")
+{
+    written.clear();
+    wby_write_json(NULL, "mod_test");
+    CHECK_THAT(written, Catch::Equals("mod_test"));
+
+    written.clear();
+    wby_write_json(NULL, "a\"b\\c\n\x01");
+    CHECK_THAT(written, Catch::Equals("a\\\"b\\\\c\\u000a\\u0001"));
+}
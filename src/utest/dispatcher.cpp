@@ -1200,6 +1200,23 @@ TEST_CASE("dispatcher_msbox")
         aasm_emit(&as, ai_ret(), 1);
     }
 
+    bool mark = false;
+
+    SECTION("mark")
+    {
+        mark = true;
+        aasm_emit(&as, ai_mrk(), 1);
+        aasm_emit(&as, ai_llv(-1), 2);
+        aasm_emit(&as, ai_lsi(4), 3);
+        aasm_emit(&as, ai_snd(), 4);
+        aasm_emit(&as, ai_rwd(), 5);
+        aasm_emit(&as, ai_lsi(0), 6);
+        aasm_emit(&as, ai_rcv(1), 7);
+        aasm_emit(&as, ai_ret(), 8);
+        aasm_emit(&as, ai_lsi(5), 9);
+        aasm_emit(&as, ai_ret(), 10);
+    }
+
     aasm_save(&as);
 
     REQUIRE(AERR_NONE ==
@@ -1216,9 +1233,350 @@ TEST_CASE("dispatcher_msbox")
 
     REQUIRE(any_count(a) == 2);
     REQUIRE(any_type(a, any_check_index(a, 1)).type == AVT_NIL);
-    REQUIRE((timeout ? 5 : 2) ==
+    REQUIRE((timeout ? 5 : mark ? 4 : 2) ==
         any_check_integer(a, any_check_index(a, 0)));
 
     ascheduler_cleanup(&s);
     aasm_cleanup(&as);
-}
\ No newline at end of file
+}
+
+TEST_CASE("dispatcher_fused")
+{
+    enum { NUM_IDX_BITS = 4 };
+    enum { NUM_GEN_BITS = 4 };
+
+    aasm_t as;
+    aasm_init(&as, &myalloc, NULL);
+    REQUIRE(aasm_load(&as, NULL) == AERR_NONE);
+    add_module(&as, "mod_test");
+
+    ascheduler_t s;
+    REQUIRE(AERR_NONE ==
+        ascheduler_init(&s, NUM_IDX_BITS, NUM_GEN_BITS, &myalloc, NULL));
+    ascheduler_on_panic(&s, &on_panic, NULL);
+
+    // i = 0; s = 0; while i < 10 { s = s + i; i = i + 1 }; return s + 100
+    aasm_module_push(&as, "test_f");
+    aasm_prototype(&as)->num_local_vars = 2;
+    aasm_emit(&as, ai_lsi(0), 1);
+    aasm_emit(&as, ai_slv(0), 1);
+    aasm_emit(&as, ai_lsi(0), 1);
+    aasm_emit(&as, ai_slv(1), 1);
+    aasm_emit(&as, ai_llv(0), 2);
+    aasm_emit(&as, ai_lsi(10), 2);
+    aasm_emit(&as, ai_gt(), 2);
+    aasm_emit(&as, ai_jin(9), 2);
+    aasm_emit(&as, ai_llv(1), 3);
+    aasm_emit(&as, ai_llv(0), 3);
+    aasm_emit(&as, ai_add(), 3);
+    aasm_emit(&as, ai_slv(1), 3);
+    aasm_emit(&as, ai_llv(0), 4);
+    aasm_emit(&as, ai_lsi(1), 4);
+    aasm_emit(&as, ai_add(), 4);
+    aasm_emit(&as, ai_slv(0), 4);
+    aasm_emit(&as, ai_jmp(-13), 5);
+    aasm_emit(&as, ai_llv(1), 6);
+    aasm_emit(&as, ai_lsi(100), 6);
+    aasm_emit(&as, ai_add(), 6);
+    aasm_emit(&as, ai_ret(), 7);
+    aasm_pop(&as);
+
+    bool checked = false;
+
+    SECTION("plain")
+    {
+    }
+
+    SECTION("fused")
+    {
+        REQUIRE(aasm_fuse(&as) == 4);
+    }
+
+    SECTION("fused_checked")
+    {
+        REQUIRE(aasm_fuse(&as) == 4);
+        checked = true;
+    }
+
+    aasm_save(&as);
+
+    REQUIRE(AERR_NONE ==
+        aloader_add_chunk(&s.loader, as.chunk, as.chunk_size, NULL, NULL));
+    REQUIRE(AERR_NONE == aloader_link(&s.loader, TRUE));
+
+    aactor_t* a;
+    REQUIRE(AERR_NONE == ascheduler_new_actor(&s, CSTACK_SZ, &a));
+    any_import(a, "mod_test", "test_f");
+    REQUIRE(a->stack.v[a->stack.sp - 1].v.avm_func->verified == TRUE);
+    if (checked) a->stack.v[a->stack.sp - 1].v.avm_func->verified = FALSE;
+    ascheduler_start(&s, a, 0);
+
+    ascheduler_run_once(&s);
+
+    REQUIRE(any_count(a) == 2);
+    REQUIRE(any_type(a, any_check_index(a, 1)).type == AVT_NIL);
+    REQUIRE(any_check_integer(a, any_check_index(a, 0)) == 145);
+
+    ascheduler_cleanup(&s);
+    aasm_cleanup(&as);
+}
+
+static aint_t run_sub(ascheduler_t* s, aactor_t** pa, avalue_t x, avalue_t y)
+{
+    aactor_t* a;
+    REQUIRE(AERR_NONE == ascheduler_new_actor(s, CSTACK_SZ, &a));
+    any_import(a, "mod_test", "test_f");
+    aactor_push(a, &x);
+    aactor_push(a, &y);
+    ascheduler_start(s, a, 2);
+    ascheduler_run_once(s);
+    REQUIRE(any_count(a) == 2);
+    *pa = a;
+    return any_check_index(a, 0);
+}
+
+TEST_CASE("dispatcher_quicken")
+{
+    enum { NUM_IDX_BITS = 4 };
+    enum { NUM_GEN_BITS = 4 };
+
+    aasm_t as;
+    aasm_init(&as, &myalloc, NULL);
+    REQUIRE(aasm_load(&as, NULL) == AERR_NONE);
+    add_module(&as, "mod_test");
+
+    ascheduler_t s;
+    REQUIRE(AERR_NONE ==
+        ascheduler_init(&s, NUM_IDX_BITS, NUM_GEN_BITS, &myalloc, NULL));
+    ascheduler_on_panic(&s, &on_panic, NULL);
+
+    aasm_module_push(&as, "test_f");
+    aasm_emit(&as, ai_llv(-1), 1);
+    aasm_emit(&as, ai_llv(-2), 2);
+    aasm_emit(&as, ai_sub(), 3);
+    aasm_emit(&as, ai_ret(), 4);
+    aasm_pop(&as);
+    aasm_save(&as);
+
+    REQUIRE(AERR_NONE ==
+        aloader_add_chunk(&s.loader, as.chunk, as.chunk_size, NULL, NULL));
+    REQUIRE(AERR_NONE == aloader_link(&s.loader, TRUE));
+
+    achunk_t* c = ALIST_NODE_CAST(achunk_t, alist_head(&s.loader.runnings));
+    aprototype_t* pt = c->prototypes->nesteds;
+    const ainstruction_t* original = (const ainstruction_t*)(
+        ((const uint8_t*)(pt->header + 1)) + pt->header->strings_sz);
+    REQUIRE(pt->instructions != original);
+
+#ifdef ANY_JIT
+    // native code does not quicken, it may run from the first call.
+    const bool interpreted = false;
+#else
+    const bool interpreted = true;
+#endif
+
+    avalue_t i10, i3, r10, r3;
+    av_integer(&i10, 10);
+    av_integer(&i3, 3);
+    av_real(&r10, 10.5);
+    av_real(&r3, 3.25);
+
+    aactor_t* a;
+    aint_t idx;
+
+    idx = run_sub(&s, &a, i10, i3);
+    CHECK(any_check_integer(a, idx) == 7);
+    if (interpreted) CHECK(pt->instructions[2].b.opcode == AOC_SUB_II);
+
+    idx = run_sub(&s, &a, i3, i10);
+    CHECK(any_check_integer(a, idx) == -7);
+    if (interpreted) CHECK(pt->instructions[2].b.opcode == AOC_SUB_II);
+
+    // guard miss, de-quickened then quickened for reals.
+    idx = run_sub(&s, &a, r10, r3);
+    CHECK(any_check_real(a, idx) == Approx(7.25));
+    if (interpreted) CHECK(pt->instructions[2].b.opcode == AOC_SUB_RR);
+
+    // mixed operands stay on the generic handler.
+    idx = run_sub(&s, &a, r10, i3);
+    CHECK(any_check_real(a, idx) == Approx(7.5));
+    if (interpreted) CHECK(pt->instructions[2].b.opcode == AOC_SUB);
+
+    idx = run_sub(&s, &a, i10, i3);
+    CHECK(any_check_integer(a, idx) == 7);
+    if (interpreted) CHECK(pt->instructions[2].b.opcode == AOC_SUB_II);
+
+    // a polymorphic site stays generic after enough misses.
+    for (aint_t k = 0; k < ANY_QUICKEN_MISSES; ++k) {
+        idx = run_sub(&s, &a, r10, r3);
+        CHECK(any_check_real(a, idx) == Approx(7.25));
+        idx = run_sub(&s, &a, i10, i3);
+        CHECK(any_check_integer(a, idx) == 7);
+    }
+    if (interpreted) {
+        CHECK(pt->instructions[2].b.opcode == AOC_SUB);
+        CHECK(pt->instructions[2].b._ == ANY_QUICKEN_MISSES);
+    }
+
+    // the chunk itself is never written to.
+    CHECK(original[2].b.opcode == AOC_SUB);
+
+    ascheduler_cleanup(&s);
+    aasm_cleanup(&as);
+}
+
+TEST_CASE("dispatcher_deep_call")
+{
+    enum { NUM_IDX_BITS = 4 };
+    enum { NUM_GEN_BITS = 4 };
+    // bytecode calls must not consume native stack.
+    enum { SMALL_CSTACK_SZ = 1024 * 64 };
+    enum { DEPTH = 10000 };
+
+    aasm_t as;
+    aasm_init(&as, &myalloc, NULL);
+    REQUIRE(aasm_load(&as, NULL) == AERR_NONE);
+    add_module(&as, "mod_test");
+
+    ascheduler_t s;
+    REQUIRE(AERR_NONE ==
+        ascheduler_init(&s, NUM_IDX_BITS, NUM_GEN_BITS, &myalloc, NULL));
+    ascheduler_on_panic(&s, &on_panic, NULL);
+
+    bool error = false;
+
+    // n == 0 ? 0 : n + test_f(n - 1)
+    aasm_module_push(&as, "test_f");
+    aint_t self = aasm_add_import(&as, "mod_test", "test_f");
+    aasm_emit(&as, ai_llv(-1), 1);
+    aasm_emit(&as, ai_lsi(0), 1);
+    aasm_emit(&as, ai_lt(), 1);
+    aasm_emit(&as, ai_jin(8), 1);
+    aasm_emit(&as, ai_imp(self), 2);
+    aasm_emit(&as, ai_llv(-1), 2);
+    aasm_emit(&as, ai_lsi(-1), 2);
+    aasm_emit(&as, ai_add(), 2);
+    aasm_emit(&as, ai_ivk(1), 2);
+    aasm_emit(&as, ai_llv(-1), 2);
+    aasm_emit(&as, ai_add(), 2);
+    aasm_emit(&as, ai_ret(), 2);
+
+    SECTION("normal")
+    {
+        aasm_emit(&as, ai_lsi(0), 3);
+        aasm_emit(&as, ai_ret(), 3);
+    }
+
+    SECTION("error")
+    {
+        error = true;
+        aasm_emit(&as, ai_nil(), 3);
+        aasm_emit(&as, ai_lsi(0), 3);
+        aasm_emit(&as, ai_add(), 3);
+        aasm_emit(&as, ai_ret(), 3);
+    }
+
+    aasm_pop(&as);
+    aasm_save(&as);
+
+    REQUIRE(AERR_NONE ==
+        aloader_add_chunk(&s.loader, as.chunk, as.chunk_size, NULL, NULL));
+    REQUIRE(AERR_NONE == aloader_link(&s.loader, TRUE));
+
+    aactor_t* a;
+    REQUIRE(AERR_NONE == ascheduler_new_actor(&s, SMALL_CSTACK_SZ, &a));
+    any_import(a, "mod_test", "test_f");
+    any_push_integer(a, DEPTH);
+    ascheduler_start(&s, a, 1);
+
+    ascheduler_run_once(&s);
+
+    REQUIRE(a->frame == a->frames);
+    REQUIRE(a->max_frames > DEPTH);
+    if (error) {
+        REQUIRE(any_count(a) == 1);
+        CHECK_THAT(any_check_string(a, any_check_index(a, 0)),
+            Catch::Equals("not number"));
+    } else {
+        REQUIRE(any_count(a) == 2);
+        CHECK(any_check_integer(a, any_check_index(a, 0)) ==
+            (aint_t)DEPTH * (DEPTH + 1) / 2);
+    }
+
+    ascheduler_cleanup(&s);
+    aasm_cleanup(&as);
+}
+
+TEST_CASE("dispatcher_tvk")
+{
+    enum { NUM_IDX_BITS = 4 };
+    enum { NUM_GEN_BITS = 4 };
+    enum { DEPTH = 100000 };
+
+    aasm_t as;
+    aasm_init(&as, &myalloc, NULL);
+    REQUIRE(aasm_load(&as, NULL) == AERR_NONE);
+    add_module(&as, "mod_test");
+
+    ascheduler_t s;
+    REQUIRE(AERR_NONE ==
+        ascheduler_init(&s, NUM_IDX_BITS, NUM_GEN_BITS, &myalloc, NULL));
+    ascheduler_on_panic(&s, &on_panic, NULL);
+
+    // n == 0 ? acc : test_f(n - 1, acc + n)
+    aasm_module_push(&as, "test_f");
+    aint_t self = aasm_add_import(&as, "mod_test", "test_f");
+    aasm_emit(&as, ai_llv(-2), 1);
+    aasm_emit(&as, ai_lsi(0), 1);
+    aasm_emit(&as, ai_ge(), 1);
+    aasm_emit(&as, ai_jin(2), 1);
+    aasm_emit(&as, ai_llv(-1), 2);
+    aasm_emit(&as, ai_ret(), 2);
+    aasm_emit(&as, ai_imp(self), 2);
+    aasm_emit(&as, ai_llv(-2), 2);
+    aasm_emit(&as, ai_lsi(-1), 2);
+    aasm_emit(&as, ai_add(), 2);
+    aasm_emit(&as, ai_llv(-1), 2);
+    aasm_emit(&as, ai_llv(-2), 2);
+    aasm_emit(&as, ai_add(), 2);
+
+    SECTION("tvk")
+    {
+        aasm_emit(&as, ai_tvk(2), 2);
+    }
+
+    SECTION("fused")
+    {
+        aasm_emit(&as, ai_ivk(2), 2);
+        aasm_emit(&as, ai_ret(), 2);
+        REQUIRE(aasm_fuse(&as) > 0);
+        aasm_current_t c = aasm_resolve(&as);
+        aint_t n = aasm_prototype(&as)->num_instructions;
+        CHECK(c.instructions[n - 1].b.opcode == AOC_TVK);
+    }
+
+    aasm_pop(&as);
+    aasm_save(&as);
+
+    REQUIRE(AERR_NONE ==
+        aloader_add_chunk(&s.loader, as.chunk, as.chunk_size, NULL, NULL));
+    REQUIRE(AERR_NONE == aloader_link(&s.loader, TRUE));
+
+    aactor_t* a;
+    REQUIRE(AERR_NONE == ascheduler_new_actor(&s, CSTACK_SZ, &a));
+    any_import(a, "mod_test", "test_f");
+    any_push_integer(a, DEPTH);
+    any_push_integer(a, 0);
+    ascheduler_start(&s, a, 2);
+
+    ascheduler_run_once(&s);
+
+    // the frame stack never grew.
+    CHECK(a->max_frames < 64);
+    REQUIRE(any_count(a) == 2);
+    CHECK(any_check_integer(a, any_check_index(a, 0)) ==
+        (aint_t)DEPTH * (DEPTH + 1) / 2);
+
+    ascheduler_cleanup(&s);
+    aasm_cleanup(&as);
+}
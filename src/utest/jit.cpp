@@ -0,0 +1,154 @@
+/* Copyright (c) 2017 Nguyen Viet Giang. All rights reserved. */
+#include "prereq.h"
+
+#include <any/asm.h>
+#include <any/scheduler.h>
+#include <any/loader.h>
+#include <any/actor.h>
+#include <any/jit.h>
+
+TEST_CASE("jit_loop")
+{
+#ifdef ANY_JIT
+    enum { NUM_IDX_BITS = 4 };
+    enum { NUM_GEN_BITS = 4 };
+    enum { NUM_LOOPS = ANY_JIT_THRESHOLD * 2 };
+
+    aasm_t as;
+    aasm_init(&as, &myalloc, NULL);
+    REQUIRE(aasm_load(&as, NULL) == AERR_NONE);
+    add_module(&as, "mod_test");
+
+    // sum = 0; i = 0; do { sum = sum + x; ++i } while (i < n); sum + x
+    aasm_module_push(&as, "test_f");
+    aasm_prototype(&as)->num_local_vars = 2;
+    aasm_emit(&as, ai_lsi(0), 1);
+    aasm_emit(&as, ai_slv(0), 1);
+    aasm_emit(&as, ai_lsi(0), 1);
+    aasm_emit(&as, ai_slv(1), 1);
+    aasm_emit(&as, ai_llv(0), 2);
+    aasm_emit(&as, ai_llv(-1), 2);
+    aasm_emit(&as, ai_add(), 2);
+    aasm_emit(&as, ai_slv(0), 2);
+    aasm_emit(&as, ai_inc(1, 1), 3);
+    aasm_emit(&as, ai_llv(1), 4);
+    aasm_emit(&as, ai_jle(NUM_LOOPS, -7), 4);
+    aasm_emit(&as, ai_add_ll(0, -1), 5);
+    aasm_emit(&as, ai_ret(), 5);
+    aasm_pop(&as);
+    aasm_save(&as);
+
+    ascheduler_t s;
+    REQUIRE(AERR_NONE ==
+        ascheduler_init(&s, NUM_IDX_BITS, NUM_GEN_BITS, &myalloc, NULL));
+    ascheduler_on_panic(&s, &on_panic, NULL);
+
+    REQUIRE(AERR_NONE ==
+        aloader_add_chunk(&s.loader, as.chunk, as.chunk_size, NULL, NULL));
+    REQUIRE(AERR_NONE == aloader_link(&s.loader, TRUE));
+
+    aactor_t* a;
+    REQUIRE(AERR_NONE == ascheduler_new_actor(&s, CSTACK_SZ, &a));
+    any_import(a, "mod_test", "test_f");
+    aprototype_t* pt = a->stack.v[a->stack.sp - 1].v.avm_func;
+    REQUIRE(pt->verified == TRUE);
+
+    SECTION("integer")
+    {
+        any_push_integer(a, 3);
+        ascheduler_start(&s, a, 1);
+        ascheduler_run_once(&s);
+
+        REQUIRE(any_count(a) == 2);
+        CHECK(any_check_integer(a, any_check_index(a, 0)) ==
+            (NUM_LOOPS + 1) * 3);
+    }
+
+    SECTION("real")
+    {
+        // integer fast paths miss, helpers take over.
+        any_push_real(a, 0.5);
+        ascheduler_start(&s, a, 1);
+        ascheduler_run_once(&s);
+
+        REQUIRE(any_count(a) == 2);
+        CHECK(any_check_real(a, any_check_index(a, 0)) ==
+            Approx((NUM_LOOPS + 1) * 0.5));
+    }
+
+    SECTION("preempt")
+    {
+        ascheduler_set_reductions(&s, 10);
+        any_push_integer(a, 1);
+        ascheduler_start(&s, a, 1);
+
+        aint_t slices = 0;
+        while (ascheduler_num_processes(&s) > 0) {
+            ascheduler_run_once(&s);
+            ++slices;
+        }
+        CHECK(slices > NUM_LOOPS / 10);
+    }
+
+    CHECK(pt->jit != NULL);
+
+    ascheduler_cleanup(&s);
+    aasm_cleanup(&as);
+#endif
+}
+
+TEST_CASE("jit_branch_real")
+{
+#ifdef ANY_JIT
+    enum { NUM_IDX_BITS = 4 };
+    enum { NUM_GEN_BITS = 4 };
+    enum { NUM_LOOPS = ANY_JIT_THRESHOLD * 2 };
+
+    aasm_t as;
+    aasm_init(&as, &myalloc, NULL);
+    REQUIRE(aasm_load(&as, NULL) == AERR_NONE);
+    add_module(&as, "mod_test");
+
+    // n = 0; k = x; do { ++n; --k } while (k >= 0); n
+    aasm_module_push(&as, "test_f");
+    aasm_prototype(&as)->num_local_vars = 2;
+    aasm_emit(&as, ai_lsi(0), 1);
+    aasm_emit(&as, ai_slv(0), 1);
+    aasm_emit(&as, ai_llv(-1), 1);
+    aasm_emit(&as, ai_slv(1), 1);
+    aasm_emit(&as, ai_inc(0, 1), 2);
+    aasm_emit(&as, ai_inc(1, -1), 2);
+    aasm_emit(&as, ai_llv(1), 3);
+    aasm_emit(&as, ai_jgt(0, -4), 3);
+    aasm_emit(&as, ai_llv(0), 4);
+    aasm_emit(&as, ai_ret(), 4);
+    aasm_pop(&as);
+    aasm_save(&as);
+
+    ascheduler_t s;
+    REQUIRE(AERR_NONE ==
+        ascheduler_init(&s, NUM_IDX_BITS, NUM_GEN_BITS, &myalloc, NULL));
+    ascheduler_on_panic(&s, &on_panic, NULL);
+
+    REQUIRE(AERR_NONE ==
+        aloader_add_chunk(&s.loader, as.chunk, as.chunk_size, NULL, NULL));
+    REQUIRE(AERR_NONE == aloader_link(&s.loader, TRUE));
+
+    aactor_t* a;
+    REQUIRE(AERR_NONE == ascheduler_new_actor(&s, CSTACK_SZ, &a));
+    any_import(a, "mod_test", "test_f");
+    aprototype_t* pt = a->stack.v[a->stack.sp - 1].v.avm_func;
+
+    // the branch helper decides, its result must survive reloading.
+    any_push_real(a, NUM_LOOPS + 0.5);
+    ascheduler_start(&s, a, 1);
+    ascheduler_run_once(&s);
+
+    REQUIRE(any_count(a) == 2);
+    CHECK(any_check_integer(a, any_check_index(a, 0)) == NUM_LOOPS + 1);
+    CHECK(pt->jit != NULL);
+
+    ascheduler_cleanup(&s);
+    aasm_cleanup(&as);
+#endif
+}
@@ -47,6 +47,33 @@ TEST_CASE("math_op_add")
         REQUIRE(any_check_integer(a, any_check_index(a, 0)) == 9119 + 1991);
     }
 
+    SECTION("integer_fused")
+    {
+        aasm_module_push(&as, "test_f");
+        aasm_emit(&as, ai_lsi(1991), 1);
+        aasm_emit(&as, ai_lsi(9119), 2);
+        aasm_emit(&as, ai_add(), 3);
+        aasm_emit(&as, ai_ret(), 4);
+        aasm_save_fused(&as);
+        REQUIRE(aasm_prototype(&as)->num_instructions == 3);
+        CHECK(aasm_resolve(&as).instructions[1].b.opcode == AOC_ADDI);
+
+        REQUIRE(AERR_NONE ==
+            aloader_add_chunk(&s.loader, as.chunk, as.chunk_size, NULL, NULL));
+        REQUIRE(AERR_NONE == aloader_link(&s.loader, TRUE));
+
+        aactor_t* a;
+        REQUIRE(AERR_NONE == ascheduler_new_actor(&s, CSTACK_SZ, &a));
+        any_import(a, "mod_test", "test_f");
+        ascheduler_start(&s, a, 0);
+
+        ascheduler_run_once(&s);
+
+        REQUIRE(any_count(a) == 2);
+        REQUIRE(any_type(a, any_check_index(a, 1)).type == AVT_NIL);
+        REQUIRE(any_check_integer(a, any_check_index(a, 0)) == 9119 + 1991);
+    }
+
     SECTION("real")
     {
         aasm_module_push(&as, "test_f");
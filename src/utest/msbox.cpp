@@ -4,6 +4,10 @@
 #include <any/actor.h>
 #include <any/scheduler.h>
 #include <any/std_string.h>
+#include <any/std_tuple.h>
+#include <any/std_array.h>
+#include <any/std_table.h>
+#include <any/std_buffer.h>
 
 static bool done;
 
@@ -130,6 +134,362 @@ static void remove_actor(aactor_t* a)
     any_push_string(a, "removed");
 }
 
+static void send_self(aactor_t* a, aint_t v)
+{
+    any_push_pid(a, ascheduler_pid(a->owner, a));
+    any_push_integer(a, v);
+    any_mbox_send(a);
+}
+
+static aint_t recv_integer(aactor_t* a)
+{
+    if (any_mbox_recv(a, ADONT_WAIT) != AERR_NONE) return -1;
+    return any_check_integer(a, any_check_index(a, 0));
+}
+
+static void mark_actor(aactor_t* a)
+{
+    for (aint_t i = 0; i < 5; ++i) {
+        send_self(a, i);
+    }
+
+    any_push_nil(a);
+
+    // remove in the middle, the freed cell is reused at the back.
+    REQUIRE(recv_integer(a) == 0);
+    REQUIRE(recv_integer(a) == 1);
+    REQUIRE(recv_integer(a) == 2);
+    any_mbox_remove(a);
+    REQUIRE(a->msbox.num_msgs == 4);
+    send_self(a, 5);
+    REQUIRE(recv_integer(a) == 0);
+    REQUIRE(recv_integer(a) == 1);
+    REQUIRE(recv_integer(a) == 3);
+    REQUIRE(recv_integer(a) == 4);
+    REQUIRE(recv_integer(a) == 5);
+    REQUIRE(recv_integer(a) == -1);
+
+    // messages queued before the marker are skipped, also after rewinding.
+    any_mbox_mark(a);
+    REQUIRE(recv_integer(a) == -1);
+    send_self(a, 6);
+    send_self(a, 7);
+    REQUIRE(recv_integer(a) == 6);
+    REQUIRE(recv_integer(a) == 7);
+    any_mbox_rewind(a);
+    REQUIRE(recv_integer(a) == 6);
+    REQUIRE(recv_integer(a) == 7);
+    any_mbox_remove(a);
+
+    // removing clears the marker.
+    REQUIRE(recv_integer(a) == 0);
+    any_mbox_remove(a);
+    REQUIRE(recv_integer(a) == 1);
+    REQUIRE(recv_integer(a) == 3);
+    REQUIRE(recv_integer(a) == 4);
+    REQUIRE(recv_integer(a) == 5);
+    any_mbox_remove(a);
+    REQUIRE(recv_integer(a) == 1);
+    REQUIRE(recv_integer(a) == 3);
+    REQUIRE(recv_integer(a) == 4);
+    REQUIRE(recv_integer(a) == 6);
+    REQUIRE(recv_integer(a) == -1);
+    REQUIRE(a->msbox.num_msgs == 4);
+
+    // an empty box grows the same way.
+    any_mbox_mark(a);
+    any_mbox_rewind(a);
+    REQUIRE(recv_integer(a) == -1);
+    for (aint_t i = 0; i < 64; ++i) {
+        send_self(a, 100 + i);
+    }
+    for (aint_t i = 0; i < 64; ++i) {
+        REQUIRE(recv_integer(a) == 100 + i);
+    }
+    REQUIRE(recv_integer(a) == -1);
+
+    any_pop(a, 1);
+    any_push_string(a, "marked");
+}
+
+static void std_set(
+    aactor_t* a, const char* module, aint_t self, aint_t key, aint_t val)
+{
+    any_import(a, module, "set/3");
+    any_push_index(a, val);
+    any_push_index(a, key);
+    any_push_index(a, self);
+    any_call(a, 3);
+    any_pop(a, 1);
+}
+
+static aint_t std_get(aactor_t* a, const char* module, aint_t self, aint_t key)
+{
+    any_import(a, module, "get/2");
+    any_push_index(a, key);
+    any_push_index(a, self);
+    any_call(a, 2);
+    return any_top(a);
+}
+
+static aint_t push_integer(aactor_t* a, aint_t v)
+{
+    any_push_integer(a, v);
+    return any_top(a);
+}
+
+static aint_t heap_idx(aactor_t* a, aint_t idx)
+{
+    return aactor_at(a, idx)->v.heap_idx;
+}
+
+// (t, t, s, [s, 7], <<"abc">>) where t = { k: s }, s = "shared".
+static aint_t push_structure(aactor_t* a)
+{
+    any_push_string(a, "shared");
+    aint_t s = any_top(a);
+    any_push_string(a, "k");
+    aint_t k = any_top(a);
+    any_push_table(a, 4);
+    aint_t t = any_top(a);
+    std_set(a, "std-table", t, k, s);
+
+    any_push_array(a, 2);
+    aint_t arr = any_top(a);
+    any_import(a, "std-array", "resize/2");
+    any_push_integer(a, 2);
+    any_push_index(a, arr);
+    any_call(a, 2);
+    std_set(a, "std-array", arr, push_integer(a, 0), s);
+    std_set(a, "std-array", arr, push_integer(a, 1), push_integer(a, 7));
+
+    any_push_buffer(a, 4);
+    aint_t b = any_top(a);
+    any_import(a, "std-buffer", "resize/2");
+    any_push_integer(a, 3);
+    any_push_index(a, b);
+    any_call(a, 2);
+    for (aint_t i = 0; i < 3; ++i) {
+        std_set(a, "std-buffer", b, push_integer(a, i),
+            push_integer(a, 'a' + i));
+    }
+
+    any_push_tuple(a, 5);
+    aint_t m = any_top(a);
+    std_set(a, "std-tuple", m, push_integer(a, 0), t);
+    std_set(a, "std-tuple", m, push_integer(a, 1), t);
+    std_set(a, "std-tuple", m, push_integer(a, 2), s);
+    std_set(a, "std-tuple", m, push_integer(a, 3), arr);
+    std_set(a, "std-tuple", m, push_integer(a, 4), b);
+    any_push_index(a, m);
+    return any_top(a);
+}
+
+static void check_structure(aactor_t* a, aint_t m)
+{
+    REQUIRE(any_type(a, m).type == AVT_TUPLE);
+    REQUIRE(any_tuple_size(a, m) == 5);
+    aint_t t0 = std_get(a, "std-tuple", m, push_integer(a, 0));
+    aint_t t1 = std_get(a, "std-tuple", m, push_integer(a, 1));
+    aint_t s = std_get(a, "std-tuple", m, push_integer(a, 2));
+    aint_t arr = std_get(a, "std-tuple", m, push_integer(a, 3));
+    aint_t b = std_get(a, "std-tuple", m, push_integer(a, 4));
+
+    // sharing is kept.
+    REQUIRE(any_type(a, t0).type == AVT_TABLE);
+    CHECK(heap_idx(a, t0) == heap_idx(a, t1));
+    CHECK_THAT(any_check_string(a, s), Catch::Equals("shared"));
+    any_push_string(a, "k");
+    aint_t v = std_get(a, "std-table", t0, any_top(a));
+    CHECK(heap_idx(a, v) == heap_idx(a, s));
+
+    REQUIRE(any_type(a, arr).type == AVT_ARRAY);
+    REQUIRE(any_array_size(a, arr) == 2);
+    v = std_get(a, "std-array", arr, push_integer(a, 0));
+    CHECK(heap_idx(a, v) == heap_idx(a, s));
+    v = std_get(a, "std-array", arr, push_integer(a, 1));
+    CHECK(any_check_integer(a, v) == 7);
+
+    REQUIRE(any_type(a, b).type == AVT_BUFFER);
+    REQUIRE(any_buffer_size(a, b) == 3);
+    for (aint_t i = 0; i < 3; ++i) {
+        v = std_get(a, "std-buffer", b, push_integer(a, i));
+        CHECK(any_check_integer(a, v) == 'a' + i);
+    }
+}
+
+static aint_t num_structures;
+
+static void structure_receiver_actor(aactor_t* a)
+{
+    any_push_nil(a);
+    aint_t idx = any_check_index(a, 0);
+    for (aint_t i = 0; i < 50; ++i) {
+        REQUIRE(AERR_NONE == any_mbox_recv(a, AINFINITE));
+        any_mbox_remove(a);
+        aint_t sp = a->stack.sp;
+        check_structure(a, idx);
+        a->stack.sp = sp;
+        ++num_structures;
+    }
+}
+
+static void structure_sender_actor(aactor_t* a)
+{
+    aint_t pid = any_check_index(a, -1);
+    aint_t m = push_structure(a);
+    for (aint_t i = 0; i < 50; ++i) {
+        any_push_index(a, pid);
+        any_push_index(a, m);
+        any_mbox_send(a);
+        any_yield(a);
+    }
+    // the original is not touched.
+    check_structure(a, m);
+}
+
+static void structure_self_actor(aactor_t* a)
+{
+    aint_t m = push_structure(a);
+    any_push_pid(a, ascheduler_pid(a->owner, a));
+    any_push_index(a, m);
+    any_mbox_send(a);
+    any_push_nil(a);
+    aint_t idx = any_top(a);
+    REQUIRE(AERR_NONE == any_mbox_recv(a, ADONT_WAIT));
+    CHECK(heap_idx(a, idx) != heap_idx(a, m));
+    check_structure(a, idx);
+    check_structure(a, m);
+    ++num_structures;
+}
+
+static void structure_spawned_actor(aactor_t* a)
+{
+    check_structure(a, any_check_index(a, -1));
+    ++num_structures;
+}
+
+static void structure_spawn_actor(aactor_t* a)
+{
+    aint_t m = push_structure(a);
+    apid_t pid;
+    any_push_native_func(a, &structure_spawned_actor);
+    any_push_index(a, m);
+    any_spawn(a, CSTACK_SZ, 1, &pid);
+    check_structure(a, m);
+}
+
+enum { NUM_BINARY_RECEIVERS = 3 };
+enum { BINARY_SZ = 1024 };
+
+static abinary_t* shared_bin;
+static aint_t num_binaries;
+
+static agc_buffer_t* buffer_of(aactor_t* a, aint_t idx)
+{
+    return AGC_CAST(agc_buffer_t, &a->gc, heap_idx(a, idx));
+}
+
+static void check_binary(const uint8_t* b, uint8_t first)
+{
+    REQUIRE(b[0] == first);
+    for (aint_t i = 1; i < BINARY_SZ; ++i) {
+        REQUIRE(b[i] == (uint8_t)i);
+    }
+}
+
+static void binary_receiver_actor(aactor_t* a)
+{
+    aint_t writes = any_check_integer(a, any_check_index(a, -1));
+    any_push_nil(a);
+    aint_t idx = any_top(a);
+    REQUIRE(AERR_NONE == any_mbox_recv(a, AINFINITE));
+    any_mbox_remove(a);
+    REQUIRE(any_type(a, idx).type == AVT_BUFFER);
+    CHECK(buffer_of(a, idx)->bin == shared_bin);
+    check_binary(any_check_buffer_view(a, idx), 0);
+    if (writes) {
+        any_check_buffer(a, idx)[0] = 0xFF;
+        CHECK(buffer_of(a, idx)->bin != shared_bin);
+        CHECK(buffer_of(a, idx)->bin->refs == 1);
+        check_binary(any_check_buffer_view(a, idx), 0xFF);
+    }
+    ++num_binaries;
+}
+
+static void binary_sender_actor(aactor_t* a)
+{
+    any_push_buffer(a, BINARY_SZ);
+    aint_t m = any_top(a);
+    any_buffer_resize(a, m, BINARY_SZ);
+    uint8_t* b = any_check_buffer(a, m);
+    for (aint_t i = 0; i < BINARY_SZ; ++i) {
+        b[i] = (uint8_t)i;
+    }
+    shared_bin = buffer_of(a, m)->bin;
+    REQUIRE(shared_bin != NULL);
+    for (aint_t i = 0; i < NUM_BINARY_RECEIVERS; ++i) {
+        any_push_index(a, any_check_index(a, -1 - i));
+        any_push_index(a, m);
+        any_mbox_send(a);
+    }
+    // receivers share bytes instead of copying.
+    CHECK(shared_bin->refs == 1 + NUM_BINARY_RECEIVERS);
+    while (num_binaries != NUM_BINARY_RECEIVERS) any_yield(a);
+    for (aint_t i = 0; i < 8 && shared_bin->refs != 1; ++i) any_yield(a);
+    CHECK(shared_bin->refs == 1);
+    CHECK(buffer_of(a, m)->bin == shared_bin);
+    check_binary(any_check_buffer_view(a, m), 0);
+}
+
+enum { NUM_FRAGMENTS = 20 };
+
+static aactor_t* fragment_receiver;
+static bool collects;
+
+static void fragment_receiver_actor(aactor_t* a)
+{
+    any_push_nil(a);
+    aint_t idx = any_top(a);
+    for (aint_t i = 0; i < NUM_FRAGMENTS; ++i) {
+        REQUIRE(AERR_NONE == any_mbox_recv(a, AINFINITE));
+        if (i == 0) {
+            CHECK(a->msbox.frags_sz > 0);
+            if (collects) {
+                // the others are merged by collecting.
+                REQUIRE(AERR_NONE ==
+                    aactor_heap_reserve(a, a->gc.heap_cap, 1));
+                CHECK(a->msbox.frags_sz == 0);
+            }
+        }
+        char buf[32];
+        snprintf(buf, sizeof(buf), "fragment %d", (int)i);
+        REQUIRE(strcmp(any_check_string(a, idx), buf) == 0);
+        any_mbox_remove(a);
+    }
+    CHECK(a->msbox.frags_sz == 0);
+    done = true;
+}
+
+static void fragment_sender_actor(aactor_t* a)
+{
+    aactor_t* ta = fragment_receiver;
+    aint_t heap_cap = ta->gc.heap_cap;
+    aint_t heap_sz = ta->gc.heap_sz;
+    for (aint_t i = 0; i < NUM_FRAGMENTS; ++i) {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "fragment %d", (int)i);
+        any_push_index(a, any_check_index(a, -1));
+        any_push_string(a, buf);
+        any_mbox_send(a);
+    }
+    // nothing is allocated on the heap of the receiver.
+    CHECK(ta->gc.heap_cap == heap_cap);
+    CHECK(ta->gc.heap_sz == heap_sz);
+    CHECK(ta->msbox.num_msgs == NUM_FRAGMENTS);
+    any_push_nil(a);
+}
+
 static void bad_remove_actor(aactor_t* a)
 {
     any_push_nil(a);
@@ -358,3 +718,167 @@ TEST_CASE("msbox_string")
 
     ascheduler_cleanup(&s);
 }
+
+TEST_CASE("msbox_mark")
+{
+    enum { NUM_IDX_BITS = 4 };
+    enum { NUM_GEN_BITS = 4 };
+
+    ascheduler_t s;
+
+    REQUIRE(AERR_NONE ==
+        ascheduler_init(&s, NUM_IDX_BITS, NUM_GEN_BITS, &myalloc, NULL));
+    ascheduler_on_panic(&s, &on_panic, NULL);
+
+    aactor_t* a;
+    REQUIRE(AERR_NONE == ascheduler_new_actor(&s, CSTACK_SZ, &a));
+    any_push_native_func(a, &mark_actor);
+    ascheduler_start(&s, a, 0);
+
+    ascheduler_run_once(&s);
+
+    REQUIRE(any_count(a) == 2);
+    REQUIRE(any_type(a, any_check_index(a, 1)).type == AVT_NIL);
+    CHECK_THAT(any_check_string(a, any_check_index(a, 0)),
+        Catch::Equals("marked"));
+
+    ascheduler_cleanup(&s);
+}
+
+TEST_CASE("msbox_structure")
+{
+    enum { NUM_IDX_BITS = 4 };
+    enum { NUM_GEN_BITS = 4 };
+
+    ascheduler_t s;
+
+    REQUIRE(AERR_NONE ==
+        ascheduler_init(&s, NUM_IDX_BITS, NUM_GEN_BITS, &myalloc, NULL));
+    ascheduler_on_panic(&s, &on_panic, NULL);
+
+    astd_lib_add_tuple(&s.loader);
+    astd_lib_add_array(&s.loader);
+    astd_lib_add_table(&s.loader);
+    astd_lib_add_buffer(&s.loader);
+
+    num_structures = 0;
+
+    SECTION("send")
+    {
+        aactor_t* ra;
+        REQUIRE(AERR_NONE == ascheduler_new_actor(&s, CSTACK_SZ, &ra));
+        any_push_native_func(ra, &structure_receiver_actor);
+        ascheduler_start(&s, ra, 0);
+
+        aactor_t* sa;
+        REQUIRE(AERR_NONE == ascheduler_new_actor(&s, CSTACK_SZ, &sa));
+        any_push_native_func(sa, &structure_sender_actor);
+        any_push_pid(sa, ascheduler_pid(&s, ra));
+        ascheduler_start(&s, sa, 1);
+
+        ascheduler_run_until_idle(&s);
+        CHECK(num_structures == 50);
+    }
+
+    SECTION("self")
+    {
+        aactor_t* a;
+        REQUIRE(AERR_NONE == ascheduler_new_actor(&s, CSTACK_SZ, &a));
+        any_push_native_func(a, &structure_self_actor);
+        ascheduler_start(&s, a, 0);
+
+        ascheduler_run_until_idle(&s);
+        CHECK(num_structures == 1);
+    }
+
+    SECTION("spawn")
+    {
+        aactor_t* a;
+        REQUIRE(AERR_NONE == ascheduler_new_actor(&s, CSTACK_SZ, &a));
+        any_push_native_func(a, &structure_spawn_actor);
+        ascheduler_start(&s, a, 0);
+
+        ascheduler_run_until_idle(&s);
+        CHECK(num_structures == 1);
+    }
+
+    CHECK(ascheduler_num_processes(&s) == 0);
+
+    ascheduler_cleanup(&s);
+}
+
+TEST_CASE("msbox_binary")
+{
+    enum { NUM_IDX_BITS = 4 };
+    enum { NUM_GEN_BITS = 4 };
+
+    ascheduler_t s;
+
+    REQUIRE(AERR_NONE ==
+        ascheduler_init(&s, NUM_IDX_BITS, NUM_GEN_BITS, &myalloc, NULL));
+    ascheduler_on_panic(&s, &on_panic, NULL);
+
+    num_binaries = 0;
+
+    aactor_t* sa;
+    REQUIRE(AERR_NONE == ascheduler_new_actor(&s, CSTACK_SZ, &sa));
+    any_push_native_func(sa, &binary_sender_actor);
+
+    for (aint_t i = 0; i < NUM_BINARY_RECEIVERS; ++i) {
+        aactor_t* ra;
+        REQUIRE(AERR_NONE == ascheduler_new_actor(&s, CSTACK_SZ, &ra));
+        any_push_native_func(ra, &binary_receiver_actor);
+        any_push_integer(ra, i == 0);
+        ascheduler_start(&s, ra, 1);
+        any_push_pid(sa, ascheduler_pid(&s, ra));
+    }
+
+    ascheduler_start(&s, sa, NUM_BINARY_RECEIVERS);
+
+    ascheduler_run_until_idle(&s);
+    CHECK(num_binaries == NUM_BINARY_RECEIVERS);
+
+    CHECK(ascheduler_num_processes(&s) == 0);
+
+    ascheduler_cleanup(&s);
+}
+
+TEST_CASE("msbox_fragment")
+{
+    enum { NUM_IDX_BITS = 4 };
+    enum { NUM_GEN_BITS = 4 };
+
+    ascheduler_t s;
+
+    REQUIRE(AERR_NONE ==
+        ascheduler_init(&s, NUM_IDX_BITS, NUM_GEN_BITS, &myalloc, NULL));
+    ascheduler_on_panic(&s, &on_panic, NULL);
+
+    done = false;
+    collects = false;
+
+    SECTION("recv") { }
+    SECTION("collect") { collects = true; }
+
+    aactor_opts_t opts;
+    memset(&opts, 0, sizeof(opts));
+    opts.heap_sz = 64;
+
+    REQUIRE(AERR_NONE ==
+        ascheduler_new_actor_opts(&s, CSTACK_SZ, &opts, &fragment_receiver));
+    any_push_native_func(fragment_receiver, &fragment_receiver_actor);
+    ascheduler_start(&s, fragment_receiver, 0);
+
+    aactor_t* a;
+    REQUIRE(AERR_NONE == ascheduler_new_actor(&s, CSTACK_SZ, &a));
+    any_push_native_func(a, &fragment_sender_actor);
+    any_push_pid(a, ascheduler_pid(&s, fragment_receiver));
+    ascheduler_start(&s, a, 1);
+
+    ascheduler_run_until_idle(&s);
+    CHECK(done);
+
+    CHECK(ascheduler_num_processes(&s) == 0);
+
+    ascheduler_cleanup(&s);
+}
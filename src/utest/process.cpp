@@ -44,3 +44,82 @@ TEST_CASE("process_allocation")
 
     ascheduler_cleanup(&s);
 }
+
+TEST_CASE("process_table_grow")
+{
+    enum { NUM_IDX_BITS = 12 };
+    enum { NUM_GEN_BITS = 4 };
+    enum { NUM_PROCS = 1 << NUM_IDX_BITS };
+    enum { CHUNK_SZ = 1 << APROCESS_CHUNK_BITS };
+
+    aprocess_table_t t;
+    REQUIRE(AERR_NONE ==
+        aprocess_table_init(&t, NUM_IDX_BITS, NUM_GEN_BITS, &myalloc, NULL));
+    CHECK(t.num_chunks == 0);
+    CHECK(aprocess_table_slot(&t, 0) == NULL);
+
+    // grows by chunks, slots never move.
+    static aprocess_t* procs[NUM_PROCS];
+    static apid_t pids[NUM_PROCS];
+    for (aint_t i = 0; i < NUM_PROCS; ++i) {
+        procs[i] = aprocess_table_alloc(&t);
+        REQUIRE(procs[i]);
+        pids[i] = procs[i]->pid;
+        CHECK(t.num_chunks == i / CHUNK_SZ + 1);
+    }
+    REQUIRE(aprocess_table_alloc(&t) == NULL);
+    CHECK(aprocess_table_size(&t) == NUM_PROCS);
+    for (aint_t i = 0; i < NUM_PROCS; ++i) {
+        REQUIRE(aprocess_table_slot(&t, pids[i]) == procs[i]);
+    }
+
+    // the least recently freed slot is reused first, with a new generation.
+    aprocess_table_free(&t, procs[7]);
+    aprocess_table_free(&t, procs[3]);
+    CHECK(aprocess_table_size(&t) == NUM_PROCS - 2);
+    aprocess_t* p = aprocess_table_alloc(&t);
+    CHECK(p == procs[7]);
+    CHECK(p->pid != pids[7]);
+    CHECK(apid_idx(NUM_IDX_BITS, p->pid) == apid_idx(NUM_IDX_BITS, pids[7]));
+    CHECK(aprocess_table_alloc(&t) == procs[3]);
+
+    for (aint_t i = 0; i < NUM_PROCS; ++i) {
+        aprocess_table_free(&t, procs[i]);
+    }
+    CHECK(aprocess_table_size(&t) == 0);
+    aprocess_table_cleanup(&t);
+}
+
+TEST_CASE("process_stale_pid")
+{
+    enum { NUM_IDX_BITS = 10 };
+    enum { NUM_GEN_BITS = 4 };
+
+    ascheduler_t s;
+    REQUIRE(AERR_NONE ==
+        ascheduler_init(&s, NUM_IDX_BITS, NUM_GEN_BITS, &myalloc, NULL));
+    ascheduler_on_panic(&s, &on_panic, NULL);
+
+    aprocess_t* p = ascheduler_alloc(&s);
+    REQUIRE(p);
+    apid_t stale = p->pid;
+    ascheduler_free(&s, p);
+    CHECK(ascheduler_actor(&s, stale) == NULL);
+
+    // every other free slot is taken before that one, then it is reused
+    // before the table grows.
+    for (aint_t i = 0; i < (1 << APROCESS_CHUNK_BITS) - 1; ++i) {
+        aprocess_t* q = ascheduler_alloc(&s);
+        REQUIRE(q);
+        CHECK(q != p);
+        CHECK(ascheduler_actor(&s, stale) == NULL);
+    }
+    aprocess_t* q = ascheduler_alloc(&s);
+    CHECK(q == p);
+    CHECK(q->pid != stale);
+    CHECK(ascheduler_actor(&s, stale) == NULL);
+    CHECK(ascheduler_num_processes(&s) == 1 << APROCESS_CHUNK_BITS);
+    CHECK(s.procs->num_chunks == 1);
+
+    ascheduler_cleanup(&s);
+}
@@ -0,0 +1,143 @@
+/* Copyright (c) 2017 Nguyen Viet Giang. All rights reserved. */
+#include "prereq.h"
+
+#include <any/asm.h>
+#include <any/scheduler.h>
+#include <any/loader.h>
+#include <any/actor.h>
+#include <any/profile.h>
+
+#ifdef ANY_PROFILE
+static void find_proto(const char* module, aprototype_t* pt, void* ud)
+{
+    aprototype_t** found = (aprototype_t**)ud;
+    const char* name = pt->strings + pt->header->symbol;
+    if (strcmp(module, "mod_test") != 0) return;
+    if (strcmp(name, "test_f") == 0) found[0] = pt;
+    if (strcmp(name, "test_g") == 0) found[1] = pt;
+}
+#endif
+
+TEST_CASE("profile_counters")
+{
+#ifdef ANY_PROFILE
+    enum { NUM_IDX_BITS = 4 };
+    enum { NUM_GEN_BITS = 4 };
+
+    aasm_t as;
+    aasm_init(&as, &myalloc, NULL);
+    REQUIRE(aasm_load(&as, NULL) == AERR_NONE);
+    add_module(&as, "mod_test");
+
+    aasm_module_push(&as, "test_f");
+    aint_t g = aasm_add_import(&as, "mod_test", "test_g");
+    aasm_emit(&as, ai_imp(g), 1);
+    aasm_emit(&as, ai_ivk(0), 1);
+    aasm_emit(&as, ai_pop(1), 1);
+    aasm_emit(&as, ai_imp(g), 2);
+    aasm_emit(&as, ai_ivk(0), 2);
+    aasm_emit(&as, ai_ret(), 2);
+    aasm_pop(&as);
+
+    aasm_module_push(&as, "test_g");
+    aasm_emit(&as, ai_lsi(1), 1);
+    aasm_emit(&as, ai_ret(), 1);
+    aasm_pop(&as);
+    aasm_save(&as);
+
+    ascheduler_t s;
+    REQUIRE(AERR_NONE ==
+        ascheduler_init(&s, NUM_IDX_BITS, NUM_GEN_BITS, &myalloc, NULL));
+    ascheduler_on_panic(&s, &on_panic, NULL);
+
+    REQUIRE(AERR_NONE ==
+        aloader_add_chunk(&s.loader, as.chunk, as.chunk_size, NULL, NULL));
+    REQUIRE(AERR_NONE == aloader_link(&s.loader, TRUE));
+
+    aactor_t* a;
+    REQUIRE(AERR_NONE == ascheduler_new_actor(&s, CSTACK_SZ, &a));
+    any_import(a, "mod_test", "test_f");
+    ascheduler_start(&s, a, 0);
+    ascheduler_run_once(&s);
+
+    aprototype_t* found[2] = { NULL, NULL };
+    aprofile_visit(&s, &find_proto, found);
+    REQUIRE(found[0] != NULL);
+    REQUIRE(found[1] != NULL);
+
+    CHECK(found[0]->profile.calls == 1);
+    CHECK(found[0]->profile.instructions == 6);
+    CHECK(found[1]->profile.calls == 2);
+    CHECK(found[1]->profile.instructions == 4);
+    CHECK(found[0]->profile.usecs >= found[1]->profile.usecs);
+    CHECK(s.opcodes[AOC_IVK] == 2);
+    CHECK(s.opcodes[AOC_RET] == 3);
+    CHECK_THAT(aprofile_opcode_name(AOC_IVK), Catch::Equals("ivk"));
+    CHECK(aprofile_opcode_name(255) == NULL);
+
+    aprofile_reset(&s);
+    CHECK(found[0]->profile.calls == 0);
+    CHECK(found[1]->profile.instructions == 0);
+    CHECK(s.opcodes[AOC_IVK] == 0);
+
+    ascheduler_cleanup(&s);
+    aasm_cleanup(&as);
+#endif
+}
+
+TEST_CASE("profile_counters_fused")
+{
+#ifdef ANY_PROFILE
+    enum { NUM_IDX_BITS = 4 };
+    enum { NUM_GEN_BITS = 4 };
+
+    aasm_t as;
+    aasm_init(&as, &myalloc, NULL);
+    REQUIRE(aasm_load(&as, NULL) == AERR_NONE);
+    add_module(&as, "mod_test");
+
+    aasm_module_push(&as, "test_f");
+    aint_t g = aasm_add_import(&as, "mod_test", "test_g");
+    aasm_emit(&as, ai_imp(g), 1);
+    aasm_emit(&as, ai_ivk(0), 1);
+    aasm_emit(&as, ai_ret(), 1);
+    aasm_pop(&as);
+
+    aasm_module_push(&as, "test_g");
+    aasm_emit(&as, ai_lsi(1), 1);
+    aasm_emit(&as, ai_ret(), 1);
+    aasm_pop(&as);
+    aasm_save_fused(&as);
+
+    ascheduler_t s;
+    REQUIRE(AERR_NONE ==
+        ascheduler_init(&s, NUM_IDX_BITS, NUM_GEN_BITS, &myalloc, NULL));
+    ascheduler_on_panic(&s, &on_panic, NULL);
+
+    REQUIRE(AERR_NONE ==
+        aloader_add_chunk(&s.loader, as.chunk, as.chunk_size, NULL, NULL));
+    REQUIRE(AERR_NONE == aloader_link(&s.loader, TRUE));
+
+    aactor_t* a;
+    REQUIRE(AERR_NONE == ascheduler_new_actor(&s, CSTACK_SZ, &a));
+    any_import(a, "mod_test", "test_f");
+    ascheduler_start(&s, a, 0);
+    ascheduler_run_once(&s);
+
+    aprototype_t* found[2] = { NULL, NULL };
+    aprofile_visit(&s, &find_proto, found);
+    REQUIRE(found[0] != NULL);
+    REQUIRE(found[1] != NULL);
+
+    // `ivk; ret` is saved as a tail call.
+    CHECK(found[0]->profile.calls == 1);
+    CHECK(found[0]->profile.instructions == 2);
+    CHECK(found[1]->profile.calls == 1);
+    CHECK(s.opcodes[AOC_IVK] == 0);
+    CHECK(s.opcodes[AOC_TVK] == 1);
+    CHECK(s.opcodes[AOC_RET] == 1);
+
+    ascheduler_cleanup(&s);
+    aasm_cleanup(&as);
+#endif
+}
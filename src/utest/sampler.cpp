@@ -0,0 +1,234 @@
+/* Copyright (c) 2017 Nguyen Viet Giang. All rights reserved. */
+#include "prereq.h"
+
+#include <any/asm.h>
+#include <any/scheduler.h>
+#include <any/loader.h>
+#include <any/actor.h>
+#include <any/sampler.h>
+
+#include <string>
+
+#ifdef ANY_SMP
+#include <thread>
+#endif
+
+static int32_t sample_step(aactor_t*, void* ud)
+{
+    asampler_sample((asampler_t*)ud);
+    return TRUE;
+}
+
+static void append_folded(const char* s, aint_t sz, void* ud)
+{
+    ((std::string*)ud)->append(s, (size_t)sz);
+}
+
+TEST_CASE("sampler_folded")
+{
+    enum { NUM_IDX_BITS = 4 };
+    enum { NUM_GEN_BITS = 4 };
+
+    aasm_t as;
+    aasm_init(&as, &myalloc, NULL);
+    REQUIRE(aasm_load(&as, NULL) == AERR_NONE);
+    add_module(&as, "mod_test");
+
+    aasm_module_push(&as, "test_f");
+    aint_t g = aasm_add_import(&as, "mod_test", "test_g");
+    aasm_emit(&as, ai_imp(g), 1);
+    aasm_emit(&as, ai_ivk(0), 2);
+    aasm_emit(&as, ai_ret(), 3);
+    aasm_pop(&as);
+
+    aasm_module_push(&as, "test_g");
+    aasm_emit(&as, ai_lsi(1), 10);
+    aasm_emit(&as, ai_ret(), 11);
+    aasm_pop(&as);
+    aasm_save(&as);
+
+    ascheduler_t s;
+    REQUIRE(AERR_NONE ==
+        ascheduler_init(&s, NUM_IDX_BITS, NUM_GEN_BITS, &myalloc, NULL));
+    ascheduler_on_panic(&s, &on_panic, NULL);
+
+    asampler_t sampler;
+    REQUIRE(AERR_NONE == asampler_init(&sampler, &myalloc, NULL, &s, 16));
+
+    REQUIRE(AERR_NONE ==
+        aloader_add_chunk(&s.loader, as.chunk, as.chunk_size, NULL, NULL));
+    REQUIRE(AERR_NONE == aloader_link(&s.loader, TRUE));
+
+    // sample before every instruction.
+    ascheduler_on_step(&s, &sample_step, &sampler);
+
+    aactor_t* a;
+    REQUIRE(AERR_NONE == ascheduler_new_actor(&s, CSTACK_SZ, &a));
+    any_import(a, "mod_test", "test_f");
+    ascheduler_start(&s, a, 0);
+    ascheduler_run_once(&s);
+    ascheduler_on_step(&s, NULL, NULL);
+
+    // outside of actors.
+    asampler_sample(&sampler);
+    asampler_sample(&sampler);
+
+    REQUIRE(AERR_NONE == asampler_collect(&sampler));
+    CHECK(sampler.num_samples == 7);
+    CHECK(sampler.num_stacks == 6);
+
+    std::string folded;
+    asampler_write(&sampler, &append_folded, &folded);
+    CHECK(folded.find("mod_test:test_f:1 1\n") != std::string::npos);
+    CHECK(folded.find("mod_test:test_f:2 1\n") != std::string::npos);
+    CHECK(folded.find(
+        "mod_test:test_f:2;mod_test:test_g:10 1\n") != std::string::npos);
+    CHECK(folded.find(
+        "mod_test:test_f:2;mod_test:test_g:11 1\n") != std::string::npos);
+    CHECK(folded.find("mod_test:test_f:3 1\n") != std::string::npos);
+    CHECK(folded.find("[scheduler] 2\n") != std::string::npos);
+
+    SECTION("dropped")
+    {
+        for (aint_t i = 0; i < 20; ++i) asampler_sample(&sampler);
+        CHECK(sampler.num_dropped == 4);
+        REQUIRE(AERR_NONE == asampler_collect(&sampler));
+        CHECK(sampler.num_samples == 7 + 16);
+    }
+
+    SECTION("clear")
+    {
+        asampler_clear(&sampler);
+        CHECK(sampler.num_stacks == 0);
+        folded.clear();
+        asampler_write(&sampler, &append_folded, &folded);
+        CHECK(folded.empty());
+    }
+
+    asampler_cleanup(&sampler);
+    ascheduler_cleanup(&s);
+    aasm_cleanup(&as);
+}
+
+TEST_CASE("sampler_folded_fused")
+{
+    enum { NUM_IDX_BITS = 4 };
+    enum { NUM_GEN_BITS = 4 };
+
+    aasm_t as;
+    aasm_init(&as, &myalloc, NULL);
+    REQUIRE(aasm_load(&as, NULL) == AERR_NONE);
+    add_module(&as, "mod_test");
+
+    aasm_module_push(&as, "test_f");
+    aint_t g = aasm_add_import(&as, "mod_test", "test_g");
+    aasm_emit(&as, ai_imp(g), 1);
+    aasm_emit(&as, ai_ivk(0), 2);
+    aasm_emit(&as, ai_ret(), 3);
+    aasm_pop(&as);
+
+    aasm_module_push(&as, "test_g");
+    aasm_emit(&as, ai_lsi(1), 10);
+    aasm_emit(&as, ai_ret(), 11);
+    aasm_pop(&as);
+    aasm_save_fused(&as);
+
+    ascheduler_t s;
+    REQUIRE(AERR_NONE ==
+        ascheduler_init(&s, NUM_IDX_BITS, NUM_GEN_BITS, &myalloc, NULL));
+    ascheduler_on_panic(&s, &on_panic, NULL);
+
+    asampler_t sampler;
+    REQUIRE(AERR_NONE == asampler_init(&sampler, &myalloc, NULL, &s, 16));
+
+    REQUIRE(AERR_NONE ==
+        aloader_add_chunk(&s.loader, as.chunk, as.chunk_size, NULL, NULL));
+    REQUIRE(AERR_NONE == aloader_link(&s.loader, TRUE));
+
+    ascheduler_on_step(&s, &sample_step, &sampler);
+
+    aactor_t* a;
+    REQUIRE(AERR_NONE == ascheduler_new_actor(&s, CSTACK_SZ, &a));
+    any_import(a, "mod_test", "test_f");
+    ascheduler_start(&s, a, 0);
+    ascheduler_run_once(&s);
+    ascheduler_on_step(&s, NULL, NULL);
+
+    REQUIRE(AERR_NONE == asampler_collect(&sampler));
+    CHECK(sampler.num_samples == 4);
+
+    // the tail call reuses the frame of test_f.
+    std::string folded;
+    asampler_write(&sampler, &append_folded, &folded);
+    CHECK(folded.find("mod_test:test_f:1 1\n") != std::string::npos);
+    CHECK(folded.find("mod_test:test_f:2 1\n") != std::string::npos);
+    CHECK(folded.find("mod_test:test_g:10 1\n") != std::string::npos);
+    CHECK(folded.find("mod_test:test_g:11 1\n") != std::string::npos);
+    CHECK(folded.find("test_f:2;") == std::string::npos);
+
+    asampler_cleanup(&sampler);
+    ascheduler_cleanup(&s);
+    aasm_cleanup(&as);
+}
+
+#if defined(ALINUX) || defined(AAPPLE)
+TEST_CASE("sampler_timer")
+{
+    enum { NUM_IDX_BITS = 4 };
+    enum { NUM_GEN_BITS = 4 };
+
+    ascheduler_t s;
+    REQUIRE(AERR_NONE ==
+        ascheduler_init(&s, NUM_IDX_BITS, NUM_GEN_BITS, &myalloc, NULL));
+
+    asampler_t sampler;
+    REQUIRE(AERR_NONE == asampler_init(&sampler, &myalloc, NULL, &s, 64));
+    asampler_t other;
+    REQUIRE(AERR_NONE == asampler_init(&other, &myalloc, NULL, &s, 64));
+
+    REQUIRE(AERR_NONE == asampler_start(&sampler, 1000));
+    CHECK(AERR_NONE != asampler_start(&other, 1000));
+
+    // burn some CPU time, for at most 2 seconds.
+    aint_t start = atimer_usecs();
+    volatile aint_t spin = 0;
+    while (sampler.head == 0 && atimer_usecs() - start < 2000000) ++spin;
+    asampler_stop(&sampler);
+
+    REQUIRE(AERR_NONE == asampler_collect(&sampler));
+    CHECK(sampler.num_samples > 0);
+
+    asampler_cleanup(&other);
+    asampler_cleanup(&sampler);
+    ascheduler_cleanup(&s);
+}
+
+TEST_CASE("sampler_timer_thread")
+{
+#ifdef ANY_SMP
+    enum { NUM_IDX_BITS = 4 };
+    enum { NUM_GEN_BITS = 4 };
+
+    ascheduler_t s;
+    REQUIRE(AERR_NONE ==
+        ascheduler_init(&s, NUM_IDX_BITS, NUM_GEN_BITS, &myalloc, NULL));
+
+    asampler_t sampler;
+    REQUIRE(AERR_NONE == asampler_init(&sampler, &myalloc, NULL, &s, 64));
+    REQUIRE(AERR_NONE == asampler_start(&sampler, 1000));
+
+    // CPU time burnt by another thread is never sampled.
+    std::thread t([]() {
+        aint_t start = atimer_usecs();
+        volatile aint_t spin = 0;
+        while (atimer_usecs() - start < 200000) ++spin;
+    });
+    t.join();
+    CHECK(sampler.head == 0);
+    asampler_stop(&sampler);
+
+    asampler_cleanup(&sampler);
+    ascheduler_cleanup(&s);
+#endif
+}
+#endif
@@ -5,6 +5,14 @@
 #include <any/scheduler.h>
 #include <any/loader.h>
 #include <any/actor.h>
+#include <any/std.h>
+#include <any/std_string.h>
+
+#include <string.h>
+
+#if defined(ALINUX) || defined(AAPPLE)
+#include <poll.h>
+#endif
 
 static void spawn_new(ascheduler_t* s)
 {
@@ -44,6 +52,11 @@ static void get_pid(aactor_t* a, void* ud)
     *(apid_t*)ud = ascheduler_pid(a->owner, a);
 }
 
+static void push_hello(aactor_t* a)
+{
+    any_push_string(a, "hello");
+}
+
 struct step_ud_t
 {
     bool brk;
@@ -75,7 +88,7 @@ TEST_CASE("scheduler_new_process")
 
     ascheduler_run_once(&s);
     ascheduler_run_once(&s); // cleanup is deferred
-    REQUIRE(alist_head(&s.runnings) == &s.root.node);
+    REQUIRE(s.num_runnables == 0);
 
     for (aint_t i = 0; i < 10; ++i) {
         spawn_new(&s);
@@ -173,6 +186,58 @@ TEST_CASE("scheduler_on_spawn_exit")
     ascheduler_cleanup(&s);
 }
 
+TEST_CASE("scheduler_exit_queue")
+{
+    enum { NUM_IDX_BITS = 4 };
+    enum { NUM_GEN_BITS = 4 };
+
+    ascheduler_t s;
+
+    REQUIRE(AERR_NONE ==
+        ascheduler_init(&s, NUM_IDX_BITS, NUM_GEN_BITS, &myalloc, NULL));
+    ascheduler_on_panic(&s, &on_panic, NULL);
+
+    aactor_t* a;
+    REQUIRE(AERR_NONE == ascheduler_new_actor(&s, CSTACK_SZ, &a));
+    any_push_native_func(a, &push_hello);
+    ascheduler_start(&s, a, 0);
+
+    ascheduler_run_once(&s);
+
+    REQUIRE((a->flags & APF_EXIT) != 0);
+    REQUIRE(ascheduler_num_processes(&s) == 1);
+    REQUIRE(alist_head(&s.exits) == &ACAST_FROM_FIELD(
+        aprocess_t, a, actor)->ptask.node);
+    REQUIRE(s.num_runnables == 0);
+    avalue_t* stack = a->stack.v;
+    aframe_t* frames = a->frames;
+    REQUIRE(a->gc.heap_cap > 0);
+
+    ascheduler_run_once(&s);
+
+    REQUIRE(ascheduler_num_processes(&s) == 0);
+    REQUIRE(alist_is_end(&s.exits, alist_head(&s.exits)));
+    CHECK(s.pool.num_stacks == 1);
+    CHECK(s.pool.num_frames == 1);
+    CHECK(s.pool.num_heaps == 1);
+
+    // buffers of the reaped actor are reused.
+    REQUIRE(AERR_NONE == ascheduler_new_actor(&s, CSTACK_SZ, &a));
+    any_push_native_func(a, &push_hello);
+    CHECK(a->stack.v == stack);
+    CHECK(a->frames == frames);
+    ascheduler_start(&s, a, 0);
+
+    ascheduler_run_once(&s);
+
+    CHECK(s.pool.num_stacks == 0);
+    CHECK(s.pool.num_frames == 0);
+    CHECK(s.pool.num_heaps == 0);
+    CHECK(strcmp(any_to_string(a, any_check_index(a, 0)), "hello") == 0);
+
+    ascheduler_cleanup(&s);
+}
+
 TEST_CASE("scheduler_on_step")
 {
     enum { NUM_IDX_BITS = 4 };
@@ -225,4 +290,930 @@ TEST_CASE("scheduler_on_step")
 
     ascheduler_cleanup(&s);
     aasm_cleanup(&as);
-}
\ No newline at end of file
+}
+
+static aint_t attach_calls;
+static aint_t attach_steps;
+
+static int32_t count_step(aactor_t*, void*)
+{
+    ++attach_steps;
+    return TRUE;
+}
+
+// Attach the debugger on the second call, in the middle of the loop.
+static void attach_on_second(aactor_t* a)
+{
+    if (++attach_calls == 2) ascheduler_on_step(a->owner, &count_step, NULL);
+    any_push_nil(a);
+}
+
+TEST_CASE("scheduler_on_step_attach")
+{
+    enum { NUM_IDX_BITS = 4 };
+    enum { NUM_GEN_BITS = 4 };
+
+    aasm_t as;
+    aasm_init(&as, &myalloc, NULL);
+    REQUIRE(aasm_load(&as, NULL) == AERR_NONE);
+    add_module(&as, "mod_test");
+
+    // i = 0; do { f(); ++i } while (i < 3); i
+    aasm_module_push(&as, "test_f");
+    aasm_prototype(&as)->num_local_vars = 1;
+    aasm_emit(&as, ai_lsi(0), 1);
+    aasm_emit(&as, ai_slv(0), 1);
+    aasm_emit(&as, ai_llv(-1), 2);
+    aasm_emit(&as, ai_ivk(0), 2);
+    aasm_emit(&as, ai_pop(1), 2);
+    aasm_emit(&as, ai_inc(0, 1), 3);
+    aasm_emit(&as, ai_llv(0), 4);
+    aasm_emit(&as, ai_jle(3, -6), 4);
+    aasm_emit(&as, ai_llv(0), 5);
+    aasm_emit(&as, ai_ret(), 5);
+    aasm_pop(&as);
+    aasm_save(&as);
+
+    ascheduler_t s;
+
+    REQUIRE(AERR_NONE ==
+        ascheduler_init(&s, NUM_IDX_BITS, NUM_GEN_BITS, &myalloc, NULL));
+    ascheduler_on_panic(&s, &on_panic, NULL);
+
+    REQUIRE(AERR_NONE ==
+        aloader_add_chunk(&s.loader, as.chunk, as.chunk_size, NULL, NULL));
+    REQUIRE(AERR_NONE == aloader_link(&s.loader, TRUE));
+
+    attach_calls = 0;
+    attach_steps = 0;
+
+    aactor_t* a;
+    REQUIRE(AERR_NONE == ascheduler_new_actor(&s, CSTACK_SZ, &a));
+    any_import(a, "mod_test", "test_f");
+    any_push_native_func(a, &attach_on_second);
+    ascheduler_start(&s, a, 1);
+
+    ascheduler_run_once(&s);
+
+    REQUIRE(attach_calls == 3);
+    // pop, inc, llv, jlt, then a whole iteration, llv and ret.
+    CHECK(attach_steps == 12);
+    CHECK(any_check_integer(a, any_check_index(a, 0)) == 3);
+
+    ascheduler_cleanup(&s);
+    aasm_cleanup(&as);
+}
+
+static std::string prio_order;
+static aint_t prio_old;
+
+// Record a letter per slice, by priority from low to max.
+static void prio_actor(aactor_t* a)
+{
+    for (aint_t i = 0; i < 20; ++i) {
+        prio_order += "lnhm"[a->priority - APRIO_LOW];
+        any_yield(a);
+    }
+    any_push_nil(a);
+}
+
+static void std_prio_actor(aactor_t* a)
+{
+    any_import(a, "std", "set_priority/1");
+    any_push_integer(a, APRIO_HIGH);
+    any_call(a, 1);
+    prio_old = any_check_integer(a, any_top(a));
+    any_pop(a, 1);
+    prio_actor(a);
+}
+
+static void spawn_prio(ascheduler_t* s, aint_t priority, anative_func_t f)
+{
+    aactor_opts_t opts;
+    memset(&opts, 0, sizeof(opts));
+    opts.priority = priority;
+    aactor_t* a;
+    REQUIRE(AERR_NONE == ascheduler_new_actor_opts(s, CSTACK_SZ, &opts, &a));
+    CHECK(a->priority == priority);
+    any_push_native_func(a, f);
+    ascheduler_start(s, a, 0);
+}
+
+TEST_CASE("scheduler_priority")
+{
+    enum { NUM_IDX_BITS = 4 };
+    enum { NUM_GEN_BITS = 4 };
+
+    ascheduler_t s;
+
+    REQUIRE(AERR_NONE ==
+        ascheduler_init(&s, NUM_IDX_BITS, NUM_GEN_BITS, &myalloc, NULL));
+    ascheduler_on_panic(&s, &on_panic, NULL);
+
+    astd_lib_add(&s.loader);
+    prio_order.clear();
+
+    SECTION("order")
+    {
+        spawn_prio(&s, APRIO_NORMAL, &prio_actor);
+        spawn_prio(&s, APRIO_LOW, &prio_actor);
+        spawn_prio(&s, APRIO_HIGH, &prio_actor);
+
+        ascheduler_run_until_idle(&s);
+
+        // lower priorities still run once per APRIO_MAX_SKIPS slices.
+        CHECK(prio_order.compare(0, 20, "hhhhhhhhnlhhhhhhhhnl") == 0);
+        CHECK(prio_order.size() == 60);
+        CHECK(ascheduler_num_processes(&s) == 0);
+    }
+
+    SECTION("std")
+    {
+        spawn_prio(&s, APRIO_NORMAL, &prio_actor);
+        spawn_prio(&s, APRIO_NORMAL, &std_prio_actor);
+
+        ascheduler_run_until_idle(&s);
+
+        CHECK(prio_old == APRIO_NORMAL);
+        CHECK(prio_order.compare(0, 11, "nhhhhhhhhhn") == 0);
+        CHECK(prio_order.size() == 40);
+    }
+
+    SECTION("bad")
+    {
+        aactor_opts_t opts;
+        memset(&opts, 0, sizeof(opts));
+        opts.priority = APRIO_MAX + 1;
+        aactor_t* a;
+        CHECK(AERR_RUNTIME ==
+            ascheduler_new_actor_opts(&s, CSTACK_SZ, &opts, &a));
+        CHECK(ascheduler_num_processes(&s) == 0);
+    }
+
+    ascheduler_cleanup(&s);
+}
+
+enum { NUM_CALLS = 20 };
+
+static std::string call_trace;
+static aint_t num_replies;
+
+// Reply `n + 1` to the pid in args for each request `n`.
+static void rpc_server(aactor_t* a)
+{
+    aint_t a_client = any_check_index(a, -1);
+    any_push_nil(a);
+    aint_t msg = any_check_index(a, 0);
+    for (aint_t i = 0; i < NUM_CALLS; ++i) {
+        any_mbox_recv(a, AINFINITE);
+        call_trace += 's';
+        any_push_index(a, a_client);
+        any_push_integer(a, any_check_integer(a, msg) + 1);
+        any_mbox_remove(a);
+        any_mbox_send(a);
+    }
+    any_push_nil(a);
+}
+
+// Call the pid in args, by std.call/2 every other time.
+static void rpc_client(aactor_t* a)
+{
+    aint_t a_server = any_check_index(a, -1);
+    for (aint_t i = 0; i < NUM_CALLS; ++i) {
+        call_trace += 'c';
+        if (i % 2) {
+            any_import(a, "std", "call/2");
+            any_push_integer(a, i);
+            any_push_index(a, a_server);
+            any_call(a, 2);
+        } else {
+            any_push_index(a, a_server);
+            any_push_integer(a, i);
+            CHECK(any_mbox_call(a, AINFINITE) == AERR_NONE);
+        }
+        if (any_check_integer(a, any_top(a)) == i + 1) ++num_replies;
+        any_pop(a, 1);
+    }
+    any_push_nil(a);
+}
+
+static void bystander(aactor_t* a)
+{
+    for (aint_t i = 0; i < NUM_CALLS; ++i) {
+        call_trace += 'b';
+        any_yield(a);
+    }
+    any_push_nil(a);
+}
+
+TEST_CASE("scheduler_call")
+{
+    enum { NUM_IDX_BITS = 4 };
+    enum { NUM_GEN_BITS = 4 };
+
+    ascheduler_t s;
+
+    REQUIRE(AERR_NONE ==
+        ascheduler_init(&s, NUM_IDX_BITS, NUM_GEN_BITS, &myalloc, NULL));
+    ascheduler_on_panic(&s, &on_panic, NULL);
+
+    astd_lib_add(&s.loader);
+    call_trace.clear();
+    num_replies = 0;
+
+    aactor_t* server;
+    aactor_t* client;
+    aactor_t* b;
+    REQUIRE(AERR_NONE == ascheduler_new_actor(&s, CSTACK_SZ, &server));
+    REQUIRE(AERR_NONE == ascheduler_new_actor(&s, CSTACK_SZ, &b));
+    REQUIRE(AERR_NONE == ascheduler_new_actor(&s, CSTACK_SZ, &client));
+
+    any_push_native_func(server, &rpc_server);
+    any_push_pid(server, ascheduler_pid(&s, client));
+    ascheduler_start(&s, server, 1);
+    any_push_native_func(b, &bystander);
+    ascheduler_start(&s, b, 0);
+    any_push_native_func(client, &rpc_client);
+    any_push_pid(client, ascheduler_pid(&s, server));
+    ascheduler_start(&s, client, 1);
+
+    ascheduler_run_until_idle(&s);
+
+    // calls and replies switch directly, the bystander still gets slices.
+    CHECK(call_trace.compare(0, 11, "bcscscscscb") == 0);
+    CHECK(num_replies == NUM_CALLS);
+    CHECK(ascheduler_num_processes(&s) == 0);
+
+    ascheduler_cleanup(&s);
+}
+
+// Call the pid in args while looking at a message queued to itself.
+static void queued_client(aactor_t* a)
+{
+    aint_t a_server = any_check_index(a, -1);
+    aint_t a_self = any_check_index(a, -2);
+    any_push_nil(a);
+    aint_t msg = any_check_index(a, 0);
+    for (aint_t i = 0; i < NUM_CALLS; ++i) {
+        any_push_index(a, a_self);
+        any_push_integer(a, -1);
+        any_mbox_send(a);
+        CHECK(any_mbox_recv(a, ADONT_WAIT) == AERR_NONE);
+        CHECK(any_check_integer(a, msg) == -1);
+        if (i % 2) {
+            any_import(a, "std", "call/2");
+            any_push_integer(a, i);
+            any_push_index(a, a_server);
+            any_call(a, 2);
+        } else {
+            any_push_index(a, a_server);
+            any_push_integer(a, i);
+            CHECK(any_mbox_call(a, AINFINITE) == AERR_NONE);
+        }
+        if (any_check_integer(a, any_top(a)) == i + 1) ++num_replies;
+        any_pop(a, 1);
+        // the message picked up before calling is still the current one.
+        any_mbox_remove(a);
+        CHECK(any_mbox_recv(a, ADONT_WAIT) == AERR_TIMEOUT);
+    }
+    any_push_nil(a);
+}
+
+TEST_CASE("scheduler_call_queued")
+{
+    enum { NUM_IDX_BITS = 4 };
+    enum { NUM_GEN_BITS = 4 };
+
+    ascheduler_t s;
+
+    REQUIRE(AERR_NONE ==
+        ascheduler_init(&s, NUM_IDX_BITS, NUM_GEN_BITS, &myalloc, NULL));
+    ascheduler_on_panic(&s, &on_panic, NULL);
+
+    astd_lib_add(&s.loader);
+    num_replies = 0;
+
+    aactor_t* server;
+    aactor_t* client;
+    REQUIRE(AERR_NONE == ascheduler_new_actor(&s, CSTACK_SZ, &server));
+    REQUIRE(AERR_NONE == ascheduler_new_actor(&s, CSTACK_SZ, &client));
+
+    any_push_native_func(server, &rpc_server);
+    any_push_pid(server, ascheduler_pid(&s, client));
+    ascheduler_start(&s, server, 1);
+    any_push_native_func(client, &queued_client);
+    any_push_pid(client, ascheduler_pid(&s, client));
+    any_push_pid(client, ascheduler_pid(&s, server));
+    ascheduler_start(&s, client, 2);
+
+    ascheduler_run_until_idle(&s);
+
+    CHECK(num_replies == NUM_CALLS);
+    CHECK(ascheduler_num_processes(&s) == 0);
+
+    ascheduler_cleanup(&s);
+}
+
+// Have the meddler in args message the client in args before each reply.
+static void meddled_server(aactor_t* a)
+{
+    aint_t a_client = any_check_index(a, -1);
+    aint_t a_meddler = any_check_index(a, -2);
+    any_push_nil(a);
+    aint_t msg = any_check_index(a, 0);
+    for (aint_t i = 0; i < NUM_CALLS; ++i) {
+        any_mbox_recv(a, AINFINITE);
+        aint_t n = any_check_integer(a, msg);
+        any_mbox_remove(a);
+        any_push_index(a, a_meddler);
+        any_push_index(a, a_client);
+        any_mbox_send(a);
+        any_mbox_recv(a, AINFINITE);
+        any_mbox_remove(a);
+        any_push_index(a, a_client);
+        any_push_integer(a, n + 1);
+        any_mbox_send(a);
+    }
+    any_push_nil(a);
+}
+
+// Send -1 to each pid received, then tell the server in args.
+static void meddler(aactor_t* a)
+{
+    aint_t a_server = any_check_index(a, -1);
+    any_push_nil(a);
+    aint_t msg = any_check_index(a, 0);
+    for (aint_t i = 0; i < NUM_CALLS; ++i) {
+        any_mbox_recv(a, AINFINITE);
+        any_push_index(a, msg);
+        any_push_integer(a, -1);
+        any_mbox_send(a);
+        any_mbox_remove(a);
+        any_push_index(a, a_server);
+        any_push_nil(a);
+        any_mbox_send(a);
+    }
+    any_push_nil(a);
+}
+
+// Call the pid in args, then pick up what the meddler sent meanwhile.
+static void meddled_client(aactor_t* a)
+{
+    aint_t a_server = any_check_index(a, -1);
+    any_push_nil(a);
+    aint_t msg = any_check_index(a, 0);
+    for (aint_t i = 0; i < NUM_CALLS; ++i) {
+        any_push_index(a, a_server);
+        any_push_integer(a, i);
+        CHECK(any_mbox_call(a, AINFINITE) == AERR_NONE);
+        if (any_check_integer(a, any_top(a)) == i + 1) ++num_replies;
+        any_pop(a, 1);
+        CHECK(any_mbox_recv(a, ADONT_WAIT) == AERR_NONE);
+        CHECK(any_check_integer(a, msg) == -1);
+        any_mbox_remove(a);
+        CHECK(any_mbox_recv(a, ADONT_WAIT) == AERR_TIMEOUT);
+    }
+    any_push_nil(a);
+}
+
+TEST_CASE("scheduler_call_others")
+{
+    enum { NUM_IDX_BITS = 4 };
+    enum { NUM_GEN_BITS = 4 };
+
+    ascheduler_t s;
+
+    REQUIRE(AERR_NONE ==
+        ascheduler_init(&s, NUM_IDX_BITS, NUM_GEN_BITS, &myalloc, NULL));
+    ascheduler_on_panic(&s, &on_panic, NULL);
+
+    num_replies = 0;
+
+    aactor_t* server;
+    aactor_t* m;
+    aactor_t* client;
+    REQUIRE(AERR_NONE == ascheduler_new_actor(&s, CSTACK_SZ, &server));
+    REQUIRE(AERR_NONE == ascheduler_new_actor(&s, CSTACK_SZ, &m));
+    REQUIRE(AERR_NONE == ascheduler_new_actor(&s, CSTACK_SZ, &client));
+
+    any_push_native_func(server, &meddled_server);
+    any_push_pid(server, ascheduler_pid(&s, m));
+    any_push_pid(server, ascheduler_pid(&s, client));
+    ascheduler_start(&s, server, 2);
+    any_push_native_func(m, &meddler);
+    any_push_pid(m, ascheduler_pid(&s, server));
+    ascheduler_start(&s, m, 1);
+    any_push_native_func(client, &meddled_client);
+    any_push_pid(client, ascheduler_pid(&s, server));
+    ascheduler_start(&s, client, 1);
+
+    ascheduler_run_until_idle(&s);
+
+    // replies are matched on the server, not taken from the meddler.
+    CHECK(num_replies == NUM_CALLS);
+    CHECK(ascheduler_num_processes(&s) == 0);
+
+    ascheduler_cleanup(&s);
+}
+
+static aint_t counter_of(aactor_t* a)
+{
+    return a->stack.v[a->frame->bp].v.integer;
+}
+
+TEST_CASE("scheduler_reductions")
+{
+    enum { NUM_IDX_BITS = 4 };
+    enum { NUM_GEN_BITS = 4 };
+    enum { NUM_LOOPS = 100 };
+
+    aasm_t as;
+    aasm_init(&as, &myalloc, NULL);
+    REQUIRE(aasm_load(&as, NULL) == AERR_NONE);
+    add_module(&as, "mod_test");
+    aasm_module_push(&as, "test_f");
+    aasm_prototype(&as)->num_local_vars = 1;
+    aasm_emit(&as, ai_lsi(0), 1);
+    aasm_emit(&as, ai_slv(0), 1);
+    aasm_emit(&as, ai_lsi(NUM_LOOPS), 2);
+    aasm_emit(&as, ai_llv(0), 2);
+    aasm_emit(&as, ai_lt(), 2);
+    aasm_emit(&as, ai_jin(5), 2);
+    aasm_emit(&as, ai_llv(0), 3);
+    aasm_emit(&as, ai_lsi(1), 3);
+    aasm_emit(&as, ai_add(), 3);
+    aasm_emit(&as, ai_slv(0), 3);
+    aasm_emit(&as, ai_jmp(-9), 3);
+    aasm_emit(&as, ai_llv(0), 4);
+    aasm_emit(&as, ai_ret(), 4);
+    aasm_pop(&as);
+    aasm_save(&as);
+
+    ascheduler_t s;
+
+    REQUIRE(AERR_NONE ==
+        ascheduler_init(&s, NUM_IDX_BITS, NUM_GEN_BITS, &myalloc, NULL));
+    ascheduler_on_panic(&s, &on_panic, NULL);
+
+    REQUIRE(AERR_NONE ==
+        aloader_add_chunk(&s.loader, as.chunk, as.chunk_size, NULL, NULL));
+    REQUIRE(AERR_NONE == aloader_link(&s.loader, TRUE));
+
+    aactor_t* a1;
+    aactor_t* a2;
+    REQUIRE(AERR_NONE == ascheduler_new_actor(&s, CSTACK_SZ, &a1));
+    REQUIRE(AERR_NONE == ascheduler_new_actor(&s, CSTACK_SZ, &a2));
+
+    SECTION("fair")
+    {
+        ascheduler_set_reductions(&s, 10);
+        any_import(a1, "mod_test", "test_f");
+        ascheduler_start(&s, a1, 0);
+        any_import(a2, "mod_test", "test_f");
+        ascheduler_start(&s, a2, 0);
+
+        // both actors are preempted in the middle of their loops.
+        ascheduler_run_once(&s);
+        CHECK(counter_of(a1) > 0);
+        CHECK(counter_of(a1) < NUM_LOOPS);
+        CHECK(counter_of(a2) > 0);
+        CHECK(counter_of(a2) < NUM_LOOPS);
+
+        aint_t slices = 1;
+        while (ascheduler_num_processes(&s) > 0) {
+            ascheduler_run_once(&s);
+            ++slices;
+        }
+        CHECK(slices >= NUM_LOOPS / 10);
+    }
+
+    SECTION("per_actor")
+    {
+        ascheduler_set_reductions(&s, 10);
+        aactor_set_reductions(a1, NUM_LOOPS * 2);
+        any_import(a1, "mod_test", "test_f");
+        ascheduler_start(&s, a1, 0);
+        any_import(a2, "mod_test", "test_f");
+        ascheduler_start(&s, a2, 0);
+
+        ascheduler_run_once(&s);
+        REQUIRE(any_count(a1) == 2);
+        CHECK(any_check_integer(a1, any_check_index(a1, 0)) == NUM_LOOPS);
+        CHECK(counter_of(a2) < NUM_LOOPS);
+    }
+
+    SECTION("disabled")
+    {
+        any_import(a1, "mod_test", "test_f");
+        ascheduler_start(&s, a1, 0);
+        any_import(a2, "mod_test", "test_f");
+        ascheduler_start(&s, a2, 0);
+
+        ascheduler_run_once(&s);
+        REQUIRE(any_count(a1) == 2);
+        CHECK(any_check_integer(a1, any_check_index(a1, 0)) == NUM_LOOPS);
+        REQUIRE(any_count(a2) == 2);
+        CHECK(any_check_integer(a2, any_check_index(a2, 0)) == NUM_LOOPS);
+    }
+
+    ascheduler_cleanup(&s);
+    aasm_cleanup(&as);
+}
+
+static void sleep_actor(aactor_t* a)
+{
+    any_sleep(a, any_check_integer(a, any_check_index(a, -1)));
+    any_push_nil(a);
+}
+
+TEST_CASE("scheduler_timers")
+{
+    enum { NUM_IDX_BITS = 6 };
+    enum { NUM_GEN_BITS = 4 };
+    enum { NUM_ACTORS = 50 };
+
+    ascheduler_t s;
+
+    REQUIRE(AERR_NONE ==
+        ascheduler_init(&s, NUM_IDX_BITS, NUM_GEN_BITS, &myalloc, NULL));
+    ascheduler_on_panic(&s, &on_panic, NULL);
+
+    SECTION("heap")
+    {
+        aprocess_t* ps[NUM_ACTORS];
+        for (aint_t i = 0; i < NUM_ACTORS; ++i) {
+            aactor_t* a;
+            REQUIRE(AERR_NONE == ascheduler_new_actor(&s, CSTACK_SZ, &a));
+            ps[i] = ACAST_FROM_FIELD(aprocess_t, a, actor);
+            ps[i]->deadline = 1000 + (i * 37) % NUM_ACTORS;
+            ascheduler_add_timer(&s, ps[i]);
+        }
+        CHECK(ascheduler_next_deadline(&s) == 1000);
+        // every 5th is woken up by a message.
+        for (aint_t i = 0; i < NUM_ACTORS; i += 5) {
+            ascheduler_remove_timer(&s, ps[i]);
+            CHECK(ps[i]->timer_idx == -1);
+        }
+        CHECK(ascheduler_pop_timer(&s, 999) == NULL);
+
+        aint_t last = 0;
+        aint_t num_expired = 0;
+        aprocess_t* p;
+        while ((p = ascheduler_pop_timer(&s, 2000)) != NULL) {
+            CHECK(p->deadline >= last);
+            CHECK(p->timer_idx == -1);
+            last = p->deadline;
+            ++num_expired;
+        }
+        CHECK(num_expired == NUM_ACTORS - NUM_ACTORS / 5);
+        CHECK(ascheduler_next_deadline(&s) == -1);
+    }
+
+    SECTION("sleep")
+    {
+        aactor_t* a;
+        REQUIRE(AERR_NONE == ascheduler_new_actor(&s, CSTACK_SZ, &a));
+        any_push_native_func(a, &sleep_actor);
+        any_push_integer(a, amsec(10));
+        ascheduler_start(&s, a, 1);
+
+        ascheduler_run_once(&s);
+        aint_t deadline = ascheduler_next_deadline(&s);
+        CHECK(deadline >= s.timer + amsec(10));
+
+        while (ascheduler_num_processes(&s) > 0) {
+            ascheduler_run_once(&s);
+        }
+        CHECK(s.timer >= deadline);
+        CHECK(ascheduler_next_deadline(&s) == -1);
+    }
+
+    ascheduler_cleanup(&s);
+}
+
+static aint_t received;
+
+static void recv_actor(aactor_t* a)
+{
+    any_push_nil(a);
+    if (any_mbox_recv(a, AINFINITE) == AERR_NONE) {
+        received = any_check_integer(a, any_check_index(a, 0));
+    }
+}
+
+static std::string received_string;
+
+static void recv_string_actor(aactor_t* a)
+{
+    any_push_nil(a);
+    if (any_mbox_recv(a, AINFINITE) == AERR_NONE) {
+        received_string = any_check_string(a, any_check_index(a, 0));
+    }
+}
+
+static bool readable(int32_t fd)
+{
+#if defined(ALINUX) || defined(AAPPLE)
+    struct pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    return poll(&pfd, 1, 0) == 1;
+#else
+    return false;
+#endif
+}
+
+TEST_CASE("scheduler_event_loop")
+{
+    enum { NUM_IDX_BITS = 4 };
+    enum { NUM_GEN_BITS = 4 };
+
+    ascheduler_t s;
+
+    REQUIRE(AERR_NONE ==
+        ascheduler_init(&s, NUM_IDX_BITS, NUM_GEN_BITS, &myalloc, NULL));
+    ascheduler_on_panic(&s, &on_panic, NULL);
+
+    CHECK(ascheduler_is_idle(&s) == TRUE);
+    CHECK(ascheduler_timeout(&s) == -1);
+
+    SECTION("sleep")
+    {
+        aactor_t* a;
+        REQUIRE(AERR_NONE == ascheduler_new_actor(&s, CSTACK_SZ, &a));
+        any_push_native_func(a, &sleep_actor);
+        any_push_integer(a, amsec(10));
+        ascheduler_start(&s, a, 1);
+        CHECK(ascheduler_timeout(&s) == 0);
+
+        ascheduler_run_until_idle(&s);
+        CHECK(ascheduler_num_processes(&s) == 1);
+        aint_t timeout = ascheduler_timeout(&s);
+        CHECK(timeout > 0);
+        CHECK(timeout <= amsec(10));
+    }
+
+#if defined(ALINUX) || defined(AAPPLE)
+    SECTION("post")
+    {
+        int32_t fd = ascheduler_wakeup_fd(&s);
+        REQUIRE(fd >= 0);
+        CHECK(readable(fd) == false);
+
+        aactor_t* a;
+        REQUIRE(AERR_NONE == ascheduler_new_actor(&s, CSTACK_SZ, &a));
+        any_push_native_func(a, &recv_actor);
+        ascheduler_start(&s, a, 0);
+        ascheduler_run_until_idle(&s);
+        CHECK(ascheduler_num_processes(&s) == 1);
+        CHECK(ascheduler_timeout(&s) == -1);
+
+        received = 0;
+        apost_t p;
+        av_integer(&p.v, 1969);
+        p.s = NULL;
+        p.frag = NULL;
+        REQUIRE(AERR_NONE == ascheduler_post(&s, ascheduler_pid(&s, a), &p));
+        CHECK(readable(fd) == true);
+        CHECK(ascheduler_is_idle(&s) == FALSE);
+        CHECK(ascheduler_timeout(&s) == 0);
+
+        ascheduler_run_until_idle(&s);
+        CHECK(readable(fd) == false);
+        CHECK(received == 1969);
+        CHECK(ascheduler_num_processes(&s) == 0);
+    }
+
+    SECTION("post_string")
+    {
+        aactor_t* a;
+        REQUIRE(AERR_NONE == ascheduler_new_actor(&s, CSTACK_SZ, &a));
+        any_push_native_func(a, &recv_string_actor);
+        ascheduler_start(&s, a, 0);
+        ascheduler_run_until_idle(&s);
+
+        received_string.clear();
+        apost_t p;
+        av_nil(&p.v);
+        p.s = (char*)myalloc(NULL, NULL, 6);
+        memcpy(p.s, "hello", 6);
+        p.frag = NULL;
+        REQUIRE(AERR_NONE == ascheduler_post(&s, ascheduler_pid(&s, a), &p));
+
+        ascheduler_run_until_idle(&s);
+        CHECK(received_string == "hello");
+        CHECK(ascheduler_num_processes(&s) == 0);
+    }
+#endif
+
+    ascheduler_cleanup(&s);
+}
+
+static aint_t exit_sum;
+static std::string exit_msg;
+
+static void sum_on_exit(aactor_t* a, void*)
+{
+    aint_t idx = any_check_index(a, 0);
+    switch (any_type(a, idx).type) {
+    case AVT_INTEGER:
+        exit_sum += any_to_integer(a, idx);
+        break;
+    case AVT_STRING:
+        exit_msg = any_to_string(a, idx);
+        break;
+    default:
+        break;
+    }
+}
+
+static void feed_actor(aactor_t* a)
+{
+    aint_t nargs = any_nargs(a);
+    for (aint_t i = 0; i < 10; ++i) {
+        for (aint_t j = 0; j < nargs; ++j) {
+            any_push_index(a, any_check_index(a, -1 - j));
+            any_push_integer(a, i);
+            any_mbox_send(a);
+        }
+        any_yield(a);
+    }
+    any_push_nil(a);
+}
+
+static void block_in_native(aactor_t* a)
+{
+    any_sleep(a, amsec(1));
+    any_push_nil(a);
+}
+
+TEST_CASE("scheduler_stackless")
+{
+    enum { NUM_IDX_BITS = 6 };
+    enum { NUM_GEN_BITS = 4 };
+    enum { NUM_ACTORS = 32 };
+    enum { NUM_LOOPS = 100 };
+
+    aasm_t as;
+    aasm_init(&as, &myalloc, NULL);
+    REQUIRE(aasm_load(&as, NULL) == AERR_NONE);
+    add_module(&as, "mod_test");
+
+    // s = 0; i = 0; while i < 10 { s = s + receive(); i = i + 1 }; return s
+    aasm_module_push(&as, "test_recv");
+    aasm_prototype(&as)->num_local_vars = 2;
+    aasm_emit(&as, ai_lsi(0), 1);
+    aasm_emit(&as, ai_slv(0), 1);
+    aasm_emit(&as, ai_lsi(0), 1);
+    aasm_emit(&as, ai_slv(1), 1);
+    aasm_emit(&as, ai_lsi(10), 2);
+    aasm_emit(&as, ai_llv(1), 2);
+    aasm_emit(&as, ai_lt(), 2);
+    aasm_emit(&as, ai_jin(11), 2);
+    aasm_emit(&as, ai_lsi(AINFINITE), 3);
+    aasm_emit(&as, ai_rcv(0), 3);
+    aasm_emit(&as, ai_llv(0), 3);
+    aasm_emit(&as, ai_add(), 3);
+    aasm_emit(&as, ai_slv(0), 3);
+    aasm_emit(&as, ai_rmv(), 3);
+    aasm_emit(&as, ai_llv(1), 4);
+    aasm_emit(&as, ai_lsi(1), 4);
+    aasm_emit(&as, ai_add(), 4);
+    aasm_emit(&as, ai_slv(1), 4);
+    aasm_emit(&as, ai_jmp(-15), 4);
+    aasm_emit(&as, ai_llv(0), 5);
+    aasm_emit(&as, ai_ret(), 5);
+    aasm_pop(&as);
+
+    aasm_module_push(&as, "test_loop");
+    aasm_prototype(&as)->num_local_vars = 1;
+    aasm_emit(&as, ai_lsi(0), 1);
+    aasm_emit(&as, ai_slv(0), 1);
+    aasm_emit(&as, ai_lsi(NUM_LOOPS), 2);
+    aasm_emit(&as, ai_llv(0), 2);
+    aasm_emit(&as, ai_lt(), 2);
+    aasm_emit(&as, ai_jin(5), 2);
+    aasm_emit(&as, ai_llv(0), 3);
+    aasm_emit(&as, ai_lsi(1), 3);
+    aasm_emit(&as, ai_add(), 3);
+    aasm_emit(&as, ai_slv(0), 3);
+    aasm_emit(&as, ai_jmp(-9), 3);
+    aasm_emit(&as, ai_llv(0), 4);
+    aasm_emit(&as, ai_ret(), 4);
+    aasm_pop(&as);
+
+    aasm_module_push(&as, "test_timeout");
+    aasm_emit(&as, ai_lsi(1000), 1);
+    aasm_emit(&as, ai_rcv(1), 1);
+    aasm_emit(&as, ai_ret(), 2);
+    aasm_emit(&as, ai_lsi(5), 3);
+    aasm_emit(&as, ai_ret(), 3);
+    aasm_pop(&as);
+
+    aasm_module_push(&as, "test_native");
+    aasm_emit(&as, ai_llv(-1), 1);
+    aasm_emit(&as, ai_ivk(0), 1);
+    aasm_emit(&as, ai_ret(), 1);
+    aasm_pop(&as);
+    aasm_save(&as);
+
+    ascheduler_t s;
+
+    REQUIRE(AERR_NONE ==
+        ascheduler_init(&s, NUM_IDX_BITS, NUM_GEN_BITS, &myalloc, NULL));
+    ascheduler_on_panic(&s, &on_panic, NULL);
+    ascheduler_on_exit(&s, &sum_on_exit, NULL);
+
+    REQUIRE(AERR_NONE ==
+        aloader_add_chunk(&s.loader, as.chunk, as.chunk_size, NULL, NULL));
+    REQUIRE(AERR_NONE == aloader_link(&s.loader, TRUE));
+
+    exit_sum = 0;
+    exit_msg.clear();
+
+    SECTION("recv")
+    {
+        aactor_t* f;
+        REQUIRE(AERR_NONE == ascheduler_new_actor(&s, CSTACK_SZ, &f));
+        any_push_native_func(f, &feed_actor);
+        for (aint_t i = 0; i < NUM_ACTORS; ++i) {
+            aactor_t* a;
+            REQUIRE(AERR_NONE == ascheduler_new_actor(&s, 0, &a));
+            any_import(a, "mod_test", "test_recv");
+            ascheduler_start(&s, a, 0);
+            any_push_pid(f, ascheduler_pid(&s, a));
+        }
+        ascheduler_run_once(&s);
+        CHECK(ascheduler_num_processes(&s) == NUM_ACTORS + 1);
+        CHECK(exit_sum == 0);
+
+        ascheduler_start(&s, f, NUM_ACTORS);
+        while (ascheduler_num_processes(&s) > 0) {
+            ascheduler_run_once(&s);
+        }
+        CHECK(exit_sum == NUM_ACTORS * 45);
+    }
+
+    SECTION("preempt")
+    {
+        ascheduler_set_reductions(&s, 10);
+        aactor_t* a1;
+        aactor_t* a2;
+        REQUIRE(AERR_NONE == ascheduler_new_actor(&s, 0, &a1));
+        REQUIRE(AERR_NONE == ascheduler_new_actor(&s, CSTACK_SZ, &a2));
+        any_import(a1, "mod_test", "test_loop");
+        ascheduler_start(&s, a1, 0);
+        any_import(a2, "mod_test", "test_loop");
+        ascheduler_start(&s, a2, 0);
+
+        ascheduler_run_once(&s);
+        CHECK(counter_of(a1) > 0);
+        CHECK(counter_of(a1) < NUM_LOOPS);
+        CHECK(counter_of(a2) > 0);
+        CHECK(counter_of(a2) < NUM_LOOPS);
+
+        while (ascheduler_num_processes(&s) > 0) {
+            ascheduler_run_once(&s);
+        }
+        CHECK(exit_sum == NUM_LOOPS * 2);
+    }
+
+    SECTION("timeout")
+    {
+        aactor_t* a;
+        REQUIRE(AERR_NONE == ascheduler_new_actor(&s, 0, &a));
+        any_import(a, "mod_test", "test_timeout");
+        ascheduler_start(&s, a, 0);
+        while (ascheduler_num_processes(&s) > 0) {
+            ascheduler_run_once(&s);
+        }
+        CHECK(exit_sum == 5);
+    }
+
+    SECTION("native_entry")
+    {
+        aactor_t* a;
+        REQUIRE(AERR_NONE == ascheduler_new_actor(&s, 0, &a));
+        any_push_native_func(a, &block_in_native);
+        ascheduler_start(&s, a, 0);
+        ascheduler_run_once(&s);
+        CHECK_THAT(exit_msg,
+            Catch::Equals("stackless actor must enter byte code"));
+    }
+
+    SECTION("native_block")
+    {
+        aactor_t* a;
+        REQUIRE(AERR_NONE == ascheduler_new_actor(&s, 0, &a));
+        any_import(a, "mod_test", "test_native");
+        any_push_native_func(a, &block_in_native);
+        ascheduler_start(&s, a, 1);
+        ascheduler_run_once(&s);
+        CHECK_THAT(exit_msg,
+            Catch::Equals("stackless actor can not block in native function"));
+    }
+
+    ascheduler_cleanup(&s);
+    aasm_cleanup(&as);
+}
@@ -0,0 +1,468 @@
+/* Copyright (c) 2017 Nguyen Viet Giang. All rights reserved. */
+#include "prereq.h"
+
+#include <any/smp.h>
+#include <any/asm.h>
+#include <any/loader.h>
+#include <any/actor.h>
+#include <any/timer.h>
+#include <any/std_string.h>
+#include <any/std_tuple.h>
+
+#ifdef ANY_SMP
+
+#include <atomic>
+#include <thread>
+#include <string.h>
+
+// Catch is not thread safe, actors only record and the test checks later.
+static std::atomic<aint_t> num_done;
+static std::atomic<aint_t> num_migrated;
+static std::atomic<aint_t> sum;
+static std::atomic<aint_t> num_strings;
+static std::atomic<aint_t> num_shared;
+
+enum { NUM_SENDERS = 8 };
+enum { NUM_MSGS = 100 };
+
+static void busy_actor(aactor_t* a)
+{
+    ascheduler_t* w = a->owner;
+    for (aint_t i = 0; i < 10000 && a->owner == w; ++i) {
+        any_yield(a);
+    }
+    if (a->owner != w) ++num_migrated;
+    ++num_done;
+    any_push_nil(a);
+}
+
+// Spin without yielding, so its worker does not steal meanwhile.
+static void hold_worker_actor(aactor_t* a)
+{
+    const aint_t until = atimer_usecs() + 50000;
+    while (atimer_usecs() < until) {}
+    any_push_nil(a);
+}
+
+static void sleepy_actor(aactor_t* a)
+{
+    ascheduler_sleep(a->owner, a, 100000);
+    busy_actor(a);
+}
+
+static void spawn_sleepy_actor(aactor_t* a)
+{
+    for (aint_t i = 0; i < 8; ++i) {
+        apid_t pid;
+        any_push_native_func(a, &sleepy_actor);
+        any_spawn(a, CSTACK_SZ, 0, &pid);
+    }
+    any_push_nil(a);
+}
+
+static void sender_actor(aactor_t* a)
+{
+    for (aint_t i = 0; i < NUM_MSGS; ++i) {
+        any_push_index(a, any_check_index(a, -1));
+        any_push_integer(a, i);
+        any_mbox_send(a);
+        any_push_index(a, any_check_index(a, -1));
+        any_push_string(a, "hi");
+        any_mbox_send(a);
+        any_yield(a);
+    }
+    any_push_nil(a);
+}
+
+static void receiver_actor(aactor_t* a)
+{
+    any_push_nil(a);
+    aint_t idx = any_check_index(a, 0);
+    for (aint_t i = 0; i < NUM_SENDERS * NUM_MSGS * 2;) {
+        if (any_mbox_recv(a, AINFINITE) != AERR_NONE) continue;
+        if (any_type(a, idx).type == AVT_STRING) {
+            if (strcmp(any_to_string(a, idx), "hi") == 0) ++num_strings;
+        } else {
+            sum += any_check_integer(a, idx);
+        }
+        any_mbox_remove(a);
+        ++i;
+    }
+    ++num_done;
+}
+
+static std::atomic<aint_t> num_out_of_order;
+
+// Posts of each host thread arrive in the order they were sent.
+static void host_receiver_actor(aactor_t* a)
+{
+    aint_t last[NUM_SENDERS];
+    for (aint_t j = 0; j < NUM_SENDERS; ++j) last[j] = -1;
+    any_push_nil(a);
+    aint_t idx = any_check_index(a, 0);
+    for (aint_t i = 0; i < NUM_SENDERS * NUM_MSGS;) {
+        if (any_mbox_recv(a, AINFINITE) != AERR_NONE) continue;
+        aint_t v = any_check_integer(a, idx);
+        aint_t j = v / NUM_MSGS;
+        if (v % NUM_MSGS != last[j] + 1) ++num_out_of_order;
+        last[j] = v % NUM_MSGS;
+        sum += v % NUM_MSGS;
+        any_mbox_remove(a);
+        ++i;
+    }
+    ++num_done;
+}
+
+static void host_sender(asmp_t* smp, apid_t pid, aint_t j)
+{
+    for (aint_t i = 0; i < NUM_MSGS; ++i) {
+        apost_t p;
+        av_integer(&p.v, j * NUM_MSGS + i);
+        p.s = NULL;
+        p.frag = NULL;
+        while (asmp_post(smp, pid, &p) != AERR_NONE) {}
+    }
+}
+
+// Send `0..NUM_MSGS - 1` to every pid in args.
+static void fanout_actor(aactor_t* a)
+{
+    aint_t nargs = any_nargs(a);
+    for (aint_t i = 0; i < NUM_MSGS; ++i) {
+        for (aint_t j = 0; j < nargs; ++j) {
+            any_push_index(a, any_check_index(a, -1 - j));
+            any_push_integer(a, i);
+            any_mbox_send(a);
+        }
+        any_yield(a);
+    }
+    any_push_nil(a);
+}
+
+static void sum_on_exit(aactor_t* a, void*)
+{
+    aint_t idx = any_check_index(a, 0);
+    if (any_type(a, idx).type == AVT_INTEGER) {
+        sum += any_to_integer(a, idx);
+        ++num_done;
+    }
+}
+
+// Send `(s, s, i)` with a shared string `s` to the pid in args.
+static void tuple_sender_actor(aactor_t* a)
+{
+    any_push_string(a, "shared");
+    aint_t s = any_top(a);
+    for (aint_t i = 0; i < NUM_MSGS; ++i) {
+        any_push_index(a, any_check_index(a, -1));
+        any_push_tuple(a, 3);
+        avalue_t* t = aactor_at(a, any_top(a));
+        avalue_t* vals = (avalue_t*)(
+            AGC_CAST(agc_tuple_t, &a->gc, t->v.heap_idx) + 1);
+        vals[0] = *aactor_at(a, s);
+        vals[1] = *aactor_at(a, s);
+        av_integer(vals + 2, i);
+        any_mbox_send(a);
+        any_yield(a);
+    }
+    any_push_nil(a);
+}
+
+static void tuple_receiver_actor(aactor_t* a)
+{
+    any_push_nil(a);
+    aint_t idx = any_check_index(a, 0);
+    for (aint_t i = 0; i < NUM_SENDERS * NUM_MSGS;) {
+        if (any_mbox_recv(a, AINFINITE) != AERR_NONE) continue;
+        avalue_t* t = aactor_at(a, idx);
+        avalue_t* vals = (avalue_t*)(
+            AGC_CAST(agc_tuple_t, &a->gc, t->v.heap_idx) + 1);
+        if (vals[0].tag.type == AVT_STRING &&
+            vals[0].v.heap_idx == vals[1].v.heap_idx &&
+            strcmp(agc_string_to_cstr(a, vals), "shared") == 0) {
+            ++num_shared;
+        }
+        sum += vals[2].v.integer;
+        any_mbox_remove(a);
+        ++i;
+    }
+    ++num_done;
+}
+
+#endif // ANY_SMP
+
+TEST_CASE("smp_steal")
+{
+#ifdef ANY_SMP
+    enum { NUM_IDX_BITS = 8 };
+    enum { NUM_GEN_BITS = 4 };
+    enum { NUM_WORKERS = 4 };
+    enum { NUM_ACTORS = 32 };
+
+    asmp_t smp;
+    REQUIRE(AERR_NONE == asmp_init(
+        &smp, NUM_WORKERS, NUM_IDX_BITS, NUM_GEN_BITS, &myalloc, NULL));
+    asmp_on_panic(&smp, &on_panic, NULL);
+
+    num_done = 0;
+    num_migrated = 0;
+
+    // all on the first worker, the others have to steal.
+    for (aint_t i = 0; i < NUM_ACTORS; ++i) {
+        aactor_t* a;
+        REQUIRE(AERR_NONE ==
+            ascheduler_new_actor(smp.workers, CSTACK_SZ, &a));
+        any_push_native_func(a, &busy_actor);
+        asmp_start(&smp, a, 0);
+    }
+    REQUIRE(asmp_num_processes(&smp) == NUM_ACTORS);
+
+    REQUIRE(AERR_NONE == asmp_run(&smp));
+
+    CHECK(asmp_num_processes(&smp) == 0);
+    CHECK(num_done == NUM_ACTORS);
+    CHECK(num_migrated > 0);
+
+    asmp_cleanup(&smp);
+#endif
+}
+
+TEST_CASE("smp_steal_parked")
+{
+#ifdef ANY_SMP
+    enum { NUM_IDX_BITS = 8 };
+    enum { NUM_GEN_BITS = 4 };
+    enum { NUM_WORKERS = 2 };
+
+    asmp_t smp;
+    REQUIRE(AERR_NONE == asmp_init(
+        &smp, NUM_WORKERS, NUM_IDX_BITS, NUM_GEN_BITS, &myalloc, NULL));
+    asmp_on_panic(&smp, &on_panic, NULL);
+
+    num_done = 0;
+    num_migrated = 0;
+
+    // sleepers all time out on the first worker, after the second one parked.
+    aactor_t* a;
+    REQUIRE(AERR_NONE == ascheduler_new_actor(smp.workers, CSTACK_SZ, &a));
+    any_push_native_func(a, &spawn_sleepy_actor);
+    asmp_start(&smp, a, 0);
+    REQUIRE(AERR_NONE ==
+        ascheduler_new_actor(smp.workers + 1, CSTACK_SZ, &a));
+    any_push_native_func(a, &hold_worker_actor);
+    asmp_start(&smp, a, 0);
+
+    REQUIRE(AERR_NONE == asmp_run(&smp));
+
+    CHECK(asmp_num_processes(&smp) == 0);
+    CHECK(num_done == 8);
+    CHECK(num_migrated > 0);
+
+    asmp_cleanup(&smp);
+#endif
+}
+
+TEST_CASE("smp_mbox")
+{
+#ifdef ANY_SMP
+    enum { NUM_IDX_BITS = 8 };
+    enum { NUM_GEN_BITS = 4 };
+    enum { NUM_WORKERS = 4 };
+
+    asmp_t smp;
+    REQUIRE(AERR_NONE == asmp_init(
+        &smp, NUM_WORKERS, NUM_IDX_BITS, NUM_GEN_BITS, &myalloc, NULL));
+    asmp_on_panic(&smp, &on_panic, NULL);
+
+    num_done = 0;
+    sum = 0;
+    num_strings = 0;
+
+    aactor_t* r;
+    REQUIRE(AERR_NONE == asmp_new_actor(&smp, CSTACK_SZ, &r));
+    any_push_native_func(r, &receiver_actor);
+    asmp_start(&smp, r, 0);
+    apid_t rpid = ascheduler_pid(r->owner, r);
+    REQUIRE(asmp_actor(&smp, rpid) == r);
+
+    for (aint_t i = 0; i < NUM_SENDERS; ++i) {
+        aactor_t* a;
+        REQUIRE(AERR_NONE == asmp_new_actor(&smp, CSTACK_SZ, &a));
+        any_push_native_func(a, &sender_actor);
+        any_push_pid(a, rpid);
+        asmp_start(&smp, a, 1);
+    }
+
+    REQUIRE(AERR_NONE == asmp_run(&smp));
+
+    CHECK(num_done == 1);
+    CHECK(num_strings == NUM_SENDERS * NUM_MSGS);
+    CHECK(sum == NUM_SENDERS * (NUM_MSGS * (NUM_MSGS - 1) / 2));
+    CHECK(asmp_actor(&smp, rpid) == NULL);
+
+    asmp_cleanup(&smp);
+#endif
+}
+
+TEST_CASE("smp_mbox_tuple")
+{
+#ifdef ANY_SMP
+    enum { NUM_IDX_BITS = 8 };
+    enum { NUM_GEN_BITS = 4 };
+    enum { NUM_WORKERS = 4 };
+
+    asmp_t smp;
+    REQUIRE(AERR_NONE == asmp_init(
+        &smp, NUM_WORKERS, NUM_IDX_BITS, NUM_GEN_BITS, &myalloc, NULL));
+    asmp_on_panic(&smp, &on_panic, NULL);
+
+    num_done = 0;
+    num_shared = 0;
+    sum = 0;
+
+    aactor_t* r;
+    REQUIRE(AERR_NONE == asmp_new_actor(&smp, CSTACK_SZ, &r));
+    any_push_native_func(r, &tuple_receiver_actor);
+    asmp_start(&smp, r, 0);
+    apid_t rpid = ascheduler_pid(r->owner, r);
+
+    for (aint_t i = 0; i < NUM_SENDERS; ++i) {
+        aactor_t* a;
+        REQUIRE(AERR_NONE == asmp_new_actor(&smp, CSTACK_SZ, &a));
+        any_push_native_func(a, &tuple_sender_actor);
+        any_push_pid(a, rpid);
+        asmp_start(&smp, a, 1);
+    }
+
+    REQUIRE(AERR_NONE == asmp_run(&smp));
+
+    CHECK(num_done == 1);
+    CHECK(num_shared == NUM_SENDERS * NUM_MSGS);
+    CHECK(sum == NUM_SENDERS * (NUM_MSGS * (NUM_MSGS - 1) / 2));
+
+    asmp_cleanup(&smp);
+#endif
+}
+
+TEST_CASE("smp_stackless")
+{
+#ifdef ANY_SMP
+    enum { NUM_IDX_BITS = 8 };
+    enum { NUM_GEN_BITS = 4 };
+    enum { NUM_WORKERS = 4 };
+    enum { NUM_RECEIVERS = 32 };
+    enum { NUM_FANOUTS = 2 };
+
+    // s = 0; i = 0; while i < n { s = s + receive(); i = i + 1 }; return s
+    aasm_t as;
+    aasm_init(&as, &myalloc, NULL);
+    REQUIRE(aasm_load(&as, NULL) == AERR_NONE);
+    add_module(&as, "mod_test");
+    aasm_module_push(&as, "test_recv");
+    aasm_prototype(&as)->num_local_vars = 2;
+    aasm_emit(&as, ai_lsi(0), 1);
+    aasm_emit(&as, ai_slv(0), 1);
+    aasm_emit(&as, ai_lsi(0), 1);
+    aasm_emit(&as, ai_slv(1), 1);
+    aasm_emit(&as, ai_lsi(NUM_FANOUTS * NUM_MSGS), 2);
+    aasm_emit(&as, ai_llv(1), 2);
+    aasm_emit(&as, ai_lt(), 2);
+    aasm_emit(&as, ai_jin(11), 2);
+    aasm_emit(&as, ai_lsi(AINFINITE), 3);
+    aasm_emit(&as, ai_rcv(0), 3);
+    aasm_emit(&as, ai_llv(0), 3);
+    aasm_emit(&as, ai_add(), 3);
+    aasm_emit(&as, ai_slv(0), 3);
+    aasm_emit(&as, ai_rmv(), 3);
+    aasm_emit(&as, ai_llv(1), 4);
+    aasm_emit(&as, ai_lsi(1), 4);
+    aasm_emit(&as, ai_add(), 4);
+    aasm_emit(&as, ai_slv(1), 4);
+    aasm_emit(&as, ai_jmp(-15), 4);
+    aasm_emit(&as, ai_llv(0), 5);
+    aasm_emit(&as, ai_ret(), 5);
+    aasm_pop(&as);
+    aasm_save(&as);
+
+    asmp_t smp;
+    REQUIRE(AERR_NONE == asmp_init(
+        &smp, NUM_WORKERS, NUM_IDX_BITS, NUM_GEN_BITS, &myalloc, NULL));
+    asmp_on_panic(&smp, &on_panic, NULL);
+    asmp_on_exit(&smp, &sum_on_exit, NULL);
+    asmp_set_reductions(&smp, 10);
+
+    REQUIRE(AERR_NONE ==
+        aloader_add_chunk(&smp.loader, as.chunk, as.chunk_size, NULL, NULL));
+    REQUIRE(AERR_NONE == aloader_link(&smp.loader, TRUE));
+
+    num_done = 0;
+    sum = 0;
+
+    apid_t pids[NUM_RECEIVERS];
+    for (aint_t i = 0; i < NUM_RECEIVERS; ++i) {
+        aactor_t* a;
+        REQUIRE(AERR_NONE == asmp_new_actor(&smp, 0, &a));
+        any_import(a, "mod_test", "test_recv");
+        asmp_start(&smp, a, 0);
+        pids[i] = ascheduler_pid(a->owner, a);
+    }
+
+    for (aint_t i = 0; i < NUM_FANOUTS; ++i) {
+        aactor_t* a;
+        REQUIRE(AERR_NONE == asmp_new_actor(&smp, CSTACK_SZ, &a));
+        any_push_native_func(a, &fanout_actor);
+        for (aint_t j = 0; j < NUM_RECEIVERS; ++j) {
+            any_push_pid(a, pids[j]);
+        }
+        asmp_start(&smp, a, NUM_RECEIVERS);
+    }
+
+    REQUIRE(AERR_NONE == asmp_run(&smp));
+
+    CHECK(asmp_num_processes(&smp) == 0);
+    CHECK(num_done == NUM_RECEIVERS);
+    CHECK(sum ==
+        NUM_RECEIVERS * NUM_FANOUTS * (NUM_MSGS * (NUM_MSGS - 1) / 2));
+
+    asmp_cleanup(&smp);
+    aasm_cleanup(&as);
+#endif
+}
+
+TEST_CASE("smp_host_post")
+{
+#ifdef ANY_SMP
+    enum { NUM_IDX_BITS = 8 };
+    enum { NUM_GEN_BITS = 4 };
+    enum { NUM_WORKERS = 4 };
+
+    asmp_t smp;
+    REQUIRE(AERR_NONE == asmp_init(
+        &smp, NUM_WORKERS, NUM_IDX_BITS, NUM_GEN_BITS, &myalloc, NULL));
+    asmp_on_panic(&smp, &on_panic, NULL);
+
+    num_done = 0;
+    num_out_of_order = 0;
+    sum = 0;
+
+    aactor_t* r;
+    REQUIRE(AERR_NONE == asmp_new_actor(&smp, CSTACK_SZ, &r));
+    any_push_native_func(r, &host_receiver_actor);
+    asmp_start(&smp, r, 0);
+    apid_t rpid = ascheduler_pid(r->owner, r);
+
+    std::thread senders[NUM_SENDERS];
+    for (aint_t j = 0; j < NUM_SENDERS; ++j) {
+        senders[j] = std::thread(&host_sender, &smp, rpid, j);
+    }
+
+    REQUIRE(AERR_NONE == asmp_run(&smp));
+    for (aint_t j = 0; j < NUM_SENDERS; ++j) senders[j].join();
+
+    CHECK(num_done == 1);
+    CHECK(num_out_of_order == 0);
+    CHECK(sum == NUM_SENDERS * (NUM_MSGS * (NUM_MSGS - 1) / 2));
+
+    asmp_cleanup(&smp);
+#endif
+}
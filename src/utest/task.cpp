@@ -47,3 +47,46 @@ TEST_CASE("task")
         alist_node_erase(&ctx[i].node);
     }
 }
+
+static void ASTDCALL deep_func(void* ud)
+{
+    ctx_t* ctx = (ctx_t*)ud;
+    // touch most of the stack, pages are committed on demand.
+    volatile char buf[CSTACK_SZ / 2];
+    for (;;) {
+        for (aint_t i = 0; i < (aint_t)sizeof(buf); i += 4096) {
+            buf[i] = (char)ctx->val;
+        }
+        ctx->val += buf[0] + 1;
+        atask_yield(&ctx->task, &ALIST_NODE_CAST(ctx_t, ctx->node.next)->task);
+    }
+}
+
+TEST_CASE("task_stack_pool")
+{
+#ifdef ANY_TASK_GCCASM
+    ctx_t m;
+    atask_shadow(&m.task);
+
+    ctx_t c;
+    c.val = 0;
+    c.node.next = &m.node;
+    m.node.next = &c.node;
+
+    REQUIRE(AERR_NONE == atask_create(&c.task, &deep_func, &c, CSTACK_SZ));
+    void* stack = c.task.stack;
+    atask_yield(&m.task, &c.task);
+    REQUIRE(c.val == 1);
+    atask_delete(&c.task);
+
+    // the same size is reused from the pool, with a fresh context.
+    c.val = 1;
+    REQUIRE(AERR_NONE == atask_create(&c.task, &deep_func, &c, CSTACK_SZ));
+    CHECK(c.task.stack == stack);
+    atask_yield(&m.task, &c.task);
+    CHECK(c.val == 3);
+    atask_yield(&m.task, &c.task);
+    CHECK(c.val == 7);
+    atask_delete(&c.task);
+#endif
+}
@@ -0,0 +1,159 @@
+/* Copyright (c) 2017 Nguyen Viet Giang. All rights reserved. */
+#include "prereq.h"
+
+#include <any/asm.h>
+#include <any/loader.h>
+#include <any/list.h>
+#include <any/scheduler.h>
+#include <any/actor.h>
+
+static aprototype_t* load_test_f(aloader_t* l, aasm_t* as)
+{
+    aasm_save(as);
+    REQUIRE(AERR_NONE ==
+        aloader_add_chunk(l, as->chunk, as->chunk_size, NULL, NULL));
+    achunk_t* c = ALIST_NODE_CAST(achunk_t, alist_head(&l->pendings));
+    REQUIRE(c->prototypes->header->num_nesteds == 1);
+    return c->prototypes->nesteds;
+}
+
+TEST_CASE("verifier_accept")
+{
+    aasm_t as;
+    aasm_init(&as, &myalloc, NULL);
+    REQUIRE(aasm_load(&as, NULL) == AERR_NONE);
+    add_module(&as, "mod_test");
+
+    aloader_t l;
+    aloader_init(&l, &myalloc, NULL);
+
+    aasm_module_push(&as, "test_f");
+    aasm_prototype(&as)->num_local_vars = 1;
+    aasm_emit(&as, ai_lsi(1), 1);
+    aasm_emit(&as, ai_slv(0), 1);
+    aasm_emit(&as, ai_llv(0), 2);
+    aasm_emit(&as, ai_llv(-2), 2);
+    aasm_emit(&as, ai_add(), 2);
+    aasm_emit(&as, ai_ldb(FALSE), 3);
+    aasm_emit(&as, ai_jin(1), 3);
+    aasm_emit(&as, ai_nop(), 4);
+    aasm_emit(&as, ai_ret(), 5);
+    aasm_pop(&as);
+
+    aprototype_t* pt = load_test_f(&l, &as);
+    CHECK(pt->verified == TRUE);
+    CHECK(pt->max_stack == 3);
+    CHECK(pt->min_args == 2);
+
+    aloader_cleanup(&l);
+    aasm_cleanup(&as);
+}
+
+TEST_CASE("verifier_reject")
+{
+    aasm_t as;
+    aasm_init(&as, &myalloc, NULL);
+    REQUIRE(aasm_load(&as, NULL) == AERR_NONE);
+    add_module(&as, "mod_test");
+
+    aloader_t l;
+    aloader_init(&l, &myalloc, NULL);
+
+    aasm_module_push(&as, "test_f");
+
+    SECTION("no_instructions")
+    {
+    }
+
+    SECTION("fall_off_end")
+    {
+        aasm_emit(&as, ai_lsi(1), 1);
+    }
+
+    SECTION("stack_mismatch")
+    {
+        aasm_emit(&as, ai_ldb(FALSE), 1);
+        aasm_emit(&as, ai_jin(1), 1);
+        aasm_emit(&as, ai_lsi(1), 2);
+        aasm_emit(&as, ai_ret(), 3);
+    }
+
+    SECTION("pop_underflow")
+    {
+        aasm_emit(&as, ai_lsi(1), 1);
+        aasm_emit(&as, ai_add(), 1);
+        aasm_emit(&as, ai_ret(), 1);
+    }
+
+    SECTION("bad_local_index")
+    {
+        aasm_emit(&as, ai_llv(1), 1);
+        aasm_emit(&as, ai_ret(), 1);
+    }
+
+    SECTION("bad_constant_index")
+    {
+        aasm_emit(&as, ai_ldk(0), 1);
+        aasm_emit(&as, ai_ret(), 1);
+    }
+
+    SECTION("bad_import_index")
+    {
+        aasm_emit(&as, ai_imp(0), 1);
+        aasm_emit(&as, ai_ret(), 1);
+    }
+
+    SECTION("bad_jump")
+    {
+        aasm_emit(&as, ai_jmp(-2), 1);
+    }
+
+    aasm_pop(&as);
+
+    aprototype_t* pt = load_test_f(&l, &as);
+    CHECK(pt->verified == FALSE);
+
+    aloader_cleanup(&l);
+    aasm_cleanup(&as);
+}
+
+TEST_CASE("verifier_missing_args")
+{
+    enum { NUM_IDX_BITS = 4 };
+    enum { NUM_GEN_BITS = 4 };
+
+    aasm_t as;
+    aasm_init(&as, &myalloc, NULL);
+    REQUIRE(aasm_load(&as, NULL) == AERR_NONE);
+    add_module(&as, "mod_test");
+
+    aasm_module_push(&as, "test_f");
+    aasm_emit(&as, ai_llv(-1), 1);
+    aasm_emit(&as, ai_ret(), 2);
+    aasm_pop(&as);
+    aasm_save(&as);
+
+    ascheduler_t s;
+    REQUIRE(AERR_NONE ==
+        ascheduler_init(&s, NUM_IDX_BITS, NUM_GEN_BITS, &myalloc, NULL));
+    ascheduler_on_panic(&s, &on_panic, NULL);
+
+    REQUIRE(AERR_NONE ==
+        aloader_add_chunk(&s.loader, as.chunk, as.chunk_size, NULL, NULL));
+    REQUIRE(AERR_NONE == aloader_link(&s.loader, TRUE));
+
+    // verified, but called with less arguments than it reads
+    aactor_t* a;
+    REQUIRE(AERR_NONE == ascheduler_new_actor(&s, CSTACK_SZ, &a));
+    any_import(a, "mod_test", "test_f");
+    REQUIRE(a->stack.v[a->stack.sp - 1].v.avm_func->verified == TRUE);
+    ascheduler_start(&s, a, 0);
+
+    ascheduler_run_once(&s);
+
+    REQUIRE(any_count(a) == 1);
+    CHECK(any_type(a, any_top(a)).type == AVT_STRING);
+
+    ascheduler_cleanup(&s);
+    aasm_cleanup(&as);
+}
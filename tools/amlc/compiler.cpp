@@ -632,6 +632,11 @@ static void match_ret(amlc_ctx_t& ctx, amlc_prototype_ctx_t&)
     aasm_emit(ctx.a, ai_ret(), ctx.line);
 }
 
+static void match_tvk(amlc_ctx_t& ctx, amlc_prototype_ctx_t&)
+{
+    aasm_emit(ctx.a, ai_tvk(match_integer(ctx)), ctx.line);
+}
+
 static void match_snd(amlc_ctx_t& ctx, amlc_prototype_ctx_t&)
 {
     aasm_emit(ctx.a, ai_snd(), ctx.line);
@@ -652,6 +657,11 @@ static void match_rwd(amlc_ctx_t& ctx, amlc_prototype_ctx_t&)
     aasm_emit(ctx.a, ai_rwd(), ctx.line);
 }
 
+static void match_mrk(amlc_ctx_t& ctx, amlc_prototype_ctx_t&)
+{
+    aasm_emit(ctx.a, ai_mrk(), ctx.line);
+}
+
 static void match_add(amlc_ctx_t& ctx, amlc_prototype_ctx_t&)
 {
     aasm_emit(ctx.a, ai_add(), ctx.line);
@@ -873,10 +883,12 @@ void amlc_compile(
     ADD_HANDLER(jin);
     ADD_HANDLER(ivk);
     ADD_HANDLER(ret);
+    ADD_HANDLER(tvk);
     ADD_HANDLER(snd);
     ADD_HANDLER(rcv);
     ADD_HANDLER(rmv);
     ADD_HANDLER(rwd);
+    ADD_HANDLER(mrk);
     ADD_HANDLER(add);
     ADD_HANDLER(sub);
     ADD_HANDLER(mul);
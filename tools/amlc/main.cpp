@@ -2,6 +2,7 @@
 #include <ProgramOptions.hxx>
 #include <fstream>
 #include <vector>
+#include <algorithm>
 #include <stdexcept>
 #include <memory>
 
@@ -10,7 +11,11 @@
 #include <any/scheduler.h>
 #include <any/db.h>
 #include <any/loader.h>
+#include <any/list.h>
 #include <any/actor.h>
+#include <any/aot.h>
+#include <any/profile.h>
+#include <any/sampler.h>
 #include <any/errno.h>
 #include <any/std.h>
 #include <any/std_io.h>
@@ -23,6 +28,7 @@
 
 #if defined(ALINUX) || defined(AAPPLE)
 #include <unistd.h>
+#include <poll.h>
 #else
 #include <mmsystem.h>
 #endif
@@ -89,7 +95,7 @@ static void compile(const std::string& i, const std::string& o, bool verbose)
         error("failed to load aasm_t");
     }
     amlc_compile(&a, buf.data(), i.c_str(), verbose);
-    aasm_save(&a);
+    aasm_save_fused(&a);
     std::ofstream os;
     os.open(o, std::fstream::out | std::fstream::binary | std::fstream::trunc);
     os.write((const char*)a.chunk, a.chunk_size);
@@ -99,11 +105,55 @@ static void compile(const std::string& i, const std::string& o, bool verbose)
     std::cout << " -> " << o << "\n";
 }
 
+static void write_stream(const char* s, aint_t sz, void* ud)
+{
+    ((std::ofstream*)ud)->write(s, (std::streamsize)sz);
+}
+
+static void translate(const std::string& i, const std::string& o)
+{
+    std::cout << "translating " << i << "\n";
+
+    std::ifstream is;
+    is.open(i, std::fstream::in | std::fstream::binary);
+    if (!is.is_open()) {
+        error("failed to open `%s`", i.c_str());
+    }
+    is.seekg(0, std::fstream::end);
+    auto sz = (size_t)is.tellg();
+    is.seekg(0, std::fstream::beg);
+    auto* chunk = (achunk_header_t*)myalloc(NULL, NULL, sz);
+    is.read((char*)chunk, sz);
+    is.close();
+
+    // loading verifies all prototypes, which the translation relies on.
+    aloader_t l;
+    aloader_init(&l, &myalloc, NULL);
+    aerror_t ec = aloader_add_chunk(&l, chunk, sz, &myalloc, NULL);
+    if (ec != AERR_NONE) {
+        aloader_cleanup(&l);
+        error("failed to add chunk %d", ec);
+    }
+    achunk_t* c = ALIST_NODE_CAST(achunk_t, alist_head(&l.pendings));
+
+    std::ofstream os;
+    os.open(o, std::fstream::out | std::fstream::binary | std::fstream::trunc);
+    ec = aaot_translate(c->prototypes, &myalloc, NULL, &write_stream, &os);
+    os.close();
+    aloader_cleanup(&l);
+    if (ec != AERR_NONE) {
+        error("failed to translate %d", ec);
+    }
+
+    std::cout << " -> " << o << "\n";
+}
+
 static std::string pid_string(aactor_t* a, apid_t pid)
 {
     std::stringstream ss;
-    apid_idx_t idx = apid_idx(a->owner->idx_bits, pid);
-    apid_gen_t gen = apid_gen(a->owner->idx_bits, a->owner->gen_bits, pid);
+    aprocess_table_t* t = a->owner->procs;
+    apid_idx_t idx = apid_idx(t->idx_bits, pid);
+    apid_gen_t gen = apid_gen(t->idx_bits, t->gen_bits, pid);
     ss << "<" << idx << "." << gen << ">";
     return ss.str();
 }
@@ -183,16 +233,99 @@ static void CALLBACK TimeProc(
 }
 #endif
 
+#ifdef ANY_PROFILE
+struct profile_entry_t
+{
+    std::string name;
+    aprofile_t counters;
+};
+
+static void collect_profile(const char* module, aprototype_t* pt, void* ud)
+{
+    auto& entries = *(std::vector<profile_entry_t>*)ud;
+    if (pt->profile.instructions == 0) return;
+    profile_entry_t e;
+    e.name = module;
+    if (pt != pt->chunk->prototypes) {
+        e.name += std::string(":") + (pt->strings + pt->header->symbol);
+    }
+    e.counters = pt->profile;
+    entries.push_back(e);
+}
+#endif
+
+static void print_profile(ascheduler_t* s)
+{
+#ifdef ANY_PROFILE
+    enum { MAX_ROWS = 20 };
+    std::vector<std::pair<aint_t, int32_t>> ops;
+    for (int32_t op = 0; op < 256; ++op) {
+        if (s->opcodes[op] == 0) continue;
+        ops.push_back(std::make_pair(s->opcodes[op], op));
+    }
+    std::sort(ops.rbegin(), ops.rend());
+    std::cout << "profile - opcodes\n";
+    for (size_t i = 0; i < ops.size() && i < MAX_ROWS; ++i) {
+        const char* name = aprofile_opcode_name(ops[i].second);
+        std::cout << "  " << (name ? name : "?") << " " << ops[i].first << "\n";
+    }
+    std::vector<profile_entry_t> entries;
+    aprofile_visit(s, &collect_profile, &entries);
+    std::sort(entries.begin(), entries.end(),
+        [](const profile_entry_t& a, const profile_entry_t& b) {
+            return a.counters.instructions > b.counters.instructions;
+        });
+    std::cout << "profile - functions (instructions calls usecs)\n";
+    for (size_t i = 0; i < entries.size() && i < MAX_ROWS; ++i) {
+        const aprofile_t& c = entries[i].counters;
+        std::cout << "  " << entries[i].name << " " << c.instructions <<
+            " " << c.calls << " " << c.usecs << "\n";
+    }
+#else
+    AUNUSED(s);
+    std::cout << "profile - not available, build with USE_PROFILE\n";
+#endif
+}
+
+static void save_samples(asampler_t* sampler, const std::string& path)
+{
+    std::ofstream os;
+    os.open(path, std::fstream::out | std::fstream::binary);
+    if (!os.is_open()) {
+        error("failed to open `%s`", path.c_str());
+    }
+    asampler_write(sampler, &write_stream, &os);
+    std::cout << "samples " << sampler->num_samples <<
+        " (dropped " << sampler->num_dropped << ")\n";
+    std::cout << " -> " << path << "\n";
+}
+
+#if defined(ALINUX) || defined(AAPPLE)
+// Block until posted to or `usecs` passed, -1 to wait for posts only.
+static void wait_for_wakeup(int32_t fd, aint_t usecs)
+{
+    struct pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    // round up, waking early just polls again.
+    int timeout = usecs < 0 ? -1 : (int)((usecs + 999) / 1000);
+    poll(&pfd, fd < 0 ? 0 : 1, timeout);
+}
+#endif
+
 static void execute(
     const std::string& module, const std::string& name,
-    int8_t idx_bits, int8_t gen_bits, aint_t cstack_sz,
+    int8_t idx_bits, int8_t gen_bits, aint_t cstack_sz, aint_t reductions,
     const std::vector<std::string>& chunks,
     address_t* debug, int32_t max_conns, bool alive,
-    int32_t realtime_resolution)
+    int32_t realtime_resolution, bool profile,
+    const std::string& samples, int32_t sample_us)
 {
     aerror_t ec;
     ascheduler_t s;
     adb_t db;
+    asampler_t sampler;
 
 #ifdef AWINDOWS
     TIMECAPS tc;
@@ -217,6 +350,7 @@ static void execute(
     }
 #endif
     ascheduler_on_panic(&s, &on_panic, NULL);
+    ascheduler_set_reductions(&s, reductions);
     aloader_on_unresolved(&s.loader, &on_unresolved, NULL);
 
     if (debug) {
@@ -268,6 +402,18 @@ static void execute(
     }
     std::cout << "linking success\n";
 
+    if (samples.length() > 0) {
+        ec = asampler_init(&sampler, &myalloc, NULL, &s, 4096);
+        if (ec != AERR_NONE) {
+            error("failed to init sampler %d", ec);
+        }
+        ec = asampler_start(&sampler, (aint_t)sample_us);
+        if (ec != AERR_NONE) {
+            error("failed to start sampler %d", ec);
+        }
+        if (debug) adb_attach_sampler(&db, &sampler);
+    }
+
     if (module.length() > 0) {
         aactor_t* a;
         std::cout << "spawn " << module << ":" << name << "\n";
@@ -288,13 +434,30 @@ static void execute(
     timeKillEvent(ud.id);
     timeEndPeriod(delay);
 #else
+    int32_t wakeup_fd = ascheduler_wakeup_fd(&s);
+    bool polling = debug || samples.length() > 0 || wakeup_fd < 0;
     while (alive || ascheduler_num_processes(&s) > 0) {
         if (debug) adb_run_once(&db);
         ascheduler_run_once(&s);
-        usleep((useconds_t)realtime_resolution);
+        if (samples.length() > 0) asampler_collect(&sampler);
+        // debugger and sampler are polled, actors only wake on events.
+        aint_t timeout = ascheduler_timeout(&s);
+        if (polling && (timeout < 0 || timeout > realtime_resolution)) {
+            timeout = realtime_resolution;
+        }
+        if (timeout != 0) wait_for_wakeup(wakeup_fd, timeout);
     }
 #endif
 
+    if (samples.length() > 0) {
+        asampler_stop(&sampler);
+        asampler_collect(&sampler);
+        save_samples(&sampler, samples);
+        if (debug) adb_attach_sampler(&db, NULL);
+        asampler_cleanup(&sampler);
+    }
+
+    if (profile) print_profile(&s);
     if (debug) adb_cleanup(&db);
     ascheduler_cleanup(&s);
 }
@@ -321,6 +484,10 @@ int entry(int argc, char** argv)
             .description("compile an AML source file")
             .type(po::string);
 
+        p["aot"]
+            .description("translate a compiled chunk into C source")
+            .type(po::string);
+
         p["execute"]
             .abbreviation('e')
             .description("run with entry point")
@@ -344,17 +511,22 @@ int entry(int argc, char** argv)
         p["idx_bits"]
             .description("number of index bits")
             .type(po::i32)
-            .fallback(8);
+            .fallback(20);
 
         p["gen_bits"]
             .description("number of generation bits")
             .type(po::i32)
-            .fallback(24);
+            .fallback(12);
 
         p["cstack_sz"]
             .description("size of entry point native stack in bytes")
             .type(po::i32)
-            .fallback(4096000);
+            .fallback(262144);
+
+        p["reductions"]
+            .description("number of reductions before preempting an actor")
+            .type(po::i32)
+            .fallback(2000);
 
         p["max_conns"]
             .description("maximum number of debug connections")
@@ -365,6 +537,19 @@ int entry(int argc, char** argv)
             .description("keep AMLC execution session alive")
             .type(po::void_);
 
+        p["profile"]
+            .description("print execution counters at exit")
+            .type(po::void_);
+
+        p["samples"]
+            .description("sample actors, write folded stacks into file")
+            .type(po::string);
+
+        p["sample_us"]
+            .description("sampling interval in us of CPU time")
+            .type(po::i32)
+            .fallback(1000);
+
         p["rt_res"]
             .description("real-time resolution hint in us")
             .type(po::i32)
@@ -390,6 +575,19 @@ int entry(int argc, char** argv)
                 }
                 compile(i, o, p["verbose"].available());
             }
+            if (p["aot"].was_set()) {
+                auto i = p["aot"].get().string;
+                if (i.length() <= 0) {
+                    error("input missing");
+                }
+                std::string o;
+                if (p["output"].was_set()) {
+                    o = p["output"].get().string;
+                } else {
+                    o = file_name_without_extension(i) + ".c";
+                }
+                translate(i, o);
+            }
             if (exec || alive) {
                 std::string module;
                 std::string name;
@@ -424,10 +622,15 @@ int entry(int argc, char** argv)
                     (int8_t)p["idx_bits"].get().i32,
                     (int8_t)p["gen_bits"].get().i32,
                     (aint_t)p["cstack_sz"].get().i32,
+                    (aint_t)p["reductions"].get().i32,
                     p[""].to_vector<po::string>(),
                     debug.get(), p["max_conns"].get().i32,
                     alive,
-                    p["rt_res"].get().i32);
+                    p["rt_res"].get().i32,
+                    p["profile"].was_set(),
+                    p["samples"].was_set()
+                        ? p["samples"].get().string : std::string(),
+                    p["sample_us"].get().i32);
             }
             return 0;
         }
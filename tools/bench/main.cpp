@@ -0,0 +1,316 @@
+/* Copyright (c) 2017 Nguyen Viet Giang. All rights reserved. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <any/asm.h>
+#include <any/scheduler.h>
+#include <any/loader.h>
+#include <any/actor.h>
+#include <any/timer.h>
+#include <any/smp.h>
+#include <any/std_string.h>
+
+// Bytes currently allocated through `myalloc`.
+static aint_t allocated;
+
+// Sizes are kept in front of each block to account for reallocations.
+static void* myalloc(void*, void* old, aint_t sz)
+{
+    aint_t* b = old ? (aint_t*)old - 2 : NULL;
+    if (b) allocated -= b[0];
+    if (sz == 0) {
+        free(b);
+        return NULL;
+    }
+    b = (aint_t*)realloc(b, (size_t)sz + sizeof(aint_t) * 2);
+    if (!b) return NULL;
+    b[0] = sz;
+    allocated += sz;
+    return b + 2;
+}
+
+static void on_panic(aactor_t*, void*)
+{
+    fprintf(stderr, "panic\n");
+    exit(1);
+}
+
+// `receive(infinite)` which never returns while the actor is idle.
+static void build_idle(aasm_t* as)
+{
+    aasm_prototype_t* p = aasm_prototype(as);
+    p->symbol = aasm_string_to_ref(as, "bench");
+    aasm_module_push(as, "idle");
+    aasm_emit(as, ai_lsi(AINFINITE), 1);
+    aasm_emit(as, ai_rcv(0), 1);
+    aasm_emit(as, ai_ret(), 1);
+    aasm_pop(as);
+}
+
+struct idle_kind_t
+{
+    const char* name;
+    aint_t cstack_sz;
+    const aactor_opts_t* opts;
+};
+
+static void bench_idle(aasm_t* as, aint_t num_actors)
+{
+    enum { NUM_IDX_BITS = 20 };
+    enum { NUM_GEN_BITS = 12 };
+    static const aactor_opts_t small = { 8, 4, 64 };
+    static const idle_kind_t kinds[] = {
+        { "stackful", 1024 * 32, NULL },
+        { "stackless", 0, NULL },
+        { "stackless small", 0, &small }
+    };
+
+    printf("idle actors: %lld\n", (long long)num_actors);
+    printf("%-16s %12s %12s %12s\n",
+        "kind", "heap/actor", "cstack", "spawn usecs");
+    for (size_t k = 0; k < sizeof(kinds) / sizeof(kinds[0]); ++k) {
+        const idle_kind_t& kind = kinds[k];
+        ascheduler_t s;
+        if (ascheduler_init(
+                &s, NUM_IDX_BITS, NUM_GEN_BITS, &myalloc, NULL) != AERR_NONE) {
+            on_panic(NULL, NULL);
+        }
+        ascheduler_on_panic(&s, &on_panic, NULL);
+        if (aloader_add_chunk(
+                &s.loader, as->chunk, as->chunk_size, NULL, NULL) != AERR_NONE ||
+            aloader_link(&s.loader, TRUE) != AERR_NONE) {
+            on_panic(NULL, NULL);
+        }
+
+        aint_t base = allocated;
+        aint_t start = atimer_usecs();
+        for (aint_t i = 0; i < num_actors; ++i) {
+            aactor_t* a;
+            if (ascheduler_new_actor_opts(
+                    &s, kind.cstack_sz, kind.opts, &a) != AERR_NONE) {
+                on_panic(NULL, NULL);
+            }
+            any_import(a, "bench", "idle");
+            ascheduler_start(&s, a, 0);
+        }
+        aint_t spawn_usecs = atimer_usecs() - start;
+        ascheduler_run_once(&s);
+
+        printf("%-16s %12lld %12lld %12.3f\n", kind.name,
+            (long long)((allocated - base) / num_actors),
+            (long long)kind.cstack_sz,
+            (double)spawn_usecs / (double)num_actors);
+        ascheduler_cleanup(&s);
+    }
+}
+
+static bool use_call;
+static bool client_done;
+
+// Reply `n + 1` to the pid in args for each request `n`.
+static void rpc_server(aactor_t* a)
+{
+    aint_t a_client = any_check_index(a, -1);
+    any_push_nil(a);
+    aint_t msg = any_check_index(a, 0);
+    for (;;) {
+        any_mbox_recv(a, AINFINITE);
+        any_push_index(a, a_client);
+        any_push_integer(a, any_check_integer(a, msg) + 1);
+        any_mbox_remove(a);
+        any_mbox_send(a);
+    }
+}
+
+static void rpc_client(aactor_t* a)
+{
+    aint_t a_server = any_check_index(a, -1);
+    aint_t num_rounds = any_check_integer(a, any_check_index(a, -2));
+    for (aint_t i = 0; i < num_rounds; ++i) {
+        any_push_index(a, a_server);
+        any_push_integer(a, i);
+        if (use_call) {
+            any_mbox_call(a, AINFINITE);
+        } else {
+            any_mbox_send(a);
+            any_push_nil(a);
+            any_mbox_recv(a, AINFINITE);
+            any_mbox_remove(a);
+        }
+        if (any_check_integer(a, any_top(a)) != i + 1) on_panic(a, NULL);
+        any_pop(a, 1);
+    }
+    client_done = true;
+    any_push_nil(a);
+}
+
+static void busy(aactor_t* a)
+{
+    for (;;) any_yield(a);
+}
+
+static aactor_t* spawn(ascheduler_t* s)
+{
+    aactor_t* a;
+    if (ascheduler_new_actor(s, 1024 * 32, &a) != AERR_NONE) {
+        on_panic(NULL, NULL);
+    }
+    return a;
+}
+
+// Round trips between two actors while `num_busy` others keep yielding.
+static void bench_call(aint_t num_busy, aint_t num_rounds)
+{
+    enum { NUM_IDX_BITS = 12 };
+    enum { NUM_GEN_BITS = 12 };
+
+    printf("round trips: %lld, busy actors: %lld\n",
+        (long long)num_rounds, (long long)num_busy);
+    printf("%-16s %12s\n", "kind", "usecs/call");
+    for (int k = 0; k < 2; ++k) {
+        ascheduler_t s;
+        if (ascheduler_init(
+                &s, NUM_IDX_BITS, NUM_GEN_BITS, &myalloc, NULL) != AERR_NONE) {
+            on_panic(NULL, NULL);
+        }
+        ascheduler_on_panic(&s, &on_panic, NULL);
+        use_call = k == 1;
+        client_done = false;
+
+        aactor_t* server = spawn(&s);
+        aactor_t* client = spawn(&s);
+        any_push_native_func(server, &rpc_server);
+        any_push_pid(server, ascheduler_pid(&s, client));
+        ascheduler_start(&s, server, 1);
+        for (aint_t i = 0; i < num_busy; ++i) {
+            aactor_t* a = spawn(&s);
+            any_push_native_func(a, &busy);
+            ascheduler_start(&s, a, 0);
+        }
+        any_push_native_func(client, &rpc_client);
+        any_push_integer(client, num_rounds);
+        any_push_pid(client, ascheduler_pid(&s, server));
+        ascheduler_start(&s, client, 2);
+
+        aint_t start = atimer_usecs();
+        while (!client_done) ascheduler_run_once(&s);
+        aint_t usecs = atimer_usecs() - start;
+
+        printf("%-16s %12.3f\n", use_call ? "call" : "send/receive",
+            (double)usecs / (double)num_rounds);
+        ascheduler_cleanup(&s);
+    }
+}
+
+#ifdef ANY_SMP
+// Workers allocate concurrently, `myalloc` does not.
+static void* smp_alloc(void*, void* old, aint_t sz)
+{
+    if (sz == 0) {
+        free(old);
+        return NULL;
+    }
+    return realloc(old, (size_t)sz);
+}
+
+// Receive the number of messages in args, from all producers.
+static void sink(aactor_t* a)
+{
+    aint_t num_msgs = any_check_integer(a, any_check_index(a, -1));
+    any_push_nil(a);
+    for (aint_t i = 0; i < num_msgs; ++i) {
+        any_mbox_recv(a, AINFINITE);
+        any_mbox_remove(a);
+    }
+}
+
+// Send the number of messages in args to the pid in args, strings if asked.
+static void produce(aactor_t* a)
+{
+    aint_t a_sink = any_check_index(a, -1);
+    aint_t num_msgs = any_check_integer(a, any_check_index(a, -2));
+    int32_t strings = any_check_bool(a, any_check_index(a, -3));
+    for (aint_t i = 0; i < num_msgs; ++i) {
+        any_push_index(a, a_sink);
+        if (strings) any_push_string(a, "hello world");
+        else any_push_integer(a, i);
+        any_mbox_send(a);
+    }
+    any_push_nil(a);
+}
+
+// Many producers on their own workers send to a single receiver.
+static void bench_send(aint_t max_producers, aint_t num_msgs, int32_t strings)
+{
+    enum { NUM_IDX_BITS = 12 };
+    enum { NUM_GEN_BITS = 12 };
+
+    printf("%s per producer: %lld\n",
+        strings ? "strings" : "integers", (long long)num_msgs);
+    printf("%-16s %12s\n", "producers", "msgs/usec");
+    for (aint_t n = 1; n <= max_producers; n *= 2) {
+        asmp_t smp;
+        if (asmp_init(&smp, (int32_t)n + 1, NUM_IDX_BITS, NUM_GEN_BITS,
+                &smp_alloc, NULL) != AERR_NONE) {
+            on_panic(NULL, NULL);
+        }
+        asmp_on_panic(&smp, &on_panic, NULL);
+
+        aactor_t* s;
+        if (asmp_new_actor(&smp, 1024 * 32, &s) != AERR_NONE) {
+            on_panic(NULL, NULL);
+        }
+        any_push_native_func(s, &sink);
+        any_push_integer(s, n * num_msgs);
+        asmp_start(&smp, s, 1);
+        for (aint_t i = 0; i < n; ++i) {
+            aactor_t* a;
+            if (asmp_new_actor(&smp, 1024 * 32, &a) != AERR_NONE) {
+                on_panic(NULL, NULL);
+            }
+            any_push_native_func(a, &produce);
+            any_push_bool(a, strings);
+            any_push_integer(a, num_msgs);
+            any_push_pid(a, ascheduler_pid(s->owner, s));
+            asmp_start(&smp, a, 3);
+        }
+
+        aint_t start = atimer_usecs();
+        if (asmp_run(&smp) != AERR_NONE) on_panic(NULL, NULL);
+        aint_t usecs = atimer_usecs() - start;
+
+        printf("%-16lld %12.3f\n", (long long)n,
+            (double)(n * num_msgs) / (double)(usecs > 0 ? usecs : 1));
+        asmp_cleanup(&smp);
+    }
+}
+#endif
+
+int main(int argc, char** argv)
+{
+    aint_t num_actors = argc > 1 ? atoll(argv[1]) : 10000;
+    if (num_actors <= 0) {
+        fprintf(stderr, "usage: bench [num_actors]\n");
+        return 1;
+    }
+
+    aasm_t as;
+    aasm_init(&as, &myalloc, NULL);
+    if (aasm_load(&as, NULL) != AERR_NONE) on_panic(NULL, NULL);
+    build_idle(&as);
+    aasm_save_fused(&as);
+
+    bench_idle(&as, num_actors);
+    printf("\n");
+    bench_call(100, 10000);
+#ifdef ANY_SMP
+    printf("\n");
+    bench_send(8, 200000, FALSE);
+    printf("\n");
+    bench_send(8, 200000, TRUE);
+#endif
+
+    aasm_cleanup(&as);
+    return 0;
+}